@@ -44,65 +44,25 @@
  */
 
 #include <Wire.h>
+#include <Si4703Core.h> //Register map and RDS decoder from the SparkFun Si4703 library
+
+using namespace si4703;
 
 int STATUS_LED = 13;
 int resetPin = 2;
 int SDIO = A4; //SDA/A4 on Arduino
 int SCLK = A5; //SCL/A5 on Arduino
 char printBuffer[50];
-uint16_t si4703_registers[16]; //There are 16 registers, each 16 bits large
+uint16_t si4703_registers[NUM_REGISTERS]; //There are 16 registers, each 16 bits large
 
 #define FAIL  0
 #define SUCCESS  1
 
-#define SI4703 0x10 //0b._001.0000 = I2C address of Si4703 - note that the Wire function assumes non-left-shifted I2C address, not 0b.0010.000W
-#define I2C_FAIL_MAX  10 //This is the number of attempts we will try to contact the device before erroring out
-
 //#define IN_EUROPE //Use this define to setup European FM reception. I wuz there for a day during testing (TEI 2011).
 
 #define SEEK_DOWN  0 //Direction used for seeking. Default is down
 #define SEEK_UP  1
 
-//Define the register names
-#define DEVICEID 0x00
-#define CHIPID  0x01
-#define POWERCFG  0x02
-#define CHANNEL  0x03
-#define SYSCONFIG1  0x04
-#define SYSCONFIG2  0x05
-#define STATUSRSSI  0x0A
-#define READCHAN  0x0B
-#define RDSA  0x0C
-#define RDSB  0x0D
-#define RDSC  0x0E
-#define RDSD  0x0F
-
-//Register 0x02 - POWERCFG
-#define SMUTE  15
-#define DMUTE  14
-#define SKMODE  10
-#define SEEKUP  9
-#define SEEK  8
-
-//Register 0x03 - CHANNEL
-#define TUNE  15
-
-//Register 0x04 - SYSCONFIG1
-#define RDS  12
-#define DE  11
-
-//Register 0x05 - SYSCONFIG2
-#define SPACE1  5
-#define SPACE0  4
-
-//Register 0x0A - STATUSRSSI
-#define RDSR  15
-#define STC  14
-#define SFBL  13
-#define AFCRL  12
-#define RDSS  11
-#define STEREO  8
-
 void setup() {                
   pinMode(13, OUTPUT);
   pinMode(A0, INPUT); //Optional trimpot for analog station control
@@ -161,7 +121,7 @@ void loop() {
     else if(option == '2') {
       Serial.println("Mute toggle");
       si4703_readRegisters();
-      si4703_registers[POWERCFG] ^= (1<<DMUTE); //Toggle Mute bit
+      si4703_registers[POWERCFG] ^= bits(DMUTE); //Toggle Mute bit
       si4703_updateRegisters();
     }
     else if(option == '3') {
@@ -170,10 +130,10 @@ void loop() {
       Serial.println();
       Serial.println("Radio Status:");
 
-      if(si4703_registers[STATUSRSSI] & (1<<RDSR)){
+      if(get(si4703_registers, RDSR)){
         Serial.print(" (RDS Available)");
 
-        byte blockerrors = (si4703_registers[STATUSRSSI] & 0x0600) >> 9; //Mask in BLERA
+        byte blockerrors = get(si4703_registers, BLERA); //Mask in BLERA
         if(blockerrors == 0) Serial.print (" (No RDS errors)");
         if(blockerrors == 1) Serial.print (" (1-2 RDS errors)");
         if(blockerrors == 2) Serial.print (" (3-5 RDS errors)");
@@ -182,20 +142,20 @@ void loop() {
       else
         Serial.print(" (No RDS)");
 
-      if(si4703_registers[STATUSRSSI] & (1<<STC)) Serial.print(" (Tune Complete)");
-      if(si4703_registers[STATUSRSSI] & (1<<SFBL)) 
+      if(get(si4703_registers, STC)) Serial.print(" (Tune Complete)");
+      if(get(si4703_registers, SFBL)) 
         Serial.print(" (Seek Fail)");
       else
         Serial.print(" (Seek Successful!)");
-      if(si4703_registers[STATUSRSSI] & (1<<AFCRL)) Serial.print(" (AFC/Invalid Channel)");
-      if(si4703_registers[STATUSRSSI] & (1<<RDSS)) Serial.print(" (RDS Synch)");
+      if(get(si4703_registers, AFCRL)) Serial.print(" (AFC/Invalid Channel)");
+      if(get(si4703_registers, RDSS)) Serial.print(" (RDS Synch)");
 
-      if(si4703_registers[STATUSRSSI] & (1<<STEREO)) 
+      if(get(si4703_registers, STEREO)) 
         Serial.print(" (Stereo!)");
       else
         Serial.print(" (Mono)");
 
-      byte rssi = si4703_registers[STATUSRSSI] & 0x00FF; //Mask in RSSI
+      byte rssi = get(si4703_registers, RSSI); //Mask in RSSI
       Serial.print(" (RSSI=");
       Serial.print(rssi, DEC);
       Serial.println(" of 75)");
@@ -213,7 +173,7 @@ void loop() {
           if(Serial.read() == 'x') break;
 
         si4703_readRegisters();
-        if(si4703_registers[STATUSRSSI] & (1<<RDSR)){
+        if(get(si4703_registers, RDSR)){
           Serial.println("We have RDS!");
           byte Ah, Al, Bh, Bl, Ch, Cl, Dh, Dl;
           Ah = (si4703_registers[RDSA] & 0xFF00) >> 8;
@@ -251,30 +211,20 @@ void loop() {
     else if(option == '7') {
       Serial.println("Poll RDS - x to exit");
 
-      char radioTextData[64];
-      char* pointerToRadioTextData = radioTextData;
-
-      memset(radioTextData, ' ', sizeof(radioTextData));
+      RdsDecoder rds;
+      rds.ascii_only = true; //Skip characters the serial monitor can't show
 
       while (1) {
         if (Serial.available() > 0)
           if (Serial.read() == 'x') break;
 
         si4703_readRegisters();
-        if(si4703_registers[STATUSRSSI] & (1<<RDSR)){
-          if (isValidRdsData())
+        if(get(si4703_registers, RDSR)){
+          if (rds.decode(si4703_registers) & RdsDecoder::RT_SEGMENT)
           {
-            if (isRadioTextData())
-            {
-              // set each element of the radio text data as we get it
-              setRadioTextData(pointerToRadioTextData);
-
-              // now write the radio text to serial
-              for (short i = 0; i < sizeof(radioTextData); i++) {
-                Serial.print(radioTextData[i]);
-              }
-              Serial.println(" ");
-            }
+            // now write the radio text to serial, it fills in as we get it
+            Serial.print(rds.rt);
+            Serial.println(" ");
           }
           delay(40); //Wait for the RDS bit to clear
         }
@@ -285,12 +235,12 @@ void loop() {
     }
     else if(option == '8') {
       Serial.println("GPIO1 High");
-      si4703_registers[SYSCONFIG1] |= (1<<1) | (1<<0);
+      set(si4703_registers, GPIO1, 0b11);
       si4703_updateRegisters();
     }
     else if(option == '9') {
       Serial.println("GPIO1 Low");
-      si4703_registers[SYSCONFIG1] &= ~(1<<0);
+      set(si4703_registers, GPIO1, 0b10);
       si4703_updateRegisters();
     }
     else if(option == 'r') {
@@ -299,30 +249,21 @@ void loop() {
     }
     else if(option == 'n') {
       Serial.println("Print station name - x to exit");
-      char stationName[8];
-      char* pointerToStationNameData = stationName;
 
-      memset(stationName, ' ', sizeof(stationName));
+      RdsDecoder rds;
+      rds.ascii_only = true; //Skip characters the serial monitor can't show
 
       while (1) {
         if (Serial.available() > 0)
           if (Serial.read() == 'x') break;
 
         si4703_readRegisters();
-        if(si4703_registers[STATUSRSSI] & (1<<RDSR)){
-          if (isValidStationNameData())
+        if(get(si4703_registers, RDSR)){
+          if (rds.decode(si4703_registers) & RdsDecoder::PS_SEGMENT)
           {
-            if (isStationNameData())
-            {
-              // set each element of the radio station name as we get it
-              setStationNameData(pointerToStationNameData);
-
-              // now write the radio text to serial
-              for (short i = 0; i < sizeof(stationName); i++) {
-                Serial.print(stationName[i]);
-              }
-              Serial.println(" ");
-            }
+            // now write the station name to serial, it fills in as we get it
+            Serial.print(rds.ps);
+            Serial.println(" ");
           }
           delay(40); //Wait for the RDS bit to clear
         }
@@ -369,20 +310,18 @@ void loop() {
           option = Serial.read();
           if(option == '+') {
             si4703_readRegisters(); //Read the current register set
-            current_vol = si4703_registers[SYSCONFIG2] & 0x000F; //Read the current volume level
-            if(current_vol < 16) current_vol++; //Limit max volume to 0x000F
-            si4703_registers[SYSCONFIG2] &= 0xFFF0; //Clear volume bits
-            si4703_registers[SYSCONFIG2] |= current_vol; //Set new volume
+            current_vol = get(si4703_registers, VOLUME); //Read the current volume level
+            if(current_vol < 15) current_vol++; //Limit max volume to 0x000F
+            set(si4703_registers, VOLUME, current_vol); //Set new volume
             si4703_updateRegisters(); //Update
             Serial.print("Volume: ");
             Serial.println(current_vol, DEC);
           }
           if(option == '-') {
             si4703_readRegisters(); //Read the current register set
-            current_vol = si4703_registers[SYSCONFIG2] & 0x000F; //Read the current volume level
+            current_vol = get(si4703_registers, VOLUME); //Read the current volume level
             if(current_vol > 0) current_vol--; //You can't go lower than zero
-            si4703_registers[SYSCONFIG2] &= 0xFFF0; //Clear volume bits
-            si4703_registers[SYSCONFIG2] |= current_vol; //Set new volume
+            set(si4703_registers, VOLUME, current_vol); //Set new volume
             si4703_updateRegisters(); //Update
             Serial.print("Volume: ");
             Serial.println(current_vol, DEC);
@@ -437,9 +376,8 @@ void gotoChannel(int newChannel){
 
   //These steps come from AN230 page 20 rev 0.5
   si4703_readRegisters();
-  si4703_registers[CHANNEL] &= 0xFE00; //Clear out the channel bits
-  si4703_registers[CHANNEL] |= newChannel; //Mask in the new channel
-  si4703_registers[CHANNEL] |= (1<<TUNE); //Set the TUNE bit to start
+  set(si4703_registers, CHAN, newChannel); //Mask in the new channel
+  set(si4703_registers, TUNE, 1); //Set the TUNE bit to start
   si4703_updateRegisters();
 
   //delay(60); //Wait 60ms - you can use or skip this delay
@@ -447,18 +385,18 @@ void gotoChannel(int newChannel){
   //Poll to see if STC is set
   while(1) {
     si4703_readRegisters();
-    if( (si4703_registers[STATUSRSSI] & (1<<STC)) != 0) break; //Tuning complete!
+    if( get(si4703_registers, STC) != 0) break; //Tuning complete!
     Serial.println("Tuning");
   }
 
   si4703_readRegisters();
-  si4703_registers[CHANNEL] &= ~(1<<TUNE); //Clear the tune after a tune has completed
+  set(si4703_registers, TUNE, 0); //Clear the tune after a tune has completed
   si4703_updateRegisters();
 
   //Wait for the si4703 to clear the STC as well
   while(1) {
     si4703_readRegisters();
-    if( (si4703_registers[STATUSRSSI] & (1<<STC)) == 0) break; //Tuning complete!
+    if( get(si4703_registers, STC) == 0) break; //Tuning complete!
     Serial.println("Waiting...");
   }
 }
@@ -467,7 +405,7 @@ void gotoChannel(int newChannel){
 //Returns a number like 973 for 97.3MHz
 int readChannel(void) {
   si4703_readRegisters();
-  int channel = si4703_registers[READCHAN] & 0x03FF; //Mask out everything but the lower 10 bits
+  int channel = get(si4703_registers, READ_CHAN); //Mask out everything but the lower 10 bits
 
 #ifdef IN_EUROPE
   //Freq(MHz) = 0.100(in Europe) * Channel + 87.5MHz
@@ -490,34 +428,33 @@ byte seek(byte seekDirection){
   si4703_readRegisters();
 
   //Set seek mode wrap bit
-  //si4703_registers[POWERCFG] |= (1<<SKMODE); //Allow wrap
-  si4703_registers[POWERCFG] &= ~(1<<SKMODE); //Disallow wrap - if you disallow wrap, you may want to tune to 87.5 first
+  //set(si4703_registers, SKMODE, 1); //Allow wrap
+  set(si4703_registers, SKMODE, 0); //Disallow wrap - if you disallow wrap, you may want to tune to 87.5 first
 
-  if(seekDirection == SEEK_DOWN) si4703_registers[POWERCFG] &= ~(1<<SEEKUP); //Seek down is the default upon reset
-  else si4703_registers[POWERCFG] |= 1<<SEEKUP; //Set the bit to seek up
+  set(si4703_registers, SEEKUP, seekDirection == SEEK_UP); //Seek down is the default upon reset
 
-  si4703_registers[POWERCFG] |= (1<<SEEK); //Start seek
+  set(si4703_registers, SEEK, 1); //Start seek
 
   si4703_updateRegisters(); //Seeking will now start
 
   //Poll to see if STC is set
   while(1) {
     si4703_readRegisters();
-    if((si4703_registers[STATUSRSSI] & (1<<STC)) != 0) break; //Tuning complete!
+    if(get(si4703_registers, STC) != 0) break; //Tuning complete!
 
     Serial.print("Trying station:");
     Serial.println(readChannel());
   }
 
   si4703_readRegisters();
-  int valueSFBL = si4703_registers[STATUSRSSI] & (1<<SFBL); //Store the value of SFBL
-  si4703_registers[POWERCFG] &= ~(1<<SEEK); //Clear the seek bit after seek has completed
+  int valueSFBL = get(si4703_registers, SFBL); //Store the value of SFBL
+  set(si4703_registers, SEEK, 0); //Clear the seek bit after seek has completed
   si4703_updateRegisters();
 
   //Wait for the si4703 to clear the STC as well
   while(1) {
     si4703_readRegisters();
-    if( (si4703_registers[STATUSRSSI] & (1<<STC)) == 0) break; //Tuning complete!
+    if( get(si4703_registers, STC) == 0) break; //Tuning complete!
     Serial.println("Waiting...");
   }
 
@@ -548,46 +485,38 @@ void si4703_init(void) {
 
   si4703_readRegisters(); //Read the current register set
   //si4703_registers[0x07] = 0xBC04; //Enable the oscillator, from AN230 page 9, rev 0.5 (DOES NOT WORK, wtf Silicon Labs datasheet?)
-  si4703_registers[0x07] = 0x8100; //Enable the oscillator, from AN230 page 9, rev 0.61 (works)
+  si4703_registers[TEST1] = 0x8100; //Enable the oscillator, from AN230 page 9, rev 0.61 (works)
   si4703_updateRegisters(); //Update
 
   delay(500); //Wait for clock to settle - from AN230 page 9
 
   si4703_readRegisters(); //Read the current register set
   si4703_registers[POWERCFG] = 0x4001; //Enable the IC
-  //  si4703_registers[POWERCFG] |= (1<<SMUTE) | (1<<DMUTE); //Disable Mute, disable softmute
-  si4703_registers[SYSCONFIG1] |= (1<<RDS); //Enable RDS
+  //  si4703_registers[POWERCFG] |= bits(DSMUTE) | bits(DMUTE); //Disable Mute, disable softmute
+  set(si4703_registers, RDS, 1); //Enable RDS
 
 #ifdef IN_EUROPE
-    si4703_registers[SYSCONFIG1] |= (1<<DE); //50kHz Europe setup
-  si4703_registers[SYSCONFIG2] |= (1<<SPACE0); //100kHz channel spacing for Europe
+  set(si4703_registers, DE, 1); //50kHz Europe setup
+  set(si4703_registers, SPACE, SPACING_100KHZ); //100kHz channel spacing for Europe
 #else
-  si4703_registers[SYSCONFIG2] &= ~(1<<SPACE1 | 1<<SPACE0) ; //Force 200kHz channel spacing for USA
+  set(si4703_registers, SPACE, SPACING_200KHZ); //Force 200kHz channel spacing for USA
 #endif
 
-  si4703_registers[SYSCONFIG2] &= 0xFFF0; //Clear volume bits
-  si4703_registers[SYSCONFIG2] |= 0x0001; //Set volume to lowest
+  set(si4703_registers, VOLUME, 1); //Set volume to lowest
   si4703_updateRegisters(); //Update
 
   delay(110); //Max powerup time, from datasheet page 13
 }
 
-//Write the current 9 control registers (0x02 to 0x07) to the Si4703
+//Write the current 6 control registers (0x02 to 0x07) to the Si4703
 //It's a little weird, you don't write an I2C addres
 //The Si4703 assumes you are writing to 0x02 first, then increments
 byte si4703_updateRegisters(void) {
 
-  Wire.beginTransmission(SI4703);
+  Wire.beginTransmission(I2C_ADDRESS);
   //A write command automatically begins with register 0x02 so no need to send a write-to address
-  //First we send the 0x02 to 0x07 control registers
   //In general, we should not write to registers 0x08 and 0x09
-  for(int regSpot = 0x02 ; regSpot < 0x08 ; regSpot++) {
-    byte high_byte = si4703_registers[regSpot] >> 8;
-    byte low_byte = si4703_registers[regSpot] & 0x00FF;
-
-    Wire.write(high_byte); //Upper 8 bits
-    Wire.write(low_byte); //Lower 8 bits
-  }
+  encodeWriteTo(si4703_registers, Wire);
 
   //End this transmission
   byte ack = Wire.endTransmission();
@@ -604,15 +533,10 @@ byte si4703_updateRegisters(void) {
 void si4703_readRegisters(void){
 
   //Si4703 begins reading from register upper register of 0x0A and reads to 0x0F, then loops to 0x00.
-  Wire.requestFrom(SI4703, 32); //We want to read the entire register set from 0x0A to 0x09 = 32 bytes.
-
-  //Remember, register 0x0A comes in first so we have to shuffle the array around a bit
-  for(int x = 0x0A ; ; x++) { //Read in these 32 bytes
-    if(x == 0x10) x = 0; //Loop back to zero
-    si4703_registers[x] = Wire.read() << 8;
-    si4703_registers[x] |= Wire.read();
-    if(x == 0x09) break; //We're done!
-  }
+  Wire.requestFrom(I2C_ADDRESS, READ_LENGTH); //We want to read the entire register set from 0x0A to 0x09 = 32 bytes.
+
+  //Remember, register 0x0A comes in first, decodeReadFrom wraps the index around for us
+  decodeReadFrom(Wire, READ_LENGTH, si4703_registers);
 }
 
 void si4703_printRegisters(void) {
@@ -625,80 +549,3 @@ void si4703_printRegisters(void) {
     Serial.println(printBuffer);
   }
 }
-
-boolean isValidAsciiBasicCharacterSet(byte rdsData)
-{
-  return rdsData >= 32 && rdsData <= 127;
-}
-
-boolean isValidRdsData() {
-
-  byte blockErrors = (byte)((si4703_registers[STATUSRSSI] & 0x0600) >> 9); //Mask in BLERA;
-
-  byte Ch = (si4703_registers[RDSC] & 0xFF00) >> 8;
-  byte Cl = (si4703_registers[RDSC] & 0x00FF);
-
-  byte Dh = (si4703_registers[RDSD] & 0xFF00) >> 8;
-  byte Dl = (si4703_registers[RDSD] & 0x00FF);
-
-  return blockErrors == 0 && isValidAsciiBasicCharacterSet(Dh) && isValidAsciiBasicCharacterSet(Dl) && isValidAsciiBasicCharacterSet(Ch) && isValidAsciiBasicCharacterSet(Cl);
-}
-
-boolean isValidStationNameData() {
-
-  byte blockErrors = (byte)((si4703_registers[STATUSRSSI] & 0x0600) >> 9); //Mask in BLERA;
-
-  byte Dh = (si4703_registers[RDSD] & 0xFF00) >> 8;
-  byte Dl = (si4703_registers[RDSD] & 0x00FF);
-
-  return blockErrors == 0 && isValidAsciiBasicCharacterSet(Dh) && isValidAsciiBasicCharacterSet(Dl);
-}
-
-boolean isRadioTextData(void) {
-  return (si4703_registers[RDSB] >> 11) == 4 || (si4703_registers[RDSB] >> 11) == 5;
-}
-
-boolean isStationNameData(void) {
-  return (si4703_registers[RDSB] >> 11) == 0 || (si4703_registers[RDSB] >> 11) == 1;
-}
-
-void setRadioTextData(char* pointerToRadioTextData)
-{
-  // retrieve where this data sits in the RDS message
-  byte positionOfData = (si4703_registers[RDSB] & 0x00FF & 0xf);
-  byte characterPosition;
-
-  byte Ch = (si4703_registers[RDSC] & 0xFF00) >> 8;
-  byte Cl = (si4703_registers[RDSC] & 0x00FF);
-
-  byte Dh = (si4703_registers[RDSD] & 0xFF00) >> 8;
-  byte Dl = (si4703_registers[RDSD] & 0x00FF);
-
-  characterPosition = positionOfData * 4;
-  pointerToRadioTextData[characterPosition] = (char)Ch;
-
-  characterPosition = positionOfData * 4 + 1;
-  pointerToRadioTextData[characterPosition] = (char)Cl;
-
-  characterPosition = positionOfData * 4 + 2;
-  pointerToRadioTextData[characterPosition] = (char)Dh;
-
-  characterPosition = positionOfData * 4 + 3;
-  pointerToRadioTextData[characterPosition] = (char)Dl;
-}
-
-void setStationNameData(char* pointerToStationNameData)
-{
-  // retrieve where this data sits in the RDS message
-  byte positionOfData = (si4703_registers[RDSB] & 0x00FF & 0x3);
-  byte characterPosition;
-
-  byte Dh = (si4703_registers[RDSD] & 0xFF00) >> 8;
-  byte Dl = (si4703_registers[RDSD] & 0x00FF);
-
-  characterPosition = positionOfData * 2;
-  pointerToStationNameData[characterPosition] = (char)Dh;
-
-  characterPosition = positionOfData * 2 + 1;
-  pointerToStationNameData[characterPosition] = (char)Dl;
-}
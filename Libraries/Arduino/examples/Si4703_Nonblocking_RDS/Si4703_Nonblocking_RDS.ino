@@ -0,0 +1,65 @@
+#include <SparkFunSi4703.h>
+#include <Wire.h>
+
+// Collects the station name and RadioText in the background with poll()
+// while loop() keeps running at full rate. The LED blink and serial commands
+// never wait on RDS.
+
+int resetPin = 2;
+int SDIO = A4;
+int SCLK = A5;
+int STC = 3;
+int LED = 13;
+
+Si4703_Breakout radio(resetPin, SDIO, SCLK, STC);
+int channel = 973;
+unsigned long lastBlink;
+
+void printStationName(const char* name)
+{
+  Serial.print("Station: ");
+  Serial.println(name);
+}
+
+void printRadioText(const char* text)
+{
+  Serial.print("Text: ");
+  Serial.println(text);
+}
+
+void setup()
+{
+  Serial.begin(9600);
+  Serial.println("\n\nSi4703_Breakout Non-blocking RDS");
+  Serial.println("================================");
+  Serial.println("u d     Seek up / down");
+
+  pinMode(LED, OUTPUT);
+
+  radio.powerOn();
+  radio.setVolume(5);
+  radio.setChannel(channel);
+  radio.onStationName(printStationName);
+  radio.onRadioText(printRadioText);
+}
+
+void loop()
+{
+  radio.poll(); // Returns immediately
+
+  if (millis() - lastBlink > 250)
+  {
+    lastBlink = millis();
+    digitalWrite(LED, !digitalRead(LED));
+  }
+
+  if (Serial.available())
+  {
+    char ch = Serial.read();
+    if (ch == 'u')
+      channel = radio.seekUp();
+    else if (ch == 'd')
+      channel = radio.seekDown();
+    Serial.print("Channel:"); Serial.println(channel);
+  }
+}
@@ -0,0 +1,41 @@
+#include <SparkFunSi4703.h>
+#include <Wire.h>
+
+// Streams every RDS group to a host, which does the decoding. GPIO2 pulses
+// on each new group (RDS_INTERRUPT); capture() reads it into the ring of the
+// Si4703_RdsCapture and the loop sends what is in the ring as 13 byte
+// frames, see si4703::encodeRdsFrame(), only when the serial buffer has room
+// for a whole frame. At 11.4 groups a second that is about 150 bytes a
+// second, well within 115200 baud. Decode on a Raspberry Pi or PC with
+//
+//   RdsSerial /dev/ttyACM0 115200
+//
+// from the Raspberry Pi library's examples.
+
+int resetPin = 2;
+int SDIO = A4;
+int SCLK = A5;
+int GPIO2 = 3; //Must be an interrupt pin
+
+Si4703_Breakout radio(resetPin, SDIO, SCLK, GPIO2);
+Si4703_RdsCapture rds(radio);
+int channel = 973;
+
+void setup()
+{
+  Serial.begin(115200);
+
+  radio.powerOn(Si4703_Breakout::RDS_INTERRUPT | Si4703_Breakout::FAST_I2C);
+  radio.setVolume(5);
+  radio.setChannel(channel);
+}
+
+void loop()
+{
+  rds.capture(); // Returns immediately unless a group is waiting
+
+  byte frame[si4703::RDS_FRAME_LENGTH];
+  while (Serial.availableForWrite() >= si4703::RDS_FRAME_LENGTH &&
+         rds.nextRDSFrame(frame))
+    Serial.write(frame, sizeof(frame));
+}
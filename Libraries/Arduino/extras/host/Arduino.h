@@ -0,0 +1,38 @@
+/*
+Arduino.h - Just enough of the Arduino core to build the library on a PC.
+
+Time is simulated by Si4703Mock.cpp: delay() moves the clock forward and
+every millis()/micros() call costs a few microseconds of it, so busy loops
+finish. Pins do nothing; attachInterrupt() hooks the handler up to the
+simulated chip's GPIO2.
+*/
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define FALLING 2
+#define A4 18
+#define A5 19
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalPinToInterrupt(uint8_t pin);
+void attachInterrupt(int interrupt, void (*handler)(), int mode);
+
+#endif
@@ -0,0 +1,137 @@
+// Measures the bus traffic of the library's calls and how long each one
+// keeps loop() from running, against the simulated chip:
+//
+//   BusBench [--fast] [--stc]
+//
+// --fast and --stc power on with FAST_I2C and STC_INTERRUPT. Built with
+// `make BusBench lib_dir=<dir>` it measures the library in <dir> instead,
+// e.g. an older one from git; libraries from before powerOn() took
+// options only run without them.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <functional>
+#include <initializer_list>
+
+#include "Si4703Mock.h"
+#include "SparkFunSi4703.h"
+
+namespace {
+
+// Si4703_Breakout::STC_INTERRUPT and FAST_I2C, which older libraries lack.
+const byte STC_INTERRUPT = 1;
+const byte FAST_I2C = 2;
+
+// powerOn(options) where the library has it.
+template <typename Radio>
+auto PowerOn(Radio* radio, byte options, int)
+    -> decltype(radio->powerOn(options)) {
+  return radio->powerOn(options);
+}
+
+template <typename Radio>
+void PowerOn(Radio* radio, byte options, long) {
+  if (options)
+    printf("This library's powerOn() takes no options\n");
+  radio->powerOn();
+}
+
+struct Phase {
+  const char* name;
+  unsigned long calls;
+  unsigned long unfinished;  // Calls that left a tune or seek under way.
+  unsigned long total;       // us in the calls.
+  unsigned long longest;     // us.
+  mock::BusStats bus;
+};
+
+void Measure(Phase* phase, const std::function<void()>& call) {
+  const mock::BusStats before = mock::busStats();
+  const unsigned long start = mock::now();
+  call();
+  const unsigned long time = mock::now() - start;
+  const mock::BusStats after = mock::busStats();
+  phase->calls++;
+  phase->unfinished += mock::busy();
+  phase->total += time;
+  if (time > phase->longest)
+    phase->longest = time;
+  phase->bus.reads += after.reads - before.reads;
+  phase->bus.writes += after.writes - before.writes;
+  phase->bus.bytes += after.bytes - before.bytes;
+  phase->bus.micros += after.micros - before.micros;
+}
+
+void Print(const Phase& phase) {
+  printf("  %-10s %6lu %7.1f %7.1f %7.1f %8.2f %8.2f %8.2f %6lu\n", phase.name,
+         phase.calls, double(phase.bus.reads) / phase.calls,
+         double(phase.bus.writes) / phase.calls,
+         double(phase.bus.bytes) / phase.calls,
+         phase.bus.micros / 1000.0 / phase.calls,
+         phase.total / 1000.0 / phase.calls, phase.longest / 1000.0,
+         phase.unfinished);
+}
+
+int Usage() {
+  fprintf(stderr, "usage: BusBench [--fast] [--stc]\n");
+  return 1;
+}
+
+}  // anonymous namespace
+
+int main(int argc, const char** argv) {
+  byte options = 0;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--fast"))
+      options |= FAST_I2C;
+    else if (!strcmp(argv[i], "--stc"))
+      options |= STC_INTERRUPT;
+    else
+      return Usage();
+  }
+
+  mock::reset();
+  for (uint16_t channel : {98, 120, 150})  // 97.3, 99.5 and 102.5 MHz.
+    mock::addStation(channel);
+  Si4703_Breakout radio(2, A4, A5, 3);
+
+  Phase power = {"powerOn()"};
+  Measure(&power, [&] { PowerOn(&radio, options, 0); });
+
+  Phase tune = {"setChannel"};
+  for (int i = 0; i < 10; i++) {
+    Measure(&tune, [&] { radio.setChannel(i % 2 ? 1011 : 973); });
+    mock::advance(mock::TUNE_TIME);  // Let one that returned early finish.
+  }
+
+  Phase seek = {"seekUp()"};
+  radio.setChannel(973);
+  for (int i = 0; i < 6; i++) {
+    Measure(&seek, [&] { radio.seekUp(); });
+    while (mock::busy())
+      mock::advance(mock::TUNE_TIME);
+  }
+
+  // Ten seconds of a loop() that only polls RDS, every millisecond.
+  Phase poll = {"poll()"};
+  radio.setChannel(973);
+  for (int i = 0; i < 120; i++)
+    mock::queueGroup(0xC201, i % 4, 0, 0x4142);
+  const unsigned long end = mock::now() + 10000000;
+  while (mock::now() < end) {
+    Measure(&poll, [&] { radio.poll(); });
+    mock::advance(1000);
+  }
+  const mock::RdsStats rds = mock::rdsStats();
+
+  printf("Per call    calls   reads  writes   bytes   bus ms  call ms   max ms"
+         "  early\n");
+  Print(power);
+  Print(tune);
+  Print(seek);
+  Print(poll);
+  printf("poll(): %lu us of bus time per second, %lu of %lu groups missed\n",
+         poll.bus.micros / 10, rds.missed, rds.sent);
+  return 0;
+}
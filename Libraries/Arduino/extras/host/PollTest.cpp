@@ -0,0 +1,151 @@
+// Runs Si4703_Breakout::poll() from a simulated loop() against the
+// simulated chip and checks that:
+// - the PS name and RadioText come out complete, once each, to the
+//   ready flags and the callbacks;
+// - radioText() goes blank once the station moves on to the next text
+//   and only returns it once all of it is in;
+// - each poll() reads the bus at most once, 12 bytes, and no group is
+//   missed.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+#include "Si4703Mock.h"
+#include "SparkFunSi4703.h"
+
+namespace {
+
+const uint16_t PI_CODE = 0xC201;
+
+bool pass = true;
+std::string callback_text;
+int callbacks = 0;
+
+void Check(bool ok, const char* what) {
+  if (!ok) {
+    printf("  FAIL: %s\n", what);
+    pass = false;
+  }
+}
+
+void OnRadioText(const char* text) {
+  callback_text = text;
+  callbacks++;
+}
+
+// |text| padded with spaces to |length|.
+std::string Padded(const char* text, size_t length) {
+  std::string padded(text);
+  padded.resize(length, ' ');
+  return padded;
+}
+
+void QueuePS(const char* ps) {
+  for (uint16_t segment = 0; segment < 4; segment++)
+    mock::queueGroup(PI_CODE, segment, 0,
+                     ps[segment * 2] << 8 | ps[segment * 2 + 1]);
+}
+
+// Group 2A segments [first, last) of |text|, padded to whole segments.
+void QueueRadioText(int ab, const char* text, int first, int last) {
+  const std::string padded = Padded(text, (strlen(text) + 3) / 4 * 4);
+  for (int segment = first; segment < last; segment++) {
+    const char* chars = padded.c_str() + segment * 4;
+    mock::queueGroup(PI_CODE, 2 << 12 | ab << 4 | segment,
+                     chars[0] << 8 | chars[1], chars[2] << 8 | chars[3]);
+  }
+}
+
+int Segments(const char* text) {
+  return (strlen(text) + 3) / 4;
+}
+
+struct LoopStats {
+  unsigned long polls;
+  unsigned long most_reads;  // In one poll().
+  unsigned long most_bytes;
+  unsigned long longest;  // us, of one poll().
+};
+
+// loop() calling poll() and nothing else every millisecond until the
+// queued groups are out and one more has had time to arrive.
+void Loop(Si4703_Breakout* radio, LoopStats* stats) {
+  unsigned long end = 0;
+  while (end == 0 || mock::now() < end) {
+    if (end == 0 && mock::queuedGroups() == 0)
+      end = mock::now() + mock::GROUP_INTERVAL;
+    const mock::BusStats before = mock::busStats();
+    const unsigned long start = mock::now();
+    radio->poll();
+    const mock::BusStats after = mock::busStats();
+    stats->polls++;
+    if (after.reads - before.reads > stats->most_reads)
+      stats->most_reads = after.reads - before.reads;
+    if (after.bytes - before.bytes > stats->most_bytes)
+      stats->most_bytes = after.bytes - before.bytes;
+    if (mock::now() - start > stats->longest)
+      stats->longest = mock::now() - start;
+    mock::advance(1000);
+  }
+}
+
+}  // anonymous namespace
+
+int main() {
+  const char* first = "First message\r";
+  const char* second = "Second message, a longer one\r";
+
+  mock::reset();
+  mock::addStation(98);  // 97.3 MHz.
+  Si4703_Breakout radio(2, A4, A5, 3);
+  radio.powerOn();
+  radio.onRadioText(OnRadioText);
+  radio.setChannel(973);
+
+  LoopStats stats = {0, 0, 0, 0};
+  QueuePS("MOCK FM ");
+  QueueRadioText(0, first, 0, Segments(first));
+  Loop(&radio, &stats);
+  printf("PS \"%s\", RadioText \"%s\"\n", radio.stationName(),
+         radio.radioText());
+  Check(radio.stationNameReady(), "no PS name ready");
+  Check(!radio.stationNameReady(), "PS name ready twice");
+  Check(std::string(radio.stationName()) == "MOCK FM ", "wrong PS name");
+  Check(radio.radioTextReady(), "no RadioText ready");
+  Check(!radio.radioTextReady(), "RadioText ready twice");
+  const std::string first_text = Padded("First message", 64);
+  Check(radio.radioText() == first_text, "wrong RadioText");
+  Check(callbacks == 1 && callback_text == first_text,
+        "wrong RadioText callback");
+
+  // The station moves on to the B text, which clears the A text in the
+  // decoder. Until all of the B text is in there is no complete one.
+  QueueRadioText(1, second, 0, 2);
+  Loop(&radio, &stats);
+  printf("Halfway through the next text: \"%s\"\n", radio.radioText());
+  Check(radio.radioText() == std::string(), "partial RadioText returned");
+  Check(!radio.radioTextReady() && callbacks == 1,
+        "RadioText ready before complete");
+
+  QueueRadioText(1, second, 2, Segments(second));
+  Loop(&radio, &stats);
+  printf("Then: \"%s\"\n", radio.radioText());
+  const std::string second_text = Padded("Second message, a longer one", 64);
+  Check(radio.radioText() == second_text, "wrong second RadioText");
+  Check(radio.radioTextReady() && callbacks == 2 &&
+            callback_text == second_text,
+        "second RadioText not reported");
+
+  const mock::RdsStats rds = mock::rdsStats();
+  printf("%lu polls, at most %lu read of %lu bytes and %lu us each; "
+         "%lu groups, %lu missed\n",
+         stats.polls, stats.most_reads, stats.most_bytes, stats.longest,
+         rds.sent, rds.missed);
+  Check(stats.most_reads <= 1 && stats.most_bytes <= 12,
+        "poll() read more than 12 bytes");
+  Check(rds.missed == 0, "groups missed");
+  printf("%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+}
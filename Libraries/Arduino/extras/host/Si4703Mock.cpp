@@ -0,0 +1,372 @@
+#include <deque>
+#include <set>
+
+#include "Arduino.h"
+#include "Si4703Mock.h"
+#include "Wire.h"
+
+TwoWire Wire;
+
+namespace {
+
+// The register map, from the datasheet rather than the library's
+// Si4703Core.h, so that a library of any age can run against it.
+enum Register {
+  DEVICEID,
+  CHIPID,
+  POWERCFG,
+  CHANNEL,
+  SYSCONFIG1,
+  SYSCONFIG2,
+  SYSCONFIG3,
+  TEST1,
+  TEST2,
+  BOOTCONFIG,
+  STATUSRSSI,
+  READCHAN,
+  RDSA,
+  RDSB,
+  RDSC,
+  RDSD,
+  NUM_REGISTERS
+};
+
+const uint8_t READ_START = STATUSRSSI;
+const uint8_t READ_LENGTH = 2 * NUM_REGISTERS;
+const uint8_t WRITE_START = POWERCFG;
+const uint8_t WRITE_LENGTH = 2 * 6;
+
+// Bits of the registers above.
+const uint16_t SKMODE = 1 << 10;  // POWERCFG
+const uint16_t SEEKUP = 1 << 9;
+const uint16_t SEEK = 1 << 8;
+const uint16_t PWR_ENABLE = 1 << 0;
+const uint16_t TUNE = 1 << 15;  // CHANNEL
+const uint16_t CHAN = 0x3FF;
+const uint16_t RDSIEN = 1 << 15;  // SYSCONFIG1
+const uint16_t STCIEN = 1 << 14;
+const uint16_t RDS = 1 << 12;
+const uint16_t GPIO2 = 0x3 << 2;
+const uint16_t GPIO2_INTERRUPT = 0x1 << 2;
+const uint16_t RDSR = 1 << 15;  // STATUSRSSI
+const uint16_t STC = 1 << 14;
+const uint16_t SFBL = 1 << 13;
+const uint16_t STEREO = 1 << 8;
+const uint16_t RSSI = 0xFF;
+const uint16_t READ_CHAN = 0x3FF;  // READCHAN
+
+const uint16_t CHANNELS = 206;  // 87.5 to 108 MHz in 100 kHz steps.
+const int STATION_RSSI = 45;
+const int NOISE_RSSI = 8;
+
+struct Group {
+  uint16_t blocks[4];
+};
+
+struct Chip {
+  unsigned long now;
+  uint32_t clock;  // Wire.setClock(), Hz.
+  void (*handler)();
+  uint16_t regs[NUM_REGISTERS];
+  std::set<uint16_t> stations;
+  uint16_t channel;
+  bool busy;  // A tune or seek is under way.
+  unsigned long done_at;
+  uint16_t target;
+  bool failed;
+  std::deque<Group> groups;
+  unsigned long next_group_at;
+  unsigned long rdsr_clear_at;
+  bool rds_unread;  // The group in RDSA-RDSD hasn't been seen with RDSR.
+  uint8_t out[READ_LENGTH];
+  uint8_t out_count;
+  uint8_t out_next;
+  uint8_t in[WRITE_LENGTH];
+  uint8_t in_count;
+  mock::BusStats bus_stats;
+  mock::RdsStats rds_stats;
+};
+
+Chip chip;
+
+bool Bit(uint8_t reg, uint16_t bit) {
+  return chip.regs[reg] & bit;
+}
+
+void Set(uint8_t reg, uint16_t bit, bool on) {
+  chip.regs[reg] = on ? chip.regs[reg] | bit : chip.regs[reg] & ~bit;
+}
+
+void Pulse(bool enabled) {
+  if (enabled && (chip.regs[SYSCONFIG1] & GPIO2) == GPIO2_INTERRUPT &&
+      chip.handler)
+    chip.handler();
+}
+
+bool RdsOn() {
+  return Bit(POWERCFG, PWR_ENABLE) && Bit(SYSCONFIG1, RDS) && !chip.busy;
+}
+
+void UpdateStatus() {
+  const bool station = chip.stations.count(chip.channel) > 0;
+  const int rssi = chip.busy ? 0 : station ? STATION_RSSI : NOISE_RSSI;
+  chip.regs[STATUSRSSI] = (chip.regs[STATUSRSSI] & ~RSSI) | rssi;
+  Set(STATUSRSSI, STEREO, !chip.busy && station);
+  chip.regs[READCHAN] = (chip.regs[READCHAN] & ~READ_CHAN) | chip.channel;
+}
+
+void ExpireGroup() {
+  if (chip.rds_unread)
+    chip.rds_stats.missed++;
+  chip.rds_unread = false;
+  Set(STATUSRSSI, RDSR, false);
+}
+
+void StartSeek() {
+  const bool up = Bit(POWERCFG, SEEKUP);
+  const bool wrap = !Bit(POWERCFG, SKMODE);
+  uint16_t channel = chip.channel;
+  for (uint16_t steps = 1; steps <= CHANNELS; steps++) {
+    if (!wrap && channel == (up ? CHANNELS - 1 : 0)) {
+      chip.done_at = chip.now + steps * mock::TUNE_TIME;
+      chip.target = channel;
+      chip.failed = true;
+      return;
+    }
+    channel = (channel + (up ? 1 : CHANNELS - 1)) % CHANNELS;
+    if (chip.stations.count(channel)) {
+      chip.done_at = chip.now + steps * mock::TUNE_TIME;
+      chip.target = channel;
+      chip.failed = false;
+      return;
+    }
+  }
+  chip.done_at = chip.now + CHANNELS * mock::TUNE_TIME;
+  chip.target = chip.channel;
+  chip.failed = true;
+}
+
+// The control registers were just written; |old| holds them as they were.
+void Write(const uint16_t* old) {
+  const bool tune = Bit(CHANNEL, TUNE) && !(old[CHANNEL] & TUNE);
+  const bool seek = Bit(POWERCFG, SEEK) && !(old[POWERCFG] & SEEK);
+  if (!Bit(CHANNEL, TUNE) && !Bit(POWERCFG, SEEK)) {
+    Set(STATUSRSSI, STC, false);
+    Set(STATUSRSSI, SFBL, false);
+  }
+  if ((tune || seek) && !chip.busy) {
+    chip.busy = true;
+    Set(STATUSRSSI, STC, false);
+    Set(STATUSRSSI, SFBL, false);
+    ExpireGroup();
+    if (tune) {
+      chip.done_at = chip.now + mock::TUNE_TIME;
+      chip.target = (chip.regs[CHANNEL] & CHAN) % CHANNELS;
+      chip.failed = false;
+    } else {
+      StartSeek();
+    }
+  }
+  if (RdsOn() && chip.next_group_at < chip.now)
+    chip.next_group_at = chip.now + mock::GROUP_INTERVAL;
+  UpdateStatus();
+}
+
+// Move the chip on to |when|, one event at a time.
+void Run(unsigned long when) {
+  while (true) {
+    unsigned long next = when;
+    if (chip.busy && chip.done_at < next)
+      next = chip.done_at;
+    if (Bit(STATUSRSSI, RDSR) && chip.rdsr_clear_at < next)
+      next = chip.rdsr_clear_at;
+    if (RdsOn() && !chip.groups.empty() && chip.next_group_at < next)
+      next = chip.next_group_at;
+    chip.now = next;
+    if (chip.busy && chip.done_at == next) {
+      chip.busy = false;
+      chip.channel = chip.target;
+      Set(STATUSRSSI, STC, true);
+      Set(STATUSRSSI, SFBL, chip.failed);
+      chip.next_group_at = next + mock::GROUP_INTERVAL;
+      UpdateStatus();
+      Pulse(Bit(SYSCONFIG1, STCIEN));
+    } else if (Bit(STATUSRSSI, RDSR) && chip.rdsr_clear_at == next) {
+      ExpireGroup();
+    } else if (RdsOn() && !chip.groups.empty() &&
+               chip.next_group_at == next) {
+      if (Bit(STATUSRSSI, RDSR))
+        ExpireGroup();
+      const Group& group = chip.groups.front();
+      for (int i = 0; i < 4; i++)
+        chip.regs[RDSA + i] = group.blocks[i];
+      chip.groups.pop_front();
+      chip.rds_stats.sent++;
+      chip.rds_unread = true;
+      Set(STATUSRSSI, RDSR, true);
+      chip.rdsr_clear_at = next + mock::RDSR_TIME;
+      chip.next_group_at = next + mock::GROUP_INTERVAL;
+      Pulse(Bit(SYSCONFIG1, RDSIEN));
+    } else {
+      return;
+    }
+  }
+}
+
+// The bus is busy for |bytes| data bytes, the address byte and the start
+// and stop conditions.
+void Transfer(uint8_t bytes) {
+  chip.bus_stats.bytes += bytes;
+  const unsigned long bits = 9ul * (bytes + 1) + 2;
+  const unsigned long micros = (bits * 1000000ul + chip.clock - 1) / chip.clock;
+  chip.bus_stats.micros += micros;
+  Run(chip.now + micros);
+}
+
+}  // anonymous namespace
+
+namespace mock {
+
+void reset() {
+  chip.now = 0;
+  chip.clock = 100000;
+  chip.handler = nullptr;
+  memset(chip.regs, 0, sizeof(chip.regs));
+  chip.regs[DEVICEID] = 0x1242;
+  chip.regs[CHIPID] = 0x1253;
+  chip.stations.clear();
+  chip.channel = 0;
+  chip.busy = false;
+  chip.done_at = 0;
+  chip.target = 0;
+  chip.failed = false;
+  chip.groups.clear();
+  chip.next_group_at = 0;
+  chip.rdsr_clear_at = 0;
+  chip.rds_unread = false;
+  chip.out_count = chip.out_next = 0;
+  chip.in_count = 0;
+  chip.bus_stats = BusStats{0, 0, 0, 0};
+  chip.rds_stats = RdsStats{0, 0};
+  UpdateStatus();
+}
+
+unsigned long now() {
+  return chip.now;
+}
+
+void advance(unsigned long us) {
+  Run(chip.now + us);
+}
+
+void addStation(uint16_t channel) {
+  chip.stations.insert(channel);
+  UpdateStatus();
+}
+
+void queueGroup(uint16_t a, uint16_t b, uint16_t c, uint16_t d) {
+  chip.groups.push_back(Group{{a, b, c, d}});
+}
+
+size_t queuedGroups() {
+  return chip.groups.size();
+}
+
+bool busy() {
+  return chip.busy;
+}
+
+BusStats busStats() {
+  return chip.bus_stats;
+}
+
+RdsStats rdsStats() {
+  return chip.rds_stats;
+}
+
+}  // namespace mock
+
+unsigned long millis() {
+  mock::advance(mock::CLOCK_READ_TIME);
+  return chip.now / 1000;
+}
+
+unsigned long micros() {
+  mock::advance(mock::CLOCK_READ_TIME);
+  return chip.now;
+}
+
+void delay(unsigned long ms) {
+  mock::advance(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  mock::advance(us);
+}
+
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t, uint8_t) {}
+
+int digitalPinToInterrupt(uint8_t pin) {
+  return pin;
+}
+
+void attachInterrupt(int, void (*handler)(), int) {
+  chip.handler = handler;
+}
+
+void TwoWire::begin() {}
+
+void TwoWire::setClock(uint32_t clock) {
+  chip.clock = clock;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t, uint8_t count) {
+  if (count > READ_LENGTH)
+    count = READ_LENGTH;
+  chip.bus_stats.reads++;
+  // The bytes are latched as the read starts.
+  uint8_t reg = READ_START;
+  for (uint8_t i = 0; i + 1 < count; i += 2) {
+    chip.out[i] = chip.regs[reg] >> 8;
+    chip.out[i + 1] = chip.regs[reg] & 0xFF;
+    reg = (reg + 1) & 0x0F;
+  }
+  if (Bit(STATUSRSSI, RDSR))
+    chip.rds_unread = false;
+  chip.out_count = count;
+  chip.out_next = 0;
+  Transfer(count);
+  return count;
+}
+
+int TwoWire::available() {
+  return chip.out_count - chip.out_next;
+}
+
+int TwoWire::read() {
+  return chip.out_next < chip.out_count ? chip.out[chip.out_next++] : -1;
+}
+
+void TwoWire::beginTransmission(uint8_t) {
+  chip.in_count = 0;
+}
+
+size_t TwoWire::write(uint8_t value) {
+  if (chip.in_count == WRITE_LENGTH)
+    return 0;
+  chip.in[chip.in_count++] = value;
+  return 1;
+}
+
+uint8_t TwoWire::endTransmission() {
+  chip.bus_stats.writes++;
+  uint16_t old[NUM_REGISTERS];
+  memcpy(old, chip.regs, sizeof(old));
+  for (uint8_t i = 0; i + 1 < chip.in_count; i += 2)
+    chip.regs[WRITE_START + i / 2] = chip.in[i] << 8 | chip.in[i + 1];
+  Write(old);
+  Transfer(chip.in_count);
+  return 0;
+}
@@ -0,0 +1,68 @@
+/*
+Si4703Mock.h - A simulated Si4703 behind the host Wire, on a simulated
+clock, for running the Arduino library on a PC.
+
+The chip answers reads from 0x0A and writes to 0x02 the way the real one
+does. Setting TUNE or SEEK raises STC TUNE_TIME per channel later, and
+clearing both drops it again. While RDS is on and no tune or seek is under
+way, the queued groups come out one every GROUP_INTERVAL, each holding
+RDSR up for RDSR_TIME. With STCIEN or RDSIEN and GPIO2 set to interrupt,
+the handler given to attachInterrupt() is called as GPIO2 pulses.
+
+Every transfer is counted and takes as long as its bits need at the clock
+Wire.setClock() chose: 9 bits a byte, the address byte included, plus the
+start and stop conditions.
+*/
+
+#ifndef Si4703Mock_h
+#define Si4703Mock_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace mock {
+
+const unsigned long TUNE_TIME = 60000;       // us, as in the datasheet.
+const unsigned long GROUP_INTERVAL = 87600;  // us, as on air.
+const unsigned long RDSR_TIME = 40000;       // us.
+
+// The time a millis() or micros() call takes, so busy loops get somewhere.
+const unsigned long CLOCK_READ_TIME = 4;  // us.
+
+struct BusStats {
+  unsigned long reads;
+  unsigned long writes;
+  unsigned long bytes;   // Data bytes, not counting the address.
+  unsigned long micros;  // Time the bus was busy.
+};
+
+struct RdsStats {
+  unsigned long sent;
+  unsigned long missed;  // Groups gone before any read saw RDSR.
+};
+
+// Back to power-on: the clock at 0, the chip in reset, no stations,
+// nothing queued and the stats cleared. Call it before anything else.
+void reset();
+
+// The simulated time in us, and moving it on.
+unsigned long now();
+void advance(unsigned long us);
+
+// A station on |channel| (CHAN: 100 kHz steps from 87.5 MHz), for seeks to
+// stop on.
+void addStation(uint16_t channel);
+
+// Send the group with blocks |a|-|d| after the ones already queued.
+void queueGroup(uint16_t a, uint16_t b, uint16_t c, uint16_t d);
+size_t queuedGroups();
+
+// Whether a tune or seek is still under way.
+bool busy();
+
+BusStats busStats();
+RdsStats rdsStats();
+
+}  // namespace mock
+
+#endif
@@ -0,0 +1,26 @@
+/*
+Wire.h - The Arduino Wire API on a PC, talking to the simulated Si4703 of
+Si4703Mock.cpp.
+*/
+
+#ifndef Wire_h
+#define Wire_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+class TwoWire {
+ public:
+  void begin();
+  void setClock(uint32_t clock);
+  uint8_t requestFrom(uint8_t address, uint8_t count);
+  int available();
+  int read();
+  void beginTransmission(uint8_t address);
+  size_t write(uint8_t value);
+  uint8_t endTransmission();
+};
+
+extern TwoWire Wire;
+
+#endif
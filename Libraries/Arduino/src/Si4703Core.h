@@ -0,0 +1,616 @@
+/*
+Si4703Core.h - Header-only register core for the Si4703 FM tuner.
+
+This is the one place that knows the Si4703 register map, the wraparound
+order of the 2-wire read, the write encoding and the RDS group layout. The
+Arduino library, the firmware example and the Raspberry Pi library are all
+thin front ends around it so the hot paths are identical on every platform.
+
+Everything here is plain C++11 with no heap, no STL and no platform headers
+so it builds unchanged with avr-gcc and with the host compiler.
+
+Register and bit names follow the Si4702/03-C19 datasheet:
+https://www.silabs.com/documents/public/data-sheets/Si4702-03-C19.pdf
+
+This code is beerware; if you see me (or any other SparkFun employee) at the
+local, and you've found our code helpful, please buy us a round!
+
+Distributed as-is; no warranty is given.
+*/
+
+#ifndef Si4703Core_h
+#define Si4703Core_h
+
+#include <stdint.h>
+
+namespace si4703 {
+
+// 0b._001.0000 = I2C address of Si4703 - note that the Wire function assumes
+// non-left-shifted I2C address, not 0b.0010.000W.
+static const uint8_t I2C_ADDRESS = 0x10;
+
+// There are 16 registers, each 16 bits large.
+static const uint8_t NUM_REGISTERS = 16;
+
+// A read always begins with the upper byte of 0x0A, runs to 0x0F and then
+// wraps around to 0x00. A full read of the register file is 32 bytes.
+static const uint8_t READ_START = 0x0A;
+static const uint8_t READ_LENGTH = 2 * NUM_REGISTERS;
+
+// A write always begins with 0x02. In general we should not write to 0x08
+// and 0x09, so only the 0x02 to 0x07 control registers are sent.
+static const uint8_t WRITE_START = 0x02;
+static const uint8_t WRITE_COUNT = 6;
+static const uint8_t WRITE_LENGTH = 2 * WRITE_COUNT;
+
+// The register map, in one place. Every register is X(name, address) and
+// every field X(name, register, shift, mask). These lists define the
+// Register enum and the Field constants below, the REGISTERS[] and FIELDS[]
+// tables that decoders and register dumps walk, and the compile time check
+// that no two fields overlap.
+#define SI4703_REGISTERS(X) \
+  X(DEVICEID, 0x00)         \
+  X(CHIPID, 0x01)           \
+  X(POWERCFG, 0x02)         \
+  X(CHANNEL, 0x03)          \
+  X(SYSCONFIG1, 0x04)       \
+  X(SYSCONFIG2, 0x05)       \
+  X(SYSCONFIG3, 0x06)       \
+  X(TEST1, 0x07)            \
+  X(TEST2, 0x08)            \
+  X(BOOTCONFIG, 0x09)       \
+  X(STATUSRSSI, 0x0A)       \
+  X(READCHAN, 0x0B)         \
+  X(RDSA, 0x0C)             \
+  X(RDSB, 0x0D)             \
+  X(RDSC, 0x0E)             \
+  X(RDSD, 0x0F)
+
+#define SI4703_FIELDS(X)                                             \
+  /* Register 0x00 - DEVICEID */                                     \
+  X(PN, DEVICEID, 12, 0xF)      /* Part number. */                   \
+  X(MFGID, DEVICEID, 0, 0xFFF)  /* Manufacturer ID. */               \
+  /* Register 0x01 - CHIPID */                                       \
+  X(REV, CHIPID, 10, 0x3F)     /* Chip version. */                   \
+  X(DEV, CHIPID, 6, 0xF)       /* Device. */                         \
+  X(FIRMWARE, CHIPID, 0, 0x3F) /* Firmware version. */               \
+  /* Register 0x02 - POWERCFG */                                     \
+  X(DSMUTE, POWERCFG, 15, 0x1) /* Softmute disable. */               \
+  X(DMUTE, POWERCFG, 14, 0x1)  /* Mute disable. */                   \
+  X(MONO, POWERCFG, 13, 0x1)                                         \
+  X(RDSM, POWERCFG, 11, 0x1) /* RDS verbose mode. */                 \
+  X(SKMODE, POWERCFG, 10, 0x1)                                       \
+  X(SEEKUP, POWERCFG, 9, 0x1)                                        \
+  X(SEEK, POWERCFG, 8, 0x1)                                          \
+  X(PWR_DISABLE, POWERCFG, 6, 0x1)                                   \
+  X(PWR_ENABLE, POWERCFG, 0, 0x1)                                    \
+  /* Register 0x03 - CHANNEL */                                      \
+  X(TUNE, CHANNEL, 15, 0x1)                                          \
+  X(CHAN, CHANNEL, 0, 0x3FF)                                         \
+  /* Register 0x04 - SYSCONFIG1 */                                   \
+  X(RDSIEN, SYSCONFIG1, 15, 0x1) /* RDS interrupt enable. */         \
+  X(STCIEN, SYSCONFIG1, 14, 0x1) /* Seek/Tune interrupt enable. */   \
+  X(RDS, SYSCONFIG1, 12, 0x1)                                        \
+  X(DE, SYSCONFIG1, 11, 0x1) /* De-emphasis, 1 = 50us. */            \
+  X(AGCD, SYSCONFIG1, 10, 0x1)                                       \
+  X(BLNDADJ, SYSCONFIG1, 6, 0x3)                                     \
+  X(GPIO3, SYSCONFIG1, 4, 0x3)                                       \
+  X(GPIO2, SYSCONFIG1, 2, 0x3)                                       \
+  X(GPIO1, SYSCONFIG1, 0, 0x3)                                       \
+  /* Register 0x05 - SYSCONFIG2 */                                   \
+  X(SEEKTH, SYSCONFIG2, 8, 0xFF)                                     \
+  X(BAND, SYSCONFIG2, 6, 0x3)                                        \
+  X(SPACE, SYSCONFIG2, 4, 0x3)                                       \
+  X(VOLUME, SYSCONFIG2, 0, 0xF)                                      \
+  /* Register 0x06 - SYSCONFIG3 */                                   \
+  X(SMUTER, SYSCONFIG3, 14, 0x3)                                     \
+  X(SMUTEA, SYSCONFIG3, 12, 0x3)                                     \
+  X(VOLEXT, SYSCONFIG3, 8, 0x1)                                      \
+  X(SKSNR, SYSCONFIG3, 4, 0xF)                                       \
+  X(SKCNT, SYSCONFIG3, 0, 0xF)                                       \
+  /* Register 0x07 - TEST1 */                                        \
+  X(XOSCEN, TEST1, 15, 0x1)                                          \
+  X(AHIZEN, TEST1, 14, 0x1)                                          \
+  /* Register 0x0A - STATUSRSSI */                                   \
+  X(RDSR, STATUSRSSI, 15, 0x1)   /* RDS Ready. */                    \
+  X(STC, STATUSRSSI, 14, 0x1)    /* Seek/Tune Complete. */           \
+  X(SFBL, STATUSRSSI, 13, 0x1)   /* Seek Fail/Band Limit. */         \
+  X(AFCRL, STATUSRSSI, 12, 0x1)  /* AFC Rail. */                     \
+  X(RDSS, STATUSRSSI, 11, 0x1)   /* RDS Synchronized. */             \
+  X(BLERA, STATUSRSSI, 9, 0x3)   /* RDS Block A Errors. */           \
+  X(STEREO, STATUSRSSI, 8, 0x1)  /* Stereo Indicator. */             \
+  X(RSSI, STATUSRSSI, 0, 0xFF)   /* Signal strength, dBuV. */        \
+  /* Register 0x0B - READCHAN */                                     \
+  X(BLERB, READCHAN, 14, 0x3)                                        \
+  X(BLERC, READCHAN, 12, 0x3)                                        \
+  X(BLERD, READCHAN, 10, 0x3)                                        \
+  X(READ_CHAN, READCHAN, 0, 0x3FF)
+
+// Register names.
+enum Register : uint8_t {
+#define SI4703_REGISTER_ENUM(name, address) name = address,
+  SI4703_REGISTERS(SI4703_REGISTER_ENUM)
+#undef SI4703_REGISTER_ENUM
+};
+
+// A field of register |reg| starting at bit |shift|. |mask| is right-aligned
+// (0x3 for a two bit field), so the in-register mask is mask << shift.
+struct Field {
+  uint8_t reg;
+  uint8_t shift;
+  uint16_t mask;
+};
+
+#define SI4703_FIELD_CONSTANT(name, reg, shift, mask) \
+  constexpr Field name = {reg, shift, mask};
+SI4703_FIELDS(SI4703_FIELD_CONSTANT)
+#undef SI4703_FIELD_CONSTANT
+
+// Register names in address order, e.g. REGISTERS[STATUSRSSI] ==
+// "STATUSRSSI".
+constexpr const char* REGISTERS[NUM_REGISTERS] = {
+#define SI4703_REGISTER_NAME(name, address) #name,
+    SI4703_REGISTERS(SI4703_REGISTER_NAME)
+#undef SI4703_REGISTER_NAME
+};
+
+// Every field with its name, grouped by register in address order and
+// from the high bits down within a register.
+struct FieldInfo {
+  const char* name;
+  Field field;
+};
+
+constexpr FieldInfo FIELDS[] = {
+#define SI4703_FIELD_INFO(name, reg, shift, mask) {#name, {reg, shift, mask}},
+    SI4703_FIELDS(SI4703_FIELD_INFO)
+#undef SI4703_FIELD_INFO
+};
+static const uint8_t NUM_FIELDS = sizeof(FIELDS) / sizeof(FIELDS[0]);
+
+// The in-register mask of |f|, e.g. bits(STC) == 0x4000.
+constexpr uint16_t bits(Field f) {
+  return static_cast<uint16_t>(f.mask << f.shift);
+}
+
+// The right-aligned value of |f| in the register file |regs|.
+inline uint16_t get(const uint16_t* regs, Field f) {
+  return (regs[f.reg] >> f.shift) & f.mask;
+}
+
+// Store |value| into |f| of the register file |regs|, leaving the other
+// bits of that register untouched.
+inline void set(uint16_t* regs, Field f, uint16_t value) {
+  regs[f.reg] = (regs[f.reg] & ~bits(f)) | ((value & f.mask) << f.shift);
+}
+
+// As above with the field fixed at compile time, e.g. get<STC>(regs). Each
+// is a single load, shift and mask whatever the optimization level.
+template <const Field& F>
+inline uint16_t get(const uint16_t* regs) {
+  return (regs[F.reg] >> F.shift) & F.mask;
+}
+
+template <const Field& F>
+inline void set(uint16_t* regs, uint16_t value) {
+  regs[F.reg] = (regs[F.reg] & ~bits(F)) | ((value & F.mask) << F.shift);
+}
+
+// Dirty register tracking. Bit n of a dirty mask is set when register n of
+// the host's copy differs from what was last written to the chip, so a
+// write need only reach as far as the highest dirty register (see
+// writeCount()). These setters only mark registers whose value changed.
+template <const Field& F>
+inline void set(uint16_t* regs, uint16_t value, uint16_t* dirty) {
+  const uint16_t old = regs[F.reg];
+  set<F>(regs, value);
+  if (regs[F.reg] != old)
+    *dirty |= 1 << F.reg;
+}
+
+inline void setRegister(uint16_t* regs,
+                        uint8_t reg,
+                        uint16_t value,
+                        uint16_t* dirty) {
+  if (regs[reg] != value)
+    *dirty |= 1 << reg;
+  regs[reg] = value;
+}
+
+// Every register a write can reach, as a dirty mask.
+static const uint16_t WRITE_REGISTERS = ((1 << WRITE_COUNT) - 1)
+                                        << WRITE_START;
+
+// The number of registers a write must send, starting at WRITE_START, to
+// reach every dirty register in |dirty|. 0 if there is nothing to write.
+inline uint8_t writeCount(uint16_t dirty) {
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < WRITE_COUNT; i++) {
+    if (dirty & (1 << (WRITE_START + i)))
+      count = i + 1;
+  }
+  return count;
+}
+
+// Compile time checks of the tables above: every field lies within its
+// register, masks are right-aligned runs of ones and no two fields of a
+// register share a bit.
+constexpr bool fieldFits(Field f) {
+  return f.reg < NUM_REGISTERS && f.mask && (f.mask & (f.mask + 1)) == 0 &&
+         (static_cast<uint32_t>(f.mask) << f.shift) <= 0xFFFF;
+}
+
+constexpr bool fieldsOverlap(Field a, Field b) {
+  return a.reg == b.reg && (bits(a) & bits(b));
+}
+
+constexpr bool overlapsLater(uint8_t i, uint8_t j) {
+  return j < NUM_FIELDS &&
+         (fieldsOverlap(FIELDS[i].field, FIELDS[j].field) ||
+          overlapsLater(i, j + 1));
+}
+
+constexpr bool fieldsValid(uint8_t i) {
+  return i >= NUM_FIELDS ||
+         (fieldFits(FIELDS[i].field) && !overlapsLater(i, i + 1) &&
+          fieldsValid(i + 1));
+}
+
+static_assert(fieldsValid(0), "Si4703 register fields overlap or overflow");
+
+// See AN230 Programmers Guide section 3.4.1 for bands.
+enum Band : uint8_t {
+  BAND_US_EUROPE = 0,   // 87.5-108 MHz.
+  BAND_JAPAN_WIDE = 1,  // 76-108 MHz.
+  BAND_JAPAN = 2,       // 76-90 MHz.
+};
+
+// See AN230 Programmers Guide section 3.4.2 for channel spacing.
+enum Spacing : uint8_t {
+  SPACING_200KHZ = 0,
+  SPACING_100KHZ = 1,
+  SPACING_50KHZ = 2,
+};
+
+// Frequencies are kept in 10 kHz units (97.3 MHz == 9730) so that every
+// band fits in 16 bits and no floating point is needed on AVR.
+constexpr uint16_t bandBottom(uint8_t band) {
+  return band == BAND_US_EUROPE ? 8750 : 7600;
+}
+
+constexpr uint16_t bandTop(uint8_t band) {
+  return band == BAND_JAPAN ? 9000 : 10800;
+}
+
+constexpr uint16_t spacingStep(uint8_t space) {
+  return space == SPACING_200KHZ ? 20 : (space == SPACING_100KHZ ? 10 : 5);
+}
+
+// This formula is from the AN230 Programmers Guide, section 3.7.1.
+// https://www.silabs.com/documents/public/application-notes/AN230.pdf
+constexpr uint16_t channelToFrequency(uint16_t channel,
+                                      uint8_t band,
+                                      uint8_t space) {
+  return bandBottom(band) + channel * spacingStep(space);
+}
+
+constexpr uint16_t frequencyToChannel(uint16_t frequency,
+                                      uint8_t band,
+                                      uint8_t space) {
+  return (frequency - bandBottom(band)) / spacingStep(space);
+}
+
+// Decode |count| bytes of a 2-wire read into |regs|. The first byte on the
+// bus is the upper byte of 0x0A, so the register index simply wraps from
+// 0x0F back to 0x00. A short read (e.g. 4 bytes for STATUSRSSI and
+// READCHAN) only refreshes the registers it covered.
+inline void decodeRead(const uint8_t* bytes, uint8_t count, uint16_t* regs) {
+  uint8_t reg = READ_START;
+  for (uint8_t i = 0; i + 1 < count; i += 2) {
+    regs[reg] = static_cast<uint16_t>(bytes[i] << 8) | bytes[i + 1];
+    reg = (reg + 1) & 0x0F;
+  }
+}
+
+// Same as above, pulling bytes from anything with a read() method returning
+// the next byte (e.g. the Arduino Wire object) to avoid a staging buffer.
+template <typename ByteSource>
+inline void decodeReadFrom(ByteSource& source, uint8_t count, uint16_t* regs) {
+  uint8_t reg = READ_START;
+  for (uint8_t i = 0; i + 1 < count; i += 2) {
+    uint16_t high = static_cast<uint8_t>(source.read());
+    regs[reg] = static_cast<uint16_t>(high << 8) |
+                static_cast<uint8_t>(source.read());
+    reg = (reg + 1) & 0x0F;
+  }
+}
+
+// Encode the 0x02 to 0x07 control registers into the 12 bytes of a write,
+// upper byte first. A shorter write of the first |count| registers (see
+// writeCount()) leaves the rest of them unchanged on the chip.
+inline void encodeWrite(const uint16_t* regs,
+                        uint8_t* bytes,
+                        uint8_t count = WRITE_COUNT) {
+  for (uint8_t i = 0; i < count; i++) {
+    bytes[2 * i] = regs[WRITE_START + i] >> 8;
+    bytes[2 * i + 1] = regs[WRITE_START + i] & 0xFF;
+  }
+}
+
+// Same as above, pushing bytes into anything with a write(uint8_t) method.
+template <typename ByteSink>
+inline void encodeWriteTo(const uint16_t* regs,
+                          ByteSink& sink,
+                          uint8_t count = WRITE_COUNT) {
+  for (uint8_t i = 0; i < count; i++) {
+    sink.write(static_cast<uint8_t>(regs[WRITE_START + i] >> 8));
+    sink.write(static_cast<uint8_t>(regs[WRITE_START + i] & 0xFF));
+  }
+}
+
+// Decodes the PI code, programme service name (groups 0A/0B) and RadioText
+// (groups 2A/2B) from the RDSA-RDSD registers. Call decode() every time RDSR
+// is set; it returns a bit set of the Events that group produced.
+struct RdsDecoder {
+  enum Event : uint8_t {
+    PI_CHANGED = 1 << 0,
+    PS_SEGMENT = 1 << 1,
+    PS_COMPLETE = 1 << 2,
+    RT_SEGMENT = 1 << 3,
+    RT_COMPLETE = 1 << 4,
+    RT_CLEARED = 1 << 5,  // The RadioText A/B flag toggled.
+    GROUP = 1 << 6,       // Any group that passed the error check.
+  };
+
+  static const uint8_t PS_LENGTH = 8;
+  static const uint8_t RT_LENGTH = 64;
+
+  uint16_t pi;
+  uint8_t pty;
+  bool tp;
+  bool ta;
+  char ps[PS_LENGTH + 1];  // Null terminated.
+  char rt[RT_LENGTH + 1];  // Null terminated.
+
+  // Groups with any block worse than this BLER level (0 = no errors,
+  // 3 = 6+ errors) are dropped.
+  uint8_t max_errors;
+
+  // Drop PS and RadioText segments with any character outside printable
+  // ASCII (the carriage return ending a RadioText aside), as the original
+  // Arduino example did. Off, the RDS character set's accented letters
+  // and symbols come through as their raw bytes.
+  bool ascii_only;
+
+  RdsDecoder() : max_errors(0), ascii_only(false) { reset(); }
+
+  void reset() {
+    pi = 0;
+    pty = 0;
+    tp = ta = false;
+    ps_mask_ = 0;
+    rt_mask_ = 0;
+    rt_end_ = RT_LENGTH / 4;
+    rt_ab_ = 0xFF;
+    for (uint8_t i = 0; i < PS_LENGTH; i++)
+      ps[i] = ' ';
+    ps[PS_LENGTH] = '\0';
+    clearRadioText();
+  }
+
+  // Decode the group held in the RDSA-RDSD registers of |regs|. The block
+  // A error level comes from STATUSRSSI; blocks B-D are only reported in
+  // READCHAN when RDS verbose mode (RDSM) is on.
+  uint8_t decode(const uint16_t* regs) {
+    if (get<BLERA>(regs) > max_errors)
+      return 0;
+    if (get<RDSM>(regs) &&
+        (get<BLERB>(regs) > max_errors || get<BLERC>(regs) > max_errors ||
+         get<BLERD>(regs) > max_errors))
+      return 0;
+    return decodeGroup(regs[RDSA], regs[RDSB], regs[RDSC], regs[RDSD]);
+  }
+
+  uint8_t decodeGroup(uint16_t a, uint16_t b, uint16_t c, uint16_t d) {
+    uint8_t events = GROUP;
+    if (a != pi) {
+      reset();
+      pi = a;
+      events |= PI_CHANGED;
+    }
+    const uint8_t type = b >> 11;  // Group type and version (A=0, B=1).
+    pty = (b >> 5) & 0x1F;
+    tp = b & (1 << 10);
+
+    if (type == 0 || type == 1) {  // 0A / 0B: basic tuning and switching.
+      ta = b & (1 << 4);
+      if (!accepts(d))
+        return events;
+      const uint8_t segment = b & 0x3;
+      ps[segment * 2] = d >> 8;
+      ps[segment * 2 + 1] = d & 0xFF;
+      ps_mask_ |= 1 << segment;
+      events |= PS_SEGMENT;
+      if (ps_mask_ == 0xF) {
+        events |= PS_COMPLETE;
+        ps_mask_ = 0;  // Start collecting the next rotation of the name.
+      }
+    } else if (type == 4 || type == 5) {  // 2A / 2B: RadioText.
+      if ((type == 4 && !accepts(c)) || !accepts(d))
+        return events;
+      const uint8_t ab = (b >> 4) & 0x1;
+      if (ab != rt_ab_) {
+        if (rt_ab_ != 0xFF)
+          events |= RT_CLEARED;
+        clearRadioText();
+        rt_ab_ = ab;
+      }
+      const uint8_t segment = b & 0xF;
+      if (type == 4) {
+        putRadioText(segment * 4, c, segment);
+        putRadioText(segment * 4 + 2, d, segment);
+      } else {
+        putRadioText(segment * 2, d, segment);
+      }
+      rt_mask_ |= 1u << segment;
+      events |= RT_SEGMENT;
+      const uint16_t want = static_cast<uint16_t>((1ul << rt_end_) - 1);
+      if ((rt_mask_ & want) == want) {
+        events |= RT_COMPLETE;
+        rt_mask_ = 0;
+      }
+    }
+    return events;
+  }
+
+ private:
+  static bool asciiChar(uint8_t c) {
+    return (c >= 0x20 && c < 0x7F) || c == '\r';
+  }
+
+  // Whether the two characters in |word| get past ascii_only.
+  bool accepts(uint16_t word) const {
+    return !ascii_only || (asciiChar(word >> 8) && asciiChar(word & 0xFF));
+  }
+
+  void clearRadioText() {
+    for (uint8_t i = 0; i < RT_LENGTH; i++)
+      rt[i] = ' ';
+    rt[RT_LENGTH] = '\0';
+    rt_mask_ = 0;
+    rt_end_ = RT_LENGTH / 4;
+  }
+
+  // Store the two characters in |word| at |pos|. A carriage return marks the
+  // end of a message shorter than 64 characters.
+  void putRadioText(uint8_t pos, uint16_t word, uint8_t segment) {
+    const char chars[2] = {static_cast<char>(word >> 8),
+                           static_cast<char>(word & 0xFF)};
+    for (uint8_t i = 0; i < 2 && pos + i < RT_LENGTH; i++) {
+      if (chars[i] == '\r') {
+        rt_end_ = segment + 1;
+        for (uint8_t j = pos + i; j < RT_LENGTH; j++)
+          rt[j] = ' ';
+        return;
+      }
+      rt[pos + i] = chars[i];
+    }
+  }
+
+  uint8_t ps_mask_;   // Bit per received PS segment.
+  uint16_t rt_mask_;  // Bit per received RadioText segment.
+  uint8_t rt_end_;    // Number of segments in the current RadioText.
+  uint8_t rt_ab_;     // Current RadioText A/B flag, 0xFF if none yet.
+};
+
+// The BLER levels (0 = no errors .. 3 = 6+ errors) of blocks A-D in one
+// byte, A in the high bits. BLERB-BLERD read 0 unless RDS verbose mode
+// (RDSM) is on.
+inline uint8_t blockErrors(const uint16_t* regs) {
+  return static_cast<uint8_t>(get<BLERA>(regs) << 6 | get<BLERB>(regs) << 4 |
+                              get<BLERC>(regs) << 2 | get<BLERD>(regs));
+}
+
+// CRC-8, polynomial 0x07.
+inline uint8_t crc8(const uint8_t* bytes, uint8_t count) {
+  uint8_t crc = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    crc ^= bytes[i];
+    for (uint8_t bit = 0; bit < 8; bit++)
+      crc = crc & 0x80 ? static_cast<uint8_t>(crc << 1) ^ 0x07 : crc << 1;
+  }
+  return crc;
+}
+
+// An RDS group framed for a byte stream, e.g. from an Arduino capturing
+// groups to a host that decodes them over a serial line: the two sync
+// bytes, a sequence number, the four blocks upper byte first, the
+// blockErrors() byte and a CRC-8 of everything after the sync bytes. The
+// sender numbers every group it received, sent or not, so a gap in the
+// sequence tells the receiver how many were lost on the way.
+static const uint8_t RDS_FRAME_SYNC0 = 0xA5;
+static const uint8_t RDS_FRAME_SYNC1 = 0x5A;
+static const uint8_t RDS_FRAME_LENGTH = 13;
+
+inline void encodeRdsFrame(uint8_t sequence,
+                           const uint16_t* blocks,
+                           uint8_t block_errors,
+                           uint8_t* frame) {
+  frame[0] = RDS_FRAME_SYNC0;
+  frame[1] = RDS_FRAME_SYNC1;
+  frame[2] = sequence;
+  for (uint8_t i = 0; i < 4; i++) {
+    frame[3 + 2 * i] = blocks[i] >> 8;
+    frame[4 + 2 * i] = blocks[i] & 0xFF;
+  }
+  frame[11] = block_errors;
+  frame[12] = crc8(frame + 2, RDS_FRAME_LENGTH - 3);
+}
+
+// Finds RDS frames in a byte stream, a byte at a time. A candidate whose
+// CRC doesn't match is dropped and the search for the sync bytes starts
+// over from its second byte, so the parser locks back on after noise or a
+// lost byte within a frame.
+struct RdsFrameParser {
+  // The last frame found.
+  uint8_t sequence;
+  uint16_t blocks[4];
+  uint8_t block_errors;
+
+  uint32_t frames;      // Good frames.
+  uint32_t bad_frames;  // Dropped for their CRC.
+  uint32_t lost;        // Groups missing from the sequence.
+
+  RdsFrameParser()
+      : sequence(0),
+        block_errors(0),
+        frames(0),
+        bad_frames(0),
+        lost(0),
+        length_(0) {}
+
+  // Returns true when |byte| completed a good frame.
+  bool feed(uint8_t byte) {
+    buffer_[length_++] = byte;
+    while (length_) {
+      if (buffer_[0] != RDS_FRAME_SYNC0 ||
+          (length_ > 1 && buffer_[1] != RDS_FRAME_SYNC1)) {
+        drop();
+        continue;
+      }
+      if (length_ < RDS_FRAME_LENGTH)
+        return false;
+      if (crc8(buffer_ + 2, RDS_FRAME_LENGTH - 3) != buffer_[12]) {
+        bad_frames++;
+        drop();
+        continue;
+      }
+      if (frames)
+        lost += static_cast<uint8_t>(buffer_[2] - sequence - 1);
+      frames++;
+      sequence = buffer_[2];
+      for (uint8_t i = 0; i < 4; i++)
+        blocks[i] = static_cast<uint16_t>(buffer_[3 + 2 * i] << 8) |
+                    buffer_[4 + 2 * i];
+      block_errors = buffer_[11];
+      length_ = 0;
+      return true;
+    }
+    return false;
+  }
+
+ private:
+  // Drop the first byte of the buffer.
+  void drop() {
+    length_--;
+    for (uint8_t i = 0; i < length_; i++)
+      buffer_[i] = buffer_[i + 1];
+  }
+
+  uint8_t buffer_[RDS_FRAME_LENGTH];
+  uint8_t length_;
+};
+
+}  // namespace si4703
+
+#endif
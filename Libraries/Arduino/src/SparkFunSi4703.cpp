@@ -2,48 +2,186 @@
 #include "SparkFunSi4703.h"
 #include "Wire.h"
 
+using namespace si4703;
+
+volatile boolean Si4703_Breakout::_stcFlag = false;
+volatile boolean Si4703_Breakout::_rdsFlag = false;
+
+//GPIO2 pulses low on STC with STC_INTERRUPT and when RDSR sets with
+//RDS_INTERRUPT, so the flags only say it is worth reading the chip
+void Si4703_Breakout::gpio2ISR()
+{
+  _stcFlag = true;
+  _rdsFlag = true;
+}
+
 Si4703_Breakout::Si4703_Breakout(int resetPin, int sdioPin, int sclkPin, int stcIntPin)
 {
   _resetPin = resetPin;
   _sdioPin = sdioPin;
   _sclkPin = sclkPin;
   _stcIntPin = stcIntPin;
+  _options = 0;
+  _stationNameCallback = 0;
+  _radioTextCallback = 0;
+  _rds.ascii_only = true; //Only printable ASCII in stationName() and radioText()
+  resetRDS();
 }
 
-void Si4703_Breakout::powerOn()
+void Si4703_Breakout::powerOn(byte options)
 {
+    _options = options;
     si4703_init();
 }
 
 void Si4703_Breakout::setChannel(int channel)
 {
-  //Freq(MHz) = 0.200(in USA) * Channel + 87.5MHz
-  //97.3 = 0.2 * Chan + 87.5
-  //9.8 / 0.2 = 49
-  int newChannel = channel * 10; //973 * 10 = 9730
-  newChannel -= 8750; //9730 - 8750 = 980
-  newChannel /= 10; //980 / 10 = 98
+  //Freq(MHz) = 0.100(in Europe) * Channel + 87.5MHz
+  //97.3 = 0.1 * Chan + 87.5
+  //9.8 / 0.1 = 98
+  int newChannel = frequencyToChannel(channel * 10, BAND_US_EUROPE, SPACING_100KHZ); //973 -> 98
+
+  resetRDS(); //The old station's name and text no longer apply
 
   //These steps come from AN230 page 20 rev 0.5
   readRegisters();
-  si4703_registers[CHANNEL] &= 0xFE00; //Clear out the channel bits
-  si4703_registers[CHANNEL] |= newChannel; //Mask in the new channel
-  si4703_registers[CHANNEL] |= (1<<TUNE); //Set the TUNE bit to start
+  set<CHAN>(si4703_registers, newChannel); //Mask in the new channel
+  set<TUNE>(si4703_registers, 1); //Set the TUNE bit to start
+  _stcFlag = false;
   updateRegisters();
 
   //delay(60); //Wait 60ms - you can use or skip this delay
 
-  while(_stcIntPin == 1) {} //Wait for STC (Seek/Tune Complete) interrupt
+  waitForSTC(); //Wait for STC (Seek/Tune Complete)
 
-  readRegisters();
-  si4703_registers[CHANNEL] &= ~(1<<TUNE); //Clear the tune after a tune has completed
+  //The control registers in the shadow copy are the ones we just wrote, no need to read them back
+  set<TUNE>(si4703_registers, 0); //Clear the tune after a tune has completed
   updateRegisters();
 
   //Wait for the si4703 to clear the STC as well
-  while(1) {
-    readRegisters();
-    if( (si4703_registers[STATUSRSSI] & (1<<STC)) == 0) break; //Tuning complete!
+  waitForSTCClear();
+}
+
+byte Si4703_Breakout::poll()
+{
+  if(!readRDSGroup(false)) return 0;
+
+  byte events = _rds.decode(si4703_registers);
+  if(events & RdsDecoder::PI_CHANGED) _rdsComplete = 0;
+  if(events & RdsDecoder::RT_CLEARED) _rdsComplete &= ~RdsDecoder::RT_COMPLETE;
+  if(events & RdsDecoder::PS_COMPLETE) {
+    _rdsComplete |= RdsDecoder::PS_COMPLETE;
+    _rdsReady |= RdsDecoder::PS_COMPLETE;
+    if(_stationNameCallback) _stationNameCallback(_rds.ps);
+  }
+  if(events & RdsDecoder::RT_COMPLETE) {
+    _rdsComplete |= RdsDecoder::RT_COMPLETE;
+    _rdsReady |= RdsDecoder::RT_COMPLETE;
+    if(_radioTextCallback) _radioTextCallback(_rds.rt);
+  }
+  return events;
+}
+
+//Reads a new group into si4703_registers. Only reads the chip when GPIO2
+//pulsed, if |onInterrupt| and powered on with RDS_INTERRUPT, or else on the
+//30/40ms schedule, so no group is missed or read twice
+boolean Si4703_Breakout::readRDSGroup(boolean onInterrupt)
+{
+  if(onInterrupt && (_options & RDS_INTERRUPT)) {
+    if(!_rdsFlag) return false;
+    _rdsFlag = false;
+  }
+  else {
+    unsigned long now = millis();
+    if(now - _rdsLastPoll < _rdsInterval) return false; //Too early, don't touch the bus
+    _rdsLastPoll = now;
   }
+
+  readStatusRegisters(RDS_READ_LENGTH);
+  if(!get<RDSR>(si4703_registers)) {
+    _rdsInterval = RDS_POLL_INTERVAL;
+    return false;
+  }
+  _rdsInterval = RDS_CLEAR_INTERVAL;
+  return true;
+}
+
+//The decoder keeps writing segments into _rds.ps and _rds.rt, so these are
+//only handed out while the decoder says they hold a whole name or text. A
+//station that changes its PS without a new PI, or its RadioText without
+//toggling the A/B flag, shows a mix of the two until the new one completes
+const char* Si4703_Breakout::stationName()
+{
+  return (_rdsComplete & RdsDecoder::PS_COMPLETE) ? _rds.ps : "";
+}
+
+const char* Si4703_Breakout::radioText()
+{
+  return (_rdsComplete & RdsDecoder::RT_COMPLETE) ? _rds.rt : "";
+}
+
+boolean Si4703_Breakout::stationNameReady()
+{
+  boolean ready = _rdsReady & RdsDecoder::PS_COMPLETE;
+  _rdsReady &= ~RdsDecoder::PS_COMPLETE;
+  return ready;
+}
+
+boolean Si4703_Breakout::radioTextReady()
+{
+  boolean ready = _rdsReady & RdsDecoder::RT_COMPLETE;
+  _rdsReady &= ~RdsDecoder::RT_COMPLETE;
+  return ready;
+}
+
+void Si4703_Breakout::onStationName(void (*callback)(const char* name))
+{
+  _stationNameCallback = callback;
+}
+
+void Si4703_Breakout::onRadioText(void (*callback)(const char* text))
+{
+  _radioTextCallback = callback;
+}
+
+void Si4703_Breakout::resetRDS()
+{
+  _rds.reset();
+  _rdsLastPoll = 0;
+  _rdsInterval = 0;
+  _rdsReady = 0;
+  _rdsComplete = 0;
+}
+
+Si4703_RdsCapture::Si4703_RdsCapture(Si4703_Breakout& radio)
+  : _radio(radio)
+{
+  _head = 0;
+  _tail = 0;
+  _sequence = 0;
+}
+
+boolean Si4703_RdsCapture::capture()
+{
+  if(!_radio.readRDSGroup(true)) return false;
+
+  byte sequence = _sequence++;
+  if((byte)(_head - _tail) == RING_SIZE) return false; //Full, the host sees the gap
+  Group& slot = _ring[_head % RING_SIZE];
+  for(byte i = 0; i < 4; i++) slot.blocks[i] = _radio.si4703_registers[RDSA + i];
+  slot.blockErrors = blockErrors(_radio.si4703_registers);
+  slot.sequence = sequence;
+  _head++;
+  return true;
+}
+
+boolean Si4703_RdsCapture::nextRDSFrame(byte* frame)
+{
+  if(_head == _tail) return false;
+  const Group& slot = _ring[_tail % RING_SIZE];
+  encodeRdsFrame(slot.sequence, slot.blocks, slot.blockErrors, frame);
+  _tail++;
+  return true;
 }
 
 int Si4703_Breakout::seekUp()
@@ -61,50 +199,34 @@ void Si4703_Breakout::setVolume(int volume)
   readRegisters(); //Read the current register set
   if(volume < 0) volume = 0;
   if (volume > 15) volume = 15;
-  si4703_registers[SYSCONFIG2] &= 0xFFF0; //Clear volume bits
-  si4703_registers[SYSCONFIG2] |= volume; //Set new volume
+  set<VOLUME>(si4703_registers, volume); //Set new volume
   updateRegisters(); //Update
 }
 
 void Si4703_Breakout::readRDS(char* buffer, long timeout)
 { 
 	long endTime = millis() + timeout;
-  boolean completed[] = {false, false, false, false};
-  int completedCount = 0;
-  while(completedCount < 4 && millis() < endTime) {
+  RdsDecoder decoder;
+  decoder.ascii_only = true;
+  boolean completed = false;
+  while(!completed && millis() < endTime) {
 	readRegisters();
-	if(si4703_registers[STATUSRSSI] & (1<<RDSR)){
+	if(get<RDSR>(si4703_registers)){
 		// ls 2 bits of B determine the 4 letter pairs
 		// once we have a full set return
-		// if you get nothing after 20 readings return with empty string
-	  uint16_t b = si4703_registers[RDSB];
-	  int index = b & 0x03;
-	  if (! completed[index] && b < 500)
-	  {
-		completed[index] = true;
-		completedCount ++;
-	  	char Dh = (si4703_registers[RDSD] & 0xFF00) >> 8;
-      	char Dl = (si4703_registers[RDSD] & 0x00FF);
-		buffer[index * 2] = Dh;
-		buffer[index * 2 +1] = Dl;
-		// Serial.print(si4703_registers[RDSD]); Serial.print(" ");
-		// Serial.print(index);Serial.print(" ");
-		// Serial.write(Dh);
-		// Serial.write(Dl);
-		// Serial.println();
-      }
+	  completed = decoder.decode(si4703_registers) & RdsDecoder::PS_COMPLETE;
       delay(40); //Wait for the RDS bit to clear
 	}
 	else {
 	  delay(30); //From AN230, using the polling method 40ms should be sufficient amount of time between checks
 	}
   }
-	if (millis() >= endTime) {
+	if (!completed) {
 		buffer[0] ='\0';
 		return;
 	}
 
-  buffer[8] = '\0';
+  memcpy(buffer, decoder.ps, RdsDecoder::PS_LENGTH + 1);
 }
 
 
@@ -117,34 +239,42 @@ void Si4703_Breakout::si4703_init()
 {
   pinMode(_resetPin, OUTPUT);
   pinMode(_sdioPin, OUTPUT); //SDIO is connected to A4 for I2C
-  pinMode(_stcIntPin, OUTPUT);
   digitalWrite(_sdioPin, LOW); //A low SDIO indicates a 2-wire interface
   digitalWrite(_resetPin, LOW); //Put Si4703 into reset
-  digitalWrite(_stcIntPin, HIGH); //STC (Seek/Tune Complete) goes low on interrupt
+  if(_options & (STC_INTERRUPT | RDS_INTERRUPT)) {
+    pinMode(_stcIntPin, INPUT_PULLUP); //GPIO2 goes low on interrupt
+    attachInterrupt(digitalPinToInterrupt(_stcIntPin), gpio2ISR, FALLING);
+  }
   delay(1); //Some delays while we allow pins to settle
   digitalWrite(_resetPin, HIGH); //Bring Si4703 out of reset with SDIO set to low and SEN pulled high with on-board resistor
   delay(1); //Allow Si4703 to come out of reset
 
   Wire.begin(); //Now that the unit is reset and I2C inteface mode, we need to begin I2C
 
+  if(_options & FAST_I2C) Wire.setClock(400000); //Fast mode, the Si4703 supports up to 400kHz
+
   readRegisters(); //Read the current register set
   //si4703_registers[0x07] = 0xBC04; //Enable the oscillator, from AN230 page 9, rev 0.5 (DOES NOT WORK, wtf Silicon Labs datasheet?)
-  si4703_registers[0x07] = 0x8100; //Enable the oscillator, from AN230 page 9, rev 0.61 (works)
-  si4703_registers[0x04] |= 0x2000; //Enable GPIO2 as SCT interrupt
+  si4703_registers[TEST1] = 0x8100; //Enable the oscillator, from AN230 page 9, rev 0.61 (works)
+  if(_options & STC_INTERRUPT)
+    set<STCIEN>(si4703_registers, 1); //Pulse GPIO2 low when a seek/tune completes
+  if(_options & RDS_INTERRUPT)
+    set<RDSIEN>(si4703_registers, 1); //Pulse GPIO2 low when RDSR sets
+  if(_options & (STC_INTERRUPT | RDS_INTERRUPT))
+    set<GPIO2>(si4703_registers, 0b01); //GPIO2 is the STC/RDS interrupt output
   updateRegisters(); //Update
 
   delay(500); //Wait for clock to settle - from AN230 page 9
 
   readRegisters(); //Read the current register set
   si4703_registers[POWERCFG] = 0x4001; //Enable the IC
-  //  si4703_registers[POWERCFG] |= (1<<SMUTE) | (1<<DMUTE); //Disable Mute, disable softmute
-  si4703_registers[SYSCONFIG1] |= (1<<RDS); //Enable RDS
+  //  si4703_registers[POWERCFG] |= bits(DSMUTE) | bits(DMUTE); //Disable Mute, disable softmute
+  set<RDS>(si4703_registers, 1); //Enable RDS
 
-  si4703_registers[SYSCONFIG1] |= (1<<DE); //50kHz Europe setup
-  si4703_registers[SYSCONFIG2] |= (1<<SPACE0); //100kHz channel spacing for Europe
+  set<DE>(si4703_registers, 1); //50kHz Europe setup
+  set<SPACE>(si4703_registers, SPACING_100KHZ); //100kHz channel spacing for Europe
 
-  si4703_registers[SYSCONFIG2] &= 0xFFF0; //Clear volume bits
-  si4703_registers[SYSCONFIG2] |= 0x0001; //Set volume to lowest
+  set<VOLUME>(si4703_registers, 1); //Set volume to lowest
   updateRegisters(); //Update
 
   delay(110); //Max powerup time, from datasheet page 13
@@ -154,33 +284,59 @@ void Si4703_Breakout::si4703_init()
 void Si4703_Breakout::readRegisters(){
 
   //Si4703 begins reading from register upper register of 0x0A and reads to 0x0F, then loops to 0x00.
-  Wire.requestFrom(SI4703, 32); //We want to read the entire register set from 0x0A to 0x09 = 32 bytes.
-
-  //Remember, register 0x0A comes in first so we have to shuffle the array around a bit
-  for(int x = 0x0A ; ; x++) { //Read in these 32 bytes
-    if(x == 0x10) x = 0; //Loop back to zero
-    si4703_registers[x] = Wire.read() << 8;
-    si4703_registers[x] |= Wire.read();
-    if(x == 0x09) break; //We're done!
+  Wire.requestFrom(I2C_ADDRESS, READ_LENGTH); //We want to read the entire register set from 0x0A to 0x09 = 32 bytes.
+
+  //Remember, register 0x0A comes in first, decodeReadFrom wraps the index around for us
+  decodeReadFrom(Wire, READ_LENGTH, si4703_registers);
+}
+
+//Read only the first |length| bytes, starting at 0x0A
+//The registers the read didn't reach are left as they were in the shadow copy
+void Si4703_Breakout::readStatusRegisters(byte length){
+  Wire.requestFrom(I2C_ADDRESS, length);
+  decodeReadFrom(Wire, length, si4703_registers);
+}
+
+//Wait for the STC bit after a tune or seek was started
+//With STC_INTERRUPT the bus stays idle until GPIO2 pulses, otherwise poll STATUSRSSI only
+void Si4703_Breakout::waitForSTC(){
+  if(_options & STC_INTERRUPT) {
+    unsigned long lastCheck = millis();
+    while(1) {
+      //With RDS_INTERRUPT the pulse may have been an RDS one, so check STC
+      if(_stcFlag || millis() - lastCheck >= STC_RECHECK_INTERVAL) {
+        _stcFlag = false;
+        lastCheck = millis();
+        readStatusRegisters(STATUS_READ_LENGTH);
+        if(get<STC>(si4703_registers)) return;
+      }
+    }
+  }
+
+  while(1) {
+    readStatusRegisters(STATUS_READ_LENGTH);
+    if(get<STC>(si4703_registers)) break; //Tuning complete!
+    delay(STC_POLL_INTERVAL); //A tune takes 60ms per channel, no need to keep the bus busy meanwhile
+  }
+}
+
+//Wait for the si4703 to clear STC after TUNE/SEEK was cleared
+void Si4703_Breakout::waitForSTCClear(){
+  while(1) {
+    readStatusRegisters(STATUS_READ_LENGTH);
+    if(!get<STC>(si4703_registers)) break; //Tuning complete!
   }
 }
 
-//Write the current 9 control registers (0x02 to 0x07) to the Si4703
+//Write the current 6 control registers (0x02 to 0x07) to the Si4703
 //It's a little weird, you don't write an I2C addres
 //The Si4703 assumes you are writing to 0x02 first, then increments
 byte Si4703_Breakout::updateRegisters() {
 
-  Wire.beginTransmission(SI4703);
+  Wire.beginTransmission(I2C_ADDRESS);
   //A write command automatically begins with register 0x02 so no need to send a write-to address
-  //First we send the 0x02 to 0x07 control registers
   //In general, we should not write to registers 0x08 and 0x09
-  for(int regSpot = 0x02 ; regSpot < 0x08 ; regSpot++) {
-    byte high_byte = si4703_registers[regSpot] >> 8;
-    byte low_byte = si4703_registers[regSpot] & 0x00FF;
-
-    Wire.write(high_byte); //Upper 8 bits
-    Wire.write(low_byte); //Lower 8 bits
-  }
+  encodeWriteTo(si4703_registers, Wire);
 
   //End this transmission
   byte ack = Wire.endTransmission();
@@ -195,28 +351,25 @@ byte Si4703_Breakout::updateRegisters() {
 //Returns the freq if it made it
 //Returns zero if failed
 int Si4703_Breakout::seek(byte seekDirection){
+  resetRDS();
   readRegisters();
   //Set seek mode wrap bit
-  si4703_registers[POWERCFG] |= (1<<SKMODE); //Allow wrap
-  //si4703_registers[POWERCFG] &= ~(1<<SKMODE); //Disallow wrap - if you disallow wrap, you may want to tune to 87.5 first
-  if(seekDirection == SEEK_DOWN) si4703_registers[POWERCFG] &= ~(1<<SEEKUP); //Seek down is the default upon reset
-  else si4703_registers[POWERCFG] |= 1<<SEEKUP; //Set the bit to seek up
+  set<SKMODE>(si4703_registers, 1); //Allow wrap
+  //set<SKMODE>(si4703_registers, 0); //Disallow wrap - if you disallow wrap, you may want to tune to 87.5 first
+  set<SEEKUP>(si4703_registers, seekDirection == SEEK_UP); //Seek down is the default upon reset
 
-  si4703_registers[POWERCFG] |= (1<<SEEK); //Start seek
+  set<SEEK>(si4703_registers, 1); //Start seek
+  _stcFlag = false;
   updateRegisters(); //Seeking will now start
 
-  while(_stcIntPin == 1) {} //Wait for STC(Seek/Tune Complete) interrupt
+  waitForSTC(); //Wait for STC(Seek/Tune Complete)
 
-  readRegisters();
-  int valueSFBL = si4703_registers[STATUSRSSI] & (1<<SFBL); //Store the value of SFBL
-  si4703_registers[POWERCFG] &= ~(1<<SEEK); //Clear the seek bit after seek has completed
+  int valueSFBL = get<SFBL>(si4703_registers); //Store the value of SFBL
+  set<SEEK>(si4703_registers, 0); //Clear the seek bit after seek has completed
   updateRegisters();
 
   //Wait for the si4703 to clear the STC as well
-  while(1) {
-    readRegisters();
-    if( (si4703_registers[STATUSRSSI] & (1<<STC)) == 0) break; //Tuning complete!
-  }
+  waitForSTCClear();
 
   if(valueSFBL) { //The bit was set indicating we hit a band limit or failed to find a station
     return(0);
@@ -227,10 +380,9 @@ return getChannel();
 //Reads the current channel from READCHAN
 //Returns a number like 973 for 97.3MHz
 int Si4703_Breakout::getChannel() {
-  readRegisters();
-  int channel = si4703_registers[READCHAN] & 0x03FF; //Mask out everything but the lower 10 bits
+  readStatusRegisters(CHANNEL_READ_LENGTH); //READCHAN is the second register of a read
   //Freq(MHz) = 0.100(in Europe) * Channel + 87.5MHz
   //X = 0.1 * Chan + 87.5
-  channel += 875; //98 + 875 = 973
-  return(channel);
+  int channel = channelToFrequency(get<READ_CHAN>(si4703_registers), BAND_US_EUROPE, SPACING_100KHZ); //98 -> 9730
+  return(channel / 10); //9730 / 10 = 973
 }
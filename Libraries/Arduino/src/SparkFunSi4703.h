@@ -43,6 +43,7 @@ cables. Too short of a cable may degrade reception.
 #define SparkFunSi4703_h
 
 #include "Arduino.h"
+#include "Si4703Core.h"
 
 
 
@@ -50,7 +51,10 @@ class Si4703_Breakout
 {
   public:
     Si4703_Breakout(int resetPin, int sdioPin, int sclkPin, int sctIntPin);
-    void powerOn();					// call in setup
+    static const byte STC_INTERRUPT = 1;	// powerOn option: wait for tune/seek on stcIntPin
+    static const byte FAST_I2C = 2;		// powerOn option: 400kHz I2C
+    static const byte RDS_INTERRUPT = 4;	// powerOn option: Si4703_RdsCapture on the RDS interrupt on stcIntPin
+    void powerOn(byte options = 0);		// call in setup
 	void setChannel(int channel);  	// 3 digit channel number
 	int seekUp(); 					// returns the tuned channel or 0
 	int seekDown(); 				
@@ -59,6 +63,18 @@ class Si4703_Breakout
 									// message should be at least 9 chars
 									// result will be null terminated
 									// timeout in milliseconds
+
+	// Non-blocking RDS. Call poll() from loop(); it returns at once and does at
+	// most one short (12 byte) register read, and only when the RDS poll
+	// interval has passed. It returns the si4703::RdsDecoder events the group
+	// produced, 0 if no new group arrived.
+	byte poll();
+	const char* stationName();	// last complete PS name, 8 chars, "" until one is in
+	const char* radioText();	// last complete RadioText, 64 chars, "" until one is in
+	boolean stationNameReady();	// true once per new PS name
+	boolean radioTextReady();	// true once per new RadioText
+	void onStationName(void (*callback)(const char* name));
+	void onRadioText(void (*callback)(const char* text));
   private:
     int  _resetPin;
 	int  _sdioPin;
@@ -69,54 +85,69 @@ class Si4703_Breakout
 	byte updateRegisters();
 	int seek(byte seekDirection);
 	int getChannel();
-	uint16_t si4703_registers[16]; //There are 16 registers, each 16 bits large
+	uint16_t si4703_registers[si4703::NUM_REGISTERS]; //There are 16 registers, each 16 bits large
+	void readStatusRegisters(byte length);
+	void waitForSTC();
+	void waitForSTCClear();
+	static void gpio2ISR();
+	static volatile boolean _stcFlag; //Set by gpio2ISR on the GPIO2 falling edge
+	static volatile boolean _rdsFlag; //Likewise, for Si4703_RdsCapture
+	byte _options;
+	void resetRDS();
+	si4703::RdsDecoder _rds;
+	unsigned long _rdsLastPoll; //millis() of the last RDS poll
+	byte _rdsInterval; //ms to wait before the next RDS poll
+	byte _rdsReady; //PS_COMPLETE/RT_COMPLETE events not yet picked up
+	byte _rdsComplete; //PS_COMPLETE/RT_COMPLETE while _rds.ps/_rds.rt hold a whole text
+	void (*_stationNameCallback)(const char*);
+	void (*_radioTextCallback)(const char*);
+	boolean readRDSGroup(boolean onInterrupt);
+	friend class Si4703_RdsCapture;
 	static const uint16_t  FAIL = 0;
 	static const uint16_t  SUCCESS = 1;
 
-	static const int  SI4703 = 0x10; //0b._001.0000 = I2C address of Si4703 - note that the Wire function assumes non-left-shifted I2C address, not 0b.0010.000W
-	static const uint16_t  I2C_FAIL_MAX = 10; //This is the number of attempts we will try to contact the device before erroring out
 	static const uint16_t  SEEK_DOWN = 0; //Direction used for seeking. Default is down
 	static const uint16_t  SEEK_UP = 1;
 
-	//Define the register names
-	static const uint16_t  DEVICEID = 0x00;
-	static const uint16_t  CHIPID = 0x01;
-	static const uint16_t  POWERCFG = 0x02;
-	static const uint16_t  CHANNEL = 0x03;
-	static const uint16_t  SYSCONFIG1 = 0x04;
-	static const uint16_t  SYSCONFIG2 = 0x05;
-	static const uint16_t  STATUSRSSI = 0x0A;
-	static const uint16_t  READCHAN = 0x0B;
-	static const uint16_t  RDSA = 0x0C;
-	static const uint16_t  RDSB = 0x0D;
-	static const uint16_t  RDSC = 0x0E;
-	static const uint16_t  RDSD = 0x0F;
-
-	//Register 0x02 - POWERCFG
-	static const uint16_t  SMUTE = 15;
-	static const uint16_t  DMUTE = 14;
-	static const uint16_t  SKMODE = 10;
-	static const uint16_t  SEEKUP = 9;
-	static const uint16_t  SEEK = 8;
-
-	//Register 0x03 - CHANNEL
-	static const uint16_t  TUNE = 15;
-
-	//Register 0x04 - SYSCONFIG1
-	static const uint16_t  RDS = 12;
-	static const uint16_t  DE = 11;
-
-	//Register 0x05 - SYSCONFIG2
-	static const uint16_t  SPACE1 = 5;
-	static const uint16_t  SPACE0 = 4;
-
-	//Register 0x0A - STATUSRSSI
-	static const uint16_t  RDSR = 15;
-	static const uint16_t  STC = 14;
-	static const uint16_t  SFBL = 13;
-	static const uint16_t  AFCRL = 12;
-	static const uint16_t  RDSS = 11;
-	static const uint16_t  STEREO = 8;
+	//From AN230, using the polling method 40ms should be sufficient amount of time between checks
+	static const byte  RDS_POLL_INTERVAL = 30;
+	static const byte  RDS_CLEAR_INTERVAL = 40; //Wait for the RDS bit to clear
+	//A read starts at 0x0A, so short reads only cover the first few registers
+	static const byte  STATUS_READ_LENGTH = 2; //STATUSRSSI
+	static const byte  CHANNEL_READ_LENGTH = 4; //STATUSRSSI, READCHAN
+	static const byte  RDS_READ_LENGTH = 12; //STATUSRSSI, READCHAN, RDSA-RDSD
+	//Re-check STC over the bus this often in case an interrupt edge was missed
+	static const byte  STC_RECHECK_INTERVAL = 100;
+	//Without STC_INTERRUPT, read STC this often while a tune or seek runs
+	static const byte  STC_POLL_INTERVAL = 5;
+};
+
+// RDS capture for a host decoder, kept out of Si4703_Breakout so sketches
+// that don't use it don't pay for the ring. Call capture() from loop()
+// instead of poll(): it copies each new group, raw RDSA-RDSD and the BLER
+// levels, into a ring of RING_SIZE groups without decoding it, and returns
+// at once. nextRDSFrame() takes the oldest one out as a frame of
+// si4703::RDS_FRAME_LENGTH bytes, see si4703::encodeRdsFrame(). It returns
+// false when the ring is empty. Groups that find the ring full are dropped,
+// leaving a gap in the frame sequence numbers.
+class Si4703_RdsCapture
+{
+  public:
+    Si4703_RdsCapture(Si4703_Breakout& radio);
+    boolean capture();
+    boolean nextRDSFrame(byte* frame);
+    static const byte RING_SIZE = 16; //A power of two
+  private:
+    Si4703_Breakout& _radio;
+    struct Group {
+      uint16_t blocks[4];
+      byte blockErrors;
+      byte sequence;
+    };
+    Group _ring[RING_SIZE];
+    byte _head; //Groups put in the ring, modulo 256
+    byte _tail; //Groups taken out
+    byte _sequence; //Groups captured, dropped ones included
 };
 
 #endif
\ No newline at end of file
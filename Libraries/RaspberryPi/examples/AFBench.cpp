@@ -0,0 +1,75 @@
+// Measures the audio interruption caused by alternative frequency following
+// against a simulated multi-transmitter environment: one programme on three
+// frequencies, with the strongest one fading out.
+
+#include "../src/Si4703AF.h"
+#include "../src/Si4703Sim.h"
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+using std::cout;
+using std::endl;
+
+namespace {
+
+double Millis(std::chrono::microseconds us) {
+  return us.count() / 1000.0;
+}
+
+}  // anonymous namespace
+
+int main(int argc, const char** argv) {
+  const std::vector<float> afs = {97.3f, 101.1f, 104.5f};
+  Si4703_SimulatedChip* chip = new Si4703_SimulatedChip;
+  chip->addTransmitter({97.3f, 0x1234, 50, true, "BENCH FM", "Main", afs});
+  chip->addTransmitter({101.1f, 0x1234, 38, true, "BENCH FM", "Relay", afs});
+  chip->addTransmitter({104.5f, 0x1234, 26, true, "BENCH FM", "Relay", afs});
+  chip->addTransmitter({99.9f, 0x5678, 45, true, "OTHER", "Other", {}});
+
+  Si4703_Breakout radio(std::unique_ptr<Si4703_Bus>(chip), -1, -1,
+                        Region::Europe);
+  radio.powerOn();
+  radio.setVolume(5);
+  radio.setFrequency(97.3f);
+
+  Si4703_AFFollower::Config config;
+  config.probe_interval = std::chrono::milliseconds(500);
+  Si4703_AFFollower follower(&radio, config);
+
+  // Learn the AF list: 4 groups carry the count code and three AFs.
+  std::this_thread::sleep_for(std::chrono::seconds(2));
+  cout << "Alternatives:";
+  for (float f : follower.alternatives())
+    cout << ' ' << f;
+  cout << endl;
+  chip->resetAudioStats();
+
+  // Fade 97.3 from 50 dBuV to 10 dBuV over 10 seconds.
+  const auto start = std::chrono::steady_clock::now();
+  const auto duration = std::chrono::seconds(10);
+  while (std::chrono::steady_clock::now() - start < duration) {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    int rssi = 50 - static_cast<int>(40 * elapsed / duration);
+    chip->setRSSI(97.3f, rssi);
+    follower.update();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+
+  Si4703_AFFollower::Stats stats = follower.stats();
+  Si4703_SimulatedChip::AudioStats audio = chip->audioStats();
+  cout << "Final frequency: " << radio.getFrequency() << " MHz, RSSI "
+       << radio.signalStrength() << endl;
+  cout << "Probes: " << stats.probes << ", switches: " << stats.switches
+       << ", rejected: " << stats.rejected << endl;
+  if (stats.probes)
+    cout << "Tuner time per probe: "
+         << Millis(stats.probe_time) / stats.probes << " ms" << endl;
+  if (stats.switches)
+    cout << "Tuner time per switch: "
+         << Millis(stats.switch_time) / stats.switches << " ms" << endl;
+  cout << "Audio gaps: " << audio.gaps << ", total " << Millis(audio.total)
+       << " ms, longest " << Millis(audio.longest) << " ms" << endl;
+
+  return 0;
+}
@@ -0,0 +1,38 @@
+//
+// Clock and test data helpers shared by the benchmarks.
+//
+
+#ifndef BenchUtil_h
+#define BenchUtil_h
+
+#include <time.h>
+#include <cmath>
+
+#include "../src/Si4703Random.h"
+
+// Seconds on the monotonic clock.
+inline double Now() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// The simulator's generator, seeded the way the benchmarks always have been
+// so their figures stay comparable from run to run.
+class Random {
+ public:
+  explicit Random(uint64_t seed) : random_(seed | 1) {}
+
+  // In [0, |n|).
+  uint32_t next(uint32_t n) { return random_.below(n); }
+
+  // Exponentially distributed with mean |mean|.
+  double exponential(double mean) {
+    return -mean * std::log((next(1 << 30) + 1.0) / (1 << 30));
+  }
+
+ private:
+  Si4703_Random random_;
+};
+
+#endif
@@ -0,0 +1,96 @@
+// Counts the bus transactions (kernel round trips on i2c-dev) that tunes,
+// RSSI probes and seeks take against a simulated chip. It runs once on a bus
+// that sends a write and the read after it as one combined transfer, as
+// Si4703_LinuxI2CBus does with I2C_RDWR, and once on a bus that sends every
+// read and write on its own, as on an SMBus-only adapter.
+
+#include "../src/Si4703Sim.h"
+#include "../src/SparkFunSi4703.h"
+#include <iomanip>
+#include <iostream>
+#include <memory>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+namespace {
+
+const int TUNES = 40;
+const int PROBES = 40;
+const int SEEKS = 10;
+
+// Forwards reads and writes but not transfer(), so the Si4703_Bus default
+// splits every combined transfer.
+class SplitBus : public Si4703_Bus {
+ public:
+  explicit SplitBus(Si4703_Bus* bus) : bus_(bus) {}
+
+  Status open() override { return bus_->open(); }
+  Status read(uint8_t* buffer, int length) override {
+    return bus_->read(buffer, length);
+  }
+  Status write(const uint8_t* buffer, int length) override {
+    return bus_->write(buffer, length);
+  }
+
+ private:
+  std::unique_ptr<Si4703_Bus> bus_;
+};
+
+// Runs |operation| |count| times and prints the bus traffic per operation.
+template <typename Operation>
+void Measure(const char* name,
+             int count,
+             Si4703_SimulatedChip* chip,
+             Operation operation) {
+  const Si4703_SimulatedChip::BusStats before = chip->busStats();
+  for (int i = 0; i < count; i++)
+    operation(i);
+  const Si4703_SimulatedChip::BusStats after = chip->busStats();
+  cout << "  " << std::left << std::setw(6) << name << std::right
+       << std::fixed << std::setprecision(1) << std::setw(7)
+       << static_cast<double>(after.transactions - before.transactions) /
+              count
+       << " transactions" << std::setw(7)
+       << static_cast<double>(after.reads - before.reads) / count
+       << " reads" << std::setw(5)
+       << static_cast<double>(after.writes - before.writes) / count
+       << " writes" << endl;
+}
+
+bool Run(bool combined) {
+  Si4703_SimulatedChip* chip = new Si4703_SimulatedChip;
+  chip->addTransmitter({93.5f, 0x1001, 50, true, "ONE", "", {}});
+  chip->addTransmitter({101.1f, 0x1002, 45, true, "TWO", "", {}});
+  chip->addTransmitter({104.3f, 0x1003, 40, true, "THREE", "", {}});
+  std::unique_ptr<Si4703_Bus> bus(chip);
+  if (!combined)
+    bus.reset(new SplitBus(bus.release()));
+  Si4703_Breakout radio(std::move(bus), -1, -1, Region::US);
+  if (radio.powerOn() != Status::SUCCESS)
+    return false;
+  radio.setFrequency(93.5f);
+
+  cout << (combined ? "Combined transfers:" : "Separate reads and writes:")
+       << endl;
+  Measure("tune", TUNES, chip,
+          [&](int i) { radio.setFrequency(i % 2 ? 93.5f : 101.1f); });
+  Measure("probe", PROBES, chip, [&](int) { radio.probeRSSI(104.3f); });
+  Measure("seek", SEEKS, chip,
+          [&](int) { radio.seek(SeekDirection::Up); });
+  radio.powerOff();
+  return true;
+}
+
+}  // anonymous namespace
+
+int main() {
+  for (bool combined : {false, true}) {
+    if (!Run(combined)) {
+      cerr << "Could not power on the tuner" << endl;
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,227 @@
+// Compares a plain FIFO of tuner commands, one register write per command
+// the way si4703d used to run them, with Si4703_CommandQueue. The input
+// comes in bursts: a volume knob turned through 30 steps 1 ms apart, then
+// tune-up pressed 5 times 15 ms apart. It reports how long after the last
+// input of a burst its effect reached the chip, and the bus traffic. The
+// simulated chip sits behind a bus that takes as long as a 100 kHz I2C bus.
+
+#include "../src/Si4703CommandQueue.h"
+#include "../src/Si4703Sim.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using std::cout;
+using std::endl;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+const int kBursts = 10;
+const int kVolumeSteps = 30;
+const int kTunePresses = 5;
+const auto kBurstInterval = std::chrono::milliseconds(300);
+
+// Delays every transfer by its length on a 100 kHz bus: 9 bit times for
+// the address and each byte.
+class SlowBus : public Si4703_Bus {
+ public:
+  explicit SlowBus(Si4703_Bus* bus) : bus_(bus) {}
+
+  Status open() override { return bus_->open(); }
+  Status read(uint8_t* buffer, int length) override {
+    wait(length);
+    return bus_->read(buffer, length);
+  }
+  Status write(const uint8_t* buffer, int length) override {
+    wait(length);
+    return bus_->write(buffer, length);
+  }
+
+ private:
+  void wait(int length) {
+    std::this_thread::sleep_for(std::chrono::microseconds(90 * (length + 1)));
+  }
+
+  std::unique_ptr<Si4703_Bus> bus_;
+};
+
+// One command after the other, each its own register write.
+class Fifo {
+ public:
+  Fifo() : running_(true), busy_(false) {
+    worker_ = std::thread([this] {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (true) {
+        cv_.wait(lock, [this] { return !running_ || !commands_.empty(); });
+        if (commands_.empty())
+          return;
+        std::function<void()> command = commands_.front();
+        commands_.pop_front();
+        busy_ = true;
+        lock.unlock();
+        command();
+        lock.lock();
+        busy_ = false;
+        cv_.notify_all();
+      }
+    });
+  }
+  ~Fifo() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      running_ = false;
+    }
+    cv_.notify_all();
+    worker_.join();
+  }
+
+  void post(const std::function<void()>& command) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    commands_.push_back(command);
+    cv_.notify_all();
+  }
+  void flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return !busy_ && commands_.empty(); });
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> commands_;
+  bool running_;
+  bool busy_;
+  std::thread worker_;
+};
+
+// When the last input of each burst took effect, in ms after it was sent.
+struct Latencies {
+  std::mutex mutex;
+  std::vector<double> volume;
+  std::vector<double> tune;
+};
+
+double Ms(Clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+void Record(Latencies* latencies,
+            std::vector<double>* list,
+            Clock::time_point sent) {
+  const double ms = Ms(Clock::now() - sent);
+  std::lock_guard<std::mutex> lock(latencies->mutex);
+  list->push_back(ms);
+}
+
+// Feed the bursts to |volume| and |tune|, which take the value and a
+// callback for when it has been written.
+template <typename VolumeFn, typename TuneFn>
+void Play(Latencies* latencies, VolumeFn volume, TuneFn tune) {
+  auto next = Clock::now();
+  for (int burst = 0; burst < kBursts; burst++) {
+    for (int step = 0; step < kVolumeSteps; step++) {
+      const int level = step % 16 < 8 ? step % 8 : 15 - step % 8;
+      const Clock::time_point sent = Clock::now();
+      const bool last = step == kVolumeSteps - 1;
+      volume(level, [=] {
+        if (last)
+          Record(latencies, &latencies->volume, sent);
+      });
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    for (int press = 0; press < kTunePresses; press++) {
+      const float frequency = 88.1f + 0.2f * (burst * kTunePresses + press);
+      const Clock::time_point sent = Clock::now();
+      const bool last = press == kTunePresses - 1;
+      tune(frequency, [=] {
+        if (last)
+          Record(latencies, &latencies->tune, sent);
+      });
+      std::this_thread::sleep_for(std::chrono::milliseconds(15));
+    }
+    next += kBurstInterval;
+    std::this_thread::sleep_until(next);
+  }
+}
+
+void Report(const char* name,
+            Latencies* latencies,
+            const Si4703_SimulatedChip::BusStats& before,
+            const Si4703_SimulatedChip::BusStats& after) {
+  std::lock_guard<std::mutex> lock(latencies->mutex);
+  cout << name << ":" << endl;
+  for (auto* list : {&latencies->volume, &latencies->tune}) {
+    std::sort(list->begin(), list->end());
+    cout << "  last " << (list == &latencies->volume ? "volume" : "tune  ")
+         << " applied after " << (*list)[list->size() / 2] << " ms median, "
+         << list->back() << " ms max" << endl;
+  }
+  cout << "  bus: " << after.writes - before.writes << " writes, "
+       << after.reads - before.reads << " reads" << endl;
+}
+
+}  // anonymous namespace
+
+int main() {
+  Si4703_SimulatedChip* chip = new Si4703_SimulatedChip;
+  chip->addTransmitter({93.5f, 0x1002, 50, true, "NEWS", "", {}});
+  Si4703_Breakout radio(std::unique_ptr<Si4703_Bus>(new SlowBus(chip)), -1,
+                        -1, Region::US);
+  if (radio.powerOn() != Status::SUCCESS)
+    return 1;
+  radio.setFrequency(93.5f);
+
+  {
+    Latencies latencies;
+    const auto before = chip->busStats();
+    {
+      Fifo fifo;
+      Play(&latencies,
+           [&](int volume, std::function<void()> done) {
+             fifo.post([&radio, volume, done] {
+               radio.setVolume(volume);
+               done();
+             });
+           },
+           [&](float frequency, std::function<void()> done) {
+             fifo.post([&radio, frequency, done] {
+               radio.setFrequency(frequency);
+               done();
+             });
+           });
+      fifo.flush();
+    }
+    Report("FIFO", &latencies, before, chip->busStats());
+  }
+
+  {
+    Latencies latencies;
+    const auto before = chip->busStats();
+    Si4703_CommandQueue::Stats stats;
+    {
+      Si4703_CommandQueue queue(&radio);
+      Play(&latencies,
+           [&](int volume, std::function<void()> done) {
+             queue.setVolume(volume, [done](Status) { done(); });
+           },
+           [&](float frequency, std::function<void()> done) {
+             queue.tune(frequency, [done](Status) { done(); });
+           });
+      queue.flush();
+      stats = queue.stats();
+    }
+    Report("Latest-wins queue", &latencies, before, chip->busStats());
+    cout << "  " << stats.commands << " commands: " << stats.merged
+         << " merged, " << stats.abandoned << " tunes cut short, "
+         << stats.applies << " applies" << endl;
+  }
+  return 0;
+}
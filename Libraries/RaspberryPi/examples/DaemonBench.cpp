@@ -0,0 +1,147 @@
+// Load test for si4703d: many clients pipelining STATUS requests while
+// subscribed to RDS, plus one client retuning every half second. Reports
+// request throughput, round trip latency, tune latency under load and the
+// daemon's CPU time per request.
+//
+//   DaemonBench [socket] [clients] [depth] [seconds]
+
+#include "../src/Si4703Client.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct ClientResult {
+  long requests = 0;
+  long groups = 0;
+  std::vector<double> rounds;  // Milliseconds per pipelined round.
+};
+
+void RunClient(Si4703_Client* client,
+               int depth,
+               Clock::time_point end,
+               ClientResult* result) {
+  client->setRdsListener([result](uint8_t, const std::vector<RdsGroup>& g) {
+    result->groups += g.size();
+  });
+  client->subscribe(0, true);
+  std::vector<uint32_t> ids(depth);
+  Si4703_Client::Frame frame;
+  while (Clock::now() < end) {
+    const auto start = Clock::now();
+    for (int i = 0; i < depth; i++)
+      ids[i] = client->send(si4703d::STATUS, 0);
+    for (int i = 0; i < depth; i++) {
+      if (client->await(ids[i], &frame) != Status::SUCCESS)
+        return;
+    }
+    result->requests += depth;
+    result->rounds.push_back(
+        std::chrono::duration<double, std::milli>(Clock::now() - start)
+            .count());
+  }
+}
+
+double Percentile(std::vector<double> values, double p) {
+  if (values.empty())
+    return 0;
+  std::sort(values.begin(), values.end());
+  return values[std::min(values.size() - 1,
+                         static_cast<size_t>(p * values.size()))];
+}
+
+}  // anonymous namespace
+
+int main(int argc, const char** argv) {
+  const std::string path = argc > 1 ? argv[1] : si4703d::DEFAULT_SOCKET;
+  const int clients = argc > 2 ? atoi(argv[2]) : 200;
+  const int depth = argc > 3 ? atoi(argv[3]) : 16;
+  const int seconds = argc > 4 ? atoi(argv[4]) : 5;
+
+  Si4703_Client control;
+  std::vector<uint32_t> before, after;
+  if (control.connect(path) != Status::SUCCESS ||
+      control.stats(&before) != Status::SUCCESS) {
+    cerr << "Is si4703d running?" << endl;
+    return 1;
+  }
+
+  std::vector<std::unique_ptr<Si4703_Client>> connections;
+  for (int i = 0; i < clients; i++) {
+    connections.emplace_back(new Si4703_Client);
+    if (connections.back()->connect(path) != Status::SUCCESS)
+      return 1;
+  }
+
+  const Clock::time_point start = Clock::now();
+  const Clock::time_point end = start + std::chrono::seconds(seconds);
+  std::vector<ClientResult> results(clients);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < clients; i++)
+    threads.emplace_back(RunClient, connections[i].get(), depth, end,
+                         &results[i]);
+
+  // Retune under load, alternating between the two ends of the band.
+  std::vector<double> tunes;
+  bool low = true;
+  while (Clock::now() < end) {
+    const auto tune_start = Clock::now();
+    if (control.tune(0, low ? 88.1f : 105.7f) == Status::SUCCESS)
+      tunes.push_back(std::chrono::duration<double, std::milli>(
+                          Clock::now() - tune_start)
+                          .count());
+    low = !low;
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  }
+  for (std::thread& thread : threads)
+    thread.join();
+  const double elapsed =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  control.stats(&after);
+
+  long requests = 0, groups = 0;
+  std::vector<double> rounds;
+  for (const ClientResult& result : results) {
+    requests += result.requests;
+    groups += result.groups;
+    rounds.insert(rounds.end(), result.rounds.begin(), result.rounds.end());
+  }
+  double tune_total = 0;
+  for (double t : tunes)
+    tune_total += t;
+
+  cout << clients << " clients, pipeline depth " << depth << ", " << elapsed
+       << " s" << endl;
+  cout << "Requests: " << requests << " (" << requests / elapsed << "/s)"
+       << endl;
+  cout << "Round trip of " << depth << " requests: median "
+       << Percentile(rounds, 0.5) << " ms, p99 " << Percentile(rounds, 0.99)
+       << " ms" << endl;
+  if (!tunes.empty())
+    cout << "Tune under load: " << tunes.size() << " tunes, mean "
+         << tune_total / tunes.size() << " ms" << endl;
+  cout << "RDS groups received per client: "
+       << static_cast<double>(groups) / clients << endl;
+  if (before.size() >= 6 && after.size() >= 6) {
+    const uint32_t handled = after[1] - before[1];
+    cout << "Daemon: " << handled << " requests, " << after[3] - before[3]
+         << " RDS batches, " << after[4] - before[4] << " dropped, "
+         << after[5] - before[5] << " us CPU";
+    if (handled)
+      cout << " (" << static_cast<double>(after[5] - before[5]) / handled
+           << " us/request)";
+    cout << endl;
+  }
+  return 0;
+}
@@ -0,0 +1,324 @@
+// Pulses the Si4703 reset lines and times it, through the GPIO character
+// device (Si4703_GpioChip) or wiringPi (Si4703_WiringPiGpio, only when
+// built with `make WIRINGPI=1`).
+//
+//   GpioReset [--chip <dev>] [--reset <line>] [--sdio <line>]
+//             [--pulses <n>] [--wiringpi] [--sim]
+//
+// --sim makes a gpio-sim chip to pulse instead (modprobe gpio-sim first; it
+// is set up through configfs, which needs root), then checks that:
+// - SDIO went to an output and back to an input once per pulse, for at
+//   least as long as the pulse should take, as line info change events
+//   tell;
+// - RST is left high, and SDIO as an input pulled up as on the breakout;
+// - the lines stay requested between pulses, so no one else can take them.
+// The chip is removed again on the way out. Without gpio-sim it prints SKIP
+// and exits with 77, the code test harnesses take for a skipped test.
+
+#include "../src/Si4703Gpio.h"
+#ifdef SI4703_WIRINGPI
+#include "../src/Si4703WiringPiGpio.h"
+#endif
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+namespace {
+
+const char SIM_ROOT[] = "/sys/kernel/config/gpio-sim/si4703-reset";
+
+// SDIO is an output for RST's low time and its hold time after, in us: the
+// RESET_LOW and SDIO_HOLD of Si4703Gpio.cpp.
+const double MIN_SDIO_OUTPUT = 210;
+
+struct Options {
+  std::string chip = "/dev/gpiochip0";
+  int reset_line = 22;  // GPIO22, pin 15.
+  int sdio_line = 2;    // GPIO2, pin 3.
+  int pulses = 100;
+  bool wiringpi = false;
+  bool sim = false;
+};
+
+double Now() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+bool WriteFile(const std::string& path, const std::string& value) {
+  std::ofstream file(path);
+  file << value;
+  file.close();
+  if (!file) {
+    cerr << "Could not write " << value << " to " << path << endl;
+    return false;
+  }
+  return true;
+}
+
+std::string ReadFile(const std::string& path) {
+  std::ifstream file(path);
+  std::string value;
+  file >> value;
+  return value;
+}
+
+// A gpio-sim chip with one bank of lines, live while this exists.
+class GpioSim {
+ public:
+  ~GpioSim() {
+    if (live_)
+      WriteFile(std::string(SIM_ROOT) + "/live", "0");
+    rmdir((std::string(SIM_ROOT) + "/bank0").c_str());
+    rmdir(SIM_ROOT);
+  }
+
+  // Whether the gpio-sim module is loaded and configfs is mounted.
+  static bool supported() {
+    return access("/sys/kernel/config/gpio-sim", F_OK) == 0;
+  }
+
+  bool create(int lines) {
+    const std::string bank = std::string(SIM_ROOT) + "/bank0";
+    if (mkdir(SIM_ROOT, 0755) < 0 || mkdir(bank.c_str(), 0755) < 0) {
+      perror(SIM_ROOT);
+      cerr << "Is the gpio-sim module loaded, and configfs mounted?" << endl;
+      return false;
+    }
+    if (!WriteFile(bank + "/num_lines", std::to_string(lines)) ||
+        !WriteFile(std::string(SIM_ROOT) + "/live", "1"))
+      return false;
+    live_ = true;
+    chip_name_ = ReadFile(bank + "/chip_name");
+    device_name_ = ReadFile(std::string(SIM_ROOT) + "/dev_name");
+    return !chip_name_.empty();
+  }
+
+  std::string device() const { return "/dev/" + chip_name_; }
+
+  // The sysfs attribute of |line| on the simulated side: "value" or "pull".
+  std::string attribute(int line, const char* name) const {
+    return "/sys/devices/platform/" + device_name_ + "/" + chip_name_ +
+           "/sim_gpio" + std::to_string(line) + "/" + name;
+  }
+
+ private:
+  bool live_ = false;
+  std::string chip_name_;
+  std::string device_name_;
+};
+
+// Line info change events of one line, with the times it was an output.
+class LineWatch {
+ public:
+  ~LineWatch() {
+    if (fd_ >= 0)
+      close(fd_);
+  }
+
+  bool start(const std::string& chip, int line) {
+    fd_ = open(chip.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd_ < 0) {
+      perror(chip.c_str());
+      return false;
+    }
+    gpio_v2_line_info info;
+    memset(&info, 0, sizeof(info));
+    info.offset = line;
+    if (ioctl(fd_, GPIO_V2_GET_LINEINFO_WATCH_IOCTL, &info) < 0) {
+      perror("Failed to watch the line");
+      return false;
+    }
+    return true;
+  }
+
+  // Read the events so far, adding how long each output stretch lasted
+  // to |outputs|, in us.
+  void read(std::vector<double>* outputs) {
+    gpio_v2_line_info_changed event;
+    while (::read(fd_, &event, sizeof(event)) == sizeof(event)) {
+      const bool output = event.info.flags & GPIO_V2_LINE_FLAG_OUTPUT;
+      if (output && !output_since_)
+        output_since_ = event.timestamp_ns;
+      else if (!output && output_since_) {
+        outputs->push_back((event.timestamp_ns - output_since_) / 1e3);
+        output_since_ = 0;
+      }
+    }
+  }
+
+ private:
+  int fd_ = -1;
+  uint64_t output_since_ = 0;
+};
+
+// Whether someone else can request |line| of |chip| as an input.
+bool Available(const std::string& chip, int line) {
+  const int fd = open(chip.c_str(), O_RDWR | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  gpio_v2_line_request request;
+  memset(&request, 0, sizeof(request));
+  request.offsets[0] = line;
+  request.num_lines = 1;
+  request.config.flags = GPIO_V2_LINE_FLAG_INPUT;
+  strncpy(request.consumer, "GpioReset", sizeof(request.consumer) - 1);
+  const bool available = ioctl(fd, GPIO_V2_GET_LINE_IOCTL, &request) == 0;
+  if (available)
+    close(request.fd);
+  close(fd);
+  return available;
+}
+
+void Print(const char* name, std::vector<double>* micros) {
+  if (micros->empty())
+    return;
+  std::sort(micros->begin(), micros->end());
+  cout << "  " << name << ": median " << (*micros)[micros->size() / 2]
+       << " us, max " << micros->back() << " us" << endl;
+}
+
+int Usage() {
+  cerr << "usage: GpioReset [--chip <dev>] [--reset <line>] [--sdio <line>]"
+       << " [--pulses <n>] [--wiringpi] [--sim]" << endl;
+  return 1;
+}
+
+}  // anonymous namespace
+
+int main(int argc, const char** argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--chip" && has_value)
+      options.chip = argv[++i];
+    else if (arg == "--reset" && has_value)
+      options.reset_line = atoi(argv[++i]);
+    else if (arg == "--sdio" && has_value)
+      options.sdio_line = atoi(argv[++i]);
+    else if (arg == "--pulses" && has_value)
+      options.pulses = atoi(argv[++i]);
+    else if (arg == "--wiringpi")
+      options.wiringpi = true;
+    else if (arg == "--sim")
+      options.sim = true;
+    else
+      return Usage();
+  }
+  if (options.pulses < 1 || (options.sim && options.wiringpi))
+    return Usage();
+  cout << std::fixed << std::setprecision(1);
+
+  std::unique_ptr<GpioSim> sim;
+  LineWatch watch;
+  if (options.sim) {
+    if (!GpioSim::supported()) {
+      cout << "SKIP: no gpio-sim; modprobe gpio-sim and mount configfs"
+           << endl;
+      return 77;
+    }
+    sim.reset(new GpioSim);
+    if (!sim->create(std::max(options.reset_line, options.sdio_line) + 1))
+      return 1;
+    options.chip = sim->device();
+    // The breakout pulls SDIO up.
+    if (!WriteFile(sim->attribute(options.sdio_line, "pull"), "pull-up") ||
+        !watch.start(options.chip, options.sdio_line))
+      return 1;
+    cout << "Simulated " << options.chip << endl;
+  }
+
+  std::unique_ptr<Si4703_Gpio> gpio;
+  if (options.wiringpi) {
+#ifdef SI4703_WIRINGPI
+    gpio.reset(new Si4703_WiringPiGpio(options.reset_line, options.sdio_line));
+#else
+    cerr << "Built without wiringPi; rebuild with make WIRINGPI=1" << endl;
+    return 1;
+#endif
+  } else {
+    gpio.reset(new Si4703_GpioChip(options.reset_line, options.sdio_line,
+                                   options.chip));
+  }
+  double start = Now();
+  if (gpio->open() != Status::SUCCESS) {
+    cerr << "Could not open the lines" << endl;
+    return 1;
+  }
+  std::vector<double> opens{(Now() - start) * 1e6};
+  // powerOn() opens every time; from the second time on it is a no-op.
+  start = Now();
+  gpio->open();
+  opens.push_back((Now() - start) * 1e6);
+
+  std::vector<double> pulses, outputs;
+  for (int i = 0; i < options.pulses; i++) {
+    start = Now();
+    if (gpio->reset() != Status::SUCCESS) {
+      cerr << "Pulse " << i << " failed" << endl;
+      return 1;
+    }
+    pulses.push_back((Now() - start) * 1e6);
+    if (options.sim)
+      watch.read(&outputs);  // Before the kernel's event queue fills up.
+  }
+  cout << (options.wiringpi ? "wiringPi" : options.chip.c_str()) << ", RST "
+       << options.reset_line << ", SDIO " << options.sdio_line << ":" << endl;
+  cout << "  open(): " << opens[0] << " us, then " << opens[1] << " us"
+       << endl;
+  Print("reset()", &pulses);
+  if (!options.sim)
+    return 0;
+
+  bool pass = true;
+  cout << "  SDIO was an output " << outputs.size() << " times";
+  Print("for", &outputs);
+  if (static_cast<int>(outputs.size()) != options.pulses) {
+    cout << "  FAIL: expected once per pulse" << endl;
+    pass = false;
+  }
+  if (!outputs.empty() && outputs.front() < MIN_SDIO_OUTPUT) {
+    cout << "  FAIL: expected at least " << MIN_SDIO_OUTPUT << " us" << endl;
+    pass = false;
+  }
+  const std::string reset = ReadFile(sim->attribute(options.reset_line,
+                                                    "value"));
+  const std::string sdio = ReadFile(sim->attribute(options.sdio_line,
+                                                   "value"));
+  cout << "  RST left at " << reset << ", SDIO at " << sdio << endl;
+  if (reset != "1" || sdio != "1") {
+    cout << "  FAIL: expected both high" << endl;
+    pass = false;
+  }
+  if (Available(options.chip, options.reset_line) ||
+      Available(options.chip, options.sdio_line)) {
+    cout << "  FAIL: the lines were not kept" << endl;
+    pass = false;
+  }
+  gpio.reset();
+  if (!Available(options.chip, options.reset_line)) {
+    cout << "  FAIL: the lines were not released" << endl;
+    pass = false;
+  }
+  cout << (pass ? "PASS" : "FAIL") << endl;
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,260 @@
+// Generates synthetic RDS, see src/Si4703RdsGenerator.h.
+//
+//   RdsGen [options]              generate in memory and report the rate
+//   RdsGen [options] -o <file>    also write records ("-" for stdout)
+//   RdsGen [options] --decode     decode with si4703::RdsDecoder
+//   RdsGen [options] --sim <s>    feed a simulated chip for <s> seconds
+//                                 and decode through Si4703_Breakout
+//
+// The station rotates three PS names and two RadioText messages and sends
+// an AF list. The same seed always gives the same stream, so a decoder
+// failure found with it can be replayed.
+
+#include "../src/Si4703RdsGenerator.h"
+#include "../src/Si4703Sim.h"
+#include "../src/SparkFunSi4703.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+namespace {
+
+const size_t CHUNK = 4096;  // Groups generated at a time.
+
+struct Options {
+  uint64_t groups = 10000000;
+  uint64_t seed = 1;
+  Si4703_RdsErrors errors;
+  bool clock_time = false;
+  bool eon = false;
+  std::string output;
+  bool decode = false;
+  double sim_seconds = 0;
+  double interval_ms = 87.6;
+};
+
+Si4703_RdsStation Station(const Options& options) {
+  Si4703_RdsStation station;
+  station.pi = 0xC201;
+  station.ps = {"SYNTH FM", "LOAD", "TEST"};
+  station.radio_text = {"Now playing: a synthetic song by the generator",
+                        "Traffic and weather on the eights"};
+  station.af = {89.1f, 94.3f, 101.7f, 104.9f};
+  station.clock_time = options.clock_time;
+  station.start = 1700000000;
+  if (options.eon) {
+    station.eon = {{0xC202, "OTHER 1", {95.5f}},
+                   {0xC203, "OTHER 2", {97.1f, 99.9f}}};
+  }
+  return station;
+}
+
+double Now() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+bool IsStationName(const Si4703_RdsStation& station, const char* ps) {
+  for (std::string name : station.ps) {
+    name.resize(8, ' ');
+    if (name == ps)
+      return true;
+  }
+  return false;
+}
+
+void PrintStats(const Si4703_RdsGenerator::Stats& stats) {
+  cout << "Generated " << stats.groups << " groups: " << stats.dropped
+       << " dropped, " << stats.error_blocks << " blocks with errors, "
+       << stats.uncorrectable << " uncorrectable" << endl;
+}
+
+int Generate(const Options& options) {
+  const Si4703_RdsStation station = Station(options);
+  Si4703_RdsGenerator generator(station, options.errors, options.seed);
+
+  FILE* out = nullptr;
+  if (options.output == "-") {
+    out = stdout;
+  } else if (!options.output.empty()) {
+    out = fopen(options.output.c_str(), "wb");
+    if (!out) {
+      perror(options.output.c_str());
+      return 1;
+    }
+  }
+
+  si4703::RdsDecoder decoder;
+  decoder.max_errors = 2;  // Take corrected blocks, as the chip would.
+  uint64_t decoded = 0, names = 0, bad_names = 0, texts = 0;
+  uint64_t checksum = 0;
+
+  std::vector<Si4703_RdsGenerator::Group> groups(CHUNK);
+  std::vector<uint8_t> records(CHUNK * Si4703_RdsGenerator::RECORD_LENGTH);
+  const double start = Now();
+  for (uint64_t done = 0; done < options.groups;) {
+    const size_t n = std::min<uint64_t>(CHUNK, options.groups - done);
+    generator.generate(groups.data(), n);
+    if (out) {
+      Si4703_RdsGenerator::write(groups.data(), n, records.data());
+      const size_t length = Si4703_RdsGenerator::RECORD_LENGTH;
+      if (fwrite(records.data(), length, n, out) != n) {
+        perror(options.output.c_str());
+        return 1;
+      }
+    }
+    for (size_t i = 0; i < n; i++) {
+      const Si4703_RdsGenerator::Group& group = groups[i];
+      checksum += group.blocks[3];
+      if (!options.decode ||
+          *std::max_element(group.errors, group.errors + 4) >
+              decoder.max_errors)
+        continue;
+      const uint8_t events =
+          decoder.decodeGroup(group.blocks[0], group.blocks[1],
+                              group.blocks[2], group.blocks[3]);
+      decoded++;
+      if (events & si4703::RdsDecoder::PS_COMPLETE) {
+        names++;
+        if (!IsStationName(station, decoder.ps))
+          bad_names++;
+      }
+      if (events & si4703::RdsDecoder::RT_COMPLETE)
+        texts++;
+    }
+    done += n;
+  }
+  const double elapsed = Now() - start;
+  if (out && out != stdout)
+    fclose(out);
+
+  // Reports go to stderr when the records go to stdout.
+  std::ostream& report = out == stdout ? cerr : cout;
+  report << options.groups << " groups in " << elapsed << " s: "
+         << options.groups / elapsed / 1e6 << " million groups/s, "
+         << options.groups / elapsed / 11.4 << "x real time (checksum "
+         << checksum % 65536 << ")" << endl;
+  if (options.decode) {
+    report << "Decoded " << decoded << " groups: " << names
+           << " complete PS names (" << bad_names << " not the station's), "
+           << texts << " complete RadioTexts" << endl;
+  }
+  if (out != stdout)
+    PrintStats(generator.stats());
+  return 0;
+}
+
+// Decode through the library: simulated chip, bus reads, rdsReadFunc() and
+// the group listeners.
+int Simulate(const Options& options) {
+  const Si4703_RdsStation station = Station(options);
+  std::shared_ptr<Si4703_RdsGenerator> generator(
+      new Si4703_RdsGenerator(station, options.errors, options.seed));
+  Si4703_SimulatedChip* chip = new Si4703_SimulatedChip;
+  Si4703_SimulatedChip::Transmitter tx{93.5f, station.pi, 50, true, "", "",
+                                       {}};
+  tx.rds = generator;
+  chip->addTransmitter(tx);
+  chip->setGroupInterval(std::chrono::microseconds(
+      static_cast<int64_t>(options.interval_ms * 1000)));
+
+  Si4703_Breakout radio(std::unique_ptr<Si4703_Bus>(chip), -1, -1,
+                        Region::US);
+  if (radio.powerOn() != Status::SUCCESS) {
+    cerr << "Could not power on the tuner" << endl;
+    return 1;
+  }
+  radio.setFrequency(93.5f);
+
+  std::atomic<int> received(0), types[16] = {};
+  radio.addRdsGroupListener([&](const RdsGroup& group) {
+    received++;
+    types[group.type()]++;
+  });
+  std::set<std::string> names;
+  const double end = Now() + options.sim_seconds;
+  while (Now() < end) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    const std::string name = radio.stationName();
+    if (!name.empty())
+      names.insert(name);
+  }
+  radio.powerOff();
+
+  PrintStats(generator->stats());
+  cout << "Received " << received << " groups through the library:";
+  for (int type = 0; type < 16; type++) {
+    if (types[type])
+      cout << " " << type << "A: " << types[type];
+  }
+  cout << endl << "PS names seen:";
+  for (const std::string& name : names)
+    cout << " \"" << name << "\"";
+  cout << endl;
+  return 0;
+}
+
+int Usage() {
+  cerr << "usage: RdsGen [-n <groups>] [--seed <n>] [--bler <p>]"
+       << " [--uncorrectable <p>] [--drop <p>] [--ct] [--eon]" << endl;
+  cerr << "              [-o <file>] [--decode] [--sim <seconds>]"
+       << " [--interval <ms>]" << endl;
+  cerr << "  --bler:          probability a block has errors" << endl;
+  cerr << "  --uncorrectable: fraction of those beyond correction" << endl;
+  cerr << "  --drop:          probability a group is lost" << endl;
+  cerr << "  -o:              write " << Si4703_RdsGenerator::RECORD_LENGTH
+       << " byte records, - for stdout" << endl;
+  cerr << "  --interval:      group interval on the simulated chip" << endl;
+  return 1;
+}
+
+}  // anonymous namespace
+
+int main(int argc, const char** argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "-n" && has_value)
+      options.groups = strtoull(argv[++i], nullptr, 10);
+    else if (arg == "--seed" && has_value)
+      options.seed = strtoull(argv[++i], nullptr, 10);
+    else if (arg == "--bler" && has_value)
+      options.errors.block_error_rate = atof(argv[++i]);
+    else if (arg == "--uncorrectable" && has_value)
+      options.errors.uncorrectable = atof(argv[++i]);
+    else if (arg == "--drop" && has_value)
+      options.errors.drop_rate = atof(argv[++i]);
+    else if (arg == "--ct")
+      options.clock_time = true;
+    else if (arg == "--eon")
+      options.eon = true;
+    else if (arg == "-o" && has_value)
+      options.output = argv[++i];
+    else if (arg == "--decode")
+      options.decode = true;
+    else if (arg == "--sim" && has_value)
+      options.sim_seconds = atof(argv[++i]);
+    else if (arg == "--interval" && has_value)
+      options.interval_ms = atof(argv[++i]);
+    else
+      return Usage();
+  }
+  if (options.errors.drop_rate >= 1)
+    return Usage();
+  return options.sim_seconds > 0 ? Simulate(options) : Generate(options);
+}
@@ -0,0 +1,187 @@
+// Measures how steadily the RDS thread polls while the CPU is loaded. A
+// simulated chip sends RDS groups on the broadcast's clock, each readable
+// for 40 ms, and a number of threads spin alongside the RDS thread. The
+// same run is made with the default Si4703_RdsThreadPolicy, with absolute
+// deadlines only, and with SCHED_FIFO, a CPU of its own, locked memory and
+// absolute deadlines. Reports the poll jitter and the groups the thread
+// missed, both as it estimates them and as the chip counts them.
+//
+//   RdsJitterBench [--seconds <n>] [--load <threads>] [--priority <n>]
+//                  [--cpu <n>] [--nice <n>] [--bursts <priority>]
+//
+// --nice sets the niceness of the spinning threads. --bursts makes them
+// spin for 60 ms in every 100 with SCHED_FIFO at |priority|, as a real-time
+// audio or video process might; the RDS thread only gets ahead of them at a
+// higher priority.
+
+#include "../src/Si4703Sim.h"
+#include "../src/SparkFunSi4703.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+namespace {
+
+struct Options {
+  int seconds = 20;
+  int load = 4;
+  int priority = 50;
+  int cpu = 0;
+  int nice = 0;  // Of the spinning threads.
+  int bursts = 0;  // Their SCHED_FIFO priority, 0 to spin all the time.
+};
+
+struct Run {
+  const char* name;
+  Si4703_RdsThreadPolicy policy;
+};
+
+// Spins until |stop|, now and then allocating and touching memory as a
+// busy process would. At |nice|, or in bursts at SCHED_FIFO |bursts|.
+void Spin(const std::atomic<bool>* stop, int nice, int bursts) {
+  setpriority(PRIO_PROCESS, syscall(SYS_gettid), nice);
+  if (bursts > 0) {
+    sched_param param;
+    param.sched_priority = bursts;
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param))
+      bursts = 0;
+  }
+  volatile uint64_t sum = 0;
+  std::vector<char> memory;
+  auto burst_end = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; !*stop; i++) {
+    sum += i * i;
+    if (i % 5000000 == 0) {
+      memory.assign(4 << 20, static_cast<char>(i));
+      sum += memory[i % memory.size()];
+    }
+    if (bursts > 0 && i % 1000 == 0 &&
+        std::chrono::steady_clock::now() > burst_end) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(40));
+      burst_end =
+          std::chrono::steady_clock::now() + std::chrono::milliseconds(60);
+    }
+  }
+}
+
+bool Measure(const Run& run, const Options& options) {
+  Si4703_SimulatedChip* chip = new Si4703_SimulatedChip;
+  chip->addTransmitter({93.5f, 0x1001, 50, true, "ONE", "Jitter", {}});
+  Si4703_Breakout radio(std::unique_ptr<Si4703_Bus>(chip), -1, -1,
+                        Region::US);
+  radio.setRdsThreadPolicy(run.policy);
+  if (radio.powerOn() != Status::SUCCESS)
+    return false;
+  radio.setFrequency(93.5f);
+  const Si4703_SimulatedChip::RdsStats before = chip->rdsStats();
+
+  std::atomic<bool> stop(false);
+  std::vector<std::thread> load;
+  for (int i = 0; i < options.load; i++)
+    load.emplace_back(Spin, &stop, options.nice, options.bursts);
+  const auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::seconds(options.seconds));
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  const Si4703_RdsThreadStats stats = radio.rdsThreadStats();
+  const Si4703_SimulatedChip::RdsStats after = chip->rdsStats();
+  stop = true;
+  for (std::thread& thread : load)
+    thread.join();
+  radio.powerOff();
+
+  const uint64_t wakeups = stats.polls ? stats.polls : 1;
+  cout << run.name << " (" << seconds << " s):";
+  if (run.policy.priority > 0)
+    cout << (stats.realtime ? " SCHED_FIFO" : " no SCHED_FIFO");
+  if (run.policy.cpu >= 0)
+    cout << (stats.pinned ? ", pinned" : ", not pinned");
+  if (run.policy.lock_memory)
+    cout << (stats.memory_locked ? ", memory locked" : ", memory not locked");
+  cout << endl;
+  cout << "  lateness: mean "
+       << static_cast<double>(stats.total_lateness.count()) / wakeups
+       << " us, p50 < " << stats.percentile(0.5).count() << " us, p99 < "
+       << stats.percentile(0.99).count() << " us, max "
+       << stats.max_lateness.count() << " us, " << stats.overruns
+       << " overruns" << endl;
+  const int sent = after.sent - before.sent;
+  const int missed = after.missed - before.missed;
+  cout << "  groups: " << sent << " sent, " << missed << " missed ("
+       << 100.0 * missed / (sent ? sent : 1) << "%), " << stats.missed_groups
+       << " missed by the thread's count, " << stats.polls << " polls"
+       << endl;
+  return true;
+}
+
+int Usage() {
+  cerr << "usage: RdsJitterBench [--seconds <n>] [--load <threads>]"
+       << " [--priority <n>] [--cpu <n>] [--nice <n>]"
+       << " [--bursts <priority>]" << endl;
+  return 1;
+}
+
+}  // anonymous namespace
+
+int main(int argc, const char** argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--seconds" && has_value)
+      options.seconds = atoi(argv[++i]);
+    else if (arg == "--load" && has_value)
+      options.load = atoi(argv[++i]);
+    else if (arg == "--priority" && has_value)
+      options.priority = atoi(argv[++i]);
+    else if (arg == "--cpu" && has_value)
+      options.cpu = atoi(argv[++i]);
+    else if (arg == "--nice" && has_value)
+      options.nice = atoi(argv[++i]);
+    else if (arg == "--bursts" && has_value)
+      options.bursts = atoi(argv[++i]);
+    else
+      return Usage();
+  }
+  if (options.seconds < 1 || options.load < 0)
+    return Usage();
+  cout << std::fixed << std::setprecision(1);
+  cout << options.load << " spinning threads";
+  if (options.bursts > 0)
+    cout << " in bursts at SCHED_FIFO " << options.bursts << endl;
+  else
+    cout << " at nice " << options.nice << endl;
+
+  Run runs[3];
+  runs[0].name = "Default";
+  runs[1].name = "Absolute deadlines";
+  runs[1].policy.absolute_deadlines = true;
+  runs[2].name = "Real-time";
+  runs[2].policy.priority = options.priority;
+  runs[2].policy.cpu = options.cpu;
+  runs[2].policy.lock_memory = true;
+  runs[2].policy.absolute_deadlines = true;
+  for (const Run& run : runs) {
+    if (!Measure(run, options)) {
+      cerr << "Could not power on the tuner" << endl;
+      return 1;
+    }
+  }
+  return 0;
+}
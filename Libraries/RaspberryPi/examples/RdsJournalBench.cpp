@@ -0,0 +1,287 @@
+// Measures the RDS event journal (src/Si4703RdsJournal.h) on synthetic
+// broadcasts. Dozens of tuners, each fed by a thread of its own as by its
+// RDS thread, hop between stations every half hour of broadcast time and
+// decode two days of groups as fast as they can, with compaction running
+// alongside. Reports how long the feeding threads spent in addGroup(),
+// what was dropped, what compaction removed, and what a query for one
+// station's RadioText over one day read. The query is checked against a
+// full scan, and again after the journal is reopened.
+//
+//   RdsJournalBench [--tuners <n>] [--stations <n>] [--hours <n>]
+//                   [--compact <seconds>] [directory]
+//
+// A quarter of the stations rotate their PS name, and an eighth have a
+// clock two minutes fast. Every station sends clock time and rotates four
+// RadioText messages.
+
+#include "../src/Si4703RdsGenerator.h"
+#include "../src/Si4703RdsJournal.h"
+#include "BenchUtil.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+namespace {
+
+const time_t START = 1792195200;  // A midnight, UTC.
+const int VISIT = 30 * 60;        // Seconds on a station before hopping.
+const int BUCKETS = 32;           // Of addGroup() times, powers of 2 ns.
+
+struct Options {
+  int tuners = 48;
+  int stations = 36;
+  int hours = 48;
+  int compact = 2;  // Seconds between compactions while feeding.
+  std::string directory = "/tmp/RdsJournalBench";
+};
+
+// xorshift64*.
+Si4703_RdsStation Station(int i) {
+  char name[16];
+  Si4703_RdsStation station;
+  station.pi = 0xC000 + i;
+  station.pty = i % 32;
+  station.tp = i % 2;
+  snprintf(name, sizeof(name), "STN %03d", i);
+  station.ps = {name};
+  if (i % 4 == 0) {
+    station.ps.push_back("NOW ON");
+    station.ps.push_back("AIR");
+    station.ps_hold = 32;  // About 6 s each.
+  }
+  station.radio_text.clear();
+  for (int k = 0; k < 4; k++) {
+    snprintf(name, sizeof(name), "%d", k + 1);
+    station.radio_text.push_back("Station " + station.ps[0] + ", message " +
+                                 name + " of 4");
+  }
+  station.rt_hold = 256;  // About 45 s each.
+  station.clock_time = true;
+  return station;
+}
+
+uint16_t Frequency(int station) {
+  return 8800 + 20 * station;  // 10 kHz units, 200 kHz apart.
+}
+
+struct Feed {
+  uint64_t groups = 0;
+  uint64_t buckets[BUCKETS] = {0};
+  double max_ns = 0;
+};
+
+void Tune(int tuner, const Options& options, Si4703_RdsJournal* journal,
+          Feed* feed) {
+  Si4703_RdsJournalMonitor monitor(nullptr, journal, tuner);
+  Random random(tuner + 1);
+  int station = tuner % options.stations;
+  const double end = options.hours * 3600.0;
+  const double group_seconds = Si4703_RdsGenerator::GROUP_MICROSECONDS / 1e6;
+  for (double visit = 0; visit < end; visit += VISIT) {
+    Si4703_RdsStation profile = Station(station);
+    // A clock two minutes fast.
+    profile.start = START + static_cast<time_t>(visit) +
+                    (station % 8 == 7 ? 120 : 0);
+    Si4703_RdsGenerator generator(profile);
+    RdsGroup group;
+    for (double at = 0; at < VISIT && visit + at < end; at += group_seconds) {
+      generator.encode(group.blocks);
+      const time_t now = START + static_cast<time_t>(visit + at);
+      timespec before, after;
+      clock_gettime(CLOCK_MONOTONIC, &before);
+      monitor.addGroup(group, Frequency(station), now);
+      clock_gettime(CLOCK_MONOTONIC, &after);
+      const double ns = (after.tv_sec - before.tv_sec) * 1e9 +
+                        (after.tv_nsec - before.tv_nsec);
+      int bucket = 0;
+      while (bucket + 1 < BUCKETS && ns >= (2 << bucket))
+        bucket++;
+      feed->buckets[bucket]++;
+      feed->max_ns = std::max(feed->max_ns, ns);
+      feed->groups++;
+    }
+    station = random.next(options.stations);
+  }
+}
+
+// Upper bound of the |fraction| percentile of the times in |feed|, in ns.
+double Percentile(const Feed& feed, double fraction) {
+  uint64_t seen = 0;
+  for (int i = 0; i < BUCKETS; i++) {
+    seen += feed.buckets[i];
+    if (seen >= fraction * feed.groups)
+      return 2 << i;
+  }
+  return feed.max_ns;
+}
+
+bool Same(const std::vector<Si4703_RdsEvent>& a,
+          const std::vector<Si4703_RdsEvent>& b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].type != b[i].type || a[i].time != b[i].time ||
+        a[i].tuner != b[i].tuner || a[i].text != b[i].text)
+      return false;
+  }
+  return true;
+}
+
+// One day of RadioText of |pi|, and checks it against a full scan.
+bool Query(Si4703_RdsJournal* journal, uint16_t pi, time_t from, time_t to) {
+  const Si4703_RdsJournal::Stats before = journal->stats();
+  const double start = Now();
+  const std::vector<Si4703_RdsEvent> texts =
+      journal->byPi(pi, from, to, Si4703_RdsEvent::mask(Si4703_RdsEvent::RT));
+  const double seconds = Now() - start;
+  const Si4703_RdsJournal::Stats after = journal->stats();
+  cout << "  RadioText of " << std::hex << pi << std::dec << " for a day: "
+       << texts.size() << " changes in " << seconds * 1e3 << " ms, "
+       << after.blocks_read - before.blocks_read << " blocks, "
+       << (after.bytes_read - before.bytes_read) / 1024.0 << " KiB read of "
+       << after.bytes / 1048576.0 << " MiB" << endl;
+
+  std::vector<Si4703_RdsEvent> scan;
+  for (const Si4703_RdsEvent& event : journal->byPi(pi, 0, INT32_MAX)) {
+    if (event.type == Si4703_RdsEvent::RT && event.time >= from &&
+        event.time <= to)
+      scan.push_back(event);
+  }
+  if (!Same(texts, scan) || texts.empty()) {
+    cout << "  FAIL: the full scan found " << scan.size() << endl;
+    return false;
+  }
+  return true;
+}
+
+// Remove what an earlier run left in |directory|.
+void Clean(const std::string& directory) {
+  DIR* dir = opendir(directory.c_str());
+  if (!dir)
+    return;
+  while (dirent* entry = readdir(dir)) {
+    const char* dot = strrchr(entry->d_name, '.');
+    if (dot && (!strcmp(dot, ".seg") || !strcmp(dot, ".tmp")))
+      unlink((directory + "/" + entry->d_name).c_str());
+  }
+  closedir(dir);
+}
+
+void Print(const char* name, const Si4703_RdsJournal::Stats& stats) {
+  cout << name << ": " << stats.written << " changes in " << stats.blocks
+       << " blocks, " << stats.segments << " segments, "
+       << stats.bytes / 1048576.0 << " MiB" << endl;
+}
+
+int Usage() {
+  cerr << "usage: RdsJournalBench [--tuners <n>] [--stations <n>]"
+       << " [--hours <n>] [--compact <seconds>] [directory]" << endl;
+  return 1;
+}
+
+}  // anonymous namespace
+
+int main(int argc, const char** argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--tuners" && has_value)
+      options.tuners = atoi(argv[++i]);
+    else if (arg == "--stations" && has_value)
+      options.stations = atoi(argv[++i]);
+    else if (arg == "--hours" && has_value)
+      options.hours = atoi(argv[++i]);
+    else if (arg == "--compact" && has_value)
+      options.compact = atoi(argv[++i]);
+    else if (arg[0] != '-')
+      options.directory = arg;
+    else
+      return Usage();
+  }
+  if (options.tuners < 1 || options.tuners > 255 || options.stations < 1 ||
+      options.hours < 24 || options.compact < 0)
+    return Usage();
+  cout << std::fixed << std::setprecision(1);
+  Clean(options.directory);
+
+  Si4703_RdsJournal::Config config;
+  config.compact_interval = std::chrono::seconds(options.compact);
+  std::unique_ptr<Si4703_RdsJournal> journal(
+      new Si4703_RdsJournal(options.directory, config));
+  if (journal->open() != Status::SUCCESS)
+    return 1;
+
+  cout << options.tuners << " tuners on " << options.stations
+       << " stations, " << options.hours << " hours of broadcast" << endl;
+  std::vector<Feed> feeds(options.tuners);
+  std::vector<std::thread> threads;
+  double start = Now();
+  for (int i = 0; i < options.tuners; i++)
+    threads.emplace_back(Tune, i, options, journal.get(), &feeds[i]);
+  for (std::thread& thread : threads)
+    thread.join();
+  journal->flush();
+  const double seconds = Now() - start;
+
+  Feed all;
+  for (const Feed& feed : feeds) {
+    all.groups += feed.groups;
+    for (int i = 0; i < BUCKETS; i++)
+      all.buckets[i] += feed.buckets[i];
+    all.max_ns = std::max(all.max_ns, feed.max_ns);
+  }
+  Si4703_RdsJournal::Stats stats = journal->stats();
+  cout << "Fed " << all.groups << " groups in " << seconds << " s ("
+       << all.groups / seconds / 1e6 << " M/s, "
+       << all.groups / seconds / 11.4 << " tuners' worth in real time)"
+       << endl;
+  cout << "  addGroup(): p50 < " << Percentile(all, 0.5) << " ns, p99 < "
+       << Percentile(all, 0.99) << " ns, p99.99 < "
+       << Percentile(all, 0.9999) << " ns, max " << all.max_ns / 1e3
+       << " us" << endl;
+  cout << "  " << stats.queued << " changes queued, " << stats.dropped
+       << " dropped, " << stats.compactions << " compactions removed "
+       << stats.removed << endl;
+  Print("Before the last compaction", stats);
+
+  start = Now();
+  if (journal->compact() != Status::SUCCESS)
+    return 1;
+  const double compact_seconds = Now() - start;
+  stats = journal->stats();
+  Print("After", stats);
+  cout << "  in " << compact_seconds * 1e3 << " ms; " << stats.removed
+       << " repeats removed in all ("
+       << 100.0 * stats.removed / (stats.queued ? stats.queued : 1)
+       << "% of the changes)" << endl;
+
+  // The last full day.
+  const time_t from = START + (options.hours / 24 - 1) * 86400;
+  const time_t to = from + 86399;
+  bool pass = Query(journal.get(), 0xC000, from, to);
+
+  journal.reset();
+  journal.reset(new Si4703_RdsJournal(options.directory, config));
+  start = Now();
+  if (journal->open() != Status::SUCCESS)
+    return 1;
+  cout << "Reopened in " << (Now() - start) * 1e3 << " ms" << endl;
+  pass = Query(journal.get(), 0xC000, from, to) && pass;
+  cout << (pass ? "PASS" : "FAIL") << endl;
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,207 @@
+// Decodes RDS groups streamed over a serial line by the Arduino library's
+// Si4703_RDS_Capture example, see src/Si4703SerialReader.h.
+//
+//   RdsSerial <device> [baud]     print PI, PS and RadioText as they arrive
+//   RdsSerial --pty [options]     self-test: stream synthetic groups through
+//                                 a pseudo terminal and report the rate
+//
+// The self-test frames Si4703_RdsGenerator groups as the sketch does, can
+// corrupt bytes on the way (--noise) and drop groups the way a full capture
+// ring does (--overflow), and checks what comes out of the reader.
+
+#include "../src/Si4703RdsGenerator.h"
+#include "../src/Si4703SerialReader.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+namespace {
+
+const int DEFAULT_BAUD = 115200;
+
+struct Options {
+  uint64_t groups = 200000;
+  double noise = 0;     // Probability that a byte is corrupted.
+  double overflow = 0;  // Probability that the sender drops a group.
+  uint64_t seed = 1;
+};
+
+double Now() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+int Live(const std::string& device, int baud) {
+  Si4703_SerialRdsReader reader;
+  if (reader.open(device, baud) != Status::SUCCESS)
+    return 1;
+  reader.setListener([](const si4703::RdsDecoder& decoder, uint8_t events) {
+    if (events & si4703::RdsDecoder::PI_CHANGED)
+      printf("PI %04X\n", decoder.pi);
+    if (events & si4703::RdsDecoder::PS_COMPLETE)
+      printf("PS \"%s\"\n", decoder.ps);
+    if (events & si4703::RdsDecoder::RT_COMPLETE)
+      printf("RT \"%s\"\n", decoder.rt);
+    fflush(stdout);
+  });
+  while (reader.poll(std::chrono::milliseconds(1000)) == Status::SUCCESS) {
+  }
+  const Si4703_SerialRdsReader::Stats stats = reader.stats();
+  cerr << "Line closed after " << stats.frames << " frames, "
+       << stats.bad_frames << " bad, " << stats.lost << " groups lost"
+       << endl;
+  return 0;
+}
+
+// In [0, 1).
+double Uniform(uint64_t* state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return (*state * 0x2545F4914F6CDD1DULL >> 11) * (1.0 / (1ULL << 53));
+}
+
+// Writes |options.groups| frames to |fd| as the capture sketch would.
+// |dropped| counts the groups skipped for a full ring.
+void Send(int fd, const Options& options, std::atomic<uint64_t>* dropped) {
+  Si4703_RdsStation station;
+  station.pi = 0xC201;
+  station.ps = {"SERIAL", "CAPTURE"};
+  station.radio_text = {"Groups framed on an Arduino, decoded on the host"};
+  Si4703_RdsGenerator generator(station, Si4703_RdsErrors(), options.seed);
+  uint64_t random = options.seed | 1;
+  std::vector<uint8_t> buffer;
+  uint8_t sequence = 0;
+  for (uint64_t i = 0; i < options.groups; i++) {
+    Si4703_RdsGenerator::Group group;
+    generator.next(&group);
+    const uint8_t number = sequence++;
+    if (options.overflow > 0 && Uniform(&random) < options.overflow) {
+      (*dropped)++;
+      continue;
+    }
+    uint8_t frame[si4703::RDS_FRAME_LENGTH];
+    si4703::encodeRdsFrame(number, group.blocks, 0, frame);
+    for (uint8_t& byte : frame) {
+      if (options.noise > 0 && Uniform(&random) < options.noise)
+        byte ^= 1 << (static_cast<int>(Uniform(&random) * 8));
+    }
+    buffer.insert(buffer.end(), frame, frame + sizeof(frame));
+    if (buffer.size() >= 4096 || i + 1 == options.groups) {
+      for (size_t done = 0; done < buffer.size();) {
+        const ssize_t n = write(fd, buffer.data() + done, buffer.size() - done);
+        if (n <= 0) {
+          perror("write");
+          return;
+        }
+        done += n;
+      }
+      buffer.clear();
+    }
+  }
+}
+
+int SelfTest(const Options& options) {
+  const int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+    perror("posix_openpt");
+    return 1;
+  }
+  Si4703_SerialRdsReader reader;
+  // Raw mode on the slave before anything is written, or the line
+  // discipline would translate the binary frames.
+  if (reader.open(ptsname(master), DEFAULT_BAUD) != Status::SUCCESS)
+    return 1;
+
+  uint64_t names = 0, bad_names = 0, texts = 0;
+  reader.setListener([&](const si4703::RdsDecoder& decoder, uint8_t events) {
+    if (events & si4703::RdsDecoder::PS_COMPLETE) {
+      names++;
+      const std::string ps = decoder.ps;
+      if (ps != "SERIAL  " && ps != "CAPTURE ")
+        bad_names++;
+    }
+    if (events & si4703::RdsDecoder::RT_COMPLETE)
+      texts++;
+  });
+
+  std::atomic<uint64_t> dropped(0);
+  std::atomic<bool> sent(false);
+  const double start = Now();
+  std::thread sender([&] {
+    Send(master, options, &dropped);
+    sent = true;
+  });
+  // Read until the sender is done and the line has gone quiet.
+  uint64_t last_bytes = ~0ULL;
+  while (!sent || reader.stats().bytes != last_bytes) {
+    last_bytes = reader.stats().bytes;
+    if (reader.poll(std::chrono::milliseconds(100)) != Status::SUCCESS)
+      break;
+  }
+  const double elapsed = Now() - start;
+  sender.join();
+  reader.close();
+  close(master);
+
+  const Si4703_SerialRdsReader::Stats stats = reader.stats();
+  cout << options.groups << " groups, " << dropped << " dropped by the sender, "
+       << stats.bytes << " bytes in " << elapsed << " s" << endl;
+  cout << "  " << stats.frames / elapsed << " frames/s, "
+       << stats.bytes / elapsed / 1e6 << " MB/s ("
+       << stats.frames / elapsed / 11.4 << "x the on-air rate)" << endl;
+  cout << "  " << stats.frames << " good frames, " << stats.bad_frames
+       << " bad, " << stats.lost << " groups lost" << endl;
+  cout << "  " << names << " complete PS names (" << bad_names
+       << " wrong), " << texts << " complete RadioTexts" << endl;
+  return 0;
+}
+
+int Usage() {
+  cerr << "usage: RdsSerial <device> [baud]" << endl;
+  cerr << "       RdsSerial --pty [-n <groups>] [--noise <p>]"
+       << " [--overflow <p>] [--seed <n>]" << endl;
+  cerr << "  --noise:    probability a byte is corrupted" << endl;
+  cerr << "  --overflow: probability the sender drops a group" << endl;
+  return 1;
+}
+
+}  // anonymous namespace
+
+int main(int argc, const char** argv) {
+  if (argc < 2)
+    return Usage();
+  if (std::string(argv[1]) != "--pty") {
+    if (argc > 3)
+      return Usage();
+    return Live(argv[1], argc == 3 ? atoi(argv[2]) : DEFAULT_BAUD);
+  }
+  Options options;
+  for (int i = 2; i < argc; i++) {
+    const std::string arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "-n" && has_value)
+      options.groups = strtoull(argv[++i], nullptr, 10);
+    else if (arg == "--noise" && has_value)
+      options.noise = atof(argv[++i]);
+    else if (arg == "--overflow" && has_value)
+      options.overflow = atof(argv[++i]);
+    else if (arg == "--seed" && has_value)
+      options.seed = strtoull(argv[++i], nullptr, 10);
+    else
+      return Usage();
+  }
+  return SelfTest(options);
+}
@@ -0,0 +1,135 @@
+// Measures how the tuner rides out bus faults. A simulated chip behind a
+// Si4703_FaultyBus is tuned back and forth, with the volume changed in
+// between, while the RDS thread reads. Each fault mix runs once with retries
+// off (one try, no recovery, as the library used to behave) and once with
+// the default Si4703_RetryPolicy, and reports the operations that failed,
+// their latency, and whether the tuner still works once the faults stop.
+
+#include "../src/Si4703Sim.h"
+#include "../src/SparkFunSi4703.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+namespace {
+
+const int OPERATIONS = 80;
+
+struct Scenario {
+  const char* name;
+  Si4703_BusFaults faults;
+};
+
+struct Result {
+  int failed;
+  double median_tune_ms;
+  double max_ms;  // Of any operation.
+  Si4703_RetryStats retry;
+  Si4703_FaultyBus::Stats bus;
+  bool works;  // Tunes once the faults stop.
+};
+
+Si4703_BusFaults Faults(double glitch_rate, int burst, double stuck_rate) {
+  Si4703_BusFaults faults;
+  faults.glitch_rate = glitch_rate;
+  faults.burst = burst;
+  faults.stuck_rate = stuck_rate;
+  return faults;
+}
+
+bool Run(const Scenario& scenario, const Si4703_RetryPolicy& policy,
+         Result* result) {
+  Si4703_SimulatedChip* chip = new Si4703_SimulatedChip;
+  chip->addTransmitter({93.5f, 0x1001, 50, true, "ONE", "", {}});
+  chip->addTransmitter({101.1f, 0x1002, 45, true, "TWO", "", {}});
+  Si4703_FaultyBus* bus = new Si4703_FaultyBus(
+      std::unique_ptr<Si4703_Bus>(chip), Si4703_BusFaults(), 7);
+  Si4703_Breakout radio(std::unique_ptr<Si4703_Bus>(bus), -1, -1,
+                        Region::US);
+  radio.setRetryPolicy(policy);
+  if (radio.powerOn() != Status::SUCCESS)
+    return false;
+  radio.setFrequency(93.5f);
+
+  bus->setFaults(scenario.faults);
+  std::vector<double> tunes;
+  result->failed = 0;
+  result->max_ms = 0;
+  for (int i = 0; i < OPERATIONS; i++) {
+    Si4703_Changes changes;
+    if (i % 2)
+      changes.volume = i % 16;
+    else
+      changes.frequency = i % 4 ? 93.5f : 101.1f;
+    const auto start = std::chrono::steady_clock::now();
+    if (radio.apply(changes) != Status::SUCCESS)
+      result->failed++;
+    const double ms = std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+    if (changes.frequency > 0)
+      tunes.push_back(ms);
+    result->max_ms = std::max(result->max_ms, ms);
+  }
+  bus->setFaults(Si4703_BusFaults());
+  result->retry = radio.retryStats();
+  result->bus = bus->stats();
+
+  Si4703_Changes changes;
+  changes.frequency = 97.5f;
+  result->works = radio.apply(changes) == Status::SUCCESS &&
+                  radio.getFrequency(std::chrono::milliseconds(0)) == 97.5f;
+  radio.powerOff();
+
+  std::sort(tunes.begin(), tunes.end());
+  result->median_tune_ms = tunes[tunes.size() / 2];
+  return true;
+}
+
+}  // anonymous namespace
+
+int main() {
+  const Scenario scenarios[] = {
+      {"glitches", Faults(0.02, 1, 0)},
+      {"bursts of 8", Faults(0.005, 8, 0)},
+      {"stuck bus", Faults(0, 1, 0.002)},
+  };
+  Si4703_RetryPolicy no_retries;
+  no_retries.attempts = 1;
+  no_retries.recover_after = 0;
+  const Si4703_RetryPolicy retries;
+
+  cout << OPERATIONS << " operations (tunes and volume changes) per run"
+       << endl
+       << endl
+       << std::left << std::setw(13) << "faults" << std::setw(9) << "policy"
+       << std::right << std::setw(7) << "failed" << std::setw(10)
+       << "tune ms" << std::setw(9) << "max ms" << std::setw(13)
+       << "bus failures" << std::setw(8) << "retries" << std::setw(11)
+       << "recoveries" << std::setw(7) << "works" << endl;
+  for (const Scenario& scenario : scenarios) {
+    for (int with_retries = 0; with_retries < 2; with_retries++) {
+      Result result;
+      if (!Run(scenario, with_retries ? retries : no_retries, &result)) {
+        cerr << "Could not power on the tuner" << endl;
+        return 1;
+      }
+      cout << std::left << std::setw(13) << scenario.name << std::setw(9)
+           << (with_retries ? "retry" : "none") << std::right << std::setw(7)
+           << result.failed << std::fixed << std::setprecision(1)
+           << std::setw(10) << result.median_tune_ms << std::setw(9)
+           << result.max_ms << std::setw(13) << result.bus.failed
+           << std::setw(8) << result.retry.retries << std::setw(11)
+           << result.retry.recoveries << std::setw(7)
+           << (result.works ? "yes" : "NO") << endl;
+    }
+  }
+  return 0;
+}
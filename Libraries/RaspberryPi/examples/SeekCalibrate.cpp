@@ -0,0 +1,122 @@
+// Calibrates the seek thresholds and saves them, see
+// src/Si4703SeekCalibration.h. Prints a full-band seek sweep with the
+// thresholds before and after. With --sim it runs on a simulated band with
+// weak stations below the default SEEKTH and interference above it.
+
+#include "../src/Si4703SeekCalibration.h"
+#include "../src/Si4703Sim.h"
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+namespace {
+
+const std::vector<Si4703_SimulatedChip::Transmitter> kTransmitters = {
+    {88.5f, 0x1001, 45, true, "ONE", "", {}},
+    {89.3f, 0x1002, 22, false, "WEAK1", "", {}},
+    {90.1f, 0x1003, 52, true, "TWO", "", {}},
+    {92.3f, 0x1004, 38, true, "THREE", "", {}},
+    {94.7f, 0x1005, 48, true, "FOUR", "", {}},
+    {95.5f, 0x1006, 21, false, "WEAK2", "", {}},
+    {96.9f, 0x1007, 40, true, "FIVE", "", {}},
+    {98.1f, 0x1008, 23, false, "WEAK3", "", {}},
+    {99.5f, 0x1009, 55, true, "SIX", "", {}},
+    {101.9f, 0x100A, 42, true, "SEVEN", "", {}},
+    {103.5f, 0x100B, 22, false, "WEAK4", "", {}},
+    {104.3f, 0x100C, 36, true, "EIGHT", "", {}},
+    {106.7f, 0x100D, 50, true, "NINE", "", {}},
+    {107.5f, 0x100E, 24, false, "WEAK5", "", {}},
+};
+
+// Spill next to strong stations, and spurs.
+const std::vector<Si4703_SimulatedChip::Interference> kInterference = {
+    {90.3f, 30, 3, 12},  {99.3f, 33, 4, 11},  {99.7f, 31, 3, 13},
+    {106.9f, 28, 2, 12}, {93.1f, 27, 5, 9},   {100.7f, 29, 4, 10},
+    {102.5f, 26, 3, 14}, {105.1f, 34, 6, 8},
+};
+
+void Print(const char* name,
+           const Si4703_SeekThresholds& thresholds,
+           const Si4703_SeekSweep& sweep,
+           size_t stations) {
+  const size_t found = sweep.stops.size() - sweep.false_stops;
+  cout << name << ": SEEKTH " << int(thresholds.rssi) << ", SKSNR "
+       << int(thresholds.snr) << ", SKCNT " << int(thresholds.impulses)
+       << endl;
+  cout << "  " << sweep.stops.size() << " stops, " << sweep.false_stops
+       << " false, " << sweep.misses << " of " << stations
+       << " stations missed, " << sweep.time.count() << " ms";
+  if (found)
+    cout << ", " << static_cast<double>(sweep.stops.size()) / found
+         << " seeks per station";
+  cout << endl;
+}
+
+int Usage() {
+  cerr << "usage: SeekCalibrate [-f <file>] [--sim]" << endl;
+  cerr << "  -f: where to save the thresholds (default seek.conf)" << endl;
+  return 1;
+}
+
+}  // anonymous namespace
+
+int main(int argc, const char** argv) {
+  std::string path = "seek.conf";
+  bool sim = false;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--sim")
+      sim = true;
+    else if (arg == "-f" && i + 1 < argc)
+      path = argv[++i];
+    else
+      return Usage();
+  }
+
+  std::unique_ptr<Si4703_Breakout> radio;
+  if (sim) {
+    Si4703_SimulatedChip* chip = new Si4703_SimulatedChip;
+    for (const auto& tx : kTransmitters)
+      chip->addTransmitter(tx);
+    for (const auto& interference : kInterference)
+      chip->addInterference(interference);
+    radio.reset(new Si4703_Breakout(std::unique_ptr<Si4703_Bus>(chip), -1,
+                                    -1, Region::US));
+  } else {
+    const int resetPin = 23;  // GPIO_23.
+    const int sdaPin = 0;     // GPIO_0 (SDA).
+    radio.reset(new Si4703_Breakout(resetPin, sdaPin, Region::US));
+  }
+  if (radio->powerOn() != Status::SUCCESS) {
+    cerr << "Could not power on the tuner" << endl;
+    return 1;
+  }
+  radio->setFrequency(radio->minFrequency());
+
+  Si4703_SeekCalibration calibration(radio.get());
+  calibration.survey();
+  const size_t stations = calibration.stations().size();
+  cout << "Survey: " << stations << " stations" << endl;
+
+  const Si4703_SeekThresholds before = radio->seekThresholds();
+  Print("Before", before, calibration.sweep(before), stations);
+
+  const auto start = std::chrono::steady_clock::now();
+  const Si4703_SeekCalibration::Result result = calibration.run();
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  Print("After", result.thresholds, result.sweep, stations);
+  cout << "  " << result.sweeps << " thresholds tried in " << elapsed.count()
+       << " s" << endl;
+
+  if (Si4703_SeekCalibration::save(path, result.thresholds) !=
+      Status::SUCCESS)
+    return 1;
+  cout << "Saved to " << path << endl;
+  return 0;
+}
@@ -0,0 +1,124 @@
+// Measures the cost of formatting tuner status for a collector. The old way
+// builds a JSON object with a std::ostringstream from the getters and the
+// *_str() helpers, each reading the register snapshot again. The new way
+// decodes the snapshot once with status() and serializes the
+// Si4703_StatusSnapshot into a stack buffer. Reports the time and the heap
+// allocations per record for each.
+
+#include "../src/Si4703Sim.h"
+#include "../src/SparkFunSi4703.h"
+#include <stdlib.h>
+#include <time.h>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+namespace {
+
+size_t g_allocations = 0;
+
+const int RECORDS = 200000;
+
+double Now() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+std::string OldJson(Si4703_Breakout* radio) {
+  std::ostringstream json;
+  json << "{\"frequency\":" << radio->getFrequency()
+       << ",\"rssi\":" << radio->signalStrength()
+       << ",\"stereo\":" << (radio->stereo() ? "true" : "false")
+       << ",\"volume\":" << radio->getVolume()
+       << ",\"block_a_errors\":\"" << radio->blockAErrors_str()
+       << "\",\"manufacturer\":\"" << radio->manufacturer_str()
+       << "\",\"device\":\"" << radio->device_str()
+       << "\",\"revision\":\"" << radio->revision_str()
+       << "\",\"firmware\":" << radio->firmware_str() << ",\"pi\":\"0x"
+       << std::hex << std::setfill('0') << std::setw(4) << radio->programId()
+       << "\"}";
+  return json.str();
+}
+
+// Runs |format| RECORDS times and prints the cost per record. |format|
+// returns the record length so the work can't be optimized away.
+template <typename Format>
+void Measure(const char* name, Format format) {
+  size_t bytes = 0;
+  const size_t allocations = g_allocations;
+  const double start = Now();
+  for (int i = 0; i < RECORDS; i++)
+    bytes += format();
+  const double elapsed = Now() - start;
+  cout << std::left << std::setw(29) << name << std::right << std::fixed
+       << std::setprecision(0) << std::setw(6) << elapsed * 1e9 / RECORDS
+       << " ns/record " << std::setprecision(1) << std::setw(5)
+       << static_cast<double>(g_allocations - allocations) / RECORDS
+       << " allocations/record " << std::setw(4) << bytes / RECORDS
+       << " bytes" << endl;
+}
+
+}  // anonymous namespace
+
+// Count every allocation. Not inlined, so the compiler can't pair a
+// malloc() it sees here with a delete it sees elsewhere.
+__attribute__((noinline)) void* operator new(size_t size) {
+  g_allocations++;
+  if (void* p = malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+  free(p);
+}
+
+int main() {
+  Si4703_SimulatedChip* chip = new Si4703_SimulatedChip;
+  chip->addTransmitter({93.5f, 0x1002, 50, true, "NEWS", "Traffic", {}});
+  Si4703_Breakout radio(std::unique_ptr<Si4703_Bus>(chip), -1, -1,
+                        Region::US);
+  if (radio.powerOn() != Status::SUCCESS) {
+    cerr << "Could not power on the tuner" << endl;
+    return 1;
+  }
+  radio.setFrequency(93.5f);
+
+  Measure("ostringstream JSON", [&] { return OldJson(&radio).size(); });
+
+  Measure("status()", [&] {
+    return radio.status().version ? sizeof(Si4703_StatusSnapshot) : 0;
+  });
+
+  char text[512];
+  Measure("status() + toJson()", [&] {
+    return radio.status().toJson(text, sizeof(text));
+  });
+
+  Measure("status() + toLineProtocol()", [&] {
+    return radio.status().toLineProtocol("si4703,tuner=0", 0, text,
+                                         sizeof(text));
+  });
+
+  uint8_t binary[Si4703_StatusSnapshot::BINARY_LENGTH];
+  Measure("status() + toBinary()", [&] {
+    return radio.status().toBinary(binary, sizeof(binary));
+  });
+
+  cout << endl << "JSON: ";
+  cout.write(text, radio.status().toJson(text, sizeof(text)));
+  cout << endl << "Line protocol: ";
+  cout.write(text, radio.status().toLineProtocol("si4703,tuner=0", 0, text,
+                                                 sizeof(text)));
+
+  radio.powerOff();
+  return 0;
+}
@@ -0,0 +1,201 @@
+// Measures how fast many processes can read the shared-memory status page
+// of one simulated tuner. The reader processes are forked before the tuner
+// exists and each reads the page in a tight loop, checking every record it
+// gets for tearing. With --stress a thread in the owner changes the volume
+// back and forth, so the page is rewritten as fast as the bus allows on top
+// of the RDS thread's reads every 30-40 ms.
+
+#include "../src/Si4703Sim.h"
+#include "../src/Si4703StatusPage.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+namespace {
+
+const char kPageName[] = "/si4703-bench";
+
+struct ReaderResult {
+  uint64_t reads;
+  uint64_t retries;
+  uint64_t failures;  // read() gave up.
+  uint64_t torn;      // Records that aren't self-consistent.
+};
+
+double Now() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// A record is consistent if its completion flags agree with its text and
+// its update count never goes backwards.
+bool Consistent(const Si4703_StatusRecord& record, uint32_t* last_updates) {
+  const bool ps = record.flags & Si4703_StatusRecord::PS_COMPLETE;
+  const bool rt = record.flags & Si4703_StatusRecord::RT_COMPLETE;
+  const bool ok = ps == (record.ps[0] != '\0') &&
+                  rt == (record.rt[0] != '\0') &&
+                  memchr(record.ps, '\0', sizeof(record.ps)) &&
+                  memchr(record.rt, '\0', sizeof(record.rt)) &&
+                  record.updates >= *last_updates;
+  *last_updates = record.updates;
+  return ok;
+}
+
+// Runs in a child: wait for |go|, read the page for |seconds| and write a
+// ReaderResult to |result|.
+int Reader(int go, int result, double seconds) {
+  char byte;
+  if (read(go, &byte, 1) != 1)
+    return 1;
+  Si4703_StatusReader reader;
+  if (reader.open(kPageName) != Status::SUCCESS)
+    return 1;
+
+  ReaderResult r = {0, 0, 0, 0};
+  Si4703_StatusRecord record;
+  uint32_t last_updates = 0;
+  const double end = Now() + seconds;
+  while (true) {
+    for (int i = 0; i < 1024; i++) {
+      if (!reader.read(&record)) {
+        r.failures++;
+        continue;
+      }
+      r.reads++;
+      if (!Consistent(record, &last_updates))
+        r.torn++;
+    }
+    if (Now() >= end)
+      break;
+  }
+  r.retries = reader.retries();
+  return write(result, &r, sizeof(r)) == sizeof(r) ? 0 : 1;
+}
+
+int Usage() {
+  cerr << "usage: StatusPageBench [<readers> [<seconds>]] [--stress]" << endl;
+  return 1;
+}
+
+}  // anonymous namespace
+
+int main(int argc, const char** argv) {
+  int readers = 8;
+  double seconds = 3;
+  bool stress = false;
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--stress")
+      stress = true;
+    else
+      args.push_back(argv[i]);
+  }
+  if (args.size() > 2)
+    return Usage();
+  if (args.size() > 0)
+    readers = atoi(args[0].c_str());
+  if (args.size() > 1)
+    seconds = atof(args[1].c_str());
+  if (readers < 1 || seconds <= 0)
+    return Usage();
+
+  // Fork before any thread exists.
+  int go[2], results[2];
+  if (pipe(go) < 0 || pipe(results) < 0) {
+    perror("pipe");
+    return 1;
+  }
+  std::vector<pid_t> children;
+  for (int i = 0; i < readers; i++) {
+    const pid_t pid = fork();
+    if (pid == 0)
+      _exit(Reader(go[0], results[1], seconds));
+    children.push_back(pid);
+  }
+  close(go[0]);
+  close(results[1]);
+
+  Si4703_SimulatedChip* chip = new Si4703_SimulatedChip;
+  chip->addTransmitter(
+      {93.5f, 0x1002, 50, true, "NEWS", "Headlines on the hour", {}});
+  Si4703_Breakout radio(std::unique_ptr<Si4703_Bus>(chip), -1, -1,
+                        Region::US);
+  if (radio.powerOn() != Status::SUCCESS)
+    return 1;
+  radio.setVolume(5);
+  radio.setFrequency(93.5f);
+
+  int status = 0;
+  {
+    Si4703_StatusPublisher publisher(&radio, kPageName);
+    if (publisher.open() != Status::SUCCESS)
+      return 1;
+    Si4703_StatusReader own;
+    Si4703_StatusRecord before, after;
+    own.open(kPageName);
+    own.read(&before);
+
+    std::atomic<bool> stressing(stress);
+    std::thread stressor([&] {
+      for (int volume = 0; stressing; volume ^= 1)
+        radio.setVolume(5 + volume);
+    });
+
+    const char bytes[1] = {0};
+    for (int i = 0; i < readers; i++) {
+      if (write(go[1], bytes, 1) != 1)
+        return 1;
+    }
+    std::vector<ReaderResult> totals;
+    ReaderResult r;
+    while (read(results[0], &r, sizeof(r)) == sizeof(r))
+      totals.push_back(r);
+    stressing = false;
+    stressor.join();
+    own.read(&after);
+
+    for (pid_t pid : children) {
+      int child_status;
+      waitpid(pid, &child_status, 0);
+      if (!WIFEXITED(child_status) || WEXITSTATUS(child_status) != 0)
+        status = 1;
+    }
+
+    ReaderResult sum = {0, 0, 0, 0};
+    for (const ReaderResult& t : totals) {
+      sum.reads += t.reads;
+      sum.retries += t.retries;
+      sum.failures += t.failures;
+      sum.torn += t.torn;
+    }
+    const double span = (after.updated_ns - before.updated_ns) * 1e-9;
+    cout << totals.size() << " reader processes, " << seconds << " s"
+         << (stress ? ", stressed" : "") << endl;
+    cout << "  publishes: " << after.updates - before.updates << " ("
+         << (after.updates - before.updates) / span << "/s)" << endl;
+    cout << "  reads:     " << sum.reads / seconds / 1e6 << " M/s total, "
+         << sum.reads / seconds / 1e6 / totals.size() << " M/s per process"
+         << endl;
+    cout << "  retries:   " << sum.retries << ", failures: " << sum.failures
+         << ", torn: " << sum.torn << endl;
+    cout << "  last:      " << after.frequency / 100.0 << " MHz, RSSI "
+         << int(after.rssi) << ", PS '" << after.ps << "', RT '" << after.rt
+         << "'" << endl;
+    if (sum.torn || sum.failures)
+      status = 1;
+  }
+  return status;
+}
@@ -0,0 +1,91 @@
+// Measures the wall time of a full-band survey on 1, 2 and 4 simulated
+// tuners, with and without rebalancing. The stations are bunched up at the
+// bottom of the band so a static split leaves most of the RDS dwells to the
+// first tuner.
+
+#include "../src/Si4703Sim.h"
+#include "../src/Si4703Survey.h"
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using std::cout;
+using std::endl;
+
+namespace {
+
+const std::vector<Si4703_SimulatedChip::Transmitter> kTransmitters = {
+    {87.9f, 0x1001, 52, true, "ONE", "", {}},
+    {88.3f, 0x1002, 44, true, "TWO", "", {}},
+    {88.7f, 0x1003, 38, true, "THREE", "", {}},
+    {89.1f, 0x1004, 47, false, "FOUR", "", {}},
+    {89.5f, 0x1005, 33, true, "FIVE", "", {}},
+    {89.9f, 0x1006, 41, true, "SIX", "", {}},
+    {90.3f, 0x1007, 29, false, "SEVEN", "", {}},
+    {90.7f, 0x1008, 50, true, "EIGHT", "", {}},
+    {91.1f, 0x1009, 36, true, "NINE", "", {}},
+    {91.5f, 0x100A, 45, true, "TEN", "", {}},
+    {101.1f, 0x100B, 48, true, "ELEVEN", "", {}},
+    {105.7f, 0x100C, 15, false, "WEAK", "", {}},
+};
+
+struct Result {
+  double seconds;
+  int stations;  // Channels with a complete PS name.
+  std::vector<Si4703_SurveyScheduler::TunerStats> stats;
+};
+
+Result Survey(int tuner_count, bool rebalance) {
+  std::vector<std::unique_ptr<Si4703_Breakout>> radios;
+  std::vector<Si4703_Breakout*> tuners;
+  for (int i = 0; i < tuner_count; i++) {
+    Si4703_SimulatedChip* chip = new Si4703_SimulatedChip;
+    for (const auto& tx : kTransmitters)
+      chip->addTransmitter(tx);
+    radios.emplace_back(new Si4703_Breakout(
+        std::unique_ptr<Si4703_Bus>(chip), -1, -1, Region::US));
+    radios.back()->powerOn();
+    tuners.push_back(radios.back().get());
+  }
+
+  Si4703_SurveyScheduler::Config config;
+  config.rebalance = rebalance;
+  Si4703_SurveyScheduler scheduler(tuners, config);
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<Si4703_ChannelReport> reports = scheduler.run();
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  Result result{elapsed.count(), 0, scheduler.stats()};
+  for (const Si4703_ChannelReport& report : reports) {
+    if (!report.ps.empty())
+      result.stations++;
+  }
+  return result;
+}
+
+}  // anonymous namespace
+
+int main(int argc, const char** argv) {
+  double single = 0;
+  for (int count : {1, 2, 4}) {
+    for (bool rebalance : {false, true}) {
+      if (count == 1 && rebalance)
+        continue;
+      Result result = Survey(count, rebalance);
+      if (count == 1)
+        single = result.seconds;
+      cout << count << " tuner(s), " << (rebalance ? "rebalanced" : "static")
+           << ": " << result.seconds << " s (x" << single / result.seconds
+           << "), " << result.stations << " stations named" << endl;
+      for (size_t i = 0; i < result.stats.size(); i++) {
+        const auto& stats = result.stats[i];
+        cout << "  tuner " << i << ": " << stats.channels << " channels, "
+             << stats.stations << " dwells, " << stats.steals << " steals, "
+             << stats.busy.count() << " ms busy" << endl;
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,288 @@
+// Measures the band survey log (src/Si4703SurveyLog.h) on a synthetic month
+// of minute-level sweeps over the European band (206 channels), then checks
+// its queries against the sweeps kept in memory.
+//
+//   SurveyLogBench [--days <n>] [--keyframes <n>] [--sim <sweeps>] [path]
+//
+// The band has 30 stations that drift by 1 dB now and then, a noise floor
+// that flickers by 1 dB, three transmitter outages of two hours and an
+// interference burst of ten minutes. --sim also records a few real sweeps
+// of four simulated tuners with Si4703_SurveyRecorder.
+
+#include "../src/Si4703Sim.h"
+#include "../src/Si4703SurveyLog.h"
+#include "BenchUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+namespace {
+
+const int CHANNELS = 206;  // 87.5-108.0 MHz every 100 kHz.
+const int STATIONS = 30;
+const int INTERVAL = 60;  // Seconds between sweeps.
+const time_t START = 1700000000;
+
+struct Options {
+  int days = 30;
+  int keyframes = 240;
+  int sim_sweeps = 0;
+  std::string path = "/tmp/SurveyLogBench.log";
+};
+
+struct Outage {
+  int channel;
+  int first;  // Sweep.
+  int sweeps;
+};
+
+// xorshift64*.
+// The band, one sweep at a time.
+class Band {
+ public:
+  explicit Band(int sweeps) : random_(11), base_(CHANNELS), n_(0) {
+    for (int i = 0; i < CHANNELS; i++)
+      base_[i] = 6 + random_.next(8);
+    for (int i = 0; i < STATIONS; i++) {
+      const int channel = random_.next(CHANNELS);
+      base_[channel] = 25 + random_.next(40);
+      stations_.push_back(channel);
+    }
+    for (int i = 0; i < 3; i++) {
+      outages_.push_back(Outage{stations_[i * 7],
+                                static_cast<int>(random_.next(sweeps - 120)),
+                                120});
+    }
+    burst_ = Outage{static_cast<int>(random_.next(CHANNELS)),
+                    static_cast<int>(random_.next(sweeps - 10)), 10};
+    current_.time = START;
+    for (int i = 0; i < CHANNELS; i++)
+      current_.points.push_back(Si4703_SweepPoint{base_[i], false, false});
+  }
+
+  const Si4703_Sweep& next() {
+    current_.time = START + n_ * INTERVAL;
+    for (int i = 0; i < CHANNELS; i++) {
+      Si4703_SweepPoint& point = current_.points[i];
+      int rssi = base_[i];
+      const int jitter = random_.next(100);
+      // Strong signals read steadier than the noise floor.
+      if (jitter < (base_[i] >= 25 ? 4 : 8))
+        rssi += jitter % 2 ? 1 : -1;
+      for (const Outage& outage : outages_) {
+        if (i == outage.channel && In(outage))
+          rssi = 8;
+      }
+      if (i == burst_.channel && In(burst_))
+        rssi += 25;
+      point.rssi = rssi;
+      point.stereo = rssi >= 30;
+      point.afc_rail = i == burst_.channel && In(burst_);
+    }
+    n_++;
+    return current_;
+  }
+
+  const std::vector<Outage>& outages() const { return outages_; }
+  const Outage& burst() const { return burst_; }
+
+ private:
+  bool In(const Outage& outage) const {
+    return n_ >= outage.first && n_ < outage.first + outage.sweeps;
+  }
+
+  Random random_;
+  std::vector<uint8_t> base_;
+  std::vector<int> stations_;
+  std::vector<Outage> outages_;
+  Outage burst_;
+  Si4703_Sweep current_;
+  int n_;
+};
+
+time_t SweepTime(int n) {
+  return START + static_cast<time_t>(n) * INTERVAL;
+}
+
+bool Found(const std::vector<Si4703_SurveyLog::Change>& changes,
+           int channel) {
+  for (const Si4703_SurveyLog::Change& change : changes) {
+    if (change.channel == channel)
+      return true;
+  }
+  return false;
+}
+
+int Simulate(const Options& options) {
+  std::vector<std::unique_ptr<Si4703_Breakout>> radios;
+  std::vector<Si4703_Breakout*> tuners;
+  for (int i = 0; i < 4; i++) {
+    Si4703_SimulatedChip* chip = new Si4703_SimulatedChip;
+    chip->addTransmitter({93.5f, 0x1001, 50, true, "ONE", "", {}});
+    chip->addTransmitter({101.1f, 0x1002, 35, true, "TWO", "", {}});
+    radios.emplace_back(new Si4703_Breakout(std::unique_ptr<Si4703_Bus>(chip),
+                                            -1, -1, Region::Europe));
+    if (radios.back()->powerOn() != Status::SUCCESS) {
+      cerr << "Could not power on the tuner" << endl;
+      return 1;
+    }
+    tuners.push_back(radios.back().get());
+  }
+  Si4703_SurveyScheduler::Config config;
+  config.rds_min_rssi = 256;  // RSSI only, no RDS dwells.
+  Si4703_SurveyScheduler scheduler(tuners, config);
+
+  const std::string path = options.path + ".sim";
+  unlink(path.c_str());
+  Si4703_SurveyLog log(path);
+  if (log.open(Si4703_SurveyLog::Band{tuners[0]->minFrequency(),
+                                      tuners[0]->channelSpacing(),
+                                      CHANNELS}) != Status::SUCCESS)
+    return 1;
+  Si4703_SurveyRecorder recorder(&scheduler, &log, std::chrono::seconds(1));
+  const double start = Now();
+  for (int i = 0; i < options.sim_sweeps; i++)
+    recorder.sweep();
+  const double elapsed = Now() - start;
+  const Si4703_SurveyLog::Stats stats = log.stats();
+  cout << "Simulated tuners: " << stats.sweeps << " sweeps of 4 tuners, "
+       << elapsed / options.sim_sweeps << " s each, " << stats.bytes
+       << " bytes logged, " << recorder.failures() << " failed" << endl;
+  for (const Si4703_SurveyLog::Change& change :
+       log.changes(-1, 0, time(nullptr))) {
+    if (change.max_rssi >= 20)
+      cout << "  " << change.frequency << " MHz: " << change.max_rssi
+           << " dBuV" << endl;
+  }
+  for (Si4703_Breakout* tuner : tuners)
+    tuner->powerOff();
+  return 0;
+}
+
+int Usage() {
+  cerr << "usage: SurveyLogBench [--days <n>] [--keyframes <n>]"
+       << " [--sim <sweeps>] [path]" << endl;
+  return 1;
+}
+
+}  // anonymous namespace
+
+int main(int argc, const char** argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--days" && has_value)
+      options.days = atoi(argv[++i]);
+    else if (arg == "--keyframes" && has_value)
+      options.keyframes = atoi(argv[++i]);
+    else if (arg == "--sim" && has_value)
+      options.sim_sweeps = atoi(argv[++i]);
+    else if (arg[0] != '-')
+      options.path = arg;
+    else
+      return Usage();
+  }
+  if (options.days < 1)
+    return Usage();
+  cout << std::fixed << std::setprecision(2);
+
+  const int sweeps = options.days * 24 * 3600 / INTERVAL;
+  const Si4703_SurveyLog::Band band_info{87.5f, 0.1f, CHANNELS};
+  unlink(options.path.c_str());
+  unlink((options.path + ".idx").c_str());
+  Si4703_SurveyLog log(options.path);
+  if (log.open(band_info, options.keyframes) != Status::SUCCESS)
+    return 1;
+
+  Band band(sweeps);
+  std::vector<Si4703_Sweep> truth;
+  truth.reserve(sweeps);
+  double start = Now();
+  for (int i = 0; i < sweeps; i++) {
+    truth.push_back(band.next());
+    if (log.append(truth.back()) != Status::SUCCESS) {
+      cerr << "append failed" << endl;
+      return 1;
+    }
+  }
+  double elapsed = Now() - start;
+  Si4703_SurveyLog::Stats stats = log.stats();
+  const double raw = 2.0 * CHANNELS * sweeps;  // RSSI and flags bytes.
+  cout << sweeps << " sweeps (" << options.days << " days at 1/min): "
+       << stats.bytes / 1e6 << " MB, " << static_cast<double>(stats.bytes) /
+                                              sweeps
+       << " bytes/sweep, " << raw / stats.bytes << "x smaller than 2 bytes"
+       << " per channel" << endl;
+  cout << "  " << stats.keyframes << " keyframes, appended at "
+       << sweeps / elapsed / 1e3 << " thousand sweeps/s" << endl;
+
+  // Queries against the sweeps in memory.
+  const time_t end = SweepTime(sweeps - 1);
+  const int channel = band.outages()[0].channel;
+  start = Now();
+  const std::vector<Si4703_SurveyLog::Sample> history =
+      log.history(channel, START, end);
+  elapsed = Now() - start;
+  bool match = history.size() == truth.size();
+  for (size_t i = 0; match && i < history.size(); i++) {
+    match = history[i].time == truth[i].time &&
+            history[i].point.rssi == truth[i].points[channel].rssi &&
+            history[i].point.stereo == truth[i].points[channel].stereo;
+  }
+  cout << "history() of one channel over " << options.days << " days: "
+       << elapsed * 1e3 << " ms, " << (match ? "matches" : "DIFFERS") << endl;
+
+  const int day = 24 * 60;
+  const Outage& outage = band.outages()[0];
+  const int from = std::max(0, outage.first - day / 2);
+  start = Now();
+  std::vector<Si4703_SurveyLog::Change> changes =
+      log.changes(10, SweepTime(from), SweepTime(from + day - 1));
+  elapsed = Now() - start;
+  cout << "changes(10 dB) over a day around an outage: " << elapsed * 1e3
+       << " ms, " << changes.size() << " channels, outage "
+       << (Found(changes, outage.channel) ? "found" : "MISSED") << endl;
+
+  const Outage& burst = band.burst();
+  start = Now();
+  changes = log.changes(10, SweepTime(burst.first),
+                        SweepTime(burst.first + 59));
+  elapsed = Now() - start;
+  cout << "changes(10 dB) over the hour of the burst: " << elapsed * 1e3
+       << " ms, burst " << (Found(changes, burst.channel) ? "found" : "MISSED")
+       << endl;
+  changes = log.changes(10, SweepTime(burst.first + 20),
+                        SweepTime(burst.first + 80));
+  cout << "  the hour after it: " << changes.size() << " channels" << endl;
+
+  // Reopen with the index, then without it.
+  log.close();
+  start = Now();
+  log.open(band_info, options.keyframes);
+  elapsed = Now() - start;
+  stats = log.stats();
+  cout << "Reopened in " << elapsed * 1e3 << " ms (" << stats.sweeps
+       << " sweeps)";
+  log.close();
+  unlink((options.path + ".idx").c_str());
+  start = Now();
+  log.open(band_info, options.keyframes);
+  elapsed = Now() - start;
+  cout << ", " << elapsed * 1e3 << " ms rebuilding the index ("
+       << log.stats().keyframes << " keyframes)" << endl;
+  log.close();
+
+  return options.sim_sweeps ? Simulate(options) : 0;
+}
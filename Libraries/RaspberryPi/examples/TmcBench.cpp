@@ -0,0 +1,269 @@
+// Measures RDS-TMC decoding and the traffic event store on synthetic 8A
+// streams. Each stream mixes single-group messages with multi-group ones of
+// two to five groups, up to three of them interleaved on different
+// continuity indexes, and sends every group twice as broadcasters do.
+//
+// First one decoder runs alone and its messages are checked against the
+// ones sent. Then several tuners feed one store at once, each at one 8A
+// group per second of broadcast time so events expire as they would on air,
+// while another thread asks for the events near random locations.
+
+#include "../src/Si4703TMC.h"
+#include "BenchUtil.h"
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using std::cout;
+using std::endl;
+
+namespace {
+
+const int ROADS = 8;
+const int ROAD_POINTS = 1000;
+const uint64_t DECODE_GROUPS = 2000000;
+const int TUNERS = 4;
+const uint64_t TUNER_GROUPS = 400000;
+const int RADIUS = 5;
+const int QUIET_QUERIES = 100000;
+
+// xorshift64*.
+// Adds |width| bits of |value| to the 28 bit chunks of optional content.
+void Put(std::vector<uint32_t>* chunks, int* bits, uint32_t value, int width) {
+  for (int i = width - 1; i >= 0; i--, (*bits)++) {
+    if (*bits % 28 == 0)
+      chunks->push_back(0);
+    chunks->back() |= ((value >> i) & 1) << (27 - *bits % 28);
+  }
+}
+
+// Encodes |message| as 8A groups, on continuity index |ci| if it has
+// further events.
+std::vector<RdsGroup> Encode(const Si4703_TmcMessage& message, uint8_t ci) {
+  std::vector<RdsGroup> groups;
+  RdsGroup group;
+  group.blocks[0] = message.pi;
+  const uint16_t c = (message.negative << 14) | (message.extent << 11) |
+                     message.event;
+  if (message.events.empty()) {
+    group.blocks[1] = (8 << 12) | (1 << 3) | message.duration;
+    group.blocks[2] = (message.diversion << 15) | c;
+    group.blocks[3] = message.location;
+    groups.push_back(group);
+    return groups;
+  }
+  std::vector<uint32_t> chunks;
+  int bits = 0;
+  Put(&chunks, &bits, 0, 4);  // Duration.
+  Put(&chunks, &bits, message.duration, 3);
+  for (uint16_t event : message.events) {
+    Put(&chunks, &bits, 9, 4);  // Additional event.
+    Put(&chunks, &bits, event, 11);
+  }
+  group.blocks[1] = (8 << 12) | ci;
+  group.blocks[2] = (1 << 15) | c;
+  group.blocks[3] = message.location;
+  groups.push_back(group);
+  for (size_t i = 0; i < chunks.size(); i++) {
+    const uint16_t gsi = chunks.size() - 1 - i;
+    group.blocks[2] = ((i == 0) << 14) | (gsi << 12) | (chunks[i] >> 16);
+    group.blocks[3] = chunks[i] & 0xFFFF;
+    groups.push_back(group);
+  }
+  return groups;
+}
+
+uint64_t Hash(const Si4703_TmcMessage& m) {
+  uint64_t h = m.location * 31 + m.event;
+  h = h * 31 + m.negative * 7 + m.extent;
+  h = h * 31 + m.duration;
+  for (uint16_t event : m.events)
+    h = h * 31 + event;
+  return h * 0x9E3779B97F4A7C15ULL;
+}
+
+// An endless 8A stream with up to three multi-group messages under way.
+class Stream {
+ public:
+  Stream(uint16_t pi, uint64_t seed) : pi_(pi), random_(seed), sent_(0) {}
+
+  // The next group, each sent twice.
+  const RdsGroup& next() {
+    if (repeat_) {
+      repeat_ = false;
+      return last_;
+    }
+    if (pending_.size() < 3) {
+      // The lowest continuity index not in use.
+      uint8_t ci = 1;
+      while (std::any_of(pending_.begin(), pending_.end(),
+                         [ci](const Pending& p) { return p.ci == ci; }))
+        ci++;
+      const Si4703_TmcMessage message = NewMessage();
+      pending_.push_back(Pending{ci, Hash(message), Encode(message, ci)});
+      std::reverse(pending_.back().groups.begin(),
+                   pending_.back().groups.end());
+    }
+    const size_t pick = random_.next(pending_.size());
+    Pending& pending = pending_[pick];
+    last_ = pending.groups.back();
+    pending.groups.pop_back();
+    if (pending.groups.empty()) {
+      sent_ += pending.hash;
+      messages_++;
+      pending_.erase(pending_.begin() + pick);
+    }
+    repeat_ = true;
+    return last_;
+  }
+
+  // Of the messages whose last group has gone out.
+  uint64_t sent() const { return sent_; }
+  uint64_t messages() const { return messages_; }
+
+ private:
+  Si4703_TmcMessage NewMessage() {
+    Si4703_TmcMessage message;
+    message.pi = pi_;
+    const int road = random_.next(ROADS);
+    message.location = 1 + road * ROAD_POINTS + random_.next(ROAD_POINTS);
+    message.event = 1 + random_.next(2047);
+    message.extent = random_.next(8);
+    message.negative = random_.next(2);
+    message.diversion = false;
+    message.duration = random_.next(8);
+    if (random_.next(10) < 4) {
+      const int extra = 1 + random_.next(6);
+      for (int i = 0; i < extra; i++)
+        message.events.push_back(1 + random_.next(2047));
+    }
+    return message;
+  }
+
+  struct Pending {
+    uint8_t ci;
+    uint64_t hash;
+    std::vector<RdsGroup> groups;  // Still to send, in reverse.
+  };
+
+  uint16_t pi_;
+  Random random_;
+  std::vector<Pending> pending_;
+  RdsGroup last_;
+  bool repeat_ = false;
+  uint64_t sent_;
+  uint64_t messages_ = 0;
+};
+
+Si4703_TmcLocations Roads() {
+  Si4703_TmcLocations locations;
+  for (int road = 0; road < ROADS; road++) {
+    const int first = 1 + road * ROAD_POINTS;
+    const int last = first + ROAD_POINTS - 1;
+    for (int code = first; code <= last; code++)
+      locations.add(code, code > first ? code - 1 : 0,
+                    code < last ? code + 1 : 0);
+  }
+  return locations;
+}
+
+void PrintLatency(const char* name, std::vector<double>* micros) {
+  std::sort(micros->begin(), micros->end());
+  cout << "  " << name << ": " << micros->size() << " queries, median "
+       << (*micros)[micros->size() / 2] << " us, p99 "
+       << (*micros)[micros->size() * 99 / 100] << " us, max "
+       << micros->back() << " us" << endl;
+}
+
+}  // anonymous namespace
+
+int main() {
+  cout << std::fixed << std::setprecision(1);
+
+  // One decoder alone.
+  {
+    Stream stream(0xD301, 1);
+    Si4703_TmcDecoder decoder;
+    Si4703_TmcMessage message;
+    uint64_t received = 0;
+    const double start = Now();
+    for (uint64_t i = 0; i < DECODE_GROUPS; i++) {
+      if (decoder.addGroup(stream.next(), &message))
+        received += Hash(message);
+    }
+    const double elapsed = Now() - start;
+    const Si4703_TmcDecoder::Stats& stats = decoder.stats();
+    cout << "Decoder: " << DECODE_GROUPS / elapsed / 1e6
+         << " million groups/s" << endl;
+    cout << "  " << stats.single << " single-group and " << stats.multi
+         << " multi-group messages, " << stats.repeats << " repeats, "
+         << stats.broken << " broken" << endl;
+    cout << "  " << stats.single + stats.multi << " of " << stream.messages()
+         << " messages sent decoded, contents "
+         << (received == stream.sent() ? "match" : "DIFFER") << endl;
+  }
+
+  // Tuners feeding one store, with queries alongside.
+  const Si4703_TmcLocations locations = Roads();
+  Si4703_TmcStore store(&locations);
+  const Si4703_TmcStore::Clock::time_point epoch =
+      Si4703_TmcStore::Clock::now();
+  std::atomic<int64_t> broadcast_seconds(0);
+  std::atomic<int> feeding(TUNERS);
+  std::vector<std::thread> tuners;
+  const double start = Now();
+  for (int t = 0; t < TUNERS; t++) {
+    tuners.emplace_back([&, t] {
+      Stream stream(0xD301 + t, 1000 * (t + 1));
+      Si4703_TmcDecoder decoder;
+      Si4703_TmcMessage message;
+      for (uint64_t i = 0; i < TUNER_GROUPS; i++) {
+        if (!decoder.addGroup(stream.next(), &message))
+          continue;
+        store.add(message, t, epoch + std::chrono::seconds(i));
+        if (t == 0)
+          broadcast_seconds = i;
+      }
+      feeding--;
+    });
+  }
+  Random random(7);
+  std::vector<double> busy, quiet;
+  size_t found = 0;
+  auto query = [&](std::vector<double>* micros) {
+    const uint16_t location = 1 + random.next(ROADS * ROAD_POINTS);
+    const double begin = Now();
+    found += store
+                 .near(location, RADIUS,
+                       epoch + std::chrono::seconds(broadcast_seconds))
+                 .size();
+    micros->push_back((Now() - begin) * 1e6);
+  };
+  while (feeding)
+    query(&busy);
+  const double elapsed = Now() - start;
+  for (std::thread& tuner : tuners)
+    tuner.join();
+  for (int i = 0; i < QUIET_QUERIES; i++)
+    query(&quiet);
+
+  const Si4703_TmcStore::Stats stats = store.stats();
+  cout << TUNERS << " tuners into one store: "
+       << TUNERS * TUNER_GROUPS / elapsed / 1e6 << " million groups/s, "
+       << (stats.added + stats.updated) / elapsed / 1e3
+       << " thousand messages/s" << endl;
+  cout << "  " << stats.added << " events added, " << stats.updated
+       << " updated, " << stats.expired << " expired, " << stats.active
+       << " active after " << broadcast_seconds / 3600 << " h of broadcast"
+       << endl;
+  cout << std::setprecision(2);
+  PrintLatency("near() while feeding", &busy);
+  PrintLatency("near() alone", &quiet);
+  cout << "  " << static_cast<double>(found) / (busy.size() + quiet.size())
+       << " events within " << RADIUS << " points on average" << endl;
+  return 0;
+}
@@ -0,0 +1,112 @@
+// Records a listening session to a binary bus trace, or replays one in place
+// of the chip.
+//
+//   TraceTool record <trace> <freq> <seconds> [--sim]
+//   TraceTool replay <trace> <freq> [--fast]
+//
+// A replay runs the same session as the recording (power on, volume, tune,
+// listen, power off) until the recorded reads run out, then reports the
+// driver's CPU time apart from the time spent waiting on the bus.
+
+#include "../src/Si4703Sim.h"
+#include "../src/Si4703Trace.h"
+#include "../src/SparkFunSi4703.h"
+#include <chrono>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <thread>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+namespace {
+
+int Usage() {
+  cerr << "usage:" << endl;
+  cerr << "  TraceTool record <trace> <freq> <seconds> [--sim]" << endl;
+  cerr << "  TraceTool replay <trace> <freq> [--fast]" << endl;
+  cerr << "where:" << endl;
+  cerr << "  --sim:  record a simulated chip instead of /dev/i2c-1" << endl;
+  cerr << "  --fast: don't hold transfers back to the recorded timing" << endl;
+  return 1;
+}
+
+double Millis(std::chrono::microseconds us) {
+  return us.count() / 1000.0;
+}
+
+// The session both modes run. |listening| returns false when it's over.
+template <typename Listening>
+void Session(Si4703_Breakout* radio, float frequency, Listening listening) {
+  radio->powerOn();
+  radio->setVolume(5);
+  radio->setFrequency(frequency);
+  while (listening())
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  radio->powerOff();
+}
+
+}  // anonymous namespace
+
+int main(int argc, const char** argv) {
+  if (argc < 4)
+    return Usage();
+  const std::string mode = argv[1];
+  const std::string path = argv[2];
+  const float frequency = atof(argv[3]);
+
+  if (mode == "record") {
+    if (argc < 5)
+      return Usage();
+    const auto duration = std::chrono::milliseconds(
+        static_cast<int>(atof(argv[4]) * 1000));
+    const bool sim = argc > 5 && std::string(argv[5]) == "--sim";
+    std::unique_ptr<Si4703_Bus> bus;
+    if (sim) {
+      Si4703_SimulatedChip* chip = new Si4703_SimulatedChip;
+      chip->addTransmitter(
+          {frequency, 0x1234, 45, true, "TRACE", "Recorded", {}});
+      bus.reset(chip);
+    } else {
+      bus.reset(new Si4703_LinuxI2CBus);
+    }
+    std::unique_ptr<Si4703_Bus> recorder(
+        new Si4703_TraceRecorder(std::move(bus), path));
+    Si4703_Breakout radio(std::move(recorder), sim ? -1 : 23, sim ? -1 : 0);
+    const auto end = std::chrono::steady_clock::now() + duration;
+    Session(&radio, frequency,
+            [end] { return std::chrono::steady_clock::now() < end; });
+    return 0;
+  }
+
+  if (mode != "replay")
+    return Usage();
+  const bool fast = argc > 4 && std::string(argv[4]) == "--fast";
+  Si4703_TraceReplayBus* replay = new Si4703_TraceReplayBus(
+      path, fast ? Si4703_TraceReplayBus::Timing::Fast
+                 : Si4703_TraceReplayBus::Timing::Recorded);
+  Si4703_Breakout radio(std::unique_ptr<Si4703_Bus>(replay), -1, -1);
+
+  const std::clock_t cpu_start = std::clock();
+  const auto start = std::chrono::steady_clock::now();
+  Session(&radio, frequency, [replay] { return !replay->finished(); });
+  const auto wall = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+  const double cpu_ms = 1000.0 * (std::clock() - cpu_start) / CLOCKS_PER_SEC;
+
+  const Si4703_TraceReplayBus::Stats stats = replay->stats();
+  cout << "Reads: " << stats.reads << ", writes: " << stats.writes
+       << ", transactions: " << stats.transactions
+       << ", resets: " << stats.resets
+       << ", mismatched writes: " << stats.mismatches
+       << ", missing: " << stats.missing << endl;
+  cout << "Wall time: " << Millis(wall) << " ms, bus time: "
+       << Millis(stats.bus_time) << " ms, driver CPU: " << cpu_ms << " ms"
+       << endl;
+  if (stats.reads)
+    cout << "Driver CPU per transfer: "
+         << 1000 * cpu_ms / (stats.reads + stats.writes) << " us" << endl;
+  return stats.mismatches ? 2 : 0;
+}
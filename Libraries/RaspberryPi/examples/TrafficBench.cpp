@@ -0,0 +1,301 @@
+// Checks Si4703_TrafficMonitor against simulated traffic announcements. A
+// home station links four others through EON: two traffic stations in
+// range, one whose only frequency is empty and one without traffic
+// programme. Announcements start at random on all of them and on the home
+// station itself. For each the bench checks that the monitor switched, or
+// rightly didn't, within the latency bound, and that it came back to the
+// frequency and volume it left. It also counts the register transfers of a
+// switch against those of setVolume() and setFrequency() in turn.
+//
+//   TrafficBench [--announcements <n>] [--bound <ms>] [--seed <n>]
+
+#include "../src/Si4703Sim.h"
+#include "../src/Si4703Traffic.h"
+#include "BenchUtil.h"
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const float HOME = 94.5f;
+const uint16_t HOME_PI = 0xD100;
+const int HOME_VOLUME = 5;
+const int ANNOUNCEMENT_VOLUME = 12;
+
+struct Options {
+  int announcements = 15;
+  int bound = 150;  // ms.
+  uint64_t seed = 1;
+};
+
+// What the monitor should do when |pi| announces.
+enum Expect { SWITCH, VOLUME, SKIP, IGNORE };
+
+struct Case {
+  const char* name;
+  uint16_t pi;
+  float frequency;  // Where the monitor should go.
+  Expect expect;
+};
+
+const Case CASES[] = {
+    {"TRAFIC 1", 0xD201, 97.9f, SWITCH},
+    {"TRAFIC 2", 0xD302, 101.3f, SWITCH},
+    {"HOME FM", HOME_PI, HOME, VOLUME},
+    {"FARAWAY", 0xD403, 0, SKIP},  // Its frequency is empty.
+    {"MUSIC", 0xD504, 0, IGNORE},  // No traffic programme.
+};
+const int CASE_COUNT = sizeof(CASES) / sizeof(CASES[0]);
+
+// xorshift64*.
+double Ms(Clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+// Poll |done| every 5 ms for at most |timeout|.
+template <typename Done>
+bool WaitFor(Done done, std::chrono::milliseconds timeout) {
+  const Clock::time_point give_up = Clock::now() + timeout;
+  while (!done()) {
+    if (Clock::now() >= give_up)
+      return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return true;
+}
+
+void AddStations(Si4703_SimulatedChip* chip) {
+  chip->addTransmitter(
+      {HOME, HOME_PI, 50, true, "HOME FM", "The home station", {}});
+  chip->addTransmitter(
+      {97.9f, 0xD201, 45, true, "TRAFIC 1", "Traffic one", {}});
+  chip->addTransmitter(
+      {101.3f, 0xD302, 38, true, "TRAFIC 2", "Traffic two", {}});
+  chip->addTransmitter({99.1f, 0xD504, 45, true, "MUSIC", "Music", {}});
+  // Traffic two also names a frequency nobody sends on.
+  chip->addOtherNetwork(HOME, {0xD201, "TRAFIC 1", {97.9f}, true});
+  chip->addOtherNetwork(HOME, {0xD302, "TRAFIC 2", {88.7f, 101.3f}, true});
+  chip->addOtherNetwork(HOME, {0xD403, "FARAWAY", {104.7f}, true});
+  chip->addOtherNetwork(HOME, {0xD504, "MUSIC", {99.1f}, false});
+}
+
+// Register transfers of |change|.
+int Transfers(Si4703_Breakout* radio, const std::function<void()>& change) {
+  const uint64_t before = radio->retryStats().transfers;
+  change();
+  return static_cast<int>(radio->retryStats().transfers - before);
+}
+
+bool Ready(Si4703_TrafficMonitor* monitor) {
+  int validated = 0;
+  for (const Si4703_EonNetwork& network : monitor->networks()) {
+    for (const Si4703_EonNetwork::Frequency& f : network.frequencies)
+      validated += f.rssi >= 25;
+  }
+  return validated >= 2;
+}
+
+bool Home(Si4703_Breakout* radio) {
+  return std::fabs(radio->getFrequency() - HOME) < 0.01f &&
+         radio->getVolume() == HOME_VOLUME;
+}
+
+int Usage() {
+  cerr << "usage: TrafficBench [--announcements <n>] [--bound <ms>]"
+       << " [--seed <n>]" << endl;
+  return 1;
+}
+
+}  // anonymous namespace
+
+int main(int argc, const char** argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--announcements" && has_value)
+      options.announcements = atoi(argv[++i]);
+    else if (arg == "--bound" && has_value)
+      options.bound = atoi(argv[++i]);
+    else if (arg == "--seed" && has_value)
+      options.seed = strtoull(argv[++i], nullptr, 10);
+    else
+      return Usage();
+  }
+  if (options.announcements < 1 || options.bound < 1)
+    return Usage();
+  cout << std::fixed << std::setprecision(1);
+
+  Si4703_SimulatedChip* chip = new Si4703_SimulatedChip;
+  AddStations(chip);
+  Si4703_Breakout radio(std::unique_ptr<Si4703_Bus>(chip), -1, -1,
+                        Region::Europe);
+  if (radio.powerOn() != Status::SUCCESS) {
+    cerr << "Could not power on the tuner" << endl;
+    return 1;
+  }
+  radio.setVolume(HOME_VOLUME);
+  radio.setFrequency(HOME);
+
+  // A switch and the switch back, both ways.
+  Si4703_Changes there;
+  there.frequency = 97.9f;
+  there.volume = ANNOUNCEMENT_VOLUME;
+  Si4703_Changes back;
+  back.frequency = HOME;
+  back.volume = HOME_VOLUME;
+  const int apply_transfers =
+      Transfers(&radio, [&] { radio.apply(there); }) +
+      Transfers(&radio, [&] { radio.apply(back); });
+  const int separate_transfers =
+      Transfers(&radio,
+                [&] {
+                  radio.setVolume(ANNOUNCEMENT_VOLUME);
+                  radio.setFrequency(97.9f);
+                }) +
+      Transfers(&radio, [&] {
+        radio.setVolume(HOME_VOLUME);
+        radio.setFrequency(HOME);
+      });
+  cout << "Switch and back: " << apply_transfers
+       << " register transfers with apply(), " << separate_transfers
+       << " with setVolume() and setFrequency()" << endl;
+
+  Si4703_TrafficMonitor::Config config;
+  config.volume = ANNOUNCEMENT_VOLUME;
+  config.latency_bound = std::chrono::milliseconds(options.bound);
+  Si4703_TrafficMonitor monitor(&radio, config);
+  monitor.start();
+  Clock::time_point start = Clock::now();
+  if (!WaitFor([&] { return Ready(&monitor); }, std::chrono::seconds(60))) {
+    cout << "FAIL: the traffic stations were never validated" << endl;
+    return 1;
+  }
+  cout << "Targets validated after " << Ms(Clock::now() - start) / 1e3
+       << " s:" << endl;
+  for (const Si4703_EonNetwork& network : monitor.networks()) {
+    cout << "  " << std::hex << network.pi << std::dec << " " << network.ps
+         << (network.tp ? " TP" : "   ");
+    for (const Si4703_EonNetwork::Frequency& f : network.frequencies)
+      cout << "  " << f.frequency << " MHz: " << f.rssi;
+    cout << endl;
+  }
+
+  Random random(options.seed);
+  bool pass = true;
+  int order[CASE_COUNT];
+  for (int i = 0; i < CASE_COUNT; i++)
+    order[i] = i;
+  std::vector<double> detections;
+  std::vector<double> returns;
+  for (int n = 0; n < options.announcements; n++) {
+    if (n % CASE_COUNT == 0) {
+      for (int i = CASE_COUNT - 1; i > 0; i--)
+        std::swap(order[i], order[random.next(i + 1)]);
+    }
+    const Case& c = CASES[order[n % CASE_COUNT]];
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(1000 + random.next(2000)));
+    const size_t switches = monitor.switches().size();
+    const Si4703_TrafficMonitor::Stats before = monitor.stats();
+    start = Clock::now();
+    chip->setTA(c.pi, true);
+
+    const char* failure = nullptr;
+    if (c.expect == SWITCH || c.expect == VOLUME) {
+      if (!WaitFor([&] { return monitor.switches().size() > switches; },
+                   std::chrono::seconds(2))) {
+        failure = "no switch";
+      } else {
+        const Si4703_TrafficSwitch s = monitor.switches().back();
+        detections.push_back(Ms(s.trigger - start));
+        cout << "  " << std::left << std::setw(9) << c.name << std::right
+             << "seen after " << std::setw(5) << Ms(s.trigger - start)
+             << " ms, on air after " << std::setw(5)
+             << s.latency.count() / 1e3 << " ms, " << s.transfers
+             << " transfers";
+        if (std::fabs(s.to - c.frequency) > 0.01f)
+          failure = "wrong frequency";
+        else if (s.latency > std::chrono::milliseconds(options.bound))
+          failure = "late";
+        else if (radio.getVolume() != ANNOUNCEMENT_VOLUME)
+          failure = "wrong volume";
+      }
+    } else {
+      std::this_thread::sleep_for(std::chrono::seconds(2));
+      const Si4703_TrafficMonitor::Stats after = monitor.stats();
+      cout << "  " << std::left << std::setw(9) << c.name << std::right
+           << (c.expect == SKIP ? "skipped" : "ignored");
+      if (monitor.switches().size() != switches)
+        failure = "switched";
+      else if (c.expect == SKIP && after.skipped != before.skipped + 1)
+        failure = "not skipped";
+      else if (c.expect == IGNORE &&
+               after.announcements != before.announcements)
+        failure = "not ignored";
+    }
+
+    // The announcement lasts 3-6 s.
+    std::this_thread::sleep_until(
+        start + std::chrono::milliseconds(3000 + random.next(3000)));
+    const Clock::time_point end = Clock::now();
+    chip->setTA(c.pi, false);
+    if (!WaitFor([&] { return !monitor.announcing() && Home(&radio); },
+                 std::chrono::seconds(2))) {
+      if (!failure)
+        failure = "not back";
+    } else if (c.expect == SWITCH || c.expect == VOLUME) {
+      returns.push_back(Ms(Clock::now() - end));
+      cout << ", back after " << Ms(Clock::now() - end) << " ms";
+    }
+    if (failure) {
+      cout << "  FAIL: " << failure;
+      pass = false;
+    }
+    cout << endl;
+  }
+  monitor.stop();
+
+  const Si4703_TrafficMonitor::Stats stats = monitor.stats();
+  cout << stats.announcements << " announcements, " << stats.switches
+       << " switches, " << stats.skipped << " skipped, " << stats.aborted
+       << " aborted, " << stats.late << " late, " << stats.probes
+       << " probes" << endl;
+  if (!detections.empty()) {
+    const int switched = stats.announcements - stats.skipped;
+    cout << "Trigger to audio: mean "
+         << stats.total_latency.count() / 1e3 / std::max(1, switched)
+         << " ms, max " << stats.max_latency.count() / 1e3 << " ms (bound "
+         << options.bound << " ms)" << endl;
+    cout << "TA up to trigger: mean "
+         << std::accumulate(detections.begin(), detections.end(), 0.0) /
+                detections.size()
+         << " ms, max "
+         << *std::max_element(detections.begin(), detections.end())
+         << " ms" << endl;
+  }
+  if (!returns.empty()) {
+    cout << "TA down to back home: max "
+         << *std::max_element(returns.begin(), returns.end()) << " ms"
+         << endl;
+  }
+  radio.powerOff();
+  cout << (pass ? "PASS" : "FAIL") << endl;
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,370 @@
+// Measures how fresh Si4703_Watchlist keeps a dozen simulated stations
+// with one tuner. The stations change their RadioText at rates from every
+// 15 s to never, two rotate their PS name, four fade in and out and one is
+// too weak for RDS. Each run samples every 100 ms which fields of which
+// stations the watchlist has right, and how old its data is. It runs the
+// same broadcast three ways, each with the same tune budget:
+// - Fixed: list order and dwells of --dwell ms, as a loop of setFrequency()
+//   and sleeps would;
+// - Adaptive dwell: list order, leaving once the stale fields are in;
+// - Adaptive: by stale fields per second of tuner time, too.
+//
+//   WatchlistBench [--seconds <n>] [--warmup <n>] [--budget <tunes/min>]
+//                  [--dwell <ms>] [--seed <n>]
+//
+// --budget may be given more than once; the default runs without a limit
+// and with 20 tunes a minute.
+
+#include "../src/Si4703Sim.h"
+#include "../src/Si4703Watchlist.h"
+#include "BenchUtil.h"
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+namespace {
+
+const int SAMPLE_MS = 100;
+
+struct Options {
+  int seconds = 180;
+  int warmup = 60;
+  std::vector<int> budgets;
+  int dwell = 3000;
+  uint64_t seed = 1;
+};
+
+// What a station does. Intervals are means, in seconds; 0 never changes.
+struct Profile {
+  float frequency;
+  int rssi;
+  double text_interval;
+  double ps_interval;
+  double fade_interval;
+};
+
+const Profile PROFILES[] = {
+    {88.1f, 50, 15, 0, 0},   {89.3f, 45, 15, 0, 0},
+    {90.5f, 40, 15, 0, 20},  {91.7f, 55, 60, 30, 0},
+    {93.1f, 35, 60, 0, 20},  {94.5f, 50, 60, 0, 0},
+    {95.9f, 45, 300, 0, 0},  {97.3f, 40, 300, 30, 20},
+    {98.7f, 55, 300, 0, 0},  {100.1f, 50, 0, 0, 0},
+    {101.5f, 45, 0, 0, 20},  {103.1f, 15, 0, 0, 0},
+};
+const int STATIONS = sizeof(PROFILES) / sizeof(PROFILES[0]);
+
+// xorshift64*.
+struct Truth {
+  int rssi;
+  std::string ps;  // Padded to 8.
+  std::string radio_text;
+};
+
+// Changes the simulated stations on their schedules, and keeps what they
+// send.
+class Broadcast {
+ public:
+  Broadcast(Si4703_SimulatedChip* chip, uint64_t seed)
+      : chip_(chip), random_(seed), stop_(false), changes_(0) {
+    for (int i = 0; i < STATIONS; i++) {
+      const Profile& profile = PROFILES[i];
+      Si4703_SimulatedChip::Transmitter tx{
+          profile.frequency, static_cast<uint16_t>(0xC201 + i),
+          profile.rssi, true, Name(i, 0), Text(i, 0), {}};
+      chip_->addTransmitter(tx);
+      truth_.push_back(Truth{profile.rssi, Name(i, 0), Text(i, 0)});
+      texts_.push_back(0);
+      names_.push_back(0);
+    }
+  }
+
+  void start() { thread_ = std::thread(&Broadcast::run, this); }
+
+  ~Broadcast() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable())
+      thread_.join();
+  }
+
+  std::vector<Truth> truth() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return truth_;
+  }
+
+  int changes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return changes_;
+  }
+
+ private:
+  enum Kind { TEXT, NAME, FADE };
+  struct Event {
+    double at;  // Seconds from start().
+    int station;
+    Kind kind;
+  };
+
+  static std::string Name(int station, int n) {
+    static const char* const NAMES[] = {"NEWS", "MUSIC", "TRAFFIC"};
+    std::string name = n == 0 ? "WATCH" + std::to_string(station)
+                              : NAMES[n % 3];
+    name.resize(8, ' ');
+    return name;
+  }
+
+  static std::string Text(int station, int n) {
+    return "Station " + std::to_string(station) + " now playing song " +
+           std::to_string(n);
+  }
+
+  void schedule(double now, int station, Kind kind) {
+    const Profile& profile = PROFILES[station];
+    const double mean = kind == TEXT ? profile.text_interval
+                        : kind == NAME ? profile.ps_interval
+                                       : profile.fade_interval;
+    if (mean > 0)
+      events_.push_back(Event{now + random_.exponential(mean), station, kind});
+  }
+
+  void run() {
+    for (int i = 0; i < STATIONS; i++) {
+      schedule(0, i, TEXT);
+      schedule(0, i, NAME);
+      schedule(0, i, FADE);
+    }
+    const auto start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+      auto next = std::min_element(
+          events_.begin(), events_.end(),
+          [](const Event& a, const Event& b) { return a.at < b.at; });
+      if (next == events_.end())
+        return;
+      const Event event = *next;
+      events_.erase(next);
+      if (cv_.wait_until(
+              lock,
+              start + std::chrono::duration_cast<
+                          std::chrono::steady_clock::duration>(
+                          std::chrono::duration<double>(event.at)),
+              [this] { return stop_; }))
+        return;
+      Truth& truth = truth_[event.station];
+      const float frequency = PROFILES[event.station].frequency;
+      switch (event.kind) {
+        case TEXT:
+          truth.radio_text = Text(event.station, ++texts_[event.station]);
+          chip_->setRadioText(frequency, truth.radio_text);
+          break;
+        case NAME:
+          truth.ps = Name(event.station, ++names_[event.station]);
+          chip_->setPS(frequency, truth.ps);
+          break;
+        case FADE:
+          // Between 10 dB under and its usual strength, never under 25.
+          truth.rssi = std::max(25, PROFILES[event.station].rssi -
+                                        static_cast<int>(random_.next(11)));
+          chip_->setRSSI(frequency, truth.rssi);
+          break;
+      }
+      changes_++;
+      schedule(event.at, event.station, event.kind);
+    }
+  }
+
+  Si4703_SimulatedChip* chip_;
+  Random random_;
+  std::thread thread_;
+  std::mutex mutex_;  // Protects everything below.
+  std::condition_variable cv_;
+  bool stop_;
+  std::vector<Event> events_;
+  std::vector<Truth> truth_;
+  std::vector<int> texts_;  // Messages sent by each station.
+  std::vector<int> names_;
+  int changes_;
+};
+
+struct Run {
+  const char* name;
+  Si4703_Watchlist::Config config;
+};
+
+struct Result {
+  double fresh[Si4703_WatchReport::FIELDS];  // Fraction right.
+  double fresh_all;
+  double mean_age;  // Seconds, of the fields the station sends.
+  Si4703_Watchlist::Stats stats;
+  std::vector<Si4703_WatchReport> reports;
+};
+
+bool Measure(const Run& run, const Options& options, Result* result) {
+  Si4703_SimulatedChip* chip = new Si4703_SimulatedChip;
+  Broadcast broadcast(chip, options.seed);
+  Si4703_Breakout radio(std::unique_ptr<Si4703_Bus>(chip), -1, -1,
+                        Region::Europe);
+  if (radio.powerOn() != Status::SUCCESS)
+    return false;
+  std::vector<float> frequencies;
+  for (const Profile& profile : PROFILES)
+    frequencies.push_back(profile.frequency);
+  Si4703_Watchlist watchlist(&radio, frequencies, run.config);
+  broadcast.start();
+  watchlist.start();
+
+  int right[Si4703_WatchReport::FIELDS] = {0};
+  int samples[Si4703_WatchReport::FIELDS] = {0};
+  double age_sum = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 1; i * SAMPLE_MS <= (options.warmup + options.seconds) * 1000;
+       i++) {
+    std::this_thread::sleep_until(start + std::chrono::milliseconds(
+                                              i * SAMPLE_MS));
+    if (i * SAMPLE_MS <= options.warmup * 1000)
+      continue;
+    const std::vector<Truth> truth = broadcast.truth();
+    const std::vector<Si4703_WatchReport> reports = watchlist.reports();
+    for (int s = 0; s < STATIONS; s++) {
+      const Si4703_WatchReport& report = reports[s];
+      const bool rds = PROFILES[s].rssi >= 20;
+      const bool ok[Si4703_WatchReport::FIELDS] = {
+          std::abs(report.rssi - truth[s].rssi) < 3,
+          report.pi == 0xC201 + s, report.ps == truth[s].ps,
+          report.radio_text == truth[s].radio_text};
+      for (int f = 0; f < Si4703_WatchReport::FIELDS; f++) {
+        if (f != Si4703_WatchReport::SIGNAL && !rds)
+          continue;
+        samples[f]++;
+        right[f] += ok[f];
+        age_sum += report.age[f].count() < 0
+                       ? options.warmup + options.seconds
+                       : report.age[f].count() / 1e3;
+      }
+    }
+  }
+  result->stats = watchlist.stats();
+  result->reports = watchlist.reports();
+  watchlist.stop();
+  radio.powerOff();
+
+  int right_all = 0, samples_all = 0;
+  for (int f = 0; f < Si4703_WatchReport::FIELDS; f++) {
+    result->fresh[f] = static_cast<double>(right[f]) / samples[f];
+    right_all += right[f];
+    samples_all += samples[f];
+  }
+  result->fresh_all = static_cast<double>(right_all) / samples_all;
+  result->mean_age = age_sum / samples_all;
+  return true;
+}
+
+void Print(const Run& run, const Result& result) {
+  cout << "  " << std::left << std::setw(15) << run.name << std::right
+       << std::setw(6) << 100 * result.fresh_all << "%" << std::setw(8)
+       << 100 * result.fresh[Si4703_WatchReport::SIGNAL] << "%"
+       << std::setw(6) << 100 * result.fresh[Si4703_WatchReport::PS] << "%"
+       << std::setw(6) << 100 * result.fresh[Si4703_WatchReport::RT] << "%"
+       << std::setw(9) << result.mean_age << " s" << std::setw(7)
+       << result.stats.tunes << std::setw(9) << result.stats.timeouts
+       << endl;
+}
+
+void PrintStations(const Result& result) {
+  cout << "  MHz     visits  age: signal  PI     PS     RT   RT changes/h"
+       << endl;
+  for (const Si4703_WatchReport& report : result.reports) {
+    cout << "  " << std::setw(5) << report.frequency << std::setw(9)
+         << report.visits << "    ";
+    for (int f = 0; f < Si4703_WatchReport::FIELDS; f++) {
+      if (report.age[f].count() < 0)
+        cout << std::setw(7) << "-";
+      else
+        cout << std::setw(6) << report.age[f].count() / 1e3 << "s";
+    }
+    cout << std::setw(10) << report.changes_per_hour[Si4703_WatchReport::RT]
+         << endl;
+  }
+}
+
+int Usage() {
+  cerr << "usage: WatchlistBench [--seconds <n>] [--warmup <n>]"
+       << " [--budget <tunes/min>] [--dwell <ms>] [--seed <n>]" << endl;
+  return 1;
+}
+
+}  // anonymous namespace
+
+int main(int argc, const char** argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--seconds" && has_value)
+      options.seconds = atoi(argv[++i]);
+    else if (arg == "--warmup" && has_value)
+      options.warmup = atoi(argv[++i]);
+    else if (arg == "--budget" && has_value)
+      options.budgets.push_back(atoi(argv[++i]));
+    else if (arg == "--dwell" && has_value)
+      options.dwell = atoi(argv[++i]);
+    else if (arg == "--seed" && has_value)
+      options.seed = strtoull(argv[++i], nullptr, 10);
+    else
+      return Usage();
+  }
+  if (options.budgets.empty())
+    options.budgets = {0, 20};
+  if (options.seconds < 1 || options.warmup < 0 || options.dwell < 100)
+    return Usage();
+  cout << std::fixed << std::setprecision(1);
+  cout << STATIONS << " stations, " << options.seconds << " s after "
+       << options.warmup << " s of warm-up" << endl;
+
+  for (int budget : options.budgets) {
+    Run runs[3];
+    runs[0].name = "Fixed";
+    runs[0].config.adaptive_order = false;
+    runs[0].config.adaptive_dwell = false;
+    runs[1].name = "Adaptive dwell";
+    runs[1].config.adaptive_order = false;
+    runs[2].name = "Adaptive";
+    Result results[3];
+    cout << endl;
+    if (budget > 0)
+      cout << budget << " tunes a minute:" << endl;
+    else
+      cout << "No tune budget:" << endl;
+    cout << "                  fresh  signal    PS    RT  mean age  tunes"
+         << "  timeouts" << endl;
+    for (int i = 0; i < 3; i++) {
+      runs[i].config.tunes_per_minute = budget;
+      runs[i].config.max_dwell = std::chrono::milliseconds(options.dwell);
+      if (!Measure(runs[i], options, &results[i])) {
+        cerr << "Could not power on the tuner" << endl;
+        return 1;
+      }
+      Print(runs[i], results[i]);
+    }
+    PrintStations(results[2]);
+  }
+  return 0;
+}
@@ -0,0 +1,133 @@
+// The tuner daemon: owns the Si4703 and serves clients over a Unix socket,
+// see src/Si4703Protocol.h.
+
+#include "../src/Si4703Daemon.h"
+#include "../src/Si4703SeekCalibration.h"
+#include "../src/Si4703Sim.h"
+#include "../src/Si4703StatusPage.h"
+#include <signal.h>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using std::cerr;
+using std::endl;
+
+namespace {
+
+Si4703_Daemon* g_daemon = nullptr;
+
+void Stop(int) {
+  if (g_daemon)
+    g_daemon->stop();
+}
+
+int Usage() {
+  cerr << "usage:" << endl;
+  cerr << "  si4703d [-s <socket>] [-r us|europe|japan] [-p <prefix>]"
+       << " [-t <file>] [--sim <tuners>]" << endl;
+  cerr << "where:" << endl;
+  cerr << "  -s:    socket path (default " << si4703d::DEFAULT_SOCKET << ")"
+       << endl;
+  cerr << "  -p:    status page of tuner i is /dev/shm<prefix><i> (default "
+       << "/si4703-), - for none" << endl;
+  cerr << "  -t:    seek thresholds saved by SeekCalibrate" << endl;
+  cerr << "  --sim: serve simulated tuners instead of /dev/i2c-1" << endl;
+  return 1;
+}
+
+// A few stations for --sim, enough to seek, scan and receive RDS.
+void AddStations(Si4703_SimulatedChip* chip) {
+  chip->addTransmitter({88.1f, 0x1001, 42, true, "JAZZ", "Jazz all night", {}});
+  chip->addTransmitter({93.5f, 0x1002, 50, true, "NEWS", "Headlines", {}});
+  chip->addTransmitter({97.3f, 0x1003, 35, true, "ROCK", "Guitar hour", {}});
+  chip->addTransmitter({101.1f, 0x1004, 28, false, "TALK", "Call in", {}});
+  chip->addTransmitter({105.7f, 0x1005, 45, true, "POP", "Top 40", {}});
+}
+
+}  // anonymous namespace
+
+int main(int argc, const char** argv) {
+  Si4703_Daemon::Config config;
+  Region region = Region::US;
+  int sim_tuners = 0;
+  std::string page_prefix = "/si4703-";
+  std::string thresholds_path;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (i + 1 >= argc)
+      return Usage();
+    const std::string value = argv[++i];
+    if (arg == "-s") {
+      config.socket_path = value;
+    } else if (arg == "-t") {
+      thresholds_path = value;
+    } else if (arg == "-p") {
+      page_prefix = value == "-" ? "" : value;
+    } else if (arg == "-r") {
+      if (value == "us")
+        region = Region::US;
+      else if (value == "europe")
+        region = Region::Europe;
+      else if (value == "japan")
+        region = Region::Japan;
+      else
+        return Usage();
+    } else if (arg == "--sim") {
+      sim_tuners = atoi(value.c_str());
+    } else {
+      return Usage();
+    }
+  }
+
+  std::vector<std::unique_ptr<Si4703_Breakout>> radios;
+  if (sim_tuners > 0) {
+    for (int i = 0; i < sim_tuners; i++) {
+      Si4703_SimulatedChip* chip = new Si4703_SimulatedChip;
+      AddStations(chip);
+      radios.emplace_back(new Si4703_Breakout(
+          std::unique_ptr<Si4703_Bus>(chip), -1, -1, region));
+    }
+  } else {
+    const int resetPin = 23;  // GPIO_23.
+    const int sdaPin = 0;     // GPIO_0 (SDA).
+    radios.emplace_back(new Si4703_Breakout(resetPin, sdaPin, region));
+  }
+
+  std::vector<Si4703_Breakout*> tuners;
+  for (auto& radio : radios) {
+    if (radio->powerOn() != Status::SUCCESS) {
+      cerr << "Could not power on the tuner" << endl;
+      return 1;
+    }
+    radio->setVolume(5);
+    Si4703_SeekThresholds thresholds = radio->seekThresholds();
+    if (!thresholds_path.empty()) {
+      if (Si4703_SeekCalibration::load(thresholds_path, &thresholds) !=
+          Status::SUCCESS)
+        return 1;
+      radio->setSeekThresholds(thresholds);
+    }
+    radio->setFrequency(radio->minFrequency());
+    tuners.push_back(radio.get());
+  }
+
+  std::vector<std::unique_ptr<Si4703_StatusPublisher>> pages;
+  for (size_t i = 0; i < tuners.size() && !page_prefix.empty(); i++) {
+    pages.emplace_back(new Si4703_StatusPublisher(
+        tuners[i], page_prefix + std::to_string(i)));
+    if (pages.back()->open() != Status::SUCCESS)
+      return 1;
+  }
+
+  Si4703_Daemon daemon(tuners, config);
+  if (daemon.start() != Status::SUCCESS)
+    return 1;
+  g_daemon = &daemon;
+  signal(SIGINT, Stop);
+  signal(SIGTERM, Stop);
+  daemon.run();
+  g_daemon = nullptr;
+  return 0;
+}
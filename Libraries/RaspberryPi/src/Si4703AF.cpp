@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <cmath>
+
+#include "Si4703AF.h"
+
+namespace {
+
+// Method A alternative frequency codes, see IEC 62106 section 3.2.1.6.1.
+const uint8_t AF_FIRST = 1;     // 87.6 MHz.
+const uint8_t AF_LAST = 204;    // 107.9 MHz.
+const uint8_t AF_LFMF = 250;    // An LF/MF frequency follows.
+
+bool SameFrequency(float a, float b) {
+  return std::fabs(a - b) < 0.01f;
+}
+
+std::chrono::microseconds Since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+}
+
+}  // anonymous namespace
+
+Si4703_AFList::Si4703_AFList() : pi_(0), skip_next_(false) {}
+
+void Si4703_AFList::clear() {
+  pi_ = 0;
+  frequencies_.clear();
+  skip_next_ = false;
+}
+
+void Si4703_AFList::addGroup(const RdsGroup& group) {
+  if (group.pi() != pi_) {
+    clear();
+    pi_ = group.pi();
+  }
+  // Only version A of group 0 carries AF codes in block C.
+  if (group.type() != 0 || group.version() != 0)
+    return;
+  addCode(group.blocks[2] >> 8);
+  addCode(group.blocks[2] & 0xFF);
+}
+
+void Si4703_AFList::addCode(uint8_t code) {
+  if (skip_next_) {
+    skip_next_ = false;
+    return;
+  }
+  if (code == AF_LFMF) {
+    skip_next_ = true;
+    return;
+  }
+  // Number-of-AF codes (224..249) and fillers carry no frequency.
+  if (code < AF_FIRST || code > AF_LAST)
+    return;
+  const float frequency = 87.5f + code / 10.0f;
+  for (float f : frequencies_) {
+    if (SameFrequency(f, frequency))
+      return;
+  }
+  frequencies_.push_back(frequency);
+}
+
+Si4703_AFFollower::Si4703_AFFollower(Si4703_Breakout* radio)
+    : Si4703_AFFollower(radio, Config()) {}
+
+Si4703_AFFollower::Si4703_AFFollower(Si4703_Breakout* radio,
+                                     const Config& config)
+    : radio_(radio),
+      config_(config),
+      last_pi_(0),
+      next_probe_(0),
+      next_probe_at_(Clock::now()),
+      stats_{0, 0, 0, std::chrono::microseconds(0),
+             std::chrono::microseconds(0)} {
+  listener_id_ = radio_->addRdsGroupListener(
+      [this](const RdsGroup& group) { onGroup(group); });
+}
+
+Si4703_AFFollower::~Si4703_AFFollower() {
+  radio_->removeRdsGroupListener(listener_id_);
+}
+
+void Si4703_AFFollower::onGroup(const RdsGroup& group) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  last_pi_ = group.pi();
+  if (af_list_.pi() != group.pi())
+    probes_.clear();
+  af_list_.addGroup(group);
+  pi_cv_.notify_all();
+}
+
+std::vector<float> Si4703_AFFollower::alternatives() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return af_list_.frequencies();
+}
+
+Si4703_AFFollower::Stats Si4703_AFFollower::stats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void Si4703_AFFollower::update() {
+  const Clock::time_point now = Clock::now();
+  const int rssi = radio_->signalStrength();
+  float probe_frequency;
+  uint16_t pi;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (now < next_probe_at_)
+      return;
+    next_probe_at_ = now + config_.probe_interval;
+    if (rssi >= config_.probe_below_rssi || af_list_.frequencies().empty())
+      return;
+    pi = af_list_.pi();
+    const std::vector<float>& afs = af_list_.frequencies();
+    probe_frequency = afs[next_probe_++ % afs.size()];
+  }
+
+  const float current = radio_->getFrequency();
+  if (SameFrequency(probe_frequency, current))
+    return;
+
+  const Clock::time_point start = Clock::now();
+  const int probe_rssi = radio_->probeRSSI(probe_frequency);
+  const std::chrono::microseconds probe_time = Since(start);
+
+  float best_frequency = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.probes++;
+    stats_.probe_time += probe_time;
+    if (probe_rssi < 0)
+      return;
+    probes_.erase(std::remove_if(probes_.begin(), probes_.end(),
+                                 [&](const Probe& p) {
+                                   return SameFrequency(p.frequency,
+                                                        probe_frequency) ||
+                                          start - p.when >
+                                              config_.probe_max_age;
+                                 }),
+                  probes_.end());
+    probes_.push_back(Probe{probe_frequency, probe_rssi, start});
+
+    int best_rssi = rssi + config_.hysteresis;
+    for (const Probe& p : probes_) {
+      if (SameFrequency(p.frequency, current))
+        continue;
+      if (p.rssi >= best_rssi) {
+        best_rssi = p.rssi;
+        best_frequency = p.frequency;
+      }
+    }
+  }
+
+  if (best_frequency != 0 && !switchTo(best_frequency, pi))
+    switchTo(current, pi);
+}
+
+// Retune to |frequency| and wait for a group carrying |pi|. Returns false
+// if another PI code, or none at all, arrived within the timeout.
+bool Si4703_AFFollower::switchTo(float frequency, uint16_t pi) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    last_pi_ = 0;
+  }
+  const Clock::time_point start = Clock::now();
+  radio_->setFrequency(frequency);
+  const std::chrono::microseconds switch_time = Since(start);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  stats_.switches++;
+  stats_.switch_time += switch_time;
+  pi_cv_.wait_for(lock, config_.pi_timeout, [this] { return last_pi_ != 0; });
+  if (last_pi_ == pi) {
+    // Its probe is from before it was tuned; the tuned RSSI replaces it.
+    probes_.erase(std::remove_if(probes_.begin(), probes_.end(),
+                                 [&](const Probe& p) {
+                                   return SameFrequency(p.frequency, frequency);
+                                 }),
+                  probes_.end());
+    return true;
+  }
+  stats_.rejected++;
+  probes_.clear();
+  return false;
+}
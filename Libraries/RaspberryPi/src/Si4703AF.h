@@ -0,0 +1,108 @@
+//
+// Alternative frequency (AF) following.
+//
+// RDS group 0A carries the list of other transmitters broadcasting the same
+// programme. When the current signal fades, Si4703_AFFollower probes those
+// alternatives with short muted RSSI measurements and retunes when one beats
+// the current signal by a hysteresis margin, confirming the PI code after
+// the switch.
+//
+
+#ifndef Si4703AF_h
+#define Si4703AF_h
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include <inttypes.h>
+
+#include "SparkFunSi4703.h"
+
+// Decodes method A AF lists from the block C of 0A groups. The list is tied
+// to the PI code it was received with and starts over when the PI changes.
+class Si4703_AFList {
+ public:
+  Si4703_AFList();
+
+  void addGroup(const RdsGroup& group);
+  void clear();
+
+  uint16_t pi() const { return pi_; }
+  // Alternative frequencies in MHz, in the order they were received.
+  const std::vector<float>& frequencies() const { return frequencies_; }
+
+ private:
+  void addCode(uint8_t code);
+
+  uint16_t pi_;
+  std::vector<float> frequencies_;
+  bool skip_next_;  // The next code is an LF/MF frequency.
+};
+
+class Si4703_AFFollower {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Config {
+    // Only probe while the current signal is weaker than this (dBuV).
+    int probe_below_rssi = 30;
+    // Time between two probes. Each probe mutes the audio for two tunes.
+    std::chrono::milliseconds probe_interval{1000};
+    // An alternative must beat the current signal by this much to switch.
+    int hysteresis = 6;  // dB.
+    // Probe results older than this are not used for a switch decision.
+    std::chrono::milliseconds probe_max_age{5000};
+    // How long to wait for the PI code after a switch before going back.
+    std::chrono::milliseconds pi_timeout{1500};
+  };
+
+  struct Stats {
+    int probes;
+    int switches;
+    int rejected;  // Switches undone because the PI code didn't match.
+    // Wall time the tuner spent away from the audio in probes and switches.
+    std::chrono::microseconds probe_time;
+    std::chrono::microseconds switch_time;
+  };
+
+  Si4703_AFFollower(Si4703_Breakout* radio, const Config& config);
+  explicit Si4703_AFFollower(Si4703_Breakout* radio);
+  ~Si4703_AFFollower();
+
+  // Run one step of the follower: at most one probe and, if that probe
+  // found a better transmitter, one switch. Call it regularly from the
+  // application loop; it returns at once when nothing is due.
+  void update();
+
+  // The alternatives of the current programme in MHz.
+  std::vector<float> alternatives();
+
+  Stats stats();
+
+ private:
+  struct Probe {
+    float frequency;
+    int rssi;
+    Clock::time_point when;
+  };
+
+  void onGroup(const RdsGroup& group);
+  bool switchTo(float frequency, uint16_t pi);
+
+  Si4703_Breakout* radio_;
+  Config config_;
+  int listener_id_;
+
+  std::mutex mutex_;  // Protects everything below.
+  std::condition_variable pi_cv_;
+  Si4703_AFList af_list_;
+  uint16_t last_pi_;  // PI of the latest group received.
+  std::vector<Probe> probes_;
+  size_t next_probe_;
+  Clock::time_point next_probe_at_;
+  Stats stats_;
+};
+
+#endif
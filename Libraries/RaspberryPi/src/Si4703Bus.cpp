@@ -0,0 +1,92 @@
+#include <stdio.h>
+
+#include <fcntl.h>
+#include <linux/i2c-dev.h>
+#include <linux/i2c.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "Si4703Bus.h"
+#include "Si4703Core.h"
+
+Si4703_LinuxI2CBus::Si4703_LinuxI2CBus(const std::string& device)
+    : device_(device), fd_(-1), combined_(false) {}
+
+Si4703_LinuxI2CBus::~Si4703_LinuxI2CBus() {
+  if (fd_ >= 0)
+    close(fd_);
+}
+
+Status Si4703_LinuxI2CBus::open() {
+  if (fd_ >= 0)
+    return Status::SUCCESS;
+
+  // Open I2C slave device.
+  if ((fd_ = ::open(device_.c_str(), O_RDWR)) < 0) {
+    perror(device_.c_str());
+    return Status::FAIL;
+  }
+
+  // Set device address 0x10.
+  if (ioctl(fd_, I2C_SLAVE, si4703::I2C_ADDRESS) < 0) {
+    perror("Failed to acquire bus access and/or talk to slave");
+    close(fd_);
+    fd_ = -1;  // So the next open() tries again.
+    return Status::FAIL;
+  }
+
+  if (ioctl(fd_, I2C_PEC, 1) < 0) {  // Enable "Packet Error Checking".
+    perror("Failed to enable PEC");
+    close(fd_);
+    fd_ = -1;
+    return Status::FAIL;
+  }
+
+  // SMBus-only adapters can't do combined transfers.
+  unsigned long funcs = 0;
+  combined_ = ioctl(fd_, I2C_FUNCS, &funcs) == 0 && (funcs & I2C_FUNC_I2C);
+
+  return Status::SUCCESS;
+}
+
+Status Si4703_LinuxI2CBus::read(uint8_t* buffer, int length) {
+  if (::read(fd_, buffer, length) != length) {
+    perror("Could not read from I2C slave device");
+    return Status::FAIL;
+  }
+  return Status::SUCCESS;
+}
+
+Status Si4703_LinuxI2CBus::write(const uint8_t* buffer, int length) {
+  if (::write(fd_, buffer, length) < length) {
+    perror("Could not write to I2C slave device");
+    return Status::FAIL;
+  }
+  return Status::SUCCESS;
+}
+
+Status Si4703_LinuxI2CBus::transfer(const Si4703_BusMessage* messages,
+                                    int count) {
+  if (!combined_ || count > I2C_RDWR_IOCTL_MAX_MSGS)
+    return Si4703_Bus::transfer(messages, count);
+  i2c_msg msgs[I2C_RDWR_IOCTL_MAX_MSGS];
+  for (int i = 0; i < count; i++) {
+    msgs[i].addr = si4703::I2C_ADDRESS;
+    msgs[i].flags = messages[i].read ? I2C_M_RD : 0;
+    msgs[i].len = messages[i].length;
+    msgs[i].buf = messages[i].buffer;
+  }
+  i2c_rdwr_ioctl_data data = {msgs, static_cast<uint32_t>(count)};
+  if (ioctl(fd_, I2C_RDWR, &data) != count) {
+    perror("Could not transfer to I2C slave device");
+    return Status::FAIL;
+  }
+  return Status::SUCCESS;
+}
+
+Status Si4703_LinuxI2CBus::reset() {
+  if (fd_ >= 0)
+    close(fd_);
+  fd_ = -1;
+  return open();
+}
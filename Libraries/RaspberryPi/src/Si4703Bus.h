@@ -0,0 +1,78 @@
+//
+// The 2-wire bus the Si4703_Breakout talks to the chip over.
+//
+
+#ifndef Si4703Bus_h
+#define Si4703Bus_h
+
+#include <string>
+
+#include <inttypes.h>
+
+enum class Status { SUCCESS, FAIL };
+
+// One read or write of a combined transfer, see Si4703_Bus::transfer().
+struct Si4703_BusMessage {
+  bool read;  // Else a write.
+  uint8_t* buffer;
+  int length;
+};
+
+// A Si4703 bus transfer has no register address: a read always starts at the
+// upper byte of 0x0A and a write always starts at 0x02. Implementations only
+// move bytes; Si4703Core.h does the encoding.
+class Si4703_Bus {
+ public:
+  virtual ~Si4703_Bus() {}
+
+  // Acquire the bus. Called by Si4703_Breakout::powerOn() after the reset
+  // pulse has put the chip into 2-wire mode.
+  virtual Status open() = 0;
+
+  // Read |length| bytes starting at register 0x0A into |buffer|.
+  virtual Status read(uint8_t* buffer, int length) = 0;
+
+  // Write |length| bytes starting at register 0x02 from |buffer|.
+  virtual Status write(const uint8_t* buffer, int length) = 0;
+
+  // Do the |count| reads and writes of |messages| in order, stopping at the
+  // first that fails. A bus that can sends them as one combined transaction
+  // (repeated starts, one stop), e.g. a control write and the status read
+  // that follows it in one kernel round trip.
+  virtual Status transfer(const Si4703_BusMessage* messages, int count) {
+    for (int i = 0; i < count; i++) {
+      const Si4703_BusMessage& m = messages[i];
+      if ((m.read ? read(m.buffer, m.length) : write(m.buffer, m.length)) !=
+          Status::SUCCESS)
+        return Status::FAIL;
+    }
+    return Status::SUCCESS;
+  }
+
+  // Acquire the bus again after the chip was reset to recover from bus
+  // errors, e.g. to clear a wedged adapter.
+  virtual Status reset() { return open(); }
+};
+
+// The Linux i2c-dev bus, e.g. /dev/i2c-1 on a Raspberry Pi.
+class Si4703_LinuxI2CBus : public Si4703_Bus {
+ public:
+  explicit Si4703_LinuxI2CBus(const std::string& device = "/dev/i2c-1");
+  ~Si4703_LinuxI2CBus() override;
+
+  Status open() override;
+  Status read(uint8_t* buffer, int length) override;
+  Status write(const uint8_t* buffer, int length) override;
+  // One I2C_RDWR ioctl for up to I2C_RDWR_IOCTL_MAX_MSGS messages, if the
+  // adapter does plain I2C.
+  Status transfer(const Si4703_BusMessage* messages, int count) override;
+  // Closes and reopens the device.
+  Status reset() override;
+
+ private:
+  std::string device_;
+  int fd_;  // I2C file descriptor.
+  bool combined_;  // The adapter supports I2C_RDWR.
+};
+
+#endif
@@ -0,0 +1,123 @@
+//
+// Little-endian integers, varints and whole-buffer file I/O, shared by the
+// on-disk formats (survey log, RDS journal, bus trace), the status page
+// records and the si4703d wire protocol. Internal to the library.
+//
+
+#ifndef Si4703Bytes_h
+#define Si4703Bytes_h
+
+#include <vector>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <unistd.h>
+
+namespace si4703bytes {
+
+inline void putU16(uint8_t* p, uint16_t value) {
+  p[0] = value & 0xFF;
+  p[1] = value >> 8;
+}
+
+inline void putU32(uint8_t* p, uint32_t value) {
+  putU16(p, value & 0xFFFF);
+  putU16(p + 2, value >> 16);
+}
+
+inline void putU64(uint8_t* p, uint64_t value) {
+  putU32(p, value & 0xFFFFFFFF);
+  putU32(p + 4, value >> 32);
+}
+
+inline uint16_t getU16(const uint8_t* p) {
+  return p[0] | (p[1] << 8);
+}
+
+inline uint32_t getU32(const uint8_t* p) {
+  return getU16(p) | (static_cast<uint32_t>(getU16(p + 2)) << 16);
+}
+
+inline uint64_t getU64(const uint8_t* p) {
+  return getU32(p) | (static_cast<uint64_t>(getU32(p + 4)) << 32);
+}
+
+// LEB128: seven bits a byte, low bits first, the top bit set on all but
+// the last byte.
+inline void putVarint(std::vector<uint8_t>* out, uint64_t value) {
+  while (value >= 0x80) {
+    out->push_back((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  out->push_back(value);
+}
+
+// Read a varint at |*pos| of |data| and move |*pos| past it. Returns false
+// if |data| ends within the varint.
+inline bool getVarint(const uint8_t* data,
+                      size_t length,
+                      size_t* pos,
+                      uint64_t* value) {
+  *value = 0;
+  for (int shift = 0; *pos < length && shift < 64; shift += 7) {
+    const uint8_t byte = data[(*pos)++];
+    *value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+// Write all of |data| at the file position of |fd|, retrying short writes
+// and EINTR.
+inline bool writeAll(int fd, const uint8_t* data, size_t length) {
+  while (length) {
+    const ssize_t n = write(fd, data, length);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    data += n;
+    length -= n;
+  }
+  return true;
+}
+
+// As above at |offset|, leaving the file position alone.
+inline bool writeAll(int fd,
+                     const uint8_t* data,
+                     size_t length,
+                     uint64_t offset) {
+  while (length) {
+    const ssize_t n = pwrite(fd, data, length, offset);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    data += n;
+    length -= n;
+    offset += n;
+  }
+  return true;
+}
+
+// Read exactly |length| bytes at |offset|. Returns false on an error or if
+// the file ends first.
+inline bool readAll(int fd, uint8_t* data, size_t length, uint64_t offset) {
+  while (length) {
+    const ssize_t n = pread(fd, data, length, offset);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    data += n;
+    length -= n;
+    offset += n;
+  }
+  return true;
+}
+
+}  // namespace si4703bytes
+
+#endif
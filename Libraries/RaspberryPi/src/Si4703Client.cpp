@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <cmath>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Si4703Client.h"
+
+using namespace si4703d;
+
+namespace {
+
+const size_t READ_CHUNK = 4096;
+
+std::string Name(const uint8_t* p) {
+  std::string name(reinterpret_cast<const char*>(p), 8);
+  name.erase(name.find_last_not_of(' ') + 1);
+  return name;
+}
+
+}  // anonymous namespace
+
+Si4703_Client::Si4703_Client() : fd_(-1), next_id_(1) {}
+
+Si4703_Client::~Si4703_Client() {
+  if (fd_ >= 0)
+    close(fd_);
+}
+
+Status Si4703_Client::connect(const std::string& path) {
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+  fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd_ < 0 || ::connect(fd_, reinterpret_cast<sockaddr*>(&address),
+                           sizeof(address)) < 0) {
+    perror(path.c_str());
+    return Status::FAIL;
+  }
+  return Status::SUCCESS;
+}
+
+uint32_t Si4703_Client::send(uint8_t type,
+                             uint8_t tuner,
+                             const uint8_t* body,
+                             uint16_t length) {
+  const uint32_t id = next_id_++;
+  if (next_id_ == 0)
+    next_id_ = 1;  // 0 marks events.
+  std::vector<uint8_t> frame(HEADER_LENGTH + length);
+  putHeader(frame.data(), Header{length, type, tuner, id});
+  std::copy(body, body + length, frame.begin() + HEADER_LENGTH);
+
+  size_t sent = 0;
+  while (sent < frame.size()) {
+    const ssize_t n =
+        ::send(fd_, frame.data() + sent, frame.size() - sent, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return 0;
+    sent += n;
+  }
+  return id;
+}
+
+Status Si4703_Client::receive(Frame* frame) {
+  while (true) {
+    if (in_.size() >= static_cast<size_t>(HEADER_LENGTH)) {
+      const Header header = getHeader(in_.data());
+      const size_t length = HEADER_LENGTH + header.length;
+      if (in_.size() >= length) {
+        frame->header = header;
+        frame->body.assign(in_.begin() + HEADER_LENGTH, in_.begin() + length);
+        in_.erase(in_.begin(), in_.begin() + length);
+        return Status::SUCCESS;
+      }
+    }
+    const size_t size = in_.size();
+    in_.resize(size + READ_CHUNK);
+    const ssize_t n = recv(fd_, in_.data() + size, READ_CHUNK, 0);
+    in_.resize(size + std::max<ssize_t>(n, 0));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return Status::FAIL;
+  }
+}
+
+Status Si4703_Client::await(uint32_t id, Frame* frame) {
+  while (true) {
+    if (receive(frame) != Status::SUCCESS)
+      return Status::FAIL;
+    if (frame->header.id == id && (frame->header.type & RESPONSE))
+      return Status::SUCCESS;
+    if (frame->header.type == RDS_GROUPS)
+      dispatchEvent(*frame);
+  }
+}
+
+void Si4703_Client::dispatchEvent(const Frame& frame) {
+  if (!rds_listener_ || frame.body.empty())
+    return;
+  const size_t count = std::min<size_t>(
+      frame.body[0], (frame.body.size() - 1) / GROUP_LENGTH);
+  std::vector<RdsGroup> groups(count);
+  const auto now = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < count; i++) {
+    for (int b = 0; b < 4; b++)
+      groups[i].blocks[b] =
+          getU16(frame.body.data() + 1 + i * GROUP_LENGTH + b * 2);
+    groups[i].received = now;
+  }
+  rds_listener_(frame.header.tuner, groups);
+}
+
+Status Si4703_Client::request(uint8_t type,
+                              uint8_t tuner,
+                              const uint8_t* body,
+                              uint16_t length,
+                              Frame* response) {
+  const uint32_t id = send(type, tuner, body, length);
+  if (!id || await(id, response) != Status::SUCCESS)
+    return Status::FAIL;
+  if (response->body.empty() || response->body[0] != OK)
+    return Status::FAIL;
+  return Status::SUCCESS;
+}
+
+Status Si4703_Client::tune(uint8_t tuner, float frequency, float* tuned) {
+  uint8_t body[2];
+  putU16(body, static_cast<uint16_t>(std::lround(frequency * 100)));
+  Frame response;
+  if (request(TUNE, tuner, body, sizeof(body), &response) != Status::SUCCESS ||
+      response.body.size() < 3)
+    return Status::FAIL;
+  if (tuned)
+    *tuned = getU16(response.body.data() + 1) / 100.0f;
+  return Status::SUCCESS;
+}
+
+Status Si4703_Client::seek(uint8_t tuner,
+                           SeekDirection direction,
+                           float* found) {
+  const uint8_t up = direction == SeekDirection::Up;
+  Frame response;
+  if (request(SEEK, tuner, &up, 1, &response) != Status::SUCCESS ||
+      response.body.size() < 3)
+    return Status::FAIL;
+  if (found)
+    *found = getU16(response.body.data() + 1) / 100.0f;
+  return Status::SUCCESS;
+}
+
+Status Si4703_Client::setVolume(uint8_t tuner, int volume) {
+  const uint8_t body = std::max(0, std::min(volume, 15));
+  Frame response;
+  return request(VOLUME, tuner, &body, 1, &response);
+}
+
+Status Si4703_Client::status(uint8_t tuner, Si4703_TunerStatus* status) {
+  Frame response;
+  if (request(STATUS, tuner, nullptr, 0, &response) != Status::SUCCESS ||
+      response.body.size() < static_cast<size_t>(STATUS_LENGTH))
+    return Status::FAIL;
+  const uint8_t* p = response.body.data() + 1;
+  status->frequency = getU16(p) / 100.0f;
+  status->rssi = p[2];
+  status->stereo = p[3] & FLAG_STEREO;
+  status->volume = p[4];
+  status->pi = getU16(p + 5);
+  status->ps = Name(p + 7);
+  return Status::SUCCESS;
+}
+
+Status Si4703_Client::scan(uint8_t tuner,
+                           std::vector<Si4703_ScanEntry>* entries) {
+  Frame response;
+  if (request(SCAN, tuner, nullptr, 0, &response) != Status::SUCCESS ||
+      response.body.size() < 3)
+    return Status::FAIL;
+  const size_t count =
+      std::min<size_t>(getU16(response.body.data() + 1),
+                       (response.body.size() - 3) / SCAN_ENTRY_LENGTH);
+  entries->clear();
+  for (size_t i = 0; i < count; i++) {
+    const uint8_t* p = response.body.data() + 3 + i * SCAN_ENTRY_LENGTH;
+    entries->push_back(Si4703_ScanEntry{getU16(p) / 100.0f, p[2],
+                                        (p[3] & FLAG_STEREO) != 0,
+                                        getU16(p + 4), Name(p + 6)});
+  }
+  return Status::SUCCESS;
+}
+
+Status Si4703_Client::subscribe(uint8_t tuner, bool on) {
+  const uint8_t body = on;
+  Frame response;
+  return request(SUBSCRIBE, tuner, &body, 1, &response);
+}
+
+Status Si4703_Client::stats(std::vector<uint32_t>* counters) {
+  Frame response;
+  if (request(STATS, 0, nullptr, 0, &response) != Status::SUCCESS ||
+      response.body.size() < static_cast<size_t>(STATS_LENGTH))
+    return Status::FAIL;
+  counters->clear();
+  for (int i = 0; i < (STATS_LENGTH - 1) / 4; i++)
+    counters->push_back(getU32(response.body.data() + 1 + i * 4));
+  return Status::SUCCESS;
+}
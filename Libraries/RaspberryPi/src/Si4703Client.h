@@ -0,0 +1,94 @@
+//
+// Client side of the si4703d protocol (see Si4703Protocol.h).
+//
+// The blocking calls send one request and wait for its response. To
+// pipeline, send() several requests and receive() the responses, matching
+// them by id. RDS_GROUPS events that arrive while waiting go to the RDS
+// listener.
+//
+
+#ifndef Si4703Client_h
+#define Si4703Client_h
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <inttypes.h>
+
+#include "Si4703Protocol.h"
+#include "SparkFunSi4703.h"
+
+struct Si4703_TunerStatus {
+  float frequency;  // MHz.
+  int rssi;         // dBuV.
+  bool stereo;
+  int volume;
+  uint16_t pi;  // 0 if none.
+  std::string ps;
+};
+
+struct Si4703_ScanEntry {
+  float frequency;  // MHz.
+  int rssi;         // dBuV.
+  bool stereo;
+  uint16_t pi;  // 0 if none.
+  std::string ps;
+};
+
+class Si4703_Client {
+ public:
+  using RdsListener =
+      std::function<void(uint8_t tuner, const std::vector<RdsGroup>& groups)>;
+
+  struct Frame {
+    si4703d::Header header;
+    std::vector<uint8_t> body;
+  };
+
+  Si4703_Client();
+  ~Si4703_Client();
+
+  Status connect(const std::string& path = si4703d::DEFAULT_SOCKET);
+
+  void setRdsListener(RdsListener listener) { rds_listener_ = listener; }
+
+  // Blocking requests. Each fails if the daemon can't be reached or
+  // doesn't return OK.
+  Status tune(uint8_t tuner, float frequency, float* tuned = nullptr);
+  // |found| is 0 if the seek found nothing.
+  Status seek(uint8_t tuner, SeekDirection direction, float* found = nullptr);
+  Status setVolume(uint8_t tuner, int volume);
+  Status status(uint8_t tuner, Si4703_TunerStatus* status);
+  // Survey every channel; can take half a minute.
+  Status scan(uint8_t tuner, std::vector<Si4703_ScanEntry>* entries);
+  Status subscribe(uint8_t tuner, bool on);
+  // The daemon's counters, in Si4703Protocol.h STATS order.
+  Status stats(std::vector<uint32_t>* counters);
+
+  // Pipelining. send() returns the request id, 0 on failure.
+  uint32_t send(uint8_t type,
+                uint8_t tuner,
+                const uint8_t* body = nullptr,
+                uint16_t length = 0);
+  // Wait for the next frame, events included.
+  Status receive(Frame* frame);
+  // Wait for the response to |id|, handing events to the RDS listener and
+  // dropping responses to other ids.
+  Status await(uint32_t id, Frame* frame);
+
+ private:
+  Status request(uint8_t type,
+                 uint8_t tuner,
+                 const uint8_t* body,
+                 uint16_t length,
+                 Frame* response);
+  void dispatchEvent(const Frame& frame);
+
+  int fd_;
+  uint32_t next_id_;
+  std::vector<uint8_t> in_;  // Received bytes not yet returned as frames.
+  RdsListener rds_listener_;
+};
+
+#endif
@@ -0,0 +1,143 @@
+#include <algorithm>
+
+#include "Si4703CommandQueue.h"
+
+namespace {
+
+bool Empty(const Si4703_Changes& changes) {
+  return changes.frequency <= 0 && changes.volume < 0 && changes.mute < 0;
+}
+
+}  // anonymous namespace
+
+Si4703_CommandQueue::Si4703_CommandQueue(Si4703_Breakout* radio)
+    : radio_(radio),
+      busy_(false),
+      paused_(false),
+      running_(true),
+      stats_{0, 0, 0, 0} {
+  worker_ = std::thread(&Si4703_CommandQueue::workerFunc, this);
+}
+
+Si4703_CommandQueue::~Si4703_CommandQueue() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+  work_cv_.notify_one();
+  worker_.join();
+}
+
+void Si4703_CommandQueue::tune(float frequency, Done done) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (pending_.frequency > 0)
+    stats_.merged++;
+  pending_.frequency = frequency;
+  if (done)
+    tune_waiting_.push_back(done);
+  post();
+}
+
+void Si4703_CommandQueue::setVolume(int volume, Done done) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (pending_.volume >= 0)
+    stats_.merged++;
+  pending_.volume = std::max(0, std::min(volume, 15));
+  if (done)
+    other_waiting_.push_back(done);
+  post();
+}
+
+void Si4703_CommandQueue::setMute(bool mute, Done done) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (pending_.mute >= 0)
+    stats_.merged++;
+  pending_.mute = mute;
+  if (done)
+    other_waiting_.push_back(done);
+  post();
+}
+
+// The caller holds mutex_.
+void Si4703_CommandQueue::post() {
+  stats_.commands++;
+  work_cv_.notify_one();
+}
+
+void Si4703_CommandQueue::flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_cv_.wait(lock, [this] { return !busy_ && Empty(pending_); });
+}
+
+void Si4703_CommandQueue::pause() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_cv_.wait(lock, [this] { return !busy_ && Empty(pending_); });
+  paused_ = true;
+}
+
+void Si4703_CommandQueue::resume() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    paused_ = false;
+  }
+  work_cv_.notify_one();
+}
+
+bool Si4703_CommandQueue::tunePending() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return pending_.frequency > 0;
+}
+
+Si4703_CommandQueue::Stats Si4703_CommandQueue::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void Si4703_CommandQueue::workerFunc() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    // Stopping writes what is pending even while paused.
+    work_cv_.wait(lock, [this] {
+      return !running_ || (!paused_ && !Empty(pending_));
+    });
+    if (Empty(pending_))
+      return;  // Stopped with nothing left to write.
+
+    const Si4703_Changes changes = pending_;
+    pending_ = Si4703_Changes();
+    std::vector<Done> tune_done, other_done;
+    tune_done.swap(tune_waiting_);
+    other_done.swap(other_waiting_);
+    busy_ = true;
+    stats_.applies++;
+    lock.unlock();
+
+    // Only a newer tune cuts a tune short; volume and mute wait for it.
+    bool abandoned = false;
+    Status status = radio_->apply(changes, [&] {
+      std::lock_guard<std::mutex> guard(mutex_);
+      abandoned = pending_.frequency > 0;
+      return abandoned;
+    });
+
+    if (abandoned) {
+      // The first write went through. The tune's callers wait for the
+      // tune that replaced it.
+      status = Status::SUCCESS;
+      lock.lock();
+      stats_.abandoned++;
+      tune_waiting_.insert(tune_waiting_.begin(), tune_done.begin(),
+                           tune_done.end());
+      tune_done.clear();
+      lock.unlock();
+    }
+    for (const Done& done : tune_done)
+      done(status);
+    for (const Done& done : other_done)
+      done(status);
+
+    lock.lock();
+    busy_ = false;
+    idle_cv_.notify_all();
+  }
+}
@@ -0,0 +1,79 @@
+//
+// A latest-wins command queue for one tuner.
+//
+// Bursty input (a volume knob, a user mashing tune-up) shouldn't turn into
+// one bus round trip per event. Si4703_CommandQueue keeps at most one pending
+// value per setting: a newer volume, mute or tune replaces the pending one,
+// and everything pending goes to the chip in a single
+// Si4703_Breakout::apply(). A tune in progress is cut short as soon as a
+// newer tune arrives instead of waiting out its STC cycle.
+//
+
+#ifndef Si4703CommandQueue_h
+#define Si4703CommandQueue_h
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <inttypes.h>
+
+#include "SparkFunSi4703.h"
+
+class Si4703_CommandQueue {
+ public:
+  // Called on the queue's thread once the command, or the newer command of
+  // the same kind that replaced it, has been written to the chip.
+  using Done = std::function<void(Status status)>;
+
+  struct Stats {
+    uint32_t commands;   // Posted.
+    uint32_t merged;     // Replaced by a newer command before being written.
+    uint32_t abandoned;  // Tunes cut short by a newer tune.
+    uint32_t applies;    // Si4703_Breakout::apply() calls.
+  };
+
+  // |radio| must be powered on and outlive the queue.
+  explicit Si4703_CommandQueue(Si4703_Breakout* radio);
+  // Writes whatever is still pending first.
+  ~Si4703_CommandQueue();
+
+  void tune(float frequency, Done done = nullptr);
+  void setVolume(int volume, Done done = nullptr);
+  void setMute(bool mute, Done done = nullptr);
+
+  // Wait until everything posted so far has been written.
+  void flush();
+
+  // Wait until everything posted so far has been written, then hold new
+  // commands back until resume(), for work that drives the radio directly
+  // (a seek or a scan). Don't flush() while paused.
+  void pause();
+  void resume();
+  // True if a tune has been posted but not yet written, e.g. one held back
+  // by pause().
+  bool tunePending() const;
+
+  Stats stats() const;
+
+ private:
+  void post();
+  void workerFunc();
+
+  Si4703_Breakout* radio_;
+  mutable std::mutex mutex_;  // Protects the variables below.
+  std::condition_variable work_cv_;
+  std::condition_variable idle_cv_;
+  Si4703_Changes pending_;
+  std::vector<Done> tune_waiting_;   // Done of the pending tunes.
+  std::vector<Done> other_waiting_;  // Done of pending volume and mute.
+  bool busy_;                        // The worker is applying changes.
+  bool paused_;
+  bool running_;
+  Stats stats_;
+  std::thread worker_;
+};
+
+#endif
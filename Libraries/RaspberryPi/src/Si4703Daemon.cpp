@@ -0,0 +1,613 @@
+#include <algorithm>
+#include <cmath>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Si4703Daemon.h"
+#include "Si4703Survey.h"
+
+using namespace si4703d;
+
+namespace {
+
+// epoll ids of the two fds that aren't connections.
+const uint64_t LISTEN_ID = 0;
+const uint64_t WAKE_ID = 1;
+const uint64_t FIRST_CONNECTION_ID = 2;
+
+const int MAX_EVENTS = 64;
+const size_t READ_CHUNK = 4096;
+// Read at most this much from one client per wakeup, so a client that
+// writes fast can't hold up the others.
+const size_t MAX_READ = 16 * READ_CHUNK;
+// Stop reading from a client with this many requests waiting on a tuner.
+const int MAX_IN_FLIGHT = 64;
+
+std::vector<uint8_t> Frame(uint8_t type,
+                           uint8_t tuner,
+                           uint32_t id,
+                           const std::vector<uint8_t>& body) {
+  std::vector<uint8_t> frame(HEADER_LENGTH + body.size());
+  putHeader(frame.data(),
+            Header{static_cast<uint16_t>(body.size()), type, tuner, id});
+  std::copy(body.begin(), body.end(), frame.begin() + HEADER_LENGTH);
+  return frame;
+}
+
+std::vector<uint8_t> Response(const Header& request,
+                              Result result,
+                              std::vector<uint8_t> body = {}) {
+  body.insert(body.begin(), result);
+  return Frame(request.type | RESPONSE, request.tuner, request.id, body);
+}
+
+// |frequency| in MHz as 10 kHz units.
+uint16_t Units(float frequency) {
+  return static_cast<uint16_t>(std::lround(frequency * 100));
+}
+
+uint32_t CpuMicros() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  const uint64_t us = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) *
+                          1000000ULL +
+                      usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+  return static_cast<uint32_t>(us);
+}
+
+}  // anonymous namespace
+
+Si4703_Daemon::Si4703_Daemon(const std::vector<Si4703_Breakout*>& tuners,
+                             const Config& config)
+    : config_(config),
+      listen_fd_(-1),
+      epoll_fd_(-1),
+      wake_fd_(-1),
+      running_(false),
+      next_connection_(FIRST_CONNECTION_ID),
+      clients_(0),
+      requests_(0),
+      groups_(0),
+      batches_(0),
+      dropped_(0) {
+  for (Si4703_Breakout* radio : tuners) {
+    Tuner* tuner = new Tuner;
+    tuner->radio = radio;
+    tuner->commands.reset(new Si4703_CommandQueue(radio));
+    tuner->listener_id = radio->addRdsGroupListener(
+        [this, tuner](const RdsGroup& group) { onGroup(tuner, group); });
+    tuners_.emplace_back(tuner);
+  }
+}
+
+Si4703_Daemon::~Si4703_Daemon() {
+  running_ = false;
+  // Every worker and RDS listener is gone before the command queues are:
+  // a worker pauses its queue around each job.
+  for (auto& tuner : tuners_) {
+    tuner->radio->removeRdsGroupListener(tuner->listener_id);
+    {
+      std::lock_guard<std::mutex> lock(tuner->job_mutex);
+      tuner->job_cv.notify_all();
+    }
+  }
+  for (auto& tuner : tuners_) {
+    if (tuner->worker.joinable())
+      tuner->worker.join();
+  }
+  for (auto& tuner : tuners_)
+    tuner->commands.reset();
+  for (auto& connection : connections_)
+    close(connection.second.fd);
+  if (listen_fd_ >= 0) {
+    close(listen_fd_);
+    unlink(config_.socket_path.c_str());
+  }
+  if (epoll_fd_ >= 0)
+    close(epoll_fd_);
+  if (wake_fd_ >= 0)
+    close(wake_fd_);
+}
+
+Status Si4703_Daemon::start() {
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (config_.socket_path.size() >= sizeof(address.sun_path)) {
+    fprintf(stderr, "%s: socket path too long\n", config_.socket_path.c_str());
+    return Status::FAIL;
+  }
+  strcpy(address.sun_path, config_.socket_path.c_str());
+
+  unlink(config_.socket_path.c_str());  // Left over from a previous run.
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0 ||
+      bind(listen_fd_, reinterpret_cast<sockaddr*>(&address),
+           sizeof(address)) < 0 ||
+      listen(listen_fd_, SOMAXCONN) < 0) {
+    perror(config_.socket_path.c_str());
+    return Status::FAIL;
+  }
+  // The daemon runs as root for the bus and GPIOs; its clients needn't.
+  chmod(config_.socket_path.c_str(), 0666);
+
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epoll_fd_ < 0 || wake_fd_ < 0) {
+    perror("si4703d");
+    return Status::FAIL;
+  }
+  epoll_event event;
+  event.events = EPOLLIN;
+  event.data.u64 = LISTEN_ID;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &event);
+  event.data.u64 = WAKE_ID;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event);
+
+  running_ = true;
+  for (size_t i = 0; i < tuners_.size(); i++)
+    tuners_[i]->worker = std::thread(&Si4703_Daemon::workerFunc, this, i);
+  return Status::SUCCESS;
+}
+
+void Si4703_Daemon::run() {
+  next_batch_ = std::chrono::steady_clock::now() + config_.batch_interval;
+  epoll_event events[MAX_EVENTS];
+  while (running_) {
+    const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+        next_batch_ - std::chrono::steady_clock::now());
+    const int n = epoll_wait(epoll_fd_, events, MAX_EVENTS,
+                             std::max<int>(0, wait.count() + 1));
+    for (int i = 0; i < n; i++) {
+      const uint64_t id = events[i].data.u64;
+      if (id == LISTEN_ID) {
+        acceptClients();
+      } else if (id == WAKE_ID) {
+        uint64_t count;
+        while (read(wake_fd_, &count, sizeof(count)) > 0) {
+        }
+      } else {
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+          readClient(id, events[i].events & (EPOLLHUP | EPOLLERR));
+        if ((events[i].events & EPOLLOUT) && connections_.count(id)) {
+          if (flush(id))
+            resumeClient(id);
+          else
+            closeClient(id);
+        }
+      }
+    }
+    deliverResponses();
+    deliverGroups();
+  }
+}
+
+void Si4703_Daemon::stop() {
+  running_ = false;
+  wake();
+}
+
+Si4703_Daemon::Stats Si4703_Daemon::stats() const {
+  uint32_t merged = 0;
+  for (const auto& tuner : tuners_) {
+    const Si4703_CommandQueue::Stats stats = tuner->commands->stats();
+    merged += stats.merged + stats.abandoned;
+  }
+  return Stats{clients_, requests_, groups_, batches_, dropped_, merged};
+}
+
+void Si4703_Daemon::wake() {
+  const uint64_t one = 1;
+  if (write(wake_fd_, &one, sizeof(one)) < 0) {
+    // The counter is full, so the loop is due to wake anyway.
+  }
+}
+
+// Called on the tuner's RDS thread.
+void Si4703_Daemon::onGroup(Tuner* tuner, const RdsGroup& group) {
+  groups_++;
+  std::lock_guard<std::mutex> lock(tuner->rds_mutex);
+  tuner->groups.push_back(group);
+  if (tuner->groups.size() == MAX_BATCH)
+    wake();
+}
+
+void Si4703_Daemon::workerFunc(int index) {
+  Tuner& tuner = *tuners_[index];
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(tuner.job_mutex);
+      tuner.job_cv.wait(lock,
+                        [&] { return !running_ || !tuner.jobs.empty(); });
+      if (!running_)
+        return;
+      job = std::move(tuner.jobs.front());
+      tuner.jobs.pop_front();
+    }
+    // Seeks and scans start from where the tunes sent before them left off,
+    // and tunes sent while they run wait for them, as if queued behind.
+    tuner.commands->pause();
+    std::vector<uint8_t> response = execute(index, job);
+    tuner.commands->resume();
+    finish(job.connection, std::move(response));
+  }
+}
+
+// Hand a TUNE or VOLUME to the tuner's command queue.
+void Si4703_Daemon::post(uint64_t connection,
+                         const Header& header,
+                         const uint8_t* body) {
+  Si4703_Breakout* radio = tuners_[header.tuner]->radio;
+  Si4703_CommandQueue* commands = tuners_[header.tuner]->commands.get();
+  if (header.type == VOLUME) {
+    if (body[0] > 15) {
+      finish(connection, Response(header, BAD_REQUEST));
+      return;
+    }
+    commands->setVolume(body[0], [=](Status status) {
+      finish(connection,
+             Response(header, status == Status::SUCCESS ? OK : FAILED));
+    });
+    return;
+  }
+
+  const float frequency = getU16(body) / 100.0f;
+  const float channel =
+      (frequency - radio->minFrequency()) / radio->channelSpacing();
+  if (frequency < radio->minFrequency() ||
+      frequency > radio->maxFrequency() + 0.001f ||
+      std::fabs(channel - std::round(channel)) > 0.01f) {
+    finish(connection, Response(header, BAD_REQUEST));
+    return;
+  }
+  commands->tune(frequency, [=](Status status) {
+    if (status != Status::SUCCESS) {
+      finish(connection, Response(header, FAILED));
+      return;
+    }
+    std::vector<uint8_t> body(2);
+    putU16(body.data(), Units(radio->getFrequency()));
+    finish(connection, Response(header, OK, body));
+  });
+}
+
+// Queue |response| for the run() thread to send. Called on tuner threads.
+void Si4703_Daemon::finish(uint64_t connection,
+                           std::vector<uint8_t> response) {
+  {
+    std::lock_guard<std::mutex> lock(done_mutex_);
+    done_.emplace_back(connection, std::move(response));
+  }
+  wake();
+}
+
+// Run a queued command on the tuner's worker thread.
+std::vector<uint8_t> Si4703_Daemon::execute(int index, const Job& job) {
+  Si4703_Breakout* radio = tuners_[index]->radio;
+  Si4703_CommandQueue* commands = tuners_[index]->commands.get();
+  const Header& request = job.header;
+  switch (request.type) {
+    case SEEK: {
+      const float frequency =
+          radio->seek(job.body[0] ? SeekDirection::Up : SeekDirection::Down);
+      std::vector<uint8_t> body(2);
+      putU16(body.data(), Units(frequency));
+      return Response(request, OK, body);
+    }
+    case SCAN: {
+      const float home = radio->getFrequency();
+      std::vector<Si4703_ChannelReport> reports;
+      {
+        Si4703_SurveyScheduler scheduler({radio});
+        reports = scheduler.run();
+      }
+      // A tune sent during the scan goes through once it's done; going
+      // home first would only cost it a second tune.
+      if (!commands->tunePending())
+        radio->setFrequency(home);
+      std::vector<uint8_t> body(2 + reports.size() * SCAN_ENTRY_LENGTH);
+      putU16(body.data(), reports.size());
+      uint8_t* p = body.data() + 2;
+      for (const Si4703_ChannelReport& report : reports) {
+        putU16(p, Units(report.frequency));
+        p[2] = std::min(report.rssi, 255);
+        p[3] = report.stereo ? FLAG_STEREO : 0;
+        putU16(p + 4, report.pi);
+        putName(p + 6, report.ps.c_str());
+        p += SCAN_ENTRY_LENGTH;
+      }
+      return Response(request, OK, body);
+    }
+  }
+  return Response(request, BAD_REQUEST);
+}
+
+void Si4703_Daemon::acceptClients() {
+  while (true) {
+    const int fd = accept4(listen_fd_, nullptr, nullptr,
+                           SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+      return;
+    const uint64_t id = next_connection_++;
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = id;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+      close(fd);
+      continue;
+    }
+    connections_[id] =
+        Connection{fd, {}, {}, 0, std::vector<bool>(tuners_.size()), EPOLLIN,
+                   0};
+    clients_++;
+  }
+}
+
+void Si4703_Daemon::readClient(uint64_t id, bool hangup) {
+  auto it = connections_.find(id);
+  if (it == connections_.end())
+    return;
+  Connection& connection = it->second;
+  if (hangup && throttled(connection)) {
+    // Gone without reading what it has waiting; nothing more will come of
+    // it, and polling on would only spin on the hangup.
+    closeClient(id);
+    return;
+  }
+  std::vector<uint8_t>& in = connection.in;
+  // Level-triggered, so whatever is left wakes the loop again.
+  for (size_t read = 0; read < MAX_READ && !throttled(connection);
+       read += READ_CHUNK) {
+    const size_t size = in.size();
+    in.resize(size + READ_CHUNK);
+    const ssize_t n = recv(connection.fd, in.data() + size, READ_CHUNK, 0);
+    in.resize(size + std::max<ssize_t>(n, 0));
+    if (n > 0)
+      continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+    closeClient(id);  // EOF or error.
+    return;
+  }
+
+  // Handle complete frames until the client has to catch up; the rest wait
+  // in |in| until it has. handle() may append to |out| but never closes the
+  // connection, so |in| stays valid.
+  size_t pos = 0;
+  while (!throttled(connection) &&
+         in.size() - pos >= static_cast<size_t>(HEADER_LENGTH)) {
+    const Header header = getHeader(in.data() + pos);
+    if (in.size() - pos < static_cast<size_t>(HEADER_LENGTH + header.length))
+      break;
+    handle(id, header, in.data() + pos + HEADER_LENGTH);
+    pos += HEADER_LENGTH + header.length;
+  }
+  in.erase(in.begin(), in.begin() + pos);
+  if (!flush(id))
+    closeClient(id);
+}
+
+// Take requests left unhandled while |id| was throttled, once it no longer
+// is.
+void Si4703_Daemon::resumeClient(uint64_t id) {
+  const auto it = connections_.find(id);
+  if (it != connections_.end() && !it->second.in.empty() &&
+      !throttled(it->second))
+    readClient(id, false);
+}
+
+void Si4703_Daemon::handle(uint64_t id,
+                           const Header& header,
+                           const uint8_t* body) {
+  requests_++;
+  Connection& connection = connections_[id];
+  auto reply = [&](const std::vector<uint8_t>& frame) {
+    connection.out.insert(connection.out.end(), frame.begin(), frame.end());
+  };
+
+  if (header.tuner >= tuners_.size()) {
+    reply(Response(header, BAD_REQUEST));
+    return;
+  }
+  Tuner& tuner = *tuners_[header.tuner];
+  switch (header.type) {
+    case STATUS: {
+      // Only the snapshot, never the chip: a tune or seek under way holds
+      // the register owner lock for up to seconds.
+      Si4703_Breakout* radio = tuner.radio;
+      const Si4703_StatusSnapshot snapshot = radio->status();
+      std::vector<uint8_t> status(STATUS_LENGTH - 1);
+      putU16(status.data(), snapshot.frequency);
+      status[2] = snapshot.rssi;
+      status[3] =
+          (snapshot.flags & Si4703_StatusSnapshot::STEREO) ? FLAG_STEREO : 0;
+      status[4] = snapshot.volume;
+      putU16(status.data() + 5, radio->programId());
+      putName(status.data() + 7, radio->stationName().c_str());
+      reply(Response(header, OK, status));
+      return;
+    }
+    case SUBSCRIBE:
+      if (header.length != 1) {
+        reply(Response(header, BAD_REQUEST));
+        return;
+      }
+      connection.subscriptions[header.tuner] = body[0] != 0;
+      reply(Response(header, OK));
+      return;
+    case STATS: {
+      std::vector<uint8_t> stats(STATS_LENGTH - 1);
+      putU32(stats.data(), clients_);
+      putU32(stats.data() + 4, requests_);
+      putU32(stats.data() + 8, groups_);
+      putU32(stats.data() + 12, batches_);
+      putU32(stats.data() + 16, dropped_);
+      putU32(stats.data() + 20, CpuMicros());
+      putU32(stats.data() + 24, this->stats().merged);
+      reply(Response(header, OK, stats));
+      return;
+    }
+    case TUNE:
+    case SEEK:
+    case VOLUME:
+    case SCAN: {
+      const uint16_t length =
+          header.type == TUNE ? 2 : header.type == SCAN ? 0 : 1;
+      if (header.length != length) {
+        reply(Response(header, BAD_REQUEST));
+        return;
+      }
+      connection.in_flight++;
+      if (header.type == TUNE || header.type == VOLUME) {
+        post(id, header, body);
+        return;
+      }
+      std::lock_guard<std::mutex> lock(tuner.job_mutex);
+      tuner.jobs.push_back(Job{id, header, {body, body + length}});
+      tuner.job_cv.notify_one();
+      return;
+    }
+  }
+  reply(Response(header, BAD_REQUEST));
+}
+
+// Write as much pending output as the socket takes. Returns false if the
+// connection is broken.
+bool Si4703_Daemon::flush(uint64_t id) {
+  Connection& connection = connections_[id];
+  while (connection.out_sent < connection.out.size()) {
+    const ssize_t n =
+        ::send(connection.fd, connection.out.data() + connection.out_sent,
+               connection.out.size() - connection.out_sent,
+               MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n > 0) {
+      connection.out_sent += n;
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+    return false;
+  }
+  if (connection.out_sent == connection.out.size()) {
+    connection.out.clear();
+    connection.out_sent = 0;
+  }
+  updatePolling(id);
+  return true;
+}
+
+// A client isn't read from while it doesn't read its responses, or has too
+// many requests outstanding, so its buffers stay bounded.
+bool Si4703_Daemon::throttled(const Connection& connection) const {
+  return connection.out.size() - connection.out_sent > config_.max_output ||
+         connection.in_flight >= MAX_IN_FLIGHT;
+}
+
+// Poll for EPOLLOUT while output is waiting, and for EPOLLIN unless
+// throttled.
+void Si4703_Daemon::updatePolling(uint64_t id) {
+  Connection& connection = connections_[id];
+  uint32_t events = connection.out.size() > connection.out_sent ? EPOLLOUT : 0;
+  if (!throttled(connection))
+    events |= EPOLLIN;
+  if (events == connection.events)
+    return;
+  epoll_event event;
+  event.events = events;
+  event.data.u64 = id;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, connection.fd, &event);
+  connection.events = events;
+}
+
+void Si4703_Daemon::closeClient(uint64_t id) {
+  auto it = connections_.find(id);
+  if (it == connections_.end())
+    return;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, it->second.fd, nullptr);
+  close(it->second.fd);
+  connections_.erase(it);
+  clients_--;
+}
+
+void Si4703_Daemon::deliverResponses() {
+  std::vector<std::pair<uint64_t, std::vector<uint8_t>>> done;
+  {
+    std::lock_guard<std::mutex> lock(done_mutex_);
+    done.swap(done_);
+  }
+  for (auto& response : done) {
+    auto it = connections_.find(response.first);
+    if (it == connections_.end())
+      continue;  // The client went away while its command ran.
+    it->second.in_flight--;
+    std::vector<uint8_t>& out = it->second.out;
+    out.insert(out.end(), response.second.begin(), response.second.end());
+    if (flush(response.first))
+      resumeClient(response.first);
+    else
+      closeClient(response.first);
+  }
+}
+
+// Send the groups each tuner received since the last batch to its
+// subscribers, when the batch interval is up or a batch is full.
+void Si4703_Daemon::deliverGroups() {
+  const auto now = std::chrono::steady_clock::now();
+  const bool due = now >= next_batch_;
+  if (due)
+    next_batch_ = now + config_.batch_interval;
+
+  std::vector<uint64_t> broken;
+  for (size_t t = 0; t < tuners_.size(); t++) {
+    std::vector<RdsGroup> groups;
+    {
+      std::lock_guard<std::mutex> lock(tuners_[t]->rds_mutex);
+      if (tuners_[t]->groups.empty() ||
+          (!due && tuners_[t]->groups.size() < MAX_BATCH))
+        continue;
+      groups.swap(tuners_[t]->groups);
+    }
+
+    std::vector<uint8_t> frames;
+    int count = 0;
+    for (size_t first = 0; first < groups.size(); first += MAX_BATCH) {
+      const size_t n = std::min<size_t>(MAX_BATCH, groups.size() - first);
+      std::vector<uint8_t> body(1 + n * GROUP_LENGTH);
+      body[0] = n;
+      for (size_t i = 0; i < n; i++) {
+        for (int b = 0; b < 4; b++)
+          putU16(body.data() + 1 + i * GROUP_LENGTH + b * 2,
+                 groups[first + i].blocks[b]);
+      }
+      const std::vector<uint8_t> frame = Frame(RDS_GROUPS, t, 0, body);
+      frames.insert(frames.end(), frame.begin(), frame.end());
+      count++;
+    }
+    batches_ += count;
+
+    for (auto& entry : connections_) {
+      Connection& connection = entry.second;
+      if (!connection.subscriptions[t])
+        continue;
+      if (connection.out.size() - connection.out_sent > config_.max_output) {
+        dropped_ += count;
+        continue;
+      }
+      connection.out.insert(connection.out.end(), frames.begin(), frames.end());
+      if (!flush(entry.first))
+        broken.push_back(entry.first);
+    }
+  }
+  for (uint64_t id : broken)
+    closeClient(id);
+}
@@ -0,0 +1,143 @@
+//
+// si4703d: one process owning the tuners, serving many clients.
+//
+// Each tuner has a Si4703_CommandQueue for tune and volume commands, one
+// worker thread for seeks and scans, and the breakout's own RDS thread.
+// Clients connect to a Unix socket and speak the protocol in
+// Si4703Protocol.h. A single epoll loop serves all of them: it answers
+// status requests from the register snapshot, hands the rest to the tuner
+// and pushes RDS groups to subscribers in batches.
+//
+
+#ifndef Si4703Daemon_h
+#define Si4703Daemon_h
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <inttypes.h>
+
+#include "Si4703CommandQueue.h"
+#include "Si4703Protocol.h"
+#include "SparkFunSi4703.h"
+
+class Si4703_Daemon {
+ public:
+  struct Config {
+    std::string socket_path = si4703d::DEFAULT_SOCKET;
+    // Received RDS groups go out at least this often, or as soon as a
+    // tuner has MAX_BATCH of them.
+    std::chrono::milliseconds batch_interval{100};
+    // A client with more unsent output than this loses RDS batches, and
+    // isn't read from, until it catches up. Responses are never dropped.
+    size_t max_output = 256 * 1024;
+  };
+
+  struct Stats {
+    uint32_t clients;   // Connected now.
+    uint32_t requests;  // Handled since start.
+    uint32_t groups;    // RDS groups received from the tuners.
+    uint32_t batches;   // RDS_GROUPS events sent.
+    uint32_t dropped;   // RDS_GROUPS events dropped for slow clients.
+    uint32_t merged;    // TUNE and VOLUME requests merged into newer ones.
+  };
+
+  // The tuners must be powered on. Tuner i in the protocol is tuners[i].
+  Si4703_Daemon(const std::vector<Si4703_Breakout*>& tuners,
+                const Config& config);
+  ~Si4703_Daemon();
+
+  // Create the socket and start the tuner workers.
+  Status start();
+
+  // Serve clients until stop() is called.
+  void run();
+
+  // Make run() return. Safe to call from a signal handler.
+  void stop();
+
+  Stats stats() const;
+
+ private:
+  struct Connection {
+    int fd;
+    std::vector<uint8_t> in;
+    std::vector<uint8_t> out;
+    size_t out_sent;  // Bytes of |out| already written.
+    // Element i: RDS_GROUPS of tuner i. One per tuner.
+    std::vector<bool> subscriptions;
+    uint32_t events;  // Polled for: EPOLLIN unless throttled, EPOLLOUT.
+    int in_flight;    // Requests handed to a tuner, not answered yet.
+  };
+
+  struct Job {
+    uint64_t connection;
+    si4703d::Header header;
+    std::vector<uint8_t> body;
+  };
+
+  struct Tuner {
+    Si4703_Breakout* radio;
+    std::unique_ptr<Si4703_CommandQueue> commands;
+    int listener_id;
+    std::thread worker;
+    std::mutex job_mutex;  // Protects jobs.
+    std::condition_variable job_cv;
+    std::deque<Job> jobs;
+    std::mutex rds_mutex;  // Protects groups.
+    std::vector<RdsGroup> groups;
+  };
+
+  void onGroup(Tuner* tuner, const RdsGroup& group);
+  void post(uint64_t connection,
+            const si4703d::Header& header,
+            const uint8_t* body);
+  void workerFunc(int tuner);
+  std::vector<uint8_t> execute(int tuner, const Job& job);
+
+  void acceptClients();
+  // |hangup|: the client has closed its end.
+  void readClient(uint64_t id, bool hangup);
+  void resumeClient(uint64_t id);
+  void handle(uint64_t id, const si4703d::Header& header, const uint8_t* body);
+  bool flush(uint64_t id);
+  bool throttled(const Connection& connection) const;
+  void updatePolling(uint64_t id);
+  void closeClient(uint64_t id);
+  void finish(uint64_t connection, std::vector<uint8_t> response);
+  void deliverResponses();
+  void deliverGroups();
+  void wake();
+
+  std::vector<std::unique_ptr<Tuner>> tuners_;
+  Config config_;
+  int listen_fd_;
+  int epoll_fd_;
+  int wake_fd_;  // eventfd: responses or a full RDS batch are waiting.
+  std::atomic<bool> running_;
+
+  // Only touched by the run() thread.
+  std::map<uint64_t, Connection> connections_;
+  uint64_t next_connection_;
+  std::chrono::steady_clock::time_point next_batch_;
+
+  std::mutex done_mutex_;  // Protects done_.
+  std::vector<std::pair<uint64_t, std::vector<uint8_t>>> done_;
+
+  std::atomic<uint32_t> clients_;
+  std::atomic<uint32_t> requests_;
+  std::atomic<uint32_t> groups_;
+  std::atomic<uint32_t> batches_;
+  std::atomic<uint32_t> dropped_;
+};
+
+#endif
@@ -0,0 +1,144 @@
+#include <chrono>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Si4703Gpio.h"
+
+namespace {
+
+// The lines of a Si4703_GpioChip request, by index.
+const int RESET = 0;
+const int SDIO = 1;
+
+// The pulse: RST low with SDIO low, then SDIO held low a little past the
+// rising edge of RST, then a pause before the first bus transfer. Each wait
+// starts once the ioctl that changed the lines has returned, so however
+// long the kernel takes to drive them only adds to it. The datasheet asks
+// for RST low at least 100 us; this gives it twice that. It asks for SDIO
+// to be set up and held for nanoseconds around the edge; the 200 us before
+// and the 10 us after leave plenty to spare.
+const std::chrono::microseconds RESET_LOW(200);
+const std::chrono::microseconds SDIO_HOLD(10);
+const std::chrono::microseconds RESET_RECOVERY(100);
+
+// |start| + |wait|.
+timespec After(const timespec& start, std::chrono::microseconds wait) {
+  timespec time = start;
+  const int64_t nsec = time.tv_nsec + wait.count() * 1000;
+  time.tv_sec += nsec / 1000000000;
+  time.tv_nsec = nsec % 1000000000;
+  return time;
+}
+
+// Sleep |wait| from now, however often a signal interrupts it.
+void SleepFor(std::chrono::microseconds wait) {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  const timespec deadline = After(now, wait);
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline,
+                         nullptr) == EINTR) {
+  }
+}
+
+// Both lines outputs, SDIO low, while a pulse is under way; otherwise RST
+// an output and SDIO an input.
+void LineConfig(bool sdio_output, bool reset_high,
+                gpio_v2_line_config* config) {
+  memset(config, 0, sizeof(*config));
+  config->flags = GPIO_V2_LINE_FLAG_OUTPUT;
+  gpio_v2_line_config_attribute& values = config->attrs[config->num_attrs++];
+  values.attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+  values.attr.values = reset_high ? 1 << RESET : 0;
+  values.mask = 1 << RESET;
+  if (sdio_output) {
+    values.mask |= 1 << SDIO;
+  } else {
+    gpio_v2_line_config_attribute& input = config->attrs[config->num_attrs++];
+    input.attr.id = GPIO_V2_LINE_ATTR_ID_FLAGS;
+    input.attr.flags = GPIO_V2_LINE_FLAG_INPUT;
+    input.mask = 1 << SDIO;
+  }
+}
+
+}  // anonymous namespace
+
+Si4703_GpioChip::Si4703_GpioChip(int reset_line,
+                                 int sdio_line,
+                                 const std::string& chip)
+    : reset_line_(reset_line), sdio_line_(sdio_line), chip_(chip), fd_(-1) {}
+
+Si4703_GpioChip::~Si4703_GpioChip() {
+  if (fd_ >= 0)
+    close(fd_);
+}
+
+Status Si4703_GpioChip::open() {
+  if (fd_ >= 0)
+    return Status::SUCCESS;
+
+  const int chip = ::open(chip_.c_str(), O_RDWR | O_CLOEXEC);
+  if (chip < 0) {
+    perror(chip_.c_str());
+    return Status::FAIL;
+  }
+  gpio_v2_line_request request;
+  memset(&request, 0, sizeof(request));
+  request.offsets[RESET] = reset_line_;
+  request.offsets[SDIO] = sdio_line_;
+  request.num_lines = 2;
+  strncpy(request.consumer, "si4703", sizeof(request.consumer) - 1);
+  LineConfig(false, true, &request.config);
+  const int result = ioctl(chip, GPIO_V2_GET_LINE_IOCTL, &request);
+  close(chip);  // The request keeps the lines.
+  if (result < 0) {
+    perror("Failed to request the reset and SDIO lines");
+    return Status::FAIL;
+  }
+  fd_ = request.fd;
+  return Status::SUCCESS;
+}
+
+Status Si4703_GpioChip::reset() {
+  if (fd_ < 0)
+    return Status::FAIL;
+  // SDIO low and RST low in one ioctl.
+  if (configure(true, false) != Status::SUCCESS)
+    return Status::FAIL;
+  SleepFor(RESET_LOW);
+  if (setReset(true) != Status::SUCCESS)
+    return Status::FAIL;
+  SleepFor(SDIO_HOLD);
+  if (configure(false, true) != Status::SUCCESS)
+    return Status::FAIL;
+  SleepFor(RESET_RECOVERY);
+  return Status::SUCCESS;
+}
+
+Status Si4703_GpioChip::configure(bool sdio_output, bool reset_high) {
+  gpio_v2_line_config config;
+  LineConfig(sdio_output, reset_high, &config);
+  if (ioctl(fd_, GPIO_V2_LINE_SET_CONFIG_IOCTL, &config) < 0) {
+    perror("Failed to configure the reset and SDIO lines");
+    return Status::FAIL;
+  }
+  return Status::SUCCESS;
+}
+
+Status Si4703_GpioChip::setReset(bool high) {
+  gpio_v2_line_values values;
+  memset(&values, 0, sizeof(values));
+  values.bits = high ? 1 << RESET : 0;
+  values.mask = 1 << RESET;
+  if (ioctl(fd_, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) < 0) {
+    perror("Failed to set the reset line");
+    return Status::FAIL;
+  }
+  return Status::SUCCESS;
+}
@@ -0,0 +1,57 @@
+//
+// The GPIO lines the Si4703_Breakout resets the chip with.
+//
+// The chip picks its control interface when RST rises: with SDIO low (and
+// SEN high, which the breakout pulls up) it comes up in 2-wire mode. The
+// reset is pulsed by powerOn() and again to recover from bus faults.
+//
+
+#ifndef Si4703Gpio_h
+#define Si4703Gpio_h
+
+#include <string>
+
+#include "Si4703Bus.h"
+
+class Si4703_Gpio {
+ public:
+  virtual ~Si4703_Gpio() {}
+
+  // Acquire the lines. Called by every Si4703_Breakout::powerOn(); the
+  // lines are kept from the first call that succeeds on.
+  virtual Status open() = 0;
+
+  // Pulse RST with SDIO held low, then let go of SDIO for the bus.
+  virtual Status reset() = 0;
+};
+
+// The Linux GPIO character device, e.g. /dev/gpiochip0, through its v2
+// ioctls: the interface libgpiod wraps. Needs read-write access to the
+// device, which the gpio group has on Raspberry Pi OS, and nothing else.
+// Both lines are requested once, by open(), and held until destruction, so
+// no other process can drive them meanwhile. RST stays an output; SDIO is
+// an output only during the pulse and an input, left to the pull-up and the
+// bus, otherwise. The pulse is timed in microseconds.
+class Si4703_GpioChip : public Si4703_Gpio {
+ public:
+  // |reset_line| and |sdio_line| are line offsets on |chip|; on a Raspberry
+  // Pi's /dev/gpiochip0 they are the BCM GPIO numbers.
+  Si4703_GpioChip(int reset_line,
+                  int sdio_line,
+                  const std::string& chip = "/dev/gpiochip0");
+  ~Si4703_GpioChip() override;
+
+  Status open() override;
+  Status reset() override;
+
+ private:
+  Status configure(bool sdio_output, bool reset_high);
+  Status setReset(bool high);
+
+  int reset_line_;
+  int sdio_line_;
+  std::string chip_;
+  int fd_;  // The line request, -1 until open().
+};
+
+#endif
@@ -0,0 +1,116 @@
+//
+// The si4703d wire protocol.
+//
+// Clients talk to the daemon over a Unix stream socket in frames. Every
+// frame starts with an 8-byte header, all integers little-endian:
+//
+//   length:u16  bytes of body following the header
+//   type:u8     a request type, a request type | RESPONSE, or an event
+//   tuner:u8    which of the daemon's tuners
+//   id:u32      chosen by the client and echoed in the response; 0 in events
+//
+// Clients may send any number of requests without waiting (pipelining).
+// Responses carry the request id and can come back out of order: STATUS,
+// SUBSCRIBE and STATS are answered at once, while TUNE, SEEK, VOLUME and
+// SCAN queue on the tuner. SEEK and SCAN run in arrival order, after any
+// TUNE and VOLUME sent before them. A TUNE or VOLUME still waiting when a
+// newer one for the same tuner arrives is merged into it, and is answered
+// once the newer one is done.
+//
+// Request bodies:
+//   TUNE       frequency:u16 (10 kHz units)
+//   SEEK       up:u8
+//   VOLUME     volume:u8 (0..15)
+//   SUBSCRIBE  on:u8
+//   SCAN, STATUS, STATS: empty
+//
+// Response bodies start with result:u8 (a Result), followed on success by:
+//   TUNE, SEEK  frequency:u16 (10 kHz units; 0 if the seek found nothing)
+//   STATUS      frequency:u16 rssi:u8 flags:u8 volume:u8 pi:u16 ps:char[8]
+//   SCAN        count:u16, then count x
+//               {frequency:u16 rssi:u8 flags:u8 pi:u16 ps:char[8]}
+//   STATS       clients:u32 requests:u32 groups:u32 batches:u32
+//               dropped:u32 cpu_us:u32 merged:u32
+//
+// RDS_GROUPS events go to subscribers of a tuner, a batch of groups at a
+// time: count:u8, then count x {a:u16 b:u16 c:u16 d:u16}.
+//
+
+#ifndef Si4703Protocol_h
+#define Si4703Protocol_h
+
+#include <string.h>
+
+#include <inttypes.h>
+
+#include "Si4703Bytes.h"
+
+namespace si4703d {
+
+const char DEFAULT_SOCKET[] = "/run/si4703d.sock";
+
+const int HEADER_LENGTH = 8;
+const int MAX_BODY = 0xFFFF;
+
+enum Type : uint8_t {
+  TUNE = 1,
+  SEEK = 2,
+  VOLUME = 3,
+  SCAN = 4,
+  STATUS = 5,
+  SUBSCRIBE = 6,
+  STATS = 7,
+
+  RDS_GROUPS = 0x40,  // Event.
+  RESPONSE = 0x80,    // Or'ed into the request type.
+};
+
+enum Result : uint8_t {
+  OK = 0,
+  FAILED = 1,       // The tuner didn't do it.
+  BAD_REQUEST = 2,  // Unknown type or tuner, or malformed body.
+};
+
+// STATUS and SCAN flags.
+const uint8_t FLAG_STEREO = 1 << 0;
+
+const int STATUS_LENGTH = 1 + 2 + 1 + 1 + 1 + 2 + 8;
+const int SCAN_ENTRY_LENGTH = 2 + 1 + 1 + 2 + 8;
+const int STATS_LENGTH = 1 + 7 * 4;
+const int GROUP_LENGTH = 8;
+// Groups per RDS_GROUPS event, at most.
+const int MAX_BATCH = 64;
+
+struct Header {
+  uint16_t length;
+  uint8_t type;
+  uint8_t tuner;
+  uint32_t id;
+};
+
+using si4703bytes::getU16;
+using si4703bytes::getU32;
+using si4703bytes::putU16;
+using si4703bytes::putU32;
+
+inline void putHeader(uint8_t* p, const Header& header) {
+  putU16(p, header.length);
+  p[2] = header.type;
+  p[3] = header.tuner;
+  putU32(p + 4, header.id);
+}
+
+inline Header getHeader(const uint8_t* p) {
+  return Header{getU16(p), p[2], p[3], getU32(p + 4)};
+}
+
+// A PS name padded or cut to 8 chars, not null terminated.
+inline void putName(uint8_t* p, const char* name) {
+  const size_t length = strnlen(name, 8);
+  memset(p, ' ', 8);
+  memcpy(p, name, length);
+}
+
+}  // namespace si4703d
+
+#endif
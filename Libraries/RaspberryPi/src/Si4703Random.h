@@ -0,0 +1,33 @@
+//
+// xorshift64*: fast, seedable and good enough for error models and test
+// data. The same seed always gives the same sequence.
+//
+
+#ifndef Si4703Random_h
+#define Si4703Random_h
+
+#include <inttypes.h>
+
+class Si4703_Random {
+ public:
+  explicit Si4703_Random(uint64_t seed = 1)
+      : state_(seed ? seed : 1) {}  // xorshift never leaves 0.
+
+  uint64_t next() {
+    state_ ^= state_ >> 12;
+    state_ ^= state_ << 25;
+    state_ ^= state_ >> 27;
+    return state_ * 0x2545F4914F6CDD1DULL;
+  }
+
+  // In [0, |n|).
+  uint32_t below(uint32_t n) { return (next() >> 32) % n; }
+
+  // In [0, 1).
+  double uniform() { return (next() >> 11) * (1.0 / (1ULL << 53)); }
+
+ private:
+  uint64_t state_;
+};
+
+#endif
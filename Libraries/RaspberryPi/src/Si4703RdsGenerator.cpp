@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <cmath>
+
+#include "Si4703Core.h"
+#include "Si4703RdsGenerator.h"
+
+using namespace si4703;
+
+namespace {
+
+// Method A alternative frequency codes, see IEC 62106 section 3.2.1.6.1.
+const uint8_t AF_FILLER = 205;
+const uint8_t AF_COUNT_BASE = 224;
+
+// Modified Julian Day of 1970-01-01.
+const int MJD_EPOCH = 40587;
+
+// A method A list: the count code, the frequencies and a filler to make
+// whole pairs.
+std::vector<uint8_t> AFCodes(const std::vector<float>& frequencies) {
+  std::vector<uint8_t> codes;
+  if (frequencies.empty())
+    return codes;
+  codes.push_back(AF_COUNT_BASE + frequencies.size());
+  for (float f : frequencies)
+    codes.push_back(static_cast<uint8_t>(std::lround((f - 87.5f) * 10)));
+  if (codes.size() % 2)
+    codes.push_back(AF_FILLER);
+  return codes;
+}
+
+// Block C of the |n|th group carrying |codes|.
+uint16_t AFPair(const std::vector<uint8_t>& codes, uint64_t n) {
+  if (codes.empty())
+    return (AF_FILLER << 8) | AF_FILLER;
+  const size_t pair = n % (codes.size() / 2);
+  return (codes[pair * 2] << 8) | codes[pair * 2 + 1];
+}
+
+// Characters |pos| and |pos| + 1 of |text|, space padded.
+uint16_t Chars(const std::string& text, size_t pos) {
+  const uint8_t high = pos < text.size() ? text[pos] : ' ';
+  const uint8_t low = pos + 1 < text.size() ? text[pos + 1] : ' ';
+  return (high << 8) | low;
+}
+
+}  // anonymous namespace
+
+Si4703_RdsGenerator::Si4703_RdsGenerator(const Si4703_RdsStation& station,
+                                         const Si4703_RdsErrors& errors,
+                                         uint64_t seed)
+    : station_(station),
+      errors_(errors),
+      seed_(seed),
+      pty_tp_((station.tp << 10) | ((station.pty & 0x1F) << 5)),
+      af_codes_(AFCodes(station.af)) {
+  if (station_.ps.empty())
+    station_.ps.push_back("");
+  if (station_.radio_text.empty())
+    station_.radio_text.push_back("");
+  for (const Si4703_RdsStation::Other& other : station_.eon)
+    eon_af_codes_.push_back(AFCodes(other.af));
+  reset();
+}
+
+void Si4703_RdsGenerator::reset() {
+  random_ = Si4703_Random(seed_);
+  slot_ = 0;
+  pattern_ = 0;
+  basic_ = 0;
+  text_ = 0;
+  other_ = 0;
+  last_minute_ = station_.start / 60;
+  stats_ = Stats{0, 0, 0, 0};
+}
+
+void Si4703_RdsGenerator::encode(uint16_t* blocks) {
+  const time_t now =
+      station_.start + slot_++ * GROUP_MICROSECONDS / 1000000;
+  blocks[0] = station_.pi;
+  if (station_.clock_time && now / 60 != last_minute_) {
+    last_minute_ = now / 60;
+    encodeClockTime(blocks, now);
+    return;
+  }
+  switch (pattern_++ % 8) {
+    case 0:
+    case 2:
+    case 4:
+    case 6:
+      encodeBasic(blocks);
+      break;
+    case 7:
+      if (!station_.eon.empty()) {
+        encodeOther(blocks);
+        break;
+      }
+      // Fall through.
+    default:
+      encodeRadioText(blocks);
+      break;
+  }
+}
+
+// 0A: two characters of the PS name and an AF pair.
+void Si4703_RdsGenerator::encodeBasic(uint16_t* blocks) {
+  const uint64_t n = basic_++;
+  const std::string& ps =
+      station_.ps[n / station_.ps_hold % station_.ps.size()];
+  const uint8_t segment = n % 4;
+  blocks[1] = pty_tp_ | (station_.ta << 4) | (1 << 3) | segment;  // Music.
+  blocks[2] = AFPair(af_codes_, n);
+  blocks[3] = Chars(ps, segment * 2);
+}
+
+// 2A: four characters of the RadioText. A message shorter than 64
+// characters ends with a carriage return.
+void Si4703_RdsGenerator::encodeRadioText(uint16_t* blocks) {
+  const uint64_t n = text_++;
+  const uint64_t message = n / station_.rt_hold;
+  std::string rt =
+      station_.radio_text[message % station_.radio_text.size()];
+  if (rt.size() < 64)
+    rt += '\r';
+  const uint8_t segments = std::min<size_t>(16, (rt.size() + 3) / 4);
+  const uint8_t segment = n % segments;
+  const uint16_t ab = station_.radio_text.size() > 1 ? message & 1 : 0;
+  blocks[1] = (2 << 12) | pty_tp_ | (ab << 4) | segment;
+  blocks[2] = Chars(rt, segment * 4);
+  blocks[3] = Chars(rt, segment * 4 + 2);
+}
+
+// 4A: UTC date and time, no local offset.
+void Si4703_RdsGenerator::encodeClockTime(uint16_t* blocks, time_t now) {
+  const uint32_t mjd = now / 86400 + MJD_EPOCH;
+  const int hour = now / 3600 % 24;
+  const int minute = now / 60 % 60;
+  blocks[1] = (4 << 12) | pty_tp_ | ((mjd >> 15) & 0x3);
+  blocks[2] = ((mjd & 0x7FFF) << 1) | (hour >> 4);
+  blocks[3] = ((hour & 0xF) << 12) | (minute << 6);
+}
+
+// 14A: the other networks in turn, each as its four PS segments (variants
+// 0-3) and then an AF pair (variant 4).
+void Si4703_RdsGenerator::encodeOther(uint16_t* blocks) {
+  const uint64_t n = other_++;
+  const size_t on = n / 5 % station_.eon.size();
+  const Si4703_RdsStation::Other& other = station_.eon[on];
+  const uint8_t variant = n % 5;
+  blocks[1] = (14 << 12) | pty_tp_ | (other.tp << 4) | variant;
+  if (variant < 4)
+    blocks[2] = Chars(other.ps, variant * 2);
+  else
+    blocks[2] = AFPair(eon_af_codes_[on], n / (5 * station_.eon.size()));
+  blocks[3] = other.pi;
+}
+
+bool Si4703_RdsGenerator::next(Group* group) {
+  stats_.groups++;
+  encode(group->blocks);
+  for (int i = 0; i < 4; i++)
+    group->errors[i] = 0;
+  if (errors_.drop_rate > 0 && random_.uniform() < errors_.drop_rate) {
+    stats_.dropped++;
+    return false;
+  }
+  if (errors_.block_error_rate > 0)
+    damage(group);
+  return true;
+}
+
+void Si4703_RdsGenerator::damage(Group* group) {
+  for (int i = 0; i < 4; i++) {
+    if (random_.uniform() >= errors_.block_error_rate)
+      continue;
+    stats_.error_blocks++;
+    if (random_.uniform() < errors_.uncorrectable) {
+      stats_.uncorrectable++;
+      group->errors[i] = 3;
+      group->blocks[i] ^= (random_.next() & 0xFFFF) | 0x1;
+    } else {
+      group->errors[i] = 1 + (random_.next() & 0x1);
+    }
+  }
+}
+
+void Si4703_RdsGenerator::generate(Group* groups, size_t count) {
+  for (size_t i = 0; i < count;) {
+    if (next(&groups[i]))
+      i++;
+  }
+}
+
+// static
+void Si4703_RdsGenerator::write(const Group* groups,
+                                size_t count,
+                                uint8_t* buffer) {
+  for (size_t i = 0; i < count; i++) {
+    const Group& group = groups[i];
+    uint8_t* record = buffer + i * RECORD_LENGTH;
+    for (int b = 0; b < 4; b++) {
+      record[b * 2] = group.blocks[b] >> 8;
+      record[b * 2 + 1] = group.blocks[b] & 0xFF;
+    }
+    record[8] = group.errors[0] << 6 | group.errors[1] << 4 |
+                group.errors[2] << 2 | group.errors[3];
+  }
+}
+
+bool Si4703_RdsGenerator::load(uint16_t* regs) {
+  Group group;
+  if (!next(&group))
+    return false;
+  const bool verbose = get<RDSM>(regs);
+  if (!verbose &&
+      (group.errors[1] == 3 || group.errors[2] == 3 || group.errors[3] == 3))
+    return false;
+  for (int i = 0; i < 4; i++)
+    regs[RDSA + i] = group.blocks[i];
+  set<BLERA>(regs, group.errors[0]);
+  set<BLERB>(regs, verbose ? group.errors[1] : 0);
+  set<BLERC>(regs, verbose ? group.errors[2] : 0);
+  set<BLERD>(regs, verbose ? group.errors[3] : 0);
+  return true;
+}
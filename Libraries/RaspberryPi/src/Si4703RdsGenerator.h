@@ -0,0 +1,145 @@
+//
+// Synthetic RDS stream generator.
+//
+// A real station sends about 11.4 groups a second, far too few to load test
+// or fuzz a decoder. Si4703_RdsGenerator encodes a station profile (PI, a
+// rotation of PS names, RadioText with A/B toggles, clock time, an AF list
+// and EON) into groups, applies a seeded error model and hands them out as
+// fast as they are asked for: as a block stream, as records for a file, or
+// loaded into a register file the way the Si4703 presents them (RDSA-RDSD,
+// BLERA-BLERD, RDSR). The same seed always gives the same stream.
+//
+// Give one to a Si4703_SimulatedChip transmitter and the library's own RDS
+// path, rdsReadFunc() and the group listeners, decodes it.
+//
+// Broadcast schedule, in slots of 8 groups: 0A, 2A, 0A, 2A, 0A, 2A, 0A and
+// then 14A if the profile has EON, else 2A. A 4A clock time group takes the
+// next slot after each minute of broadcast time.
+//
+
+#ifndef Si4703RdsGenerator_h
+#define Si4703RdsGenerator_h
+
+#include <stddef.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include <inttypes.h>
+
+#include "Si4703Random.h"
+
+struct Si4703_RdsStation {
+  // Another network sent in 14A groups.
+  struct Other {
+    uint16_t pi;
+    std::string ps;
+    std::vector<float> af;  // MHz.
+    bool tp;                // TP(ON): it carries traffic programme.
+  };
+
+  uint16_t pi = 0x1234;
+  uint8_t pty = 10;  // Pop music.
+  bool tp = true;
+  bool ta = false;
+  // Names in rotation, each held for |ps_hold| 0A groups.
+  std::vector<std::string> ps = {"SYNTH FM"};
+  int ps_hold = 16;
+  // Messages in rotation, each held for |rt_hold| 2A groups. The A/B flag
+  // toggles on every change.
+  std::vector<std::string> radio_text = {"Synthetic RadioText"};
+  int rt_hold = 32;
+  std::vector<float> af;  // MHz, method A.
+  std::vector<Other> eon;
+  // Send 4A clock time, counting broadcast time from |start|.
+  bool clock_time = false;
+  time_t start = 0;
+};
+
+// Reception errors, drawn independently per group and per block.
+struct Si4703_RdsErrors {
+  // Probability that a block has bit errors.
+  double block_error_rate = 0;
+  // Of the blocks with errors, the fraction beyond correction (BLER 3,
+  // garbage data). The rest are corrected and report BLER 1 or 2.
+  double uncorrectable = 0;
+  // Probability that a group is lost entirely (RDSR never set).
+  double drop_rate = 0;
+};
+
+class Si4703_RdsGenerator {
+ public:
+  // A group as received. |errors| holds the BLER level (0: none, 1: 1-2,
+  // 2: 3-5, 3: 6+ errors) of each block.
+  struct Group {
+    uint16_t blocks[4];  // A, B, C, D.
+    uint8_t errors[4];
+  };
+
+  struct Stats {
+    uint64_t groups;         // Sent, dropped ones included.
+    uint64_t dropped;
+    uint64_t error_blocks;   // BLER 1-3.
+    uint64_t uncorrectable;  // BLER 3.
+  };
+
+  // Bytes per group in write(): the four blocks big-endian, as on the bus,
+  // then the four BLER levels packed A-D from the high bits of one byte.
+  static const size_t RECORD_LENGTH = 9;
+
+  // Group duration on air, 104 bits at 1187.5 bit/s.
+  static const int GROUP_MICROSECONDS = 87579;
+
+  Si4703_RdsGenerator(const Si4703_RdsStation& station,
+                      const Si4703_RdsErrors& errors = Si4703_RdsErrors(),
+                      uint64_t seed = 1);
+
+  // Encode the next group on air, before errors.
+  void encode(uint16_t* blocks);
+
+  // The next group as received. Returns false if it was dropped.
+  bool next(Group* group);
+
+  // Fill |groups| with |count| received groups, skipping dropped ones.
+  void generate(Group* groups, size_t count);
+
+  // Pack |count| groups as records of RECORD_LENGTH bytes into |buffer|.
+  static void write(const Group* groups, size_t count, uint8_t* buffer);
+
+  // Load the next received group into the register file |regs|: RDSA-RDSD,
+  // BLERA in STATUSRSSI and BLERB-BLERD in READCHAN. Without RDS verbose
+  // mode (RDSM) the chip never presents a group with an uncorrectable
+  // block B-D. Returns false, leaving |regs| alone, if there is no group to
+  // present.
+  bool load(uint16_t* regs);
+
+  // Start over from the first group with the original seed.
+  void reset();
+
+  const Stats& stats() const { return stats_; }
+
+ private:
+  void encodeBasic(uint16_t* blocks);
+  void encodeRadioText(uint16_t* blocks);
+  void encodeClockTime(uint16_t* blocks, time_t now);
+  void encodeOther(uint16_t* blocks);
+  void damage(Group* group);
+
+  Si4703_RdsStation station_;
+  Si4703_RdsErrors errors_;
+  uint64_t seed_;
+  Si4703_Random random_;
+  uint16_t pty_tp_;  // The PTY and TP bits of block B.
+  std::vector<uint8_t> af_codes_;
+  std::vector<std::vector<uint8_t>> eon_af_codes_;
+  uint64_t slot_;        // Groups sent, for the broadcast time.
+  uint64_t pattern_;     // Position in the 8 group schedule.
+  uint64_t basic_;       // 0A groups sent.
+  uint64_t text_;        // 2A groups sent.
+  uint64_t other_;       // 14A groups sent.
+  int64_t last_minute_;  // Of the last clock time sent.
+  Stats stats_;
+};
+
+#endif
@@ -0,0 +1,908 @@
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Si4703Bytes.h"
+#include "Si4703RdsJournal.h"
+
+using namespace si4703bytes;
+
+namespace {
+
+const char MAGIC[4] = {'S', '4', 'R', 'J'};
+const uint8_t VERSION = 1;
+const size_t HEADER_LENGTH = 12;
+const size_t BLOCK_HEADER_LENGTH = 28;
+const size_t STATE_ENTRY_LENGTH = 16;
+
+const uint8_t EVENTS = 'E';
+const uint8_t STATE = 'S';
+
+// How often the writer looks for blocks that have waited long enough.
+const std::chrono::milliseconds WRITER_TICK(100);
+
+const int MJD_EPOCH = 40587;  // 1970-01-01.
+
+uint64_t ZigZag(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^ (value >> 63);
+}
+
+int64_t UnZigZag(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+uint32_t Station(uint16_t pi, uint16_t frequency) {
+  return (static_cast<uint32_t>(pi) << 16) | frequency;
+}
+
+uint64_t StateKeyOf(const Si4703_RdsEvent& event) {
+  return (static_cast<uint64_t>(Station(event.pi, event.frequency)) << 8) |
+         event.type;
+}
+
+// What compaction compares: the text (FNV-1a), the flag or PTY, or for CT
+// the station's clock offset from ours in minutes, and its local offset.
+uint64_t ValueOf(const Si4703_RdsEvent& event) {
+  switch (event.type) {
+    case Si4703_RdsEvent::PS:
+    case Si4703_RdsEvent::RT: {
+      uint64_t hash = 14695981039346656037ull;
+      for (char c : event.text)
+        hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+      return hash;
+    }
+    case Si4703_RdsEvent::CT: {
+      const int64_t minutes =
+          std::lround((event.clock - event.time) / 60.0);
+      return (ZigZag(minutes) << 8) | static_cast<uint8_t>(event.offset);
+    }
+    default:
+      return event.value;
+  }
+}
+
+void PutEvent(const Si4703_RdsEvent& event, time_t first,
+              std::vector<uint8_t>* out) {
+  out->push_back(event.type);
+  out->push_back(event.tuner);
+  putVarint(out, event.time - first);
+  switch (event.type) {
+    case Si4703_RdsEvent::PS:
+      for (size_t i = 0; i < si4703::RdsDecoder::PS_LENGTH; i++)
+        out->push_back(i < event.text.size() ? event.text[i] : ' ');
+      break;
+    case Si4703_RdsEvent::RT: {
+      const size_t length =
+          std::min<size_t>(event.text.size(), si4703::RdsDecoder::RT_LENGTH);
+      out->push_back(length);
+      out->insert(out->end(), event.text.begin(),
+                  event.text.begin() + length);
+      break;
+    }
+    case Si4703_RdsEvent::CT:
+      putVarint(out, ZigZag(event.clock - event.time));
+      out->push_back(static_cast<uint8_t>(event.offset));
+      break;
+    default:
+      out->push_back(event.value);
+      break;
+  }
+}
+
+// Returns false if |data| ends within the event or it is not one.
+bool GetEvent(const uint8_t* data, size_t length, size_t* pos, time_t first,
+              Si4703_RdsEvent* event) {
+  if (*pos + 2 > length || data[*pos] > Si4703_RdsEvent::CT)
+    return false;
+  event->type = static_cast<Si4703_RdsEvent::Type>(data[(*pos)++]);
+  event->tuner = data[(*pos)++];
+  uint64_t value;
+  if (!getVarint(data, length, pos, &value))
+    return false;
+  event->time = first + value;
+  event->text.clear();
+  event->value = 0;
+  event->clock = 0;
+  event->offset = 0;
+  switch (event->type) {
+    case Si4703_RdsEvent::PS:
+      if (*pos + si4703::RdsDecoder::PS_LENGTH > length)
+        return false;
+      event->text.assign(reinterpret_cast<const char*>(data + *pos),
+                         si4703::RdsDecoder::PS_LENGTH);
+      *pos += si4703::RdsDecoder::PS_LENGTH;
+      return true;
+    case Si4703_RdsEvent::RT: {
+      if (*pos >= length || *pos + 1 + data[*pos] > length)
+        return false;
+      const size_t text_length = data[(*pos)++];
+      event->text.assign(reinterpret_cast<const char*>(data + *pos),
+                         text_length);
+      *pos += text_length;
+      return true;
+    }
+    case Si4703_RdsEvent::CT:
+      if (!getVarint(data, length, pos, &value) || *pos >= length)
+        return false;
+      event->clock = event->time + UnZigZag(value);
+      event->offset = static_cast<int8_t>(data[(*pos)++]);
+      return true;
+    default:
+      if (*pos >= length)
+        return false;
+      event->value = data[(*pos)++];
+      return true;
+  }
+}
+
+// Whether |name| is a segment, "<sequence>.seg", and which.
+bool ParseSegmentName(const char* name, uint32_t* sequence) {
+  char* end;
+  const unsigned long value = strtoul(name, &end, 10);
+  if (end == name || strcmp(end, ".seg") != 0)
+    return false;
+  *sequence = value;
+  return true;
+}
+
+}  // anonymous namespace
+
+struct Si4703_RdsJournal::Segment {
+  uint32_t sequence = 0;
+  bool compacted = false;
+  uint32_t covers_from = 0;
+  int fd = -1;
+  uint64_t size = 0;
+  uint64_t events = 0;
+  time_t first_time = 0;  // Of the blocks, when there are any.
+  time_t last_time = 0;
+  std::vector<Block> blocks;
+  // Positions in |blocks|, in the order written.
+  std::unordered_map<uint16_t, std::vector<uint32_t>> by_pi;
+  std::unordered_map<uint16_t, std::vector<uint32_t>> by_frequency;
+
+  ~Segment() {
+    if (fd >= 0)
+      ::close(fd);
+  }
+
+  void add(const Block& block) {
+    if (blocks.empty() || block.first_time < first_time)
+      first_time = block.first_time;
+    if (blocks.empty() || block.last_time > last_time)
+      last_time = block.last_time;
+    by_pi[block.pi].push_back(blocks.size());
+    by_frequency[block.frequency].push_back(blocks.size());
+    blocks.push_back(block);
+    events += block.count;
+  }
+};
+
+Si4703_RdsJournal::Si4703_RdsJournal(const std::string& directory,
+                                     const Config& config)
+    : directory_(directory),
+      config_(config),
+      stop_(false),
+      flush_requests_(0),
+      flushed_(0),
+      queued_(0),
+      dropped_(0),
+      next_sequence_(1),
+      stats_{0, 0, 0, 0, 0, 0, 0, 0, 0, 0} {
+  config_.block_events = std::max(1, std::min(config_.block_events, 0xFFFF));
+}
+
+Si4703_RdsJournal::~Si4703_RdsJournal() {
+  close();
+}
+
+std::string Si4703_RdsJournal::segmentPath(uint32_t sequence) const {
+  char name[16];
+  snprintf(name, sizeof(name), "%08u.seg", sequence);
+  return directory_ + "/" + name;
+}
+
+Status Si4703_RdsJournal::open() {
+  if (writer_.joinable())
+    return Status::SUCCESS;
+  if (mkdir(directory_.c_str(), 0755) < 0 && errno != EEXIST) {
+    perror(directory_.c_str());
+    return Status::FAIL;
+  }
+  if (load() != Status::SUCCESS)
+    return Status::FAIL;
+  stop_ = false;
+  writer_ = std::thread(&Si4703_RdsJournal::run, this);
+  if (config_.compact_interval.count() > 0)
+    compactor_ = std::thread(&Si4703_RdsJournal::runCompactions, this);
+  return Status::SUCCESS;
+}
+
+void Si4703_RdsJournal::close() {
+  if (!writer_.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    stop_ = true;
+  }
+  queue_cv_.notify_all();
+  compact_cv_.notify_all();
+  if (compactor_.joinable())
+    compactor_.join();
+  writer_.join();
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (active_)
+    sealLocked();
+  segments_.clear();
+  pending_.clear();
+  state_.clear();
+}
+
+Status Si4703_RdsJournal::load() {
+  DIR* dir = opendir(directory_.c_str());
+  if (!dir) {
+    perror(directory_.c_str());
+    return Status::FAIL;
+  }
+  std::vector<uint32_t> sequences;
+  while (dirent* entry = readdir(dir)) {
+    uint32_t sequence;
+    if (ParseSegmentName(entry->d_name, &sequence))
+      sequences.push_back(sequence);
+    else if (strstr(entry->d_name, ".tmp"))  // A compaction cut short.
+      unlink((directory_ + "/" + entry->d_name).c_str());
+  }
+  closedir(dir);
+  std::sort(sequences.begin(), sequences.end());
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  segments_.clear();
+  active_.reset();
+  state_.clear();
+  stats_ = Stats{0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+  next_sequence_ = sequences.empty() ? 1 : sequences.back() + 1;
+  // Newest first, so a compacted segment is seen before the segments it
+  // replaced, if a crash left them behind.
+  uint32_t covered_from = UINT32_MAX;
+  for (auto it = sequences.rbegin(); it != sequences.rend(); ++it) {
+    if (*it >= covered_from) {
+      unlink(segmentPath(*it).c_str());
+      continue;
+    }
+    std::shared_ptr<Segment> segment;
+    if (loadSegment(*it, &segment) != Status::SUCCESS)
+      return Status::FAIL;
+    if (!segment)
+      continue;
+    if (segment->compacted)
+      covered_from = segment->covers_from;
+    segments_.insert(segments_.begin(), segment);
+    stats_.written += segment->events;
+    stats_.blocks += segment->blocks.size();
+    stats_.bytes += segment->size;
+  }
+  stats_.segments = segments_.size();
+  return Status::SUCCESS;
+}
+
+Status Si4703_RdsJournal::loadSegment(uint32_t sequence,
+                                      std::shared_ptr<Segment>* segment) {
+  const std::string path = segmentPath(sequence);
+  std::shared_ptr<Segment> loaded = std::make_shared<Segment>();
+  loaded->sequence = sequence;
+  loaded->fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+  if (loaded->fd < 0) {
+    perror(path.c_str());
+    return Status::FAIL;
+  }
+  struct stat st;
+  fstat(loaded->fd, &st);
+  if (static_cast<size_t>(st.st_size) < HEADER_LENGTH) {
+    // Cut short as it was started; there is nothing in it.
+    unlink(path.c_str());
+    return Status::SUCCESS;
+  }
+  uint8_t header[BLOCK_HEADER_LENGTH];
+  if (!readAll(loaded->fd, header, HEADER_LENGTH, 0) ||
+      memcmp(header, MAGIC, sizeof(MAGIC)) != 0 || header[4] != VERSION) {
+    fprintf(stderr, "%s: not an RDS journal segment\n", path.c_str());
+    return Status::FAIL;
+  }
+  loaded->compacted = header[5];
+  loaded->covers_from = getU32(header + 8);
+
+  // The block headers make the index; the state block of the newest
+  // compacted segment is where the next compaction picks up.
+  uint64_t offset = HEADER_LENGTH;
+  bool seen_state = false;
+  while (offset + BLOCK_HEADER_LENGTH <= static_cast<uint64_t>(st.st_size)) {
+    if (!readAll(loaded->fd, header, BLOCK_HEADER_LENGTH, offset))
+      break;
+    Block block;
+    block.pi = getU16(header + 1);
+    block.frequency = getU16(header + 3);
+    block.types = header[5];
+    block.count = getU16(header + 6);
+    block.first_time = static_cast<int64_t>(getU64(header + 8));
+    block.last_time = static_cast<int64_t>(getU64(header + 16));
+    block.length = getU32(header + 24);
+    block.offset = offset + BLOCK_HEADER_LENGTH;
+    if (block.offset + block.length > static_cast<uint64_t>(st.st_size))
+      break;
+    if (header[0] == EVENTS) {
+      loaded->add(block);
+    } else if (header[0] == STATE && loaded->compacted) {
+      // Segments load newest first; an older state is out of date.
+      std::vector<uint8_t> payload(state_.empty() ? block.length : 0);
+      if (!readAll(loaded->fd, payload.data(), payload.size(), block.offset))
+        break;
+      for (size_t i = 0; i + STATE_ENTRY_LENGTH <= payload.size();
+           i += STATE_ENTRY_LENGTH)
+        state_[getU64(&payload[i])] = getU64(&payload[i + 8]);
+      seen_state = true;
+    } else {
+      break;
+    }
+    offset = block.offset + block.length;
+  }
+  if (offset < static_cast<uint64_t>(st.st_size)) {
+    fprintf(stderr, "%s: dropping %" PRIu64 " bytes after the last block\n",
+            path.c_str(), static_cast<uint64_t>(st.st_size) - offset);
+    if (ftruncate(loaded->fd, offset) < 0)
+      perror(path.c_str());
+  }
+  loaded->size = offset;
+  if (loaded->compacted && !seen_state) {
+    // Renamed into place only once complete, so this is not a crash.
+    fprintf(stderr, "%s: compacted segment without its state\n",
+            path.c_str());
+    return Status::FAIL;
+  }
+  *segment = loaded;
+  return Status::SUCCESS;
+}
+
+Status Si4703_RdsJournal::startSegmentLocked() {
+  std::shared_ptr<Segment> segment = std::make_shared<Segment>();
+  segment->sequence = next_sequence_++;
+  const std::string path = segmentPath(segment->sequence);
+  segment->fd =
+      ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (segment->fd < 0) {
+    perror(path.c_str());
+    return Status::FAIL;
+  }
+  uint8_t header[HEADER_LENGTH] = {0};
+  memcpy(header, MAGIC, sizeof(MAGIC));
+  header[4] = VERSION;
+  if (!writeAll(segment->fd, header, sizeof(header), 0)) {
+    perror(path.c_str());
+    return Status::FAIL;
+  }
+  segment->size = HEADER_LENGTH;
+  segments_.push_back(segment);
+  active_ = segment;
+  stats_.segments++;
+  stats_.bytes += HEADER_LENGTH;
+  return Status::SUCCESS;
+}
+
+void Si4703_RdsJournal::sealLocked() {
+  if (fdatasync(active_->fd) < 0)
+    perror(segmentPath(active_->sequence).c_str());
+  active_.reset();
+}
+
+Status Si4703_RdsJournal::writeBlock(Segment* segment,
+                                     char kind,
+                                     uint16_t pi,
+                                     uint16_t frequency,
+                                     const Si4703_RdsEvent* events,
+                                     size_t count,
+                                     const std::vector<uint8_t>& state) {
+  Block block;
+  block.pi = pi;
+  block.frequency = frequency;
+  block.types = 0;
+  block.count = count;
+  block.first_time = count ? events[0].time : 0;
+  block.last_time = block.first_time;
+  for (size_t i = 0; i < count; i++) {
+    block.types |= Si4703_RdsEvent::mask(events[i].type);
+    block.first_time = std::min(block.first_time, events[i].time);
+    block.last_time = std::max(block.last_time, events[i].time);
+  }
+  std::vector<uint8_t> data(BLOCK_HEADER_LENGTH);
+  for (size_t i = 0; i < count; i++)
+    PutEvent(events[i], block.first_time, &data);
+  data.insert(data.end(), state.begin(), state.end());
+  block.length = data.size() - BLOCK_HEADER_LENGTH;
+  data[0] = kind;
+  putU16(&data[1], pi);
+  putU16(&data[3], frequency);
+  data[5] = block.types;
+  putU16(&data[6], count);
+  putU64(&data[8], block.first_time);
+  putU64(&data[16], block.last_time);
+  putU32(&data[24], block.length);
+  if (!writeAll(segment->fd, data.data(), data.size(), segment->size)) {
+    perror(segmentPath(segment->sequence).c_str());
+    return Status::FAIL;
+  }
+  block.offset = segment->size + BLOCK_HEADER_LENGTH;
+  segment->size += data.size();
+  if (kind == EVENTS)
+    segment->add(block);
+  return Status::SUCCESS;
+}
+
+void Si4703_RdsJournal::writePendingLocked(StationKey key) {
+  Pending& pending = pending_[key];
+  if (pending.events.empty())
+    return;
+  if (active_ || startSegmentLocked() == Status::SUCCESS) {
+    Segment* segment = active_.get();
+    const uint64_t start = segment->size;
+    for (size_t i = 0; i < pending.events.size();
+         i += config_.block_events) {
+      const size_t count = std::min<size_t>(config_.block_events,
+                                            pending.events.size() - i);
+      if (writeBlock(segment, EVENTS, key >> 16, key & 0xFFFF,
+                     &pending.events[i], count, {}) != Status::SUCCESS)
+        break;
+      stats_.written += count;
+      stats_.blocks++;
+    }
+    stats_.bytes += segment->size - start;
+  }
+  pending.events.clear();
+}
+
+bool Si4703_RdsJournal::add(const Si4703_RdsEvent& event) {
+  std::lock_guard<std::mutex> lock(queue_mutex_);
+  if (queue_.size() >= config_.queue_events) {
+    dropped_++;
+    return false;
+  }
+  queue_.push_back(event);
+  queued_++;
+  // Otherwise the writer picks it up on its next tick.
+  if (queue_.size() == config_.queue_events / 2)
+    queue_cv_.notify_one();
+  return true;
+}
+
+void Si4703_RdsJournal::flush() {
+  std::unique_lock<std::mutex> lock(queue_mutex_);
+  if (!writer_.joinable())
+    return;
+  const uint64_t request = ++flush_requests_;
+  queue_cv_.notify_one();
+  flushed_cv_.wait(lock, [this, request] { return flushed_ >= request; });
+}
+
+void Si4703_RdsJournal::run() {
+  std::vector<Si4703_RdsEvent> events;
+  std::unique_lock<std::mutex> lock(queue_mutex_);
+  while (true) {
+    queue_cv_.wait_for(lock, WRITER_TICK, [this] {
+      return stop_ || flush_requests_ > flushed_ ||
+             queue_.size() >= config_.queue_events / 2;
+    });
+    events.swap(queue_);
+    const bool stop = stop_;
+    const uint64_t requests = flush_requests_;
+    lock.unlock();
+
+    {
+      std::lock_guard<std::mutex> state(mutex_);
+      const auto now = std::chrono::steady_clock::now();
+      for (Si4703_RdsEvent& event : events) {
+        const StationKey key = Station(event.pi, event.frequency);
+        Pending& pending = pending_[key];
+        if (pending.events.empty())
+          pending.since = now;
+        pending.events.push_back(std::move(event));
+        if (pending.events.size() >=
+            static_cast<size_t>(config_.block_events))
+          writePendingLocked(key);
+      }
+      const bool all = stop || requests > flushed_;
+      for (auto& entry : pending_) {
+        if (!entry.second.events.empty() &&
+            (all || now - entry.second.since >= config_.flush_interval))
+          writePendingLocked(entry.first);
+      }
+      if (active_ && active_->size >= config_.segment_bytes)
+        sealLocked();
+    }
+    events.clear();
+
+    lock.lock();
+    if (requests > flushed_) {
+      flushed_ = requests;
+      flushed_cv_.notify_all();
+    }
+    if (stop && queue_.empty())
+      return;
+  }
+}
+
+void Si4703_RdsJournal::runCompactions() {
+  std::unique_lock<std::mutex> lock(queue_mutex_);
+  while (!compact_cv_.wait_for(lock, config_.compact_interval,
+                               [this] { return stop_; })) {
+    lock.unlock();
+    compact();
+    lock.lock();
+  }
+}
+
+Status Si4703_RdsJournal::compact() {
+  std::lock_guard<std::mutex> compacting(compact_mutex_);
+  std::vector<std::shared_ptr<Segment>> fresh;
+  std::unordered_map<StateKey, uint64_t> state;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (active_)
+      sealLocked();
+    for (const std::shared_ptr<Segment>& segment : segments_) {
+      if (!segment->compacted)
+        fresh.push_back(segment);
+    }
+    state = state_;
+  }
+  if (fresh.empty())
+    return Status::SUCCESS;
+
+  // Every compacted segment covers all before it, so the fresh ones are
+  // the last few numbers but those written since; the compacted segment
+  // takes the number of the newest.
+  std::shared_ptr<Segment> compacted = std::make_shared<Segment>();
+  compacted->sequence = fresh.back()->sequence;
+  compacted->compacted = true;
+  compacted->covers_from = fresh.front()->sequence;
+  const std::string path = segmentPath(compacted->sequence);
+  const std::string temporary = path + ".tmp";
+  compacted->fd = ::open(temporary.c_str(),
+                         O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (compacted->fd < 0) {
+    perror(temporary.c_str());
+    return Status::FAIL;
+  }
+  uint8_t header[HEADER_LENGTH] = {0};
+  memcpy(header, MAGIC, sizeof(MAGIC));
+  header[4] = VERSION;
+  header[5] = 1;
+  putU32(header + 8, compacted->covers_from);
+  if (!writeAll(compacted->fd, header, sizeof(header), 0)) {
+    perror(temporary.c_str());
+    unlink(temporary.c_str());
+    return Status::FAIL;
+  }
+  compacted->size = HEADER_LENGTH;
+
+  // Station by station, so only one station's changes are in memory at a
+  // time, and in the order they were written.
+  std::map<StationKey, std::vector<std::pair<const Segment*, Block>>>
+      stations;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);  // Sealed, but to be sure.
+    for (const std::shared_ptr<Segment>& segment : fresh) {
+      for (const Block& block : segment->blocks)
+        stations[Station(block.pi, block.frequency)].emplace_back(
+            segment.get(), block);
+    }
+  }
+  uint64_t removed = 0;
+  uint64_t bytes_read = 0;
+  std::vector<Si4703_RdsEvent> events, kept;
+  bool failed = false;
+  for (const auto& station : stations) {
+    kept.clear();
+    for (const auto& located : station.second) {
+      events.clear();
+      if (readBlock(*located.first, located.second, &events) !=
+          Status::SUCCESS) {
+        failed = true;
+        break;
+      }
+      bytes_read += located.second.length + BLOCK_HEADER_LENGTH;
+      for (Si4703_RdsEvent& event : events) {
+        const uint64_t value = ValueOf(event);
+        auto last = state.emplace(StateKeyOf(event), value);
+        if (!last.second && last.first->second == value) {
+          removed++;
+          continue;
+        }
+        last.first->second = value;
+        kept.push_back(std::move(event));
+      }
+    }
+    // One kind of change per block, where there are enough, so a query
+    // for one kind skips the rest.
+    std::stable_sort(kept.begin(), kept.end(),
+                     [](const Si4703_RdsEvent& a, const Si4703_RdsEvent& b) {
+                       return a.type < b.type;
+                     });
+    for (size_t i = 0; !failed && i < kept.size(); i += config_.block_events) {
+      const size_t count =
+          std::min<size_t>(config_.block_events, kept.size() - i);
+      failed = writeBlock(compacted.get(), EVENTS, station.first >> 16,
+                          station.first & 0xFFFF, &kept[i], count,
+                          {}) != Status::SUCCESS;
+    }
+    if (failed)
+      break;
+  }
+  std::vector<uint8_t> entries(state.size() * STATE_ENTRY_LENGTH);
+  size_t i = 0;
+  for (const auto& entry : state) {
+    putU64(&entries[i], entry.first);
+    putU64(&entries[i + 8], entry.second);
+    i += STATE_ENTRY_LENGTH;
+  }
+  if (failed ||
+      writeBlock(compacted.get(), STATE, 0, 0, nullptr, 0, entries) !=
+          Status::SUCCESS ||
+      fdatasync(compacted->fd) < 0 ||
+      rename(temporary.c_str(), path.c_str()) < 0) {
+    if (!failed)
+      perror(temporary.c_str());
+    unlink(temporary.c_str());
+    return Status::FAIL;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto position = std::find(segments_.begin(), segments_.end(), fresh[0]);
+    for (const std::shared_ptr<Segment>& old : fresh) {
+      stats_.written -= old->events;
+      stats_.blocks -= old->blocks.size();
+      stats_.bytes -= old->size;
+    }
+    position = segments_.erase(position, position + fresh.size());
+    segments_.insert(position, compacted);
+    state_.swap(state);
+    stats_.written += compacted->events;
+    stats_.blocks += compacted->blocks.size();
+    stats_.bytes += compacted->size;
+    stats_.segments = segments_.size();
+    stats_.compactions++;
+    stats_.removed += removed;
+    stats_.bytes_read += bytes_read;
+  }
+  // Open readers keep their descriptors; the newest was renamed over.
+  for (size_t j = 0; j + 1 < fresh.size(); j++)
+    unlink(segmentPath(fresh[j]->sequence).c_str());
+  return Status::SUCCESS;
+}
+
+std::vector<Si4703_RdsEvent> Si4703_RdsJournal::byPi(uint16_t pi,
+                                                     time_t from,
+                                                     time_t to,
+                                                     uint8_t types) {
+  return query(true, pi, from, to, types);
+}
+
+std::vector<Si4703_RdsEvent> Si4703_RdsJournal::byFrequency(
+    uint16_t frequency,
+    time_t from,
+    time_t to,
+    uint8_t types) {
+  return query(false, frequency, from, to, types);
+}
+
+std::vector<Si4703_RdsEvent> Si4703_RdsJournal::query(bool by_pi,
+                                                      uint16_t code,
+                                                      time_t from,
+                                                      time_t to,
+                                                      uint8_t types) {
+  std::vector<std::pair<std::shared_ptr<Segment>, Block>> blocks;
+  std::vector<Si4703_RdsEvent> pending;
+  auto wanted = [&](const Si4703_RdsEvent& event) {
+    return (Si4703_RdsEvent::mask(event.type) & types) &&
+           event.time >= from && event.time <= to;
+  };
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const std::shared_ptr<Segment>& segment : segments_) {
+      if (segment->blocks.empty() || segment->last_time < from ||
+          segment->first_time > to)
+        continue;
+      const auto& index = by_pi ? segment->by_pi : segment->by_frequency;
+      const auto found = index.find(code);
+      if (found == index.end())
+        continue;
+      for (uint32_t position : found->second) {
+        const Block& block = segment->blocks[position];
+        if ((block.types & types) && block.last_time >= from &&
+            block.first_time <= to)
+          blocks.emplace_back(segment, block);
+      }
+    }
+    for (const auto& entry : pending_) {
+      if ((by_pi ? entry.first >> 16 : entry.first & 0xFFFF) != code)
+        continue;
+      for (const Si4703_RdsEvent& event : entry.second.events) {
+        if (wanted(event))
+          pending.push_back(event);
+      }
+    }
+  }
+
+  std::vector<Si4703_RdsEvent> result, events;
+  uint64_t bytes_read = 0;
+  for (const auto& located : blocks) {
+    events.clear();
+    if (readBlock(*located.first, located.second, &events) !=
+        Status::SUCCESS)
+      continue;
+    bytes_read += located.second.length;
+    for (Si4703_RdsEvent& event : events) {
+      if (wanted(event))
+        result.push_back(std::move(event));
+    }
+  }
+  result.insert(result.end(), pending.begin(), pending.end());
+  std::stable_sort(result.begin(), result.end(),
+                   [](const Si4703_RdsEvent& a, const Si4703_RdsEvent& b) {
+                     return a.time < b.time;
+                   });
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.blocks_read += blocks.size();
+  stats_.bytes_read += bytes_read;
+  return result;
+}
+
+Status Si4703_RdsJournal::readBlock(const Segment& segment,
+                                    const Block& block,
+                                    std::vector<Si4703_RdsEvent>* events) {
+  std::vector<uint8_t> payload(block.length);
+  if (!readAll(segment.fd, payload.data(), payload.size(), block.offset)) {
+    perror(segmentPath(segment.sequence).c_str());
+    return Status::FAIL;
+  }
+  Si4703_RdsEvent event;
+  event.pi = block.pi;
+  event.frequency = block.frequency;
+  size_t pos = 0;
+  for (int i = 0; i < block.count; i++) {
+    if (!GetEvent(payload.data(), payload.size(), &pos, block.first_time,
+                  &event)) {
+      fprintf(stderr, "%s: bad block at %" PRIu64 "\n",
+              segmentPath(segment.sequence).c_str(), block.offset);
+      return Status::FAIL;
+    }
+    events->push_back(event);
+  }
+  return Status::SUCCESS;
+}
+
+Si4703_RdsJournal::Stats Si4703_RdsJournal::stats() {
+  Stats stats;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats = stats_;
+  }
+  std::lock_guard<std::mutex> lock(queue_mutex_);
+  stats.queued = queued_;
+  stats.dropped = dropped_;
+  return stats;
+}
+
+Si4703_RdsJournalMonitor::Si4703_RdsJournalMonitor(Si4703_Breakout* radio,
+                                                   Si4703_RdsJournal* journal,
+                                                   uint8_t tuner)
+    : radio_(radio),
+      journal_(journal),
+      tuner_(tuner),
+      listener_id_(-1),
+      frequency_(0) {
+  forget();
+  if (radio_) {
+    listener_id_ = radio_->addRdsGroupListener([this](const RdsGroup& group) {
+      addGroup(group, radio_->status().frequency, time(nullptr));
+    });
+  }
+}
+
+Si4703_RdsJournalMonitor::~Si4703_RdsJournalMonitor() {
+  if (radio_)
+    radio_->removeRdsGroupListener(listener_id_);
+}
+
+void Si4703_RdsJournalMonitor::forget() {
+  ps_.clear();
+  rt_.clear();
+  pty_ = tp_ = ta_ = -1;
+}
+
+void Si4703_RdsJournalMonitor::emit(Si4703_RdsEvent* event,
+                                    Si4703_RdsEvent::Type type,
+                                    time_t now) {
+  event->type = type;
+  event->time = now;
+  event->pi = decoder_.pi;
+  event->frequency = frequency_;
+  event->tuner = tuner_;
+  journal_->add(*event);
+}
+
+void Si4703_RdsJournalMonitor::addGroup(const RdsGroup& group,
+                                        uint16_t frequency,
+                                        time_t now) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (frequency != frequency_) {
+    decoder_.reset();
+    frequency_ = frequency;
+    forget();
+  }
+  const uint8_t decoded =
+      decoder_.decodeGroup(group.blocks[0], group.blocks[1], group.blocks[2],
+                           group.blocks[3]);
+  if (decoded & si4703::RdsDecoder::PI_CHANGED)
+    forget();
+
+  Si4703_RdsEvent event;
+  event.value = 0;
+  event.clock = 0;
+  event.offset = 0;
+  if (decoded & si4703::RdsDecoder::PS_COMPLETE && ps_ != decoder_.ps) {
+    ps_ = decoder_.ps;
+    event.text = ps_;
+    emit(&event, Si4703_RdsEvent::PS, now);
+    event.text.clear();
+  }
+  if (decoded & si4703::RdsDecoder::RT_COMPLETE) {
+    // Without the padding, up to the carriage return if there was one.
+    size_t length = strlen(decoder_.rt);
+    while (length && decoder_.rt[length - 1] == ' ')
+      length--;
+    if (rt_.compare(0, std::string::npos, decoder_.rt, length) != 0) {
+      rt_.assign(decoder_.rt, length);
+      event.text = rt_;
+      emit(&event, Si4703_RdsEvent::RT, now);
+      event.text.clear();
+    }
+  }
+  if (decoder_.pty != pty_) {
+    pty_ = decoder_.pty;
+    event.value = pty_;
+    emit(&event, Si4703_RdsEvent::PTY, now);
+  }
+  if (decoder_.tp != tp_) {
+    tp_ = decoder_.tp;
+    event.value = tp_;
+    emit(&event, Si4703_RdsEvent::TP, now);
+  }
+  // TA only comes with 0A and 0B groups.
+  if (group.type() == 0 && decoder_.ta != ta_) {
+    ta_ = decoder_.ta;
+    event.value = ta_;
+    emit(&event, Si4703_RdsEvent::TA, now);
+  }
+  if (group.type() == 4 && group.version() == 0) {
+    const uint16_t* blocks = group.blocks;
+    const uint32_t mjd = ((blocks[1] & 0x3) << 15) | (blocks[2] >> 1);
+    const int hour = ((blocks[2] & 0x1) << 4) | (blocks[3] >> 12);
+    const int minute = (blocks[3] >> 6) & 0x3F;
+    const int offset = blocks[3] & 0x1F;
+    if (mjd >= MJD_EPOCH && hour < 24 && minute < 60) {
+      event.value = 0;
+      event.clock = (static_cast<time_t>(mjd - MJD_EPOCH) * 24 + hour) * 3600 +
+                    minute * 60;
+      event.offset = blocks[3] & 0x20 ? -offset : offset;
+      emit(&event, Si4703_RdsEvent::CT, now);
+    }
+  }
+}
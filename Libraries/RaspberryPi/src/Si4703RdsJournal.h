@@ -0,0 +1,254 @@
+//
+// Journal of decoded RDS changes.
+//
+// Raw groups are too many to keep for long, but what they said and when it
+// changed is worth keeping for good. Si4703_RdsJournalMonitor decodes the
+// groups of one tuner and hands every change of PS name, RadioText, PTY, TP
+// or TA, and every clock time (CT), to a Si4703_RdsJournal. The journal
+// queues them and a writer thread of its own appends them to segment files
+// in a directory, so the RDS threads never wait for the disk. If the queue
+// is full, changes are dropped and counted, never waited for.
+//
+// The writer gathers changes in blocks per station, a PI on a frequency. A
+// block is written once it holds |block_events| changes or has waited for
+// |flush_interval|. Each segment keeps an index of its blocks in memory, by
+// PI and by frequency, with their time spans and the kinds of change in
+// them. A query for one PI or one frequency over a time span reads only the
+// blocks the index picks out. The index is rebuilt from the block headers
+// when the journal is opened, and a block cut short by a crash is dropped.
+//
+// compact() seals the segment being written. It then rewrites every
+// segment written since the last compaction into one, without the changes
+// that repeat the value before them from the same station. Repeats come
+// from a second tuner on the station, a retune that decodes the same name
+// again, and a clock that keeps the same offset from ours, to the minute.
+// The compacted segment holds each station's changes together, a kind at a
+// time, so the index can skip the blocks of other kinds. Older compacted
+// segments are left as they are. Each compacted segment ends with the last
+// value of every station, where the next compaction picks up.
+//
+// Segment file format, integers little-endian:
+//
+//   segment: "S4RJ" version:u8 compacted:u8 reserved:u16 covers_from:u32
+//            block*
+//   block:   kind:u8 pi:u16 frequency:u16 types:u8 count:u16
+//            first_time:i64 last_time:i64 length:u32 payload:u8[length]
+//   event:   type:u8 tuner:u8 time:varint value
+//
+// A compacted segment replaces the segments numbered |covers_from| up to
+// its own number. kind is 'E' for a block of events and 'S' for the state
+// block ending a compacted segment. The time of an event is in seconds
+// after the block's first_time. value is the PS name (8 bytes), the
+// RadioText (length:u8 and the text), the PTY, TP or TA (u8), or for CT the
+// zigzag varint of the station's UTC time minus the event's, and the
+// station's local offset (i8, half hours).
+//
+
+#ifndef Si4703RdsJournal_h
+#define Si4703RdsJournal_h
+
+#include <time.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <inttypes.h>
+
+#include "SparkFunSi4703.h"
+
+struct Si4703_RdsEvent {
+  enum Type : uint8_t { PS, RT, PTY, TP, TA, CT };
+
+  // Masks of types for queries.
+  static const uint8_t ALL = 0x3F;
+  static uint8_t mask(Type type) { return 1 << type; }
+
+  Type type;
+  time_t time;         // Received, seconds since the epoch.
+  uint16_t pi;
+  uint16_t frequency;  // 10 kHz units, as in Si4703_StatusSnapshot.
+  uint8_t tuner;
+  std::string text;    // PS: 8 characters; RT: up to 64.
+  uint8_t value;       // PTY: 0..31; TP, TA: 0 or 1.
+  time_t clock;        // CT: the station's UTC time.
+  int8_t offset;       // CT: its local time offset, in half hours.
+};
+
+class Si4703_RdsJournal {
+ public:
+  struct Config {
+    // Changes waiting for the writer; more are dropped.
+    size_t queue_events = 65536;
+    int block_events = 256;
+    std::chrono::seconds flush_interval = std::chrono::seconds(10);
+    // A segment is sealed and a new one started at this size.
+    uint64_t segment_bytes = 64 << 20;
+    // Run compact() this often on a thread of its own. 0 never does.
+    std::chrono::seconds compact_interval = std::chrono::seconds(0);
+  };
+
+  struct Stats {
+    uint64_t queued;
+    uint64_t dropped;   // The queue was full.
+    uint64_t written;   // Changes in blocks on disk.
+    uint64_t blocks;
+    uint64_t bytes;     // Of all segments.
+    uint64_t segments;
+    uint64_t compactions;
+    uint64_t removed;   // Repeats dropped by compaction.
+    uint64_t blocks_read;  // By queries.
+    uint64_t bytes_read;
+  };
+
+  Si4703_RdsJournal(const std::string& directory, const Config& config);
+  ~Si4703_RdsJournal();
+
+  // Load the segments in the directory, creating it if need be, and start
+  // the writer.
+  Status open();
+  // Write out what is queued and stop.
+  void close();
+
+  // Queue |event| for the writer. Never waits for I/O. Returns false if the
+  // queue was full and |event| was dropped.
+  bool add(const Si4703_RdsEvent& event);
+
+  // Wait until everything queued so far is written.
+  void flush();
+
+  // Rewrite the segments written since the last compaction without repeated
+  // values. add() and queries carry on meanwhile.
+  Status compact();
+
+  // The changes of |types| from |pi|, or on |frequency|, received from
+  // |from| to |to|, both included, in the order they were received.
+  // Changes still waiting to be written are included.
+  std::vector<Si4703_RdsEvent> byPi(uint16_t pi,
+                                    time_t from,
+                                    time_t to,
+                                    uint8_t types = Si4703_RdsEvent::ALL);
+  std::vector<Si4703_RdsEvent> byFrequency(
+      uint16_t frequency,
+      time_t from,
+      time_t to,
+      uint8_t types = Si4703_RdsEvent::ALL);
+
+  Stats stats();
+
+ private:
+  // A station, a PI on a frequency.
+  using StationKey = uint32_t;
+  // A station and a type, for the last values compaction compares with.
+  using StateKey = uint64_t;
+
+  struct Block {
+    uint16_t pi;
+    uint16_t frequency;
+    uint8_t types;
+    uint16_t count;
+    time_t first_time;
+    time_t last_time;
+    uint64_t offset;  // Of the payload.
+    uint32_t length;
+  };
+
+  struct Segment;
+  struct Pending {
+    std::vector<Si4703_RdsEvent> events;
+    std::chrono::steady_clock::time_point since;  // Of the first.
+  };
+
+  std::string segmentPath(uint32_t sequence) const;
+  Status load();
+  Status loadSegment(uint32_t sequence, std::shared_ptr<Segment>* segment);
+  Status startSegmentLocked();
+  void sealLocked();
+  Status writeBlock(Segment* segment,
+                    char kind,
+                    uint16_t pi,
+                    uint16_t frequency,
+                    const Si4703_RdsEvent* events,
+                    size_t count,
+                    const std::vector<uint8_t>& state);
+  void writePendingLocked(StationKey key);
+  void run();
+  void runCompactions();
+  std::vector<Si4703_RdsEvent> query(bool by_pi,
+                                     uint16_t code,
+                                     time_t from,
+                                     time_t to,
+                                     uint8_t types);
+  Status readBlock(const Segment& segment,
+                   const Block& block,
+                   std::vector<Si4703_RdsEvent>* events);
+
+  std::string directory_;
+  Config config_;
+  std::thread writer_;
+  std::thread compactor_;
+
+  std::mutex queue_mutex_;  // Protects the variables below.
+  std::condition_variable queue_cv_;
+  std::vector<Si4703_RdsEvent> queue_;
+  bool stop_;
+  uint64_t flush_requests_;
+  uint64_t flushed_;
+  std::condition_variable flushed_cv_;
+  uint64_t queued_;
+  uint64_t dropped_;
+  std::condition_variable compact_cv_;  // Wakes the compactor to stop.
+
+  std::mutex compact_mutex_;  // Held for a whole compaction.
+
+  std::mutex mutex_;  // Protects everything below.
+  std::vector<std::shared_ptr<Segment>> segments_;  // Oldest first.
+  std::shared_ptr<Segment> active_;  // The last of segments_, or null.
+  uint32_t next_sequence_;
+  std::unordered_map<StationKey, Pending> pending_;
+  // The last value of each station and type, as of the newest compacted
+  // segment.
+  std::unordered_map<StateKey, uint64_t> state_;
+  Stats stats_;
+};
+
+class Si4703_RdsJournalMonitor {
+ public:
+  // Journal the RDS changes |radio| receives as |tuner|. With a null
+  // |radio|, only what is passed to addGroup().
+  Si4703_RdsJournalMonitor(Si4703_Breakout* radio,
+                           Si4703_RdsJournal* journal,
+                           uint8_t tuner);
+  ~Si4703_RdsJournalMonitor();
+
+  // Decode |group|, received on |frequency| (10 kHz units) at |now|, and
+  // journal what changed. The group listener calls this on the RDS thread;
+  // it is public for replaying recorded groups.
+  void addGroup(const RdsGroup& group, uint16_t frequency, time_t now);
+
+ private:
+  void forget();
+  void emit(Si4703_RdsEvent* event, Si4703_RdsEvent::Type type, time_t now);
+
+  Si4703_Breakout* radio_;
+  Si4703_RdsJournal* journal_;
+  uint8_t tuner_;
+  int listener_id_;
+  std::mutex mutex_;  // Protects everything below.
+  si4703::RdsDecoder decoder_;
+  uint16_t frequency_;
+  // The values last journaled since the station was tuned in, so each
+  // change goes out once.
+  std::string ps_;
+  std::string rt_;
+  int pty_;  // -1 until the first group.
+  int tp_;
+  int ta_;
+};
+
+#endif
@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <map>
+
+#include <stdio.h>
+
+#include "Si4703SeekCalibration.h"
+#include "Si4703Survey.h"
+
+namespace {
+
+// Candidate values, searched one field at a time.
+const std::vector<uint8_t> kCandidates[] = {
+    {10, 15, 20, 25, 30, 35},  // SEEKTH.
+    {0, 2, 4, 6, 8},           // SKSNR.
+    {0, 4, 8, 12},             // SKCNT.
+};
+uint8_t Si4703_SeekThresholds::*const kFields[] = {
+    &Si4703_SeekThresholds::rssi,
+    &Si4703_SeekThresholds::snr,
+    &Si4703_SeekThresholds::impulses,
+};
+const char* const kNames[] = {"SEEKTH", "SKSNR", "SKCNT"};
+const int MAX_PASSES = 3;
+
+bool SameChannel(float a, float b) {
+  return std::fabs(a - b) < 0.01f;
+}
+
+int Cost(const Si4703_SeekSweep& sweep) {
+  return 2 * sweep.misses + sweep.false_stops;
+}
+
+// Ties go to a clearly faster sweep.
+bool Better(const Si4703_SeekSweep& a, const Si4703_SeekSweep& b) {
+  if (Cost(a) != Cost(b))
+    return Cost(a) < Cost(b);
+  return a.time.count() < 0.9 * b.time.count();
+}
+
+uint32_t Key(const Si4703_SeekThresholds& thresholds) {
+  return thresholds.rssi << 16 | thresholds.snr << 8 | thresholds.impulses;
+}
+
+}  // anonymous namespace
+
+Si4703_SeekCalibration::Si4703_SeekCalibration(Si4703_Breakout* radio)
+    : radio_(radio), surveyed_(false) {}
+
+void Si4703_SeekCalibration::survey() {
+  const float home = radio_->getFrequency();
+  std::vector<Si4703_ChannelReport> reports;
+  {
+    Si4703_SurveyScheduler scheduler({radio_});
+    reports = scheduler.run();
+  }
+  stations_.clear();
+  for (const Si4703_ChannelReport& report : reports) {
+    if (report.pi || report.stereo)
+      stations_.push_back(report.frequency);
+  }
+  std::sort(stations_.begin(), stations_.end());
+  surveyed_ = true;
+  radio_->setFrequency(home);
+}
+
+bool Si4703_SeekCalibration::isStation(float frequency) const {
+  for (float station : stations_) {
+    if (SameChannel(station, frequency))
+      return true;
+  }
+  return false;
+}
+
+Si4703_SeekSweep Si4703_SeekCalibration::sweep(
+    const Si4703_SeekThresholds& thresholds) {
+  radio_->setSeekThresholds(thresholds);
+  const float bottom = radio_->minFrequency();
+  radio_->setFrequency(bottom);
+
+  Si4703_SeekSweep result{{}, 0, 0, std::chrono::milliseconds(0)};
+  const auto start = std::chrono::steady_clock::now();
+  const int channels =
+      std::lround((radio_->maxFrequency() - bottom) / radio_->channelSpacing());
+  float last = bottom;
+  for (int i = 0; i < channels; i++) {
+    const float frequency = radio_->seek(SeekDirection::Up);
+    if (frequency <= last + 0.001f)
+      break;  // 0: reached the band limit.
+    result.stops.push_back(frequency);
+    if (!isStation(frequency))
+      result.false_stops++;
+    last = frequency;
+  }
+  result.time = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+
+  // Seeking up can't stop on the channel it starts from.
+  for (float station : stations_) {
+    if (SameChannel(station, bottom))
+      continue;
+    if (std::none_of(result.stops.begin(), result.stops.end(),
+                     [&](float stop) { return SameChannel(stop, station); }))
+      result.misses++;
+  }
+  return result;
+}
+
+Si4703_SeekCalibration::Result Si4703_SeekCalibration::run() {
+  if (!surveyed_)
+    survey();
+  const float home = radio_->getFrequency();
+
+  std::map<uint32_t, Si4703_SeekSweep> tried;
+  auto evaluate = [&](const Si4703_SeekThresholds& thresholds)
+      -> const Si4703_SeekSweep& {
+    auto it = tried.find(Key(thresholds));
+    if (it == tried.end())
+      it = tried.emplace(Key(thresholds), sweep(thresholds)).first;
+    return it->second;
+  };
+
+  Si4703_SeekThresholds best = radio_->seekThresholds();
+  bool improved = true;
+  for (int pass = 0; pass < MAX_PASSES && improved; pass++) {
+    improved = false;
+    for (int field = 0; field < 3; field++) {
+      for (uint8_t value : kCandidates[field]) {
+        Si4703_SeekThresholds candidate = best;
+        candidate.*kFields[field] = value;
+        if (Better(evaluate(candidate), evaluate(best))) {
+          best = candidate;
+          improved = true;
+        }
+      }
+    }
+  }
+
+  radio_->setSeekThresholds(best);
+  radio_->setFrequency(home);
+  return Result{best, tried[Key(best)], static_cast<int>(tried.size())};
+}
+
+Status Si4703_SeekCalibration::save(const std::string& path,
+                                    const Si4703_SeekThresholds& thresholds) {
+  std::ofstream file(path);
+  file << "# Si4703 seek thresholds, see Si4703SeekCalibration.h." << '\n';
+  for (int field = 0; field < 3; field++)
+    file << kNames[field] << ' ' << int(thresholds.*kFields[field]) << '\n';
+  file.close();
+  if (!file) {
+    perror(path.c_str());
+    return Status::FAIL;
+  }
+  return Status::SUCCESS;
+}
+
+Status Si4703_SeekCalibration::load(const std::string& path,
+                                    Si4703_SeekThresholds* thresholds) {
+  std::ifstream file(path);
+  if (!file) {
+    perror(path.c_str());
+    return Status::FAIL;
+  }
+  Si4703_SeekThresholds loaded = *thresholds;
+  int found = 0;
+  std::string name;
+  while (file >> name) {
+    if (name[0] == '#') {
+      std::getline(file, name);
+      continue;
+    }
+    int value;
+    if (!(file >> value))
+      break;
+    for (int field = 0; field < 3; field++) {
+      if (name == kNames[field]) {
+        loaded.*kFields[field] = std::max(0, std::min(value, 127));
+        found |= 1 << field;
+      }
+    }
+  }
+  if (found != 0x7) {
+    fprintf(stderr, "%s: not a seek threshold file\n", path.c_str());
+    return Status::FAIL;
+  }
+  *thresholds = loaded;
+  return Status::SUCCESS;
+}
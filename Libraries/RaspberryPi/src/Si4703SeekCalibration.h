@@ -0,0 +1,69 @@
+//
+// Seek threshold calibration.
+//
+// The chip's reset thresholds suit no place in particular: where there is
+// interference seeks stop on it, and where stations are weak seeks skip
+// them. Every needless stop costs a tune. Si4703_SeekCalibration surveys
+// the band once to learn which channels carry a station, then sweeps the
+// band with seek() under candidate thresholds. A sweep counts the stops
+// on other channels (false stops) and the stations passed over (misses).
+// The calibration keeps the thresholds with the fewest of both. They can
+// be saved to a file and set again after the next power on.
+//
+
+#ifndef Si4703SeekCalibration_h
+#define Si4703SeekCalibration_h
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "SparkFunSi4703.h"
+
+struct Si4703_SeekSweep {
+  std::vector<float> stops;  // Where seek up stopped, in MHz.
+  int false_stops;           // Stops on channels without a station.
+  int misses;                // Stations passed over.
+  std::chrono::milliseconds time;
+};
+
+class Si4703_SeekCalibration {
+ public:
+  struct Result {
+    Si4703_SeekThresholds thresholds;
+    Si4703_SeekSweep sweep;  // With |thresholds|.
+    int sweeps;              // Thresholds tried.
+  };
+
+  // |radio| must be powered on.
+  explicit Si4703_SeekCalibration(Si4703_Breakout* radio);
+
+  // Find the stations to calibrate against with a Si4703_SurveyScheduler
+  // run. A channel has a station if it is in stereo or carries RDS.
+  void survey();
+  const std::vector<float>& stations() const { return stations_; }
+
+  // Seek up from the bottom of the band to the top with |thresholds| and
+  // compare the stops with the survey.
+  Si4703_SeekSweep sweep(const Si4703_SeekThresholds& thresholds);
+
+  // Survey unless done already, then search for the thresholds with the
+  // fewest misses and false stops, a miss counting double. Leaves the best
+  // thresholds set and the radio tuned back where it was.
+  Result run();
+
+  // Persist thresholds as a small text file.
+  static Status save(const std::string& path,
+                     const Si4703_SeekThresholds& thresholds);
+  static Status load(const std::string& path,
+                     Si4703_SeekThresholds* thresholds);
+
+ private:
+  bool isStation(float frequency) const;
+
+  Si4703_Breakout* radio_;
+  bool surveyed_;
+  std::vector<float> stations_;  // MHz, ascending.
+};
+
+#endif
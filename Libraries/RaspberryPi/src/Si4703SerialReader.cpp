@@ -0,0 +1,137 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "Si4703SerialReader.h"
+
+using namespace si4703;
+
+namespace {
+
+// Bytes read per read(): about 30 frames.
+const size_t READ_CHUNK = 384;
+
+speed_t Speed(int baud) {
+  switch (baud) {
+    case 9600:
+      return B9600;
+    case 19200:
+      return B19200;
+    case 38400:
+      return B38400;
+    case 57600:
+      return B57600;
+    case 115200:
+      return B115200;
+    case 230400:
+      return B230400;
+    case 460800:
+      return B460800;
+    case 921600:
+      return B921600;
+    default:
+      return B0;
+  }
+}
+
+}  // anonymous namespace
+
+Si4703_SerialRdsReader::Si4703_SerialRdsReader(uint8_t max_errors)
+    : fd_(-1), bytes_(0), rejected_(0) {
+  decoder_.max_errors = max_errors;
+}
+
+Si4703_SerialRdsReader::~Si4703_SerialRdsReader() {
+  close();
+}
+
+Status Si4703_SerialRdsReader::open(const std::string& path, int baud) {
+  close();
+  const speed_t speed = Speed(baud);
+  if (speed == B0) {
+    fprintf(stderr, "Unsupported baud rate %d\n", baud);
+    return Status::FAIL;
+  }
+  const int fd = ::open(path.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if (fd < 0) {
+    perror(path.c_str());
+    return Status::FAIL;
+  }
+  termios tio;
+  if (tcgetattr(fd, &tio) == 0) {
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    if (tcsetattr(fd, TCSANOW, &tio) < 0) {
+      perror(path.c_str());
+      ::close(fd);
+      return Status::FAIL;
+    }
+    // Bytes from before the port was set up may be at the wrong rate.
+    tcflush(fd, TCIFLUSH);
+  }
+  open(fd);
+  return Status::SUCCESS;
+}
+
+void Si4703_SerialRdsReader::open(int fd) {
+  close();
+  fd_ = fd;
+}
+
+void Si4703_SerialRdsReader::close() {
+  if (fd_ >= 0)
+    ::close(fd_);
+  fd_ = -1;
+}
+
+Status Si4703_SerialRdsReader::poll(std::chrono::milliseconds timeout) {
+  if (fd_ < 0)
+    return Status::FAIL;
+  pollfd pfd = {fd_, POLLIN, 0};
+  const int ready = ::poll(&pfd, 1, timeout.count());
+  if (ready < 0)
+    return errno == EINTR ? Status::SUCCESS : Status::FAIL;
+  if (ready == 0)
+    return Status::SUCCESS;
+  uint8_t buffer[READ_CHUNK];
+  const ssize_t n = ::read(fd_, buffer, sizeof(buffer));
+  if (n < 0)
+    return errno == EINTR || errno == EAGAIN ? Status::SUCCESS : Status::FAIL;
+  // A hung up line polls readable and reads nothing.
+  if (n == 0)
+    return Status::FAIL;
+  feed(buffer, n);
+  return Status::SUCCESS;
+}
+
+void Si4703_SerialRdsReader::feed(const uint8_t* bytes, size_t length) {
+  bytes_ += length;
+  for (size_t i = 0; i < length; i++) {
+    if (!parser_.feed(bytes[i]))
+      continue;
+    const uint8_t bler = parser_.block_errors;
+    if ((bler >> 6) > decoder_.max_errors ||
+        ((bler >> 4) & 0x3) > decoder_.max_errors ||
+        ((bler >> 2) & 0x3) > decoder_.max_errors ||
+        (bler & 0x3) > decoder_.max_errors) {
+      rejected_++;
+      continue;
+    }
+    const uint16_t* b = parser_.blocks;
+    const uint8_t events = decoder_.decodeGroup(b[0], b[1], b[2], b[3]);
+    if (listener_)
+      listener_(decoder_, events);
+  }
+}
+
+Si4703_SerialRdsReader::Stats Si4703_SerialRdsReader::stats() const {
+  return Stats{bytes_, parser_.frames, parser_.bad_frames, parser_.lost,
+               rejected_};
+}
@@ -0,0 +1,75 @@
+//
+// Host side of RDS capture over a serial line.
+//
+// The Arduino library's capture() and nextRDSFrame() stream every RDS group
+// the chip receives as si4703::encodeRdsFrame() frames (see
+// examples/Si4703_RDS_Capture). Si4703_SerialRdsReader reads them from the
+// tty, finds the frames with si4703::RdsFrameParser and decodes the groups
+// with si4703::RdsDecoder, so the microcontroller only has to move bytes.
+// Frames that fail their CRC are dropped; groups the sender had to drop
+// show up as gaps in the frame sequence numbers and are counted.
+//
+
+#ifndef Si4703SerialReader_h
+#define Si4703SerialReader_h
+
+#include <chrono>
+#include <functional>
+#include <string>
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "Si4703Bus.h"
+#include "Si4703Core.h"
+
+class Si4703_SerialRdsReader {
+ public:
+  // Called for each group that passed the error check, with the decoder
+  // state after it and the si4703::RdsDecoder::Event bits it raised.
+  using Listener =
+      std::function<void(const si4703::RdsDecoder& decoder, uint8_t events)>;
+
+  struct Stats {
+    uint64_t bytes;
+    uint64_t frames;      // With a good CRC.
+    uint64_t bad_frames;  // Dropped for their CRC.
+    uint64_t lost;        // Groups missing from the frame sequence.
+    uint64_t rejected;    // Good frames with a block over max_errors.
+  };
+
+  // Groups with any block worse than |max_errors| (BLER level, 0-3) are
+  // not decoded. The capture sketch doesn't turn on RDS verbose mode, so
+  // blocks B-D report 0 and the chip itself drops groups it can't correct.
+  explicit Si4703_SerialRdsReader(uint8_t max_errors = 2);
+  ~Si4703_SerialRdsReader();
+
+  // Opens the tty at |path| raw at |baud| (e.g. 115200). Anything that
+  // isn't a tty, such as a pipe or a pty master, is used as it is.
+  Status open(const std::string& path, int baud);
+  // Reads from an already open descriptor instead; the reader closes it.
+  void open(int fd);
+  void close();
+
+  void setListener(Listener listener) { listener_ = listener; }
+
+  // Waits up to |timeout| for input and decodes whatever has arrived. Fails
+  // when the line is closed or the read fails.
+  Status poll(std::chrono::milliseconds timeout);
+
+  // Decodes |length| bytes of the stream.
+  void feed(const uint8_t* bytes, size_t length);
+
+  const si4703::RdsDecoder& decoder() const { return decoder_; }
+  Stats stats() const;
+
+ private:
+  int fd_;
+  si4703::RdsFrameParser parser_;
+  si4703::RdsDecoder decoder_;
+  Listener listener_;
+  uint64_t bytes_;
+  uint64_t rejected_;
+};
+
+#endif
@@ -0,0 +1,605 @@
+#include <algorithm>
+#include <cmath>
+
+#include "Si4703Core.h"
+#include "Si4703Sim.h"
+
+using namespace si4703;
+
+namespace {
+
+// RDS groups are sent at ~11.4 groups/s and RDSR stays set for 40 ms, or
+// until the next group.
+const std::chrono::microseconds GROUP_INTERVAL(87600);
+const std::chrono::microseconds RDSR_HOLD(40000);
+
+// A host that hasn't read for this many groups is taken to have stopped
+// polling (the radio was off, say), and the stream starts over rather than
+// counting them all as missed.
+const int MAX_CATCH_UP = 16;
+
+// Signal strength reported on a channel with no transmitter.
+const int NOISE_FLOOR = 8;  // dBuV.
+
+// Register values of a powered up Si4703 rev C.
+const uint16_t DEVICEID_VALUE = 0x1242;
+const uint16_t CHIPID_VALUE = 0x1253;
+
+// Method A alternative frequency codes, see IEC 62106 section 3.2.1.6.1.
+const uint8_t AF_FILLER = 205;
+const uint8_t AF_COUNT_BASE = 224;
+
+uint8_t AFCode(float frequency) {
+  return static_cast<uint8_t>(std::lround((frequency - 87.5f) * 10));
+}
+
+// The codes sent for |af|: their number, then one per frequency, padded to
+// whole pairs. None for no frequencies.
+std::vector<uint8_t> AFCodes(const std::vector<float>& af) {
+  std::vector<uint8_t> codes;
+  if (af.empty())
+    return codes;
+  codes.push_back(AF_COUNT_BASE + af.size());
+  for (float f : af)
+    codes.push_back(AFCode(f));
+  if (codes.size() % 2)
+    codes.push_back(AF_FILLER);
+  return codes;
+}
+
+// The PTY and TP bits of block B: TP, PTY 10 (pop music).
+const uint16_t PTY_TP = (1 << 10) | (10 << 5);
+
+// 14A variants sent for each linked network in turn: the PS name (0-3), the
+// AF list (4) and PTY(ON) and TA(ON) (13).
+const uint8_t EON_VARIANTS[] = {0, 1, 2, 3, 4, 13};
+const unsigned EON_VARIANT_COUNT = sizeof(EON_VARIANTS);
+
+// 14B groups sent for a change of TA(ON), as stations repeat them.
+const int TA_REPEATS = 4;
+
+}  // anonymous namespace
+
+Si4703_SimulatedChip::Si4703_SimulatedChip()
+    : tune_time_(60000),
+      group_interval_(GROUP_INTERVAL),
+      tuning_(false),
+      tune_channel_(0),
+      seek_failed_(false),
+      rds_unread_(false),
+      group_counter_(0),
+      audible_(false),
+      heard_(false),
+      audio_stats_{0, std::chrono::microseconds(0),
+                   std::chrono::microseconds(0)},
+      bus_stats_{0, 0, 0, 0, 0},
+      rds_stats_{0, 0} {
+  resetRegisters();
+}
+
+void Si4703_SimulatedChip::resetRegisters() {
+  std::fill(regs_, regs_ + NUM_REGISTERS, 0);
+  regs_[DEVICEID] = DEVICEID_VALUE;
+  regs_[CHIPID] = CHIPID_VALUE;
+  set<SEEKTH>(regs_, 0x19);  // Reset value from the datasheet.
+}
+
+void Si4703_SimulatedChip::addTransmitter(const Transmitter& transmitter) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  transmitters_.push_back(transmitter);
+  text_ab_.push_back(0);
+  ta_.push_back(0);
+  links_.emplace_back();
+}
+
+void Si4703_SimulatedChip::addInterference(const Interference& interference) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  interference_.push_back(interference);
+}
+
+void Si4703_SimulatedChip::setRSSI(float frequency, int rssi) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (Transmitter& tx : transmitters_) {
+    if (std::fabs(tx.frequency - frequency) < 0.01f)
+      tx.rssi = rssi;
+  }
+}
+
+void Si4703_SimulatedChip::setPS(float frequency, const std::string& ps) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (Transmitter& tx : transmitters_) {
+    if (std::fabs(tx.frequency - frequency) < 0.01f)
+      tx.ps = ps;
+  }
+}
+
+void Si4703_SimulatedChip::setRadioText(float frequency,
+                                        const std::string& radio_text) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (size_t i = 0; i < transmitters_.size(); i++) {
+    if (std::fabs(transmitters_[i].frequency - frequency) < 0.01f &&
+        transmitters_[i].radio_text != radio_text) {
+      transmitters_[i].radio_text = radio_text;
+      text_ab_[i] ^= 1;
+    }
+  }
+}
+
+void Si4703_SimulatedChip::addOtherNetwork(
+    float frequency,
+    const Si4703_RdsStation::Other& other) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (size_t i = 0; i < transmitters_.size(); i++) {
+    if (std::fabs(transmitters_[i].frequency - frequency) < 0.01f)
+      links_[i].push_back(Link{other, false, 0});
+  }
+}
+
+void Si4703_SimulatedChip::setTA(uint16_t pi, bool ta) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (size_t i = 0; i < transmitters_.size(); i++) {
+    if (transmitters_[i].pi == pi)
+      ta_[i] = ta;
+    for (Link& link : links_[i]) {
+      if (link.other.pi == pi && link.ta != ta) {
+        link.ta = ta;
+        link.repeats = TA_REPEATS;
+      }
+    }
+  }
+}
+
+void Si4703_SimulatedChip::setTuneTime(std::chrono::microseconds tune_time) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  tune_time_ = tune_time;
+}
+
+void Si4703_SimulatedChip::setGroupInterval(
+    std::chrono::microseconds group_interval) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  group_interval_ = group_interval;
+}
+
+Si4703_SimulatedChip::AudioStats Si4703_SimulatedChip::audioStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  AudioStats stats = audio_stats_;
+  if (heard_ && !audible_) {  // Count the gap we are in right now.
+    auto gap = std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now() - gap_start_);
+    stats.gaps++;
+    stats.total += gap;
+    stats.longest = std::max(stats.longest, gap);
+  }
+  return stats;
+}
+
+void Si4703_SimulatedChip::resetAudioStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  audio_stats_ = AudioStats{0, std::chrono::microseconds(0),
+                            std::chrono::microseconds(0)};
+  gap_start_ = Clock::now();
+}
+
+Si4703_SimulatedChip::BusStats Si4703_SimulatedChip::busStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return bus_stats_;
+}
+
+Si4703_SimulatedChip::RdsStats Si4703_SimulatedChip::rdsStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return rds_stats_;
+}
+
+Status Si4703_SimulatedChip::open() {
+  return Status::SUCCESS;
+}
+
+Status Si4703_SimulatedChip::read(uint8_t* buffer, int length) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  bus_stats_.transactions++;
+  readLocked(buffer, length);
+  return Status::SUCCESS;
+}
+
+Status Si4703_SimulatedChip::write(const uint8_t* buffer, int length) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  bus_stats_.transactions++;
+  writeLocked(buffer, length);
+  return Status::SUCCESS;
+}
+
+Status Si4703_SimulatedChip::transfer(const Si4703_BusMessage* messages,
+                                      int count) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  bus_stats_.transactions++;
+  for (int i = 0; i < count; i++) {
+    if (messages[i].read)
+      readLocked(messages[i].buffer, messages[i].length);
+    else
+      writeLocked(messages[i].buffer, messages[i].length);
+  }
+  return Status::SUCCESS;
+}
+
+void Si4703_SimulatedChip::readLocked(uint8_t* buffer, int length) {
+  advance(Clock::now());
+  bus_stats_.reads++;
+  bus_stats_.bytes_read += length;
+  if (get<RDSR>(regs_))
+    rds_unread_ = false;
+
+  // Same wraparound order as the chip: 0x0A..0x0F, 0x00..0x09.
+  uint8_t reg = READ_START;
+  for (int i = 0; i + 1 < length; i += 2) {
+    buffer[i] = regs_[reg] >> 8;
+    buffer[i + 1] = regs_[reg] & 0xFF;
+    reg = (reg + 1) & 0x0F;
+  }
+}
+
+void Si4703_SimulatedChip::writeLocked(const uint8_t* buffer, int length) {
+  const Clock::time_point now = Clock::now();
+  advance(now);
+  bus_stats_.writes++;
+  bus_stats_.bytes_written += length;
+
+  const bool was_tune = get<TUNE>(regs_);
+  const bool was_seek = get<SEEK>(regs_);
+  for (int i = 0; i + 1 < length && WRITE_START + i / 2 < READ_START; i += 2)
+    regs_[WRITE_START + i / 2] = static_cast<uint16_t>(buffer[i] << 8) |
+                                 buffer[i + 1];
+
+  if (get<TUNE>(regs_) && !was_tune) {
+    tuning_ = true;
+    tune_channel_ = get<CHAN>(regs_);
+    tune_done_at_ = now + tune_time_;
+    set<STC>(regs_, 0);
+    set<RDSR>(regs_, 0);
+    set<RDSS>(regs_, 0);
+    rds_unread_ = false;
+  } else if (get<SEEK>(regs_) && !was_seek) {
+    startSeek(now);
+  }
+  // Clearing TUNE/SEEK after STC lets the chip clear STC.
+  if (!get<TUNE>(regs_) && !get<SEEK>(regs_) && !tuning_)
+    set<STC>(regs_, 0);
+
+  updateAudio(now);
+}
+
+Status Si4703_SimulatedChip::reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  resetRegisters();
+  tuning_ = false;
+  seek_failed_ = false;
+  updateAudio(Clock::now());
+  return Status::SUCCESS;
+}
+
+float Si4703_SimulatedChip::channelFrequency(uint16_t channel) const {
+  return channelToFrequency(channel, get<BAND>(regs_), get<SPACE>(regs_)) /
+         100.0f;
+}
+
+const Si4703_SimulatedChip::Transmitter* Si4703_SimulatedChip::transmitterAt(
+    float frequency) const {
+  const Transmitter* best = nullptr;
+  for (const Transmitter& tx : transmitters_) {
+    if (std::fabs(tx.frequency - frequency) < 0.01f &&
+        (!best || tx.rssi > best->rssi))
+      best = &tx;
+  }
+  return best;
+}
+
+const Si4703_SimulatedChip::Interference*
+Si4703_SimulatedChip::interferenceAt(float frequency) const {
+  for (const Interference& interference : interference_) {
+    if (std::fabs(interference.frequency - frequency) < 0.01f)
+      return &interference;
+  }
+  return nullptr;
+}
+
+// Whether a seek stops on |channel|. A station's SNR is its height above
+// the noise floor, and weak stations pick up some impulse noise. SKSNR n
+// asks for 2n dB of SNR, SKCNT n allows 16 - n impulses.
+bool Si4703_SimulatedChip::seekStopsAt(int channel) const {
+  const float frequency = channelFrequency(channel);
+  int rssi = NOISE_FLOOR, snr = 0, impulses = 15;
+  if (const Transmitter* tx = transmitterAt(frequency)) {
+    rssi = tx->rssi;
+    snr = tx->rssi - NOISE_FLOOR;
+    impulses = std::max(0, (30 - tx->rssi) / 4);
+  } else if (const Interference* interference = interferenceAt(frequency)) {
+    rssi = interference->rssi;
+    snr = interference->snr;
+    impulses = interference->impulses;
+  }
+  const int sksnr = get<SKSNR>(regs_);
+  const int skcnt = get<SKCNT>(regs_);
+  return rssi >= get<SEEKTH>(regs_) && (!sksnr || snr >= 2 * sksnr) &&
+         (!skcnt || impulses <= 16 - skcnt);
+}
+
+// Bring the simulated chip up to |now|: finish a pending tune and deliver
+// any RDS group that is due.
+void Si4703_SimulatedChip::advance(Clock::time_point now) {
+  if (tuning_ && now >= tune_done_at_)
+    completeTune(tune_done_at_);
+  if (tuning_ || !get<PWR_ENABLE>(regs_))
+    return;
+
+  const float frequency = channelFrequency(get<READ_CHAN>(regs_));
+  const Transmitter* tx = transmitterAt(frequency);
+  const Interference* interference = interferenceAt(frequency);
+  int rssi = NOISE_FLOOR;
+  if (tx)
+    rssi = tx->rssi;
+  else if (interference)
+    rssi = interference->rssi;
+  set<RSSI>(regs_, rssi);
+  set<STEREO>(regs_, tx && tx->stereo && tx->rssi > 30 && !get<MONO>(regs_));
+
+  if (get<RDSR>(regs_) && now >= rdsr_clear_at_) {
+    set<RDSR>(regs_, 0);
+    if (rds_unread_)
+      rds_stats_.missed++;
+    rds_unread_ = false;
+  }
+  if (!tx || !get<RDS>(regs_) || tx->rssi < 20) {
+    next_group_at_ = now + group_interval_;
+    rds_unread_ = false;
+    return;
+  }
+  // Groups keep the broadcast's time whether or not they are read: one the
+  // host is too late for is overwritten by the next.
+  if (now - next_group_at_ > group_interval_ * MAX_CATCH_UP)
+    next_group_at_ = now;
+  while (now >= next_group_at_) {
+    const Clock::time_point sent_at = next_group_at_;
+    next_group_at_ += group_interval_;
+    if (rds_unread_)
+      rds_stats_.missed++;
+    rds_unread_ = false;
+    if (tx->rds) {
+      if (!tx->rds->load(regs_))
+        continue;  // Lost or uncorrectable.
+    } else {
+      nextGroup(*tx);
+    }
+    rds_stats_.sent++;
+    rds_unread_ = true;
+    set<RDSR>(regs_, 1);
+    set<RDSS>(regs_, 1);
+    rdsr_clear_at_ = sent_at + std::min(RDSR_HOLD, group_interval_);
+  }
+  if (get<RDSR>(regs_) && now >= rdsr_clear_at_) {
+    set<RDSR>(regs_, 0);  // The last group of a catch-up came and went.
+    if (rds_unread_)
+      rds_stats_.missed++;
+    rds_unread_ = false;
+  }
+}
+
+void Si4703_SimulatedChip::completeTune(Clock::time_point when) {
+  tuning_ = false;
+  set<READ_CHAN>(regs_, tune_channel_);
+  set<STC>(regs_, 1);
+  set<SFBL>(regs_, seek_failed_);
+  set<AFCRL>(regs_, 0);
+  seek_failed_ = false;
+  group_counter_ = 0;
+  // The first group needs a little while to be synchronised.
+  next_group_at_ = when + group_interval_;
+  updateAudio(when);
+}
+
+// Find the next channel meeting the seek criteria in the SEEKUP direction,
+// interference included. A seek costs one tune time per 8 channels passed,
+// at least one tune time.
+void Si4703_SimulatedChip::startSeek(Clock::time_point now) {
+  const uint8_t band = get<BAND>(regs_);
+  const uint8_t space = get<SPACE>(regs_);
+  const int channels =
+      frequencyToChannel(bandTop(band), band, space) + 1;
+  const int step = get<SEEKUP>(regs_) ? 1 : -1;
+  const bool wrap = !get<SKMODE>(regs_);
+
+  int channel = get<READ_CHAN>(regs_);
+  int passed = 0;
+  seek_failed_ = true;
+  for (passed = 1; passed < channels; passed++) {
+    channel += step;
+    if (channel < 0 || channel >= channels) {
+      if (!wrap)
+        break;
+      channel = (channel + channels) % channels;
+    }
+    if (seekStopsAt(channel)) {
+      seek_failed_ = false;
+      break;
+    }
+  }
+  if (seek_failed_)
+    channel = get<READ_CHAN>(regs_);
+
+  tuning_ = true;
+  tune_channel_ = channel;
+  tune_done_at_ = now + tune_time_ * std::max(1, passed / 8);
+  set<STC>(regs_, 0);
+  set<RDSR>(regs_, 0);
+  set<RDSS>(regs_, 0);
+  rds_unread_ = false;
+}
+
+// Load the next group of |tx| into RDSA-RDSD. Even groups are 0A (PS, AF
+// and TA), odd groups are 2A (RadioText), except that every fourth is 14A
+// or 14B for a transmitter linked to other networks.
+void Si4703_SimulatedChip::nextGroup(const Transmitter& tx) {
+  const unsigned n = group_counter_++;
+  const size_t index = &tx - &transmitters_[0];
+  regs_[RDSA] = tx.pi;
+  if (n % 4 == 3 && !links_[index].empty()) {
+    nextOtherNetwork(index, n / 4);
+  } else if (n % 2 == 0) {
+    const uint8_t segment = (n / 2) % 4;
+    const std::vector<uint8_t> codes = AFCodes(tx.af);
+    // Group 0A, music.
+    regs_[RDSB] = PTY_TP | (ta_[index] << 4) | (1 << 3) | segment;
+    if (codes.empty()) {
+      regs_[RDSC] = (AF_FILLER << 8) | AF_FILLER;
+    } else {
+      const size_t pair = (n / 2) % (codes.size() / 2);
+      regs_[RDSC] = (codes[pair * 2] << 8) | codes[pair * 2 + 1];
+    }
+    std::string ps = tx.ps;
+    ps.resize(8, ' ');
+    regs_[RDSD] = (static_cast<uint8_t>(ps[segment * 2]) << 8) |
+                  static_cast<uint8_t>(ps[segment * 2 + 1]);
+  } else {
+    std::string rt = tx.radio_text;
+    if (rt.size() < 64)
+      rt += '\r';
+    const uint8_t segments = std::min<size_t>(16, (rt.size() + 3) / 4);
+    rt.resize(64, ' ');
+    const uint8_t segment = (n / 2) % segments;
+    const uint8_t ab = text_ab_[index];
+    regs_[RDSB] = (2 << 12) | PTY_TP | (ab << 4) | segment;  // Group 2A.
+    regs_[RDSC] = (static_cast<uint8_t>(rt[segment * 4]) << 8) |
+                  static_cast<uint8_t>(rt[segment * 4 + 1]);
+    regs_[RDSD] = (static_cast<uint8_t>(rt[segment * 4 + 2]) << 8) |
+                  static_cast<uint8_t>(rt[segment * 4 + 3]);
+  }
+}
+
+// Load the |n|th EON group of transmitter |index| into RDSB-RDSD. A change
+// of TA(ON) goes out first, as 14B; otherwise the linked networks take
+// turns through EON_VARIANTS of 14A.
+void Si4703_SimulatedChip::nextOtherNetwork(size_t index, unsigned n) {
+  std::vector<Link>& links = links_[index];
+  for (Link& link : links) {
+    if (link.repeats == 0)
+      continue;
+    link.repeats--;
+    regs_[RDSB] = (14 << 12) | (1 << 11) | PTY_TP | (link.other.tp << 4) |
+                  (link.ta << 3);
+    regs_[RDSC] = transmitters_[index].pi;
+    regs_[RDSD] = link.other.pi;
+    return;
+  }
+  const Link& link = links[n / EON_VARIANT_COUNT % links.size()];
+  const uint8_t variant = EON_VARIANTS[n % EON_VARIANT_COUNT];
+  regs_[RDSB] = (14 << 12) | PTY_TP | (link.other.tp << 4) | variant;
+  if (variant < 4) {
+    std::string ps = link.other.ps;
+    ps.resize(8, ' ');
+    regs_[RDSC] = (ps[variant * 2] << 8) |
+                  static_cast<uint8_t>(ps[variant * 2 + 1]);
+  } else if (variant == 4) {
+    const std::vector<uint8_t> codes = AFCodes(link.other.af);
+    if (codes.empty()) {
+      regs_[RDSC] = (AF_FILLER << 8) | AF_FILLER;
+    } else {
+      const size_t pair =
+          n / (EON_VARIANT_COUNT * links.size()) % (codes.size() / 2);
+      regs_[RDSC] = (codes[pair * 2] << 8) | codes[pair * 2 + 1];
+    }
+  } else {
+    regs_[RDSC] = (10 << 11) | link.ta;  // PTY(ON) 10.
+  }
+  regs_[RDSD] = link.other.pi;
+}
+
+void Si4703_SimulatedChip::updateAudio(Clock::time_point when) {
+  const bool audible = get<PWR_ENABLE>(regs_) && !get<PWR_DISABLE>(regs_) &&
+                       get<DMUTE>(regs_) && !tuning_;
+  if (audible == audible_)
+    return;
+  audible_ = audible;
+  if (!audible) {
+    gap_start_ = when;
+    return;
+  }
+  if (heard_) {
+    auto gap = std::chrono::duration_cast<std::chrono::microseconds>(
+        when - gap_start_);
+    audio_stats_.gaps++;
+    audio_stats_.total += gap;
+    audio_stats_.longest = std::max(audio_stats_.longest, gap);
+  }
+  heard_ = true;
+}
+
+Si4703_FaultyBus::Si4703_FaultyBus(std::unique_ptr<Si4703_Bus> bus,
+                                   const Si4703_BusFaults& faults,
+                                   uint64_t seed)
+    : bus_(std::move(bus)),
+      faults_(faults),
+      random_(seed),
+      burst_left_(0),
+      stuck_(false),
+      stats_{0, 0, 0, 0} {}
+
+void Si4703_FaultyBus::setFaults(const Si4703_BusFaults& faults) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  faults_ = faults;
+}
+
+Si4703_FaultyBus::Stats Si4703_FaultyBus::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+Status Si4703_FaultyBus::open() {
+  return bus_->open();
+}
+
+Status Si4703_FaultyBus::read(uint8_t* buffer, int length) {
+  if (fail())
+    return Status::FAIL;
+  return bus_->read(buffer, length);
+}
+
+Status Si4703_FaultyBus::write(const uint8_t* buffer, int length) {
+  if (fail())
+    return Status::FAIL;
+  return bus_->write(buffer, length);
+}
+
+Status Si4703_FaultyBus::transfer(const Si4703_BusMessage* messages,
+                                  int count) {
+  if (fail())
+    return Status::FAIL;
+  return bus_->transfer(messages, count);
+}
+
+Status Si4703_FaultyBus::reset() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.resets++;
+    stuck_ = false;
+    burst_left_ = 0;
+  }
+  return bus_->reset();
+}
+
+// Whether to fail this transfer.
+bool Si4703_FaultyBus::fail() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.transfers++;
+  if (!stuck_ && faults_.stuck_rate > 0 &&
+      random_.uniform() < faults_.stuck_rate) {
+    stuck_ = true;
+    stats_.stuck++;
+  }
+  if (!stuck_ && !burst_left_ && faults_.glitch_rate > 0 &&
+      random_.uniform() < faults_.glitch_rate)
+    burst_left_ = std::max(1, faults_.burst);
+  if (!stuck_ && !burst_left_)
+    return false;
+  if (burst_left_)
+    burst_left_--;
+  stats_.failed++;
+  return true;
+}
@@ -0,0 +1,222 @@
+//
+// A simulated Si4703 and RF environment behind the Si4703_Bus interface.
+//
+// The simulator answers reads and writes the way the chip does (reads start
+// at 0x0A, writes at 0x02, TUNE/SEEK raise STC after a settling time, RDS
+// groups arrive at the broadcast rate) for a set of transmitters, so the
+// library and anything built on it can be exercised and timed on any Linux
+// host without hardware. Si4703_FaultyBus wraps a bus to make its transfers
+// fail, for exercising error handling.
+//
+
+#ifndef Si4703Sim_h
+#define Si4703Sim_h
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <inttypes.h>
+
+#include "Si4703Bus.h"
+#include "Si4703Random.h"
+#include "Si4703RdsGenerator.h"
+
+class Si4703_SimulatedChip : public Si4703_Bus {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Transmitter {
+    float frequency;  // MHz.
+    uint16_t pi;
+    int rssi;  // dBuV.
+    bool stereo;
+    std::string ps;          // Programme service name, up to 8 chars.
+    std::string radio_text;  // Up to 64 chars.
+    std::vector<float> af;   // Alternative frequencies sent in group 0A.
+    // If set, RDS comes from this generator instead of the fields above,
+    // errors and drops included. It keeps running across tunes.
+    std::shared_ptr<Si4703_RdsGenerator> rds;
+  };
+
+  // Signal on a channel without a station: a spur, or spill from a strong
+  // station nearby. Seeks stop on it unless SKSNR or SKCNT rule it out.
+  struct Interference {
+    float frequency;  // MHz.
+    int rssi;         // dBuV.
+    int snr;          // dB.
+    int impulses;     // FM impulse noise detections while validating a stop.
+  };
+
+  // Interruptions of the audio the listener hears: the chip is muted,
+  // disabled or in the middle of a tune or seek.
+  struct AudioStats {
+    int gaps;
+    std::chrono::microseconds total;
+    std::chrono::microseconds longest;
+  };
+
+  // Bus traffic seen by the chip. A combined transfer is one transaction
+  // of several reads and writes.
+  struct BusStats {
+    int reads;
+    int writes;
+    int bytes_read;
+    int bytes_written;
+    int transactions;
+  };
+
+  // RDS groups sent while the host was tuned to a station with RDS on, and
+  // those it missed: overwritten by the next group or past their RDSR
+  // window before a read saw RDSR set.
+  struct RdsStats {
+    int sent;
+    int missed;
+  };
+
+  Si4703_SimulatedChip();
+
+  void addTransmitter(const Transmitter& transmitter);
+  void addInterference(const Interference& interference);
+
+  // Change the signal strength of the transmitter on |frequency|, e.g. to
+  // simulate a fade.
+  void setRSSI(float frequency, int rssi);
+
+  // Change what the transmitter on |frequency| sends, when it has no
+  // generator, as a station does between songs. A new RadioText toggles the
+  // A/B flag.
+  void setPS(float frequency, const std::string& ps);
+  void setRadioText(float frequency, const std::string& radio_text);
+
+  // Link the transmitter on |frequency|, when it has no generator, to
+  // |other| through EON: every fourth group is a 14A with its PS name, AF
+  // list or TA flag, or a 14B when its TA flag changes.
+  void addOtherNetwork(float frequency, const Si4703_RdsStation::Other& other);
+
+  // Start or end a traffic announcement of the station with |pi|: the TA
+  // flag of its transmitters in 0A, and its TA(ON) where others link to it.
+  void setTA(uint16_t pi, bool ta);
+
+  // Time from setting TUNE to STC. 60 ms matches the datasheet.
+  void setTuneTime(std::chrono::microseconds tune_time);
+
+  // Time between two RDS groups, 87.6 ms by default as on air.
+  void setGroupInterval(std::chrono::microseconds group_interval);
+
+  AudioStats audioStats() const;
+  void resetAudioStats();
+
+  BusStats busStats() const;
+
+  RdsStats rdsStats() const;
+
+  // Si4703_Bus
+  Status open() override;
+  Status read(uint8_t* buffer, int length) override;
+  Status write(const uint8_t* buffer, int length) override;
+  Status transfer(const Si4703_BusMessage* messages, int count) override;
+  // Also does what pulsing RST does to the chip: every register back to its
+  // reset value, powered down, any tune dropped.
+  Status reset() override;
+
+ private:
+  // A network linked to a transmitter through EON.
+  struct Link {
+    Si4703_RdsStation::Other other;
+    bool ta;
+    int repeats;  // 14B groups still to send for the last change of |ta|.
+  };
+
+  void resetRegisters();
+  void readLocked(uint8_t* buffer, int length);
+  void writeLocked(const uint8_t* buffer, int length);
+  float channelFrequency(uint16_t channel) const;
+  const Transmitter* transmitterAt(float frequency) const;
+  const Interference* interferenceAt(float frequency) const;
+  bool seekStopsAt(int channel) const;
+  void advance(Clock::time_point now);
+  void completeTune(Clock::time_point when);
+  void startSeek(Clock::time_point now);
+  void nextGroup(const Transmitter& tx);
+  void nextOtherNetwork(size_t index, unsigned n);
+  void updateAudio(Clock::time_point when);
+
+  mutable std::mutex mutex_;  // Everything below.
+  std::vector<Transmitter> transmitters_;
+  std::vector<uint8_t> text_ab_;  // The A/B flag of each transmitter.
+  std::vector<uint8_t> ta_;       // The TA flag of each.
+  std::vector<std::vector<Link>> links_;  // The networks each links to.
+  std::vector<Interference> interference_;
+  uint16_t regs_[16];
+  std::chrono::microseconds tune_time_;
+  std::chrono::microseconds group_interval_;
+  bool tuning_;
+  Clock::time_point tune_done_at_;
+  uint16_t tune_channel_;
+  bool seek_failed_;
+  Clock::time_point next_group_at_;
+  Clock::time_point rdsr_clear_at_;
+  bool rds_unread_;  // The group in RDSA-RDSD hasn't been read yet.
+  unsigned group_counter_;
+  bool audible_;
+  bool heard_;  // Audio has been audible at least once.
+  Clock::time_point gap_start_;
+  AudioStats audio_stats_;
+  BusStats bus_stats_;
+  RdsStats rds_stats_;
+};
+
+// Faults for Si4703_FaultyBus, drawn per transfer.
+struct Si4703_BusFaults {
+  // Probability that a transfer starts a run of |burst| failed transfers,
+  // as a glitch or a burst of noise on the lines would.
+  double glitch_rate = 0;
+  int burst = 1;
+  // Probability that a transfer wedges the bus: it and every transfer after
+  // it fail until reset(), as when the chip holds SDA low.
+  double stuck_rate = 0;
+};
+
+class Si4703_FaultyBus : public Si4703_Bus {
+ public:
+  struct Stats {
+    uint64_t transfers;
+    uint64_t failed;  // Transfers that were made to fail.
+    uint64_t stuck;   // Times the bus wedged.
+    uint64_t resets;
+  };
+
+  // Fails transfers to |bus| as |faults| says. The same |seed| fails the
+  // same transfers.
+  Si4703_FaultyBus(std::unique_ptr<Si4703_Bus> bus,
+                   const Si4703_BusFaults& faults,
+                   uint64_t seed = 1);
+
+  void setFaults(const Si4703_BusFaults& faults);
+  Stats stats() const;
+
+  // Si4703_Bus
+  Status open() override;
+  Status read(uint8_t* buffer, int length) override;
+  Status write(const uint8_t* buffer, int length) override;
+  // Fails or passes on as a whole.
+  Status transfer(const Si4703_BusMessage* messages, int count) override;
+  // Unwedges the bus and resets |bus|.
+  Status reset() override;
+
+ private:
+  bool fail();
+
+  std::unique_ptr<Si4703_Bus> bus_;
+  mutable std::mutex mutex_;  // Everything below.
+  Si4703_BusFaults faults_;
+  Si4703_Random random_;
+  int burst_left_;
+  bool stuck_;
+  Stats stats_;
+};
+
+#endif
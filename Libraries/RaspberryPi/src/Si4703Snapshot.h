@@ -0,0 +1,93 @@
+//
+// Lock-free published copy of the Si4703 register file.
+//
+// One thread at a time (the holder of the breakout's register owner lock)
+// publishes the registers it just read or wrote. Any number of readers copy
+// them out under a sequence lock: they never take a lock, never block the
+// publisher, and retry only if a publish of the 16 words overlapped their
+// copy.
+//
+// Each snapshot also carries the time the chip was last read. Writes only
+// change registers 0x02-0x07, which the host alone controls, so they keep
+// that time: the status registers are no fresher after a write.
+//
+
+#ifndef Si4703Snapshot_h
+#define Si4703Snapshot_h
+
+#include <atomic>
+#include <chrono>
+
+#include <inttypes.h>
+
+#include "Si4703Core.h"
+
+class Si4703_RegisterSnapshot {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  Si4703_RegisterSnapshot()
+      : sequence_(0),
+        read_at_(Clock::time_point::min().time_since_epoch().count()) {
+    for (int i = 0; i < si4703::NUM_REGISTERS; i++)
+      words_[i].store(0, std::memory_order_relaxed);
+  }
+
+  // Publish |regs| as the new register file, as read from the chip at
+  // |read_at|, and return its version. Publishers must not overlap.
+  uint32_t publish(const uint16_t* regs, Clock::time_point read_at) {
+    const uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);  // Odd: busy.
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int i = 0; i < si4703::NUM_REGISTERS; i++)
+      words_[i].store(regs[i], std::memory_order_relaxed);
+    read_at_.store(read_at.time_since_epoch().count(),
+                   std::memory_order_relaxed);
+    sequence_.store(sequence + 2, std::memory_order_release);
+    return (sequence + 2) / 2;
+  }
+
+  // Publish |regs| after a write, keeping the time of the last read.
+  uint32_t publish(const uint16_t* regs) { return publish(regs, readAt()); }
+
+  // Copy a consistent register file into |regs| (NUM_REGISTERS words) and
+  // return its version, which goes up by one with every publish.
+  uint32_t read(uint16_t* regs) const {
+    uint32_t before, after;
+    do {
+      before = sequence_.load(std::memory_order_acquire);
+      for (int i = 0; i < si4703::NUM_REGISTERS; i++)
+        regs[i] = words_[i].load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = sequence_.load(std::memory_order_relaxed);
+    } while (before != after || (before & 1));
+    return before / 2;
+  }
+
+  // When the chip was last read, Clock::time_point::min() if never.
+  Clock::time_point readAt() const {
+    return Clock::time_point(
+        Clock::duration(read_at_.load(std::memory_order_acquire)));
+  }
+
+  // Was the chip read at most |max_age| ago?
+  bool fresh(Clock::duration max_age) const {
+    const Clock::time_point read_at = readAt();
+    return read_at != Clock::time_point::min() &&
+           Clock::now() - read_at <= max_age;
+  }
+
+  // A single field from the latest register file. A field never spans two
+  // registers, so one word load is consistent without the retry loop.
+  uint16_t get(si4703::Field field) const {
+    return (words_[field.reg].load(std::memory_order_acquire) >> field.shift) &
+           field.mask;
+  }
+
+ private:
+  std::atomic<uint32_t> sequence_;
+  std::atomic<uint16_t> words_[si4703::NUM_REGISTERS];
+  std::atomic<Clock::rep> read_at_;
+};
+
+#endif
@@ -0,0 +1,389 @@
+#include <string.h>
+
+#include "Si4703Bytes.h"
+#include "Si4703Status.h"
+
+using namespace si4703;
+using namespace si4703bytes;
+
+namespace {
+
+// Appends to a caller's buffer, remembering if anything didn't fit.
+class Writer {
+ public:
+  Writer(char* buffer, size_t size)
+      : begin_(buffer), p_(buffer), end_(buffer + size), overflow_(false) {}
+
+  void chr(char c) {
+    if (p_ == end_) {
+      overflow_ = true;
+      return;
+    }
+    *p_++ = c;
+  }
+
+  void str(const char* s) {
+    const size_t length = strlen(s);
+    if (static_cast<size_t>(end_ - p_) < length) {
+      overflow_ = true;
+      return;
+    }
+    memcpy(p_, s, length);
+    p_ += length;
+  }
+
+  void num(uint64_t value) {
+    char digits[20];
+    int n = 0;
+    do {
+      digits[n++] = '0' + value % 10;
+      value /= 10;
+    } while (value);
+    while (n)
+      chr(digits[--n]);
+  }
+
+  // At least |width| digits, zero padded.
+  void hex(unsigned value, int width) {
+    char digits[8];
+    int n = 0;
+    do {
+      digits[n++] = "0123456789abcdef"[value & 0xF];
+      value >>= 4;
+    } while (value || n < width);
+    while (n)
+      chr(digits[--n]);
+  }
+
+  // 10 kHz units as MHz, without trailing zeros: 93.5, 101.15, 88.
+  void mhz(uint16_t units) {
+    num(units / 100);
+    const int fraction = units % 100;
+    if (!fraction)
+      return;
+    chr('.');
+    chr('0' + fraction / 10);
+    if (fraction % 10)
+      chr('0' + fraction % 10);
+  }
+
+  void name(const char* known, unsigned value) {
+    if (known) {
+      str(known);
+      return;
+    }
+    str("<Unknown: 0x");
+    hex(value, 1);
+    chr('>');
+  }
+
+  // |s| right-aligned in |width| columns.
+  void padded(const char* s, size_t width) {
+    for (size_t length = strlen(s); length < width; length++)
+      chr(' ');
+    str(s);
+  }
+
+  void boolean(bool value) { str(value ? "true" : "false"); }
+  void yesNo(bool value) { chr(value ? 'Y' : 'N'); }
+
+  size_t finish() const { return overflow_ ? 0 : p_ - begin_; }
+
+ private:
+  char* begin_;
+  char* p_;
+  char* end_;
+  bool overflow_;
+};
+
+}  // anonymous namespace
+
+void Si4703_StatusSnapshot::fill(const uint16_t* regs, uint32_t version) {
+  this->version = version;
+  band = get<BAND>(regs);
+  space = get<SPACE>(regs);
+  channel = get<READ_CHAN>(regs);
+  frequency = channelToFrequency(channel, band, space);
+  flags = (get<RDSR>(regs) ? RDS_READY : 0) |
+          (get<STC>(regs) ? TUNE_COMPLETE : 0) |
+          (get<SFBL>(regs) ? SEEK_FAILED : 0) |
+          (get<AFCRL>(regs) ? AFC_RAIL : 0) |
+          (get<RDSS>(regs) ? RDS_SYNCED : 0) |
+          (get<si4703::STEREO>(regs) ? STEREO : 0) |
+          (get<DMUTE>(regs) ? 0 : MUTED) |
+          (get<PWR_ENABLE>(regs) ? ENABLED : 0);
+  rssi = get<RSSI>(regs);
+  volume = get<VOLUME>(regs);
+  seekth = get<SEEKTH>(regs);
+  sksnr = get<SKSNR>(regs);
+  skcnt = get<SKCNT>(regs);
+  block_a_errors = get<BLERA>(regs);
+  for (int i = 0; i < 4; i++)
+    rds[i] = regs[RDSA + i];
+  manufacturer = get<MFGID>(regs);
+  part = get<PN>(regs);
+  firmware = get<FIRMWARE>(regs);
+  device = get<DEV>(regs);
+  revision = get<REV>(regs);
+  memcpy(registers, regs, sizeof(registers));
+}
+
+size_t Si4703_StatusSnapshot::toBinary(uint8_t* buffer, size_t size) const {
+  if (size < BINARY_LENGTH)
+    return 0;
+  uint8_t* p = buffer;
+  putU32(p, version);
+  putU16(p + 4, frequency);
+  putU16(p + 6, channel);
+  putU16(p + 8, flags);
+  const uint8_t bytes[] = {rssi,  volume, band,  space,
+                           seekth, sksnr, skcnt, block_a_errors};
+  memcpy(p + 10, bytes, sizeof(bytes));
+  for (int i = 0; i < 4; i++)
+    putU16(p + 18 + i * 2, rds[i]);
+  putU16(p + 26, manufacturer);
+  p[28] = part;
+  p[29] = firmware;
+  p[30] = device;
+  p[31] = revision;
+  return BINARY_LENGTH;
+}
+
+size_t Si4703_StatusSnapshot::toJson(char* buffer, size_t size) const {
+  Writer w(buffer, size);
+  w.str("{\"version\":");
+  w.num(version);
+  w.str(",\"frequency\":");
+  w.mhz(frequency);
+  w.str(",\"channel\":");
+  w.num(channel);
+  w.str(",\"rssi\":");
+  w.num(rssi);
+  w.str(",\"stereo\":");
+  w.boolean(flags & STEREO);
+  w.str(",\"muted\":");
+  w.boolean(flags & MUTED);
+  w.str(",\"volume\":");
+  w.num(volume);
+  w.str(",\"rds_ready\":");
+  w.boolean(flags & RDS_READY);
+  w.str(",\"rds_synced\":");
+  w.boolean(flags & RDS_SYNCED);
+  w.str(",\"block_a_errors\":");
+  w.num(block_a_errors);
+  w.str(",\"rds\":[");
+  for (int i = 0; i < 4; i++) {
+    if (i)
+      w.chr(',');
+    w.num(rds[i]);
+  }
+  w.str("],\"tune_complete\":");
+  w.boolean(flags & TUNE_COMPLETE);
+  w.str(",\"seek_failed\":");
+  w.boolean(flags & SEEK_FAILED);
+  w.str(",\"afc_rail\":");
+  w.boolean(flags & AFC_RAIL);
+  w.str(",\"seekth\":");
+  w.num(seekth);
+  w.str(",\"sksnr\":");
+  w.num(sksnr);
+  w.str(",\"skcnt\":");
+  w.num(skcnt);
+  w.str(",\"enabled\":");
+  w.boolean(flags & ENABLED);
+  w.str(",\"manufacturer\":");
+  w.num(manufacturer);
+  w.str(",\"device\":");
+  w.num(device);
+  w.str(",\"revision\":");
+  w.num(revision);
+  w.str(",\"firmware\":");
+  w.num(firmware);
+  w.chr('}');
+  return w.finish();
+}
+
+size_t Si4703_StatusSnapshot::toLineProtocol(const char* series,
+                                             uint64_t timestamp_ns,
+                                             char* buffer,
+                                             size_t size) const {
+  Writer w(buffer, size);
+  w.str(series);
+  w.str(" frequency=");
+  w.mhz(frequency);
+  w.str(",rssi=");
+  w.num(rssi);
+  w.str("i,stereo=");
+  w.boolean(flags & STEREO);
+  w.str(",muted=");
+  w.boolean(flags & MUTED);
+  w.str(",volume=");
+  w.num(volume);
+  w.str("i,rds_synced=");
+  w.boolean(flags & RDS_SYNCED);
+  w.str(",block_a_errors=");
+  w.num(block_a_errors);
+  w.str("i,pi=");
+  w.num(flags & RDS_SYNCED ? rds[0] : 0);
+  w.str("i,version=");
+  w.num(version);
+  w.chr('i');
+  if (timestamp_ns) {
+    w.chr(' ');
+    w.num(timestamp_ns);
+  }
+  w.chr('\n');
+  return w.finish();
+}
+
+size_t Si4703_StatusSnapshot::toText(char* buffer, size_t size) const {
+  Writer w(buffer, size);
+  w.str("Register  Value\n");
+  w.str("========= ================================================\n");
+  for (int i = 0; i < NUM_REGISTERS; i++) {
+    w.padded(REGISTERS[i], 10);
+    w.str("[0x");
+    w.hex(i, 1);
+    w.str("]: 0x");
+    w.hex(registers[i], 4);
+    // Now the decoded supplemental data.
+    switch (i) {
+      case DEVICEID:
+        w.str(" (mfr=\"");
+        w.name(manufacturerName(manufacturer), manufacturer);
+        w.str("\", part=");
+        w.name(partName(part), part);
+        w.chr(')');
+        break;
+      case CHIPID:
+        w.str(" (firmware=");
+        w.num(firmware);
+        w.str(", device=\"");
+        w.name(deviceName(device), device);
+        w.str("\", rev=");
+        w.name(revisionName(revision), revision);
+        w.chr(')');
+        break;
+      case SYSCONFIG2:
+        w.str(" (SEEKTH:");
+        w.num(seekth);
+        w.str(", VOLUME:");
+        w.num(volume);
+        w.chr(')');
+        break;
+      case SYSCONFIG3:
+        w.str(" (SKSNR:");
+        w.num(sksnr);
+        w.str(", SKCNT:");
+        w.num(skcnt);
+        w.chr(')');
+        break;
+      case READCHAN:
+        w.str(" (channel=");
+        w.num(channel);
+        w.str(" (");
+        w.mhz(frequency);
+        w.str("MHz))");
+        break;
+      case STATUSRSSI:
+        w.str(" (RDSR:");
+        w.yesNo(flags & RDS_READY);
+        w.str(", STC:");
+        w.yesNo(flags & TUNE_COMPLETE);
+        w.str(", SFBL:");
+        w.yesNo(flags & SEEK_FAILED);
+        w.str(", AFCRL:");
+        w.yesNo(flags & AFC_RAIL);
+        w.str(", RDSS:");
+        w.yesNo(flags & RDS_SYNCED);
+        w.str(", STEREO:");
+        w.yesNo(flags & STEREO);
+        w.str(", RSSI:");
+        w.num(rssi);
+        w.str(", BLERA:");
+        w.name(blockErrorsName(block_a_errors), block_a_errors);
+        w.chr(')');
+        break;
+    }
+    w.chr('\n');
+  }
+  return w.finish();
+}
+
+size_t Si4703_StatusSnapshot::toFields(char* buffer, size_t size) const {
+  Writer w(buffer, size);
+  int reg = -1;
+  for (const FieldInfo& info : FIELDS) {
+    if (info.field.reg != reg) {
+      if (reg >= 0)
+        w.chr('\n');
+      reg = info.field.reg;
+      w.padded(REGISTERS[reg], 10);
+      w.chr(':');
+    }
+    w.chr(' ');
+    w.str(info.name);
+    w.chr('=');
+    w.num(get(registers, info.field));
+  }
+  w.chr('\n');
+  return w.finish();
+}
+
+// static
+const char* Si4703_StatusSnapshot::manufacturerName(uint16_t manufacturer) {
+  return manufacturer == 0x242 ? "Silicon Labs" : nullptr;
+}
+
+// static
+const char* Si4703_StatusSnapshot::partName(uint8_t part) {
+  return part == 1 ? "Si4700/01/02/03" : nullptr;
+}
+
+// static
+const char* Si4703_StatusSnapshot::deviceName(uint8_t device) {
+  switch (device) {
+    case 0b0000:
+      return "Si4700";  // or not yet powered up.
+    case 0b0001:
+      return "Si4702";
+    case 0b1000:
+      return "Si4701";
+    case 0b1001:
+      return "Si4703";
+    default:
+      return nullptr;
+  }
+}
+
+// static
+const char* Si4703_StatusSnapshot::revisionName(uint8_t revision) {
+  switch (revision) {
+    case 1:
+      return "A";
+    case 2:
+      return "B";
+    case 3:
+      return "C";
+    case 4:
+      return "D";
+    default:
+      return nullptr;
+  }
+}
+
+// static
+const char* Si4703_StatusSnapshot::blockErrorsName(uint8_t block_errors) {
+  switch (block_errors) {
+    case 0b00:
+      return "0";
+    case 0b01:
+      return "1-2";
+    case 0b10:
+      return "3-5";
+    case 0b11:
+      return "6+";
+    default:
+      return nullptr;
+  }
+}
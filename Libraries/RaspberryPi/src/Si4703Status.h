@@ -0,0 +1,92 @@
+//
+// Decoded tuner status and its serializers.
+//
+// Si4703_StatusSnapshot holds every field worth reporting, decoded in one
+// pass from a register file (see Si4703_Breakout::status()). It is plain
+// old data: copy it, memcpy it, keep arrays of it. The serializers write
+// into caller-supplied buffers and never allocate, so status can be
+// streamed at a high rate:
+//
+//   toBinary()        a fixed BINARY_LENGTH byte record, little-endian
+//   toJson()          one JSON object
+//   toLineProtocol()  one InfluxDB line protocol line
+//   toText()          the register dump printed by printRegisters()
+//   toFields()        every field of si4703::FIELDS by name, a line per
+//                     register
+//
+// Each returns the number of bytes written, or 0 if |size| is too small.
+// Text output is not null terminated.
+//
+// Binary record layout:
+//
+//   version:u32 frequency:u16 channel:u16 flags:u16 rssi:u8 volume:u8
+//   band:u8 space:u8 seekth:u8 sksnr:u8 skcnt:u8 block_a_errors:u8
+//   rds:u16[4] manufacturer:u16 part:u8 firmware:u8 device:u8 revision:u8
+//
+
+#ifndef Si4703Status_h
+#define Si4703Status_h
+
+#include <stddef.h>
+
+#include <inttypes.h>
+
+#include "Si4703Core.h"
+
+struct Si4703_StatusSnapshot {
+  enum Flags : uint16_t {
+    RDS_READY = 1 << 0,      // RDSR.
+    TUNE_COMPLETE = 1 << 1,  // STC.
+    SEEK_FAILED = 1 << 2,    // SFBL.
+    AFC_RAIL = 1 << 3,       // AFCRL.
+    RDS_SYNCED = 1 << 4,     // RDSS.
+    STEREO = 1 << 5,
+    MUTED = 1 << 6,    // DMUTE clear.
+    ENABLED = 1 << 7,  // ENABLE set.
+  };
+
+  static const size_t BINARY_LENGTH = 32;
+
+  uint32_t version;    // Of the register snapshot this was decoded from.
+  uint16_t frequency;  // 10 kHz units.
+  uint16_t channel;    // READCHAN.
+  uint16_t flags;
+  uint8_t rssi;  // dBuV.
+  uint8_t volume;
+  uint8_t band;
+  uint8_t space;
+  uint8_t seekth;
+  uint8_t sksnr;
+  uint8_t skcnt;
+  uint8_t block_a_errors;  // BLERA: 0, 1-2, 3-5, 6+.
+  uint16_t rds[4];         // RDSA-RDSD.
+  uint16_t manufacturer;
+  uint8_t part;
+  uint8_t firmware;
+  uint8_t device;
+  uint8_t revision;
+  uint16_t registers[si4703::NUM_REGISTERS];
+
+  // Decode |regs|, |version| as returned by Si4703_Breakout::registers().
+  void fill(const uint16_t* regs, uint32_t version);
+
+  size_t toBinary(uint8_t* buffer, size_t size) const;
+  size_t toJson(char* buffer, size_t size) const;
+  // |series| is the measurement and tags, e.g. "si4703,tuner=0". A
+  // |timestamp_ns| of 0 leaves the time to the collector.
+  size_t toLineProtocol(const char* series,
+                        uint64_t timestamp_ns,
+                        char* buffer,
+                        size_t size) const;
+  size_t toText(char* buffer, size_t size) const;
+  size_t toFields(char* buffer, size_t size) const;
+
+  // Names of the identity and error fields, nullptr if unknown.
+  static const char* manufacturerName(uint16_t manufacturer);
+  static const char* partName(uint8_t part);
+  static const char* deviceName(uint8_t device);
+  static const char* revisionName(uint8_t revision);
+  static const char* blockErrorsName(uint8_t block_errors);
+};
+
+#endif
@@ -0,0 +1,247 @@
+#include <new>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Si4703StatusPage.h"
+
+using namespace si4703;
+
+namespace {
+
+const uint32_t MAGIC = 0x50373453;  // "S47P".
+const uint16_t LAYOUT = 1;
+
+static_assert(std::is_trivially_copyable<Si4703_StatusRecord>::value,
+              "the record is copied through the page word by word");
+static_assert(sizeof(Si4703_StatusRecord) % 4 == 0,
+              "the record is stored as 32-bit words");
+const int RECORD_WORDS = sizeof(Si4703_StatusRecord) / 4;
+
+struct Page {
+  uint32_t magic;
+  uint16_t layout;
+  uint16_t record_size;
+  std::atomic<uint32_t> sequence;
+  uint32_t publisher_pid;
+  std::atomic<uint32_t> words[RECORD_WORDS];
+};
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2,
+              "the sequence lock needs address-free atomics");
+
+// Readers spin this many times on a busy page, then yield so a preempted
+// publisher on the same CPU can finish, and give up on a publisher that
+// stays mid-update for MAX_READ_TRIES (e.g. it died there).
+const int SPIN_TRIES = 100;
+const int MAX_READ_TRIES = 10000;
+
+uint64_t MonotonicNanos() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+}  // anonymous namespace
+
+Si4703_StatusPublisher::Si4703_StatusPublisher(Si4703_Breakout* radio,
+                                               const std::string& name)
+    : radio_(radio),
+      name_(name),
+      register_listener_id_(-1),
+      rds_listener_id_(-1),
+      page_(nullptr),
+      channel_(0xFFFF),
+      ps_complete_(false),
+      rt_complete_(false) {
+  memset(&record_, 0, sizeof(record_));
+}
+
+Si4703_StatusPublisher::~Si4703_StatusPublisher() {
+  if (!page_)
+    return;
+  radio_->removeRegisterListener(register_listener_id_);
+  radio_->removeRdsGroupListener(rds_listener_id_);
+  munmap(page_, sizeof(Page));
+  shm_unlink(name_.c_str());
+}
+
+Status Si4703_StatusPublisher::open() {
+  const int fd = shm_open(name_.c_str(), O_CREAT | O_RDWR, 0644);
+  if (fd < 0 || ftruncate(fd, sizeof(Page)) < 0) {
+    perror(name_.c_str());
+    if (fd >= 0)
+      close(fd);
+    return Status::FAIL;
+  }
+  void* page =
+      mmap(nullptr, sizeof(Page), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (page == MAP_FAILED) {
+    perror(name_.c_str());
+    return Status::FAIL;
+  }
+
+  Page* p = new (page) Page;
+  p->magic = MAGIC;
+  p->layout = LAYOUT;
+  p->record_size = sizeof(Si4703_StatusRecord);
+  p->sequence.store(0, std::memory_order_relaxed);
+  p->publisher_pid = getpid();
+  page_ = page;
+
+  uint16_t regs[NUM_REGISTERS];
+  const uint32_t version = radio_->registers(regs);
+  onRegisters(regs, version);
+  register_listener_id_ = radio_->addRegisterListener(
+      [this](const uint16_t* regs, uint32_t version) {
+        onRegisters(regs, version);
+      });
+  rds_listener_id_ = radio_->addRdsGroupListener(
+      [this](const RdsGroup& group) { onGroup(group); });
+  return Status::SUCCESS;
+}
+
+// Called with the breakout's register owner lock held.
+void Si4703_StatusPublisher::onRegisters(const uint16_t* regs,
+                                         uint32_t version) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const uint16_t channel = get<READ_CHAN>(regs);
+  if (channel != channel_) {  // Retuned: the RDS state is stale.
+    channel_ = channel;
+    decoder_.reset();
+    ps_complete_ = rt_complete_ = false;
+    record_.pi = 0;
+    record_.pty = 0;
+    record_.ps[0] = record_.rt[0] = '\0';
+  }
+  record_.register_version = version;
+  record_.frequency =
+      channelToFrequency(channel, get<BAND>(regs), get<SPACE>(regs));
+  record_.rssi = get<RSSI>(regs);
+  record_.volume = get<VOLUME>(regs);
+  uint8_t flags = 0;
+  if (get<STEREO>(regs))
+    flags |= Si4703_StatusRecord::STEREO;
+  if (get<RDSS>(regs))
+    flags |= Si4703_StatusRecord::RDS_SYNCED;
+  if (ps_complete_)
+    flags |= Si4703_StatusRecord::PS_COMPLETE;
+  if (rt_complete_)
+    flags |= Si4703_StatusRecord::RT_COMPLETE;
+  record_.flags = flags;
+  publish();
+}
+
+void Si4703_StatusPublisher::onGroup(const RdsGroup& group) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const uint8_t events = decoder_.decodeGroup(
+      group.blocks[0], group.blocks[1], group.blocks[2], group.blocks[3]);
+  if (events & RdsDecoder::PI_CHANGED)
+    ps_complete_ = rt_complete_ = false;
+  if (events & RdsDecoder::PS_COMPLETE)
+    ps_complete_ = true;
+  if (events & RdsDecoder::RT_CLEARED)
+    rt_complete_ = false;
+  if (events & RdsDecoder::RT_COMPLETE)
+    rt_complete_ = true;
+
+  record_.pi = decoder_.pi;
+  record_.pty = decoder_.pty;
+  strcpy(record_.ps, ps_complete_ ? decoder_.ps : "");
+  strcpy(record_.rt, rt_complete_ ? decoder_.rt : "");
+  record_.flags &= ~(Si4703_StatusRecord::PS_COMPLETE |
+                     Si4703_StatusRecord::RT_COMPLETE);
+  if (ps_complete_)
+    record_.flags |= Si4703_StatusRecord::PS_COMPLETE;
+  if (rt_complete_)
+    record_.flags |= Si4703_StatusRecord::RT_COMPLETE;
+  publish();
+}
+
+// Write record_ to the page. The caller holds mutex_.
+void Si4703_StatusPublisher::publish() {
+  if (!page_)
+    return;
+  record_.updated_ns = MonotonicNanos();
+  record_.updates++;
+
+  uint32_t words[RECORD_WORDS];
+  memcpy(words, &record_, sizeof(words));
+  Page* page = static_cast<Page*>(page_);
+  const uint32_t sequence = page->sequence.load(std::memory_order_relaxed);
+  page->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (int i = 0; i < RECORD_WORDS; i++)
+    page->words[i].store(words[i], std::memory_order_relaxed);
+  page->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+Si4703_StatusReader::Si4703_StatusReader() : page_(nullptr), retries_(0) {}
+
+Si4703_StatusReader::~Si4703_StatusReader() {
+  if (page_)
+    munmap(const_cast<void*>(page_), sizeof(Page));
+}
+
+Status Si4703_StatusReader::open(const std::string& name) {
+  const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    perror(name.c_str());
+    return Status::FAIL;
+  }
+  struct stat info;
+  if (fstat(fd, &info) < 0 ||
+      info.st_size < static_cast<off_t>(sizeof(Page))) {
+    fprintf(stderr, "%s: not a status page\n", name.c_str());
+    close(fd);
+    return Status::FAIL;
+  }
+  void* page = mmap(nullptr, sizeof(Page), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (page == MAP_FAILED) {
+    perror(name.c_str());
+    return Status::FAIL;
+  }
+  const Page* p = static_cast<const Page*>(page);
+  if (p->magic != MAGIC || p->layout != LAYOUT ||
+      p->record_size != sizeof(Si4703_StatusRecord)) {
+    fprintf(stderr, "%s: unknown status page layout\n", name.c_str());
+    munmap(page, sizeof(Page));
+    return Status::FAIL;
+  }
+  page_ = page;
+  return Status::SUCCESS;
+}
+
+bool Si4703_StatusReader::read(Si4703_StatusRecord* record) const {
+  if (!page_)
+    return false;
+  const Page* page = static_cast<const Page*>(page_);
+  uint32_t words[RECORD_WORDS];
+  for (int tries = 0; tries < MAX_READ_TRIES; tries++) {
+    if (tries > SPIN_TRIES)
+      sched_yield();
+    const uint32_t before = page->sequence.load(std::memory_order_acquire);
+    if (before & 1) {
+      retries_++;
+      continue;
+    }
+    for (int i = 0; i < RECORD_WORDS; i++)
+      words[i] = page->words[i].load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (page->sequence.load(std::memory_order_relaxed) == before) {
+      memcpy(record, words, sizeof(words));
+      return true;
+    }
+    retries_++;
+  }
+  return false;
+}
@@ -0,0 +1,101 @@
+//
+// Tuner status published in a shared memory page.
+//
+// Si4703_StatusPublisher, in the process owning the tuner, keeps a fixed
+// layout page in /dev/shm up to date: it rewrites it under a sequence lock
+// after every register transfer and every decoded RDS group. Any number of
+// processes map the page read-only with Si4703_StatusReader and copy out a
+// consistent Si4703_StatusRecord without a system call or a lock.
+//
+// Page layout (native byte order, the page never leaves the machine):
+//
+//   magic:u32 layout:u16 record_size:u16 sequence:u32 publisher_pid:u32
+//   record: Si4703_StatusRecord, stored as 32-bit words
+//
+// sequence is odd while the publisher is writing the record.
+//
+
+#ifndef Si4703StatusPage_h
+#define Si4703StatusPage_h
+
+#include <atomic>
+#include <mutex>
+#include <string>
+
+#include <inttypes.h>
+
+#include "SparkFunSi4703.h"
+
+struct Si4703_StatusRecord {
+  enum Flags : uint8_t {
+    STEREO = 1 << 0,
+    RDS_SYNCED = 1 << 1,  // RDSS: the decoder is synchronized.
+    PS_COMPLETE = 1 << 2,
+    RT_COMPLETE = 1 << 3,
+  };
+
+  uint64_t updated_ns;        // CLOCK_MONOTONIC time of this update.
+  uint32_t updates;           // Publishes so far.
+  uint32_t register_version;  // Si4703_Breakout::registers() version.
+  uint16_t frequency;         // 10 kHz units.
+  uint16_t pi;                // 0 if none.
+  uint8_t rssi;               // dBuV.
+  uint8_t flags;
+  uint8_t volume;
+  uint8_t pty;
+  char ps[9];   // Null terminated.
+  char rt[65];  // Null terminated.
+  uint8_t reserved[2];
+};
+
+class Si4703_StatusPublisher {
+ public:
+  // Publish the status of |radio| in /dev/shm|name|. The page is removed
+  // again when the publisher goes away.
+  Si4703_StatusPublisher(Si4703_Breakout* radio, const std::string& name);
+  ~Si4703_StatusPublisher();
+
+  // Creates the page. Fails if shared memory isn't available.
+  Status open();
+
+ private:
+  void onRegisters(const uint16_t* regs, uint32_t version);
+  void onGroup(const RdsGroup& group);
+  void publish();
+
+  Si4703_Breakout* radio_;
+  std::string name_;
+  int register_listener_id_;
+  int rds_listener_id_;
+  void* page_;
+
+  std::mutex mutex_;  // Protects the variables below and page writes.
+  Si4703_StatusRecord record_;
+  uint16_t channel_;  // READ_CHAN of record_, to spot retunes.
+  si4703::RdsDecoder decoder_;
+  bool ps_complete_;
+  bool rt_complete_;
+};
+
+class Si4703_StatusReader {
+ public:
+  Si4703_StatusReader();
+  ~Si4703_StatusReader();
+
+  // Map /dev/shm|name| read-only.
+  Status open(const std::string& name);
+
+  // Copy the current record. Returns false if the page isn't open, or the
+  // publisher stayed in the middle of an update for too long (e.g. it
+  // died there).
+  bool read(Si4703_StatusRecord* record) const;
+
+  // Sequence lock retries so far, for benchmarking.
+  uint64_t retries() const { return retries_; }
+
+ private:
+  const void* page_;
+  mutable uint64_t retries_;
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include <thread>
+
+#include "Si4703Survey.h"
+
+namespace {
+
+std::chrono::milliseconds Since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+}
+
+}  // anonymous namespace
+
+Si4703_SurveyScheduler::Si4703_SurveyScheduler(
+    const std::vector<Si4703_Breakout*>& tuners)
+    : Si4703_SurveyScheduler(tuners, Config()) {}
+
+Si4703_SurveyScheduler::Si4703_SurveyScheduler(
+    const std::vector<Si4703_Breakout*>& tuners,
+    const Config& config)
+    : config_(config), min_frequency_(0), spacing_(0), channels_(0) {
+  if (tuners.empty())
+    return;
+  const Si4703_Breakout* first = tuners.front();
+  min_frequency_ = first->minFrequency();
+  spacing_ = first->channelSpacing();
+  channels_ = static_cast<int>((first->maxFrequency() - min_frequency_) /
+                                   spacing_ +
+                               0.001f) +
+              1;
+  for (Si4703_Breakout* radio : tuners) {
+    Tuner* tuner = new Tuner;
+    tuner->radio = radio;
+    tuner->ps_complete = false;
+    tuner->listener_id = radio->addRdsGroupListener(
+        [this, tuner](const RdsGroup& group) { onGroup(tuner, group); });
+    tuners_.emplace_back(tuner);
+  }
+}
+
+Si4703_SurveyScheduler::~Si4703_SurveyScheduler() {
+  for (auto& tuner : tuners_)
+    tuner->radio->removeRdsGroupListener(tuner->listener_id);
+}
+
+void Si4703_SurveyScheduler::onGroup(Tuner* tuner, const RdsGroup& group) {
+  std::lock_guard<std::mutex> lock(tuner->mutex);
+  if (group.received < tuner->tuned_at)
+    return;
+  const uint8_t events = tuner->decoder.decodeGroup(
+      group.blocks[0], group.blocks[1], group.blocks[2], group.blocks[3]);
+  if (events & si4703::RdsDecoder::PS_COMPLETE) {
+    tuner->ps_complete = true;
+    tuner->cv.notify_all();
+  }
+}
+
+std::vector<Si4703_ChannelReport> Si4703_SurveyScheduler::run() {
+  const int count = static_cast<int>(tuners_.size());
+  reports_.assign(channels_, Si4703_ChannelReport());
+  stats_.assign(count, TunerStats{0, 0, 0, std::chrono::milliseconds(0)});
+  slices_.clear();
+  for (int i = 0; i < count; i++)
+    slices_.push_back(
+        Slice{channels_ * i / count, channels_ * (i + 1) / count});
+
+  std::vector<std::thread> workers;
+  for (int i = 0; i < count; i++)
+    workers.emplace_back(&Si4703_SurveyScheduler::worker, this, i);
+  for (std::thread& worker : workers)
+    worker.join();
+  return reports_;
+}
+
+void Si4703_SurveyScheduler::worker(int tuner) {
+  const auto start = std::chrono::steady_clock::now();
+  int channel;
+  while (nextChannel(tuner, &channel)) {
+    reports_[channel] = measure(tuner, channel);
+    stats_[tuner].channels++;
+  }
+  stats_[tuner].busy = Since(start);
+}
+
+// Take the next channel of |tuner|'s own slice. When that is used up, move
+// the far half of the largest remaining slice over to |tuner|.
+bool Si4703_SurveyScheduler::nextChannel(int tuner, int* channel) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Slice& own = slices_[tuner];
+  if (own.next >= own.end) {
+    if (!config_.rebalance)
+      return false;
+    Slice* victim = nullptr;
+    for (Slice& slice : slices_) {
+      if (!victim || slice.end - slice.next > victim->end - victim->next)
+        victim = &slice;
+    }
+    const int left = victim->end - victim->next;
+    if (left <= 0)
+      return false;
+    own.end = victim->end;
+    own.next = victim->end - (left + 1) / 2;
+    victim->end = own.next;
+    stats_[tuner].steals++;
+  }
+  *channel = own.next++;
+  return true;
+}
+
+Si4703_ChannelReport Si4703_SurveyScheduler::measure(int index, int channel) {
+  Tuner& tuner = *tuners_[index];
+  Si4703_ChannelReport report;
+  report.frequency = min_frequency_ + spacing_ * channel;
+  report.tuner = index;
+  report.pi = 0;
+
+  tuner.radio->setFrequency(report.frequency);
+  {
+    std::lock_guard<std::mutex> lock(tuner.mutex);
+    tuner.tuned_at = std::chrono::steady_clock::now();
+    tuner.decoder.reset();
+    tuner.ps_complete = false;
+  }
+  // setFrequency() leaves the status registers of the new channel in the
+  // register snapshot.
+  const Si4703_StatusSnapshot status = tuner.radio->status();
+  report.rssi = status.rssi;
+  report.stereo = status.flags & Si4703_StatusSnapshot::STEREO;
+  report.afc_rail = status.flags & Si4703_StatusSnapshot::AFC_RAIL;
+  if (report.rssi < config_.rds_min_rssi)
+    return report;
+
+  stats_[index].stations++;
+  std::unique_lock<std::mutex> lock(tuner.mutex);
+  tuner.cv.wait_for(lock, config_.rds_dwell,
+                    [&tuner] { return tuner.ps_complete; });
+  report.pi = tuner.decoder.pi;
+  if (tuner.ps_complete)
+    report.ps = tuner.decoder.ps;
+  return report;
+}
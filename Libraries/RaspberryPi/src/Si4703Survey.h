@@ -0,0 +1,102 @@
+//
+// Full-band survey split across several tuners.
+//
+// Each tuner starts on its own contiguous slice of the band. A tuner that
+// runs out of channels takes the far half of the largest slice still left,
+// so tuners that hit many stations (and their long RDS dwells) hand work to
+// idle ones and all of them finish at about the same time.
+//
+
+#ifndef Si4703Survey_h
+#define Si4703Survey_h
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <inttypes.h>
+
+#include "SparkFunSi4703.h"
+
+struct Si4703_ChannelReport {
+  float frequency;  // MHz.
+  int rssi;         // dBuV.
+  bool stereo;
+  bool afc_rail;   // AFCRL: the AFC couldn't lock, e.g. on a strong neighbour.
+  uint16_t pi;     // 0 if no RDS was received.
+  std::string ps;  // Empty if no complete name was received.
+  int tuner;       // Index of the tuner that measured the channel.
+};
+
+class Si4703_SurveyScheduler {
+ public:
+  struct Config {
+    // Channels at or above this strength get an RDS dwell.
+    int rds_min_rssi = 20;
+    // Longest time to wait for the PI code and a complete PS name.
+    std::chrono::milliseconds rds_dwell{1500};
+    // Let idle tuners take channels from busy ones. Without it every tuner
+    // only surveys its own slice.
+    bool rebalance = true;
+  };
+
+  struct TunerStats {
+    int channels;  // Channels measured.
+    int stations;  // Channels that got an RDS dwell.
+    int steals;    // Times the tuner took work from another one.
+    std::chrono::milliseconds busy;
+  };
+
+  // The tuners must all be powered on and use the same region. With no
+  // tuners there is nothing to survey with: run() returns no reports.
+  Si4703_SurveyScheduler(const std::vector<Si4703_Breakout*>& tuners,
+                         const Config& config);
+  explicit Si4703_SurveyScheduler(const std::vector<Si4703_Breakout*>& tuners);
+  ~Si4703_SurveyScheduler();
+
+  // Survey every channel of the band, one thread per tuner. Returns one
+  // report per channel in frequency order, or none without tuners.
+  std::vector<Si4703_ChannelReport> run();
+
+  const std::vector<TunerStats>& stats() const { return stats_; }
+
+ private:
+  // The half-open channel range [next, end) still to be done by a tuner.
+  struct Slice {
+    int next;
+    int end;
+  };
+
+  // RDS state of one tuner, fed by its group listener.
+  struct Tuner {
+    Si4703_Breakout* radio;
+    int listener_id;
+    std::mutex mutex;  // Protects everything below.
+    std::condition_variable cv;
+    // Groups read before this time may come from the previous channel.
+    std::chrono::steady_clock::time_point tuned_at;
+    si4703::RdsDecoder decoder;
+    bool ps_complete;
+  };
+
+  void onGroup(Tuner* tuner, const RdsGroup& group);
+  void worker(int tuner);
+  bool nextChannel(int tuner, int* channel);
+  Si4703_ChannelReport measure(int tuner, int channel);
+
+  std::vector<std::unique_ptr<Tuner>> tuners_;
+  Config config_;
+  float min_frequency_;
+  float spacing_;
+  int channels_;
+
+  std::mutex mutex_;  // Protects slices_.
+  std::vector<Slice> slices_;
+  std::vector<Si4703_ChannelReport> reports_;  // Indexed by channel.
+  std::vector<TunerStats> stats_;              // Indexed by tuner.
+};
+
+#endif
@@ -0,0 +1,602 @@
+#include <algorithm>
+#include <cmath>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Si4703Bytes.h"
+#include "Si4703SurveyLog.h"
+
+using namespace si4703bytes;
+
+namespace {
+
+const char MAGIC[4] = {'S', '4', 'S', 'V'};
+const char INDEX_MAGIC[4] = {'S', '4', 'S', 'I'};
+const uint8_t VERSION = 1;
+const size_t HEADER_LENGTH = 16;
+const size_t INDEX_HEADER_LENGTH = 8;
+const size_t INDEX_ENTRY_LENGTH = 24;
+
+const uint8_t KEYFRAME = 'K';
+const uint8_t DELTA = 'D';
+
+class BitWriter {
+ public:
+  explicit BitWriter(std::vector<uint8_t>* out) : out_(out), used_(8) {}
+
+  void put(uint32_t value, int bits) {
+    for (int i = bits - 1; i >= 0; i--) {
+      if (used_ == 8) {
+        out_->push_back(0);
+        used_ = 0;
+      }
+      out_->back() |= ((value >> i) & 1) << (7 - used_++);
+    }
+  }
+
+  // Elias gamma code of |n| >= 1.
+  void gamma(uint32_t n) {
+    int bits = 0;
+    while (n >> (bits + 1))
+      bits++;
+    put(0, bits);
+    put(n, bits + 1);
+  }
+
+ private:
+  std::vector<uint8_t>* out_;
+  int used_;  // Bits used of the last byte.
+};
+
+class BitReader {
+ public:
+  BitReader(const uint8_t* data, size_t length)
+      : data_(data), bits_(length * 8), pos_(0) {}
+
+  bool overrun() const { return pos_ > bits_; }
+
+  uint32_t get(int bits) {
+    uint32_t value = 0;
+    for (int i = 0; i < bits; i++, pos_++) {
+      const uint32_t bit =
+          pos_ < bits_ ? (data_[pos_ / 8] >> (7 - pos_ % 8)) & 1 : 0;
+      value = (value << 1) | bit;
+    }
+    return value;
+  }
+
+  uint32_t gamma() {
+    int zeros = 0;
+    while (!get(1)) {
+      if (overrun() || ++zeros > 31)
+        return 0;
+    }
+    return (1u << zeros) | get(zeros);
+  }
+
+ private:
+  const uint8_t* data_;
+  size_t bits_;
+  size_t pos_;
+};
+
+uint8_t FlagsOf(const Si4703_SweepPoint& point) {
+  return (point.stereo << 1) | point.afc_rail;
+}
+
+bool Same(const Si4703_SweepPoint& a, const Si4703_SweepPoint& b) {
+  return a.rssi == b.rssi && FlagsOf(a) == FlagsOf(b);
+}
+
+// |channel| of a sweep is coded against the same channel of the previous
+// sweep, or in a keyframe against the channel below it.
+const Si4703_SweepPoint& Reference(const std::vector<Si4703_SweepPoint>& sweep,
+                                   const std::vector<Si4703_SweepPoint>& last,
+                                   bool key,
+                                   int channel) {
+  static const Si4703_SweepPoint ZERO = {0, false, false};
+  if (!key)
+    return last[channel];
+  return channel ? sweep[channel - 1] : ZERO;
+}
+
+// Decode a frame's payload into |points|, which holds the previous sweep.
+bool DecodePoints(const uint8_t* data,
+                  size_t length,
+                  bool key,
+                  std::vector<Si4703_SweepPoint>* points) {
+  BitReader reader(data, length);
+  const int channels = points->size();
+  for (int channel = 0; channel < channels;) {
+    const uint32_t run = reader.gamma();
+    if (!run || channel + run - 1 > static_cast<uint32_t>(channels))
+      return false;
+    for (uint32_t i = 1; i < run; i++, channel++) {
+      if (key)
+        (*points)[channel] = Reference(*points, *points, true, channel);
+    }
+    if (channel == channels)
+      break;
+    const Si4703_SweepPoint ref = Reference(*points, *points, key, channel);
+    Si4703_SweepPoint& point = (*points)[channel++];
+    int rssi;
+    uint8_t flags;
+    if (!reader.get(1)) {
+      rssi = ref.rssi + (reader.get(1) ? -1 : 1);
+      flags = FlagsOf(ref);
+    } else if (!reader.get(1)) {
+      flags = reader.get(2);
+      const int delta = reader.get(4);
+      rssi = ref.rssi + (delta & 0x8 ? delta - 16 : delta);
+    } else {
+      rssi = reader.get(8);
+      flags = reader.get(2);
+    }
+    point.rssi = rssi;
+    point.stereo = flags & 0x2;
+    point.afc_rail = flags & 0x1;
+  }
+  return !reader.overrun();
+}
+
+}  // anonymous namespace
+
+Si4703_SurveyLog::Si4703_SurveyLog(const std::string& path)
+    : path_(path),
+      band_{0, 0, 0},
+      keyframe_interval_(1),
+      fd_(-1),
+      index_fd_(-1),
+      unindexed_(0),
+      size_(0),
+      sweeps_(0),
+      since_keyframe_(0) {}
+
+Si4703_SurveyLog::~Si4703_SurveyLog() {
+  close();
+}
+
+Status Si4703_SurveyLog::open(const Band& band, int keyframe_interval) {
+  close();
+  std::lock_guard<std::mutex> lock(mutex_);
+  band_ = band;
+  keyframe_interval_ = std::max(1, keyframe_interval);
+  unindexed_ = 0;
+  fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    perror(path_.c_str());
+    return Status::FAIL;
+  }
+  struct stat st;
+  const Status s = fstat(fd_, &st) == 0 && st.st_size > 0 ? load() : create();
+  if (s != Status::SUCCESS) {
+    ::close(fd_);
+    fd_ = -1;
+    if (index_fd_ >= 0)
+      ::close(index_fd_);
+    index_fd_ = -1;
+  }
+  return s;
+}
+
+void Si4703_SurveyLog::close() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (fd_ >= 0)
+    ::close(fd_);
+  if (index_fd_ >= 0)
+    ::close(index_fd_);
+  fd_ = index_fd_ = -1;
+  index_.clear();
+  last_.points.clear();
+}
+
+// The caller holds mutex_.
+Status Si4703_SurveyLog::create() {
+  uint8_t header[HEADER_LENGTH] = {0};
+  memcpy(header, MAGIC, sizeof(MAGIC));
+  header[4] = VERSION;
+  putU16(header + 6, band_.channels);
+  putU32(header + 8, std::lround(band_.min_frequency * 1000));
+  putU32(header + 12, std::lround(band_.spacing * 1000));
+  if (ftruncate(fd_, 0) < 0 || !writeAll(fd_, header, sizeof(header))) {
+    perror(path_.c_str());
+    return Status::FAIL;
+  }
+  const std::string index_path = path_ + ".idx";
+  index_fd_ = ::open(index_path.c_str(),
+                     O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+  uint8_t index_header[INDEX_HEADER_LENGTH] = {0};
+  memcpy(index_header, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  if (index_fd_ < 0 ||
+      !writeAll(index_fd_, index_header, sizeof(index_header))) {
+    perror(index_path.c_str());
+    return Status::FAIL;
+  }
+  size_ = HEADER_LENGTH;
+  sweeps_ = 0;
+  since_keyframe_ = 0;
+  last_.points.clear();
+  return Status::SUCCESS;
+}
+
+// The caller holds mutex_.
+Status Si4703_SurveyLog::load() {
+  uint8_t header[HEADER_LENGTH];
+  if (!readAll(fd_, header, sizeof(header), 0) ||
+      memcmp(header, MAGIC, sizeof(MAGIC)) || header[4] != VERSION) {
+    fprintf(stderr, "%s: not a survey log\n", path_.c_str());
+    return Status::FAIL;
+  }
+  if (getU16(header + 6) != band_.channels ||
+      getU32(header + 8) != static_cast<uint32_t>(
+                                std::lround(band_.min_frequency * 1000)) ||
+      getU32(header + 12) !=
+          static_cast<uint32_t>(std::lround(band_.spacing * 1000))) {
+    fprintf(stderr, "%s: logged for another band\n", path_.c_str());
+    return Status::FAIL;
+  }
+  struct stat st;
+  fstat(fd_, &st);
+  const uint64_t file_size = st.st_size;
+
+  // Keep the index entries that point at whole frames; the frames after
+  // the last of them are scanned and any keyframes among them re-indexed.
+  const std::string index_path = path_ + ".idx";
+  index_fd_ = ::open(index_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (index_fd_ < 0) {
+    perror(index_path.c_str());
+    return Status::FAIL;
+  }
+  std::vector<uint8_t> index;
+  struct stat index_st;
+  fstat(index_fd_, &index_st);
+  index.resize(index_st.st_size);
+  if (!readAll(index_fd_, index.data(), index.size(), 0) ||
+      index.size() < INDEX_HEADER_LENGTH ||
+      memcmp(index.data(), INDEX_MAGIC, sizeof(INDEX_MAGIC)))
+    index.assign(INDEX_HEADER_LENGTH, 0);
+  memcpy(index.data(), INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  index_.clear();
+  for (size_t pos = INDEX_HEADER_LENGTH;
+       pos + INDEX_ENTRY_LENGTH <= index.size(); pos += INDEX_ENTRY_LENGTH) {
+    const IndexEntry entry{static_cast<time_t>(getU64(&index[pos])),
+                           getU64(&index[pos + 8]), getU64(&index[pos + 16])};
+    if (entry.offset < HEADER_LENGTH || entry.offset >= file_size)
+      break;
+    index_.push_back(entry);
+  }
+  // The last entry is checked by decoding from it below.
+  uint64_t start = HEADER_LENGTH;
+  sweeps_ = 0;
+  if (!index_.empty()) {
+    start = index_.back().offset;
+    sweeps_ = index_.back().sweep;
+  }
+  std::vector<uint8_t> tail(file_size - start);
+  if (!readAll(fd_, tail.data(), tail.size(), start))
+    return Status::FAIL;
+  last_.time = 0;
+  last_.points.assign(band_.channels, Si4703_SweepPoint{0, false, false});
+  std::vector<IndexEntry> found;
+  since_keyframe_ = 0;
+  bool first = true;
+  const size_t used = decode(
+      tail.data(), tail.size(), &last_,
+      [&](const Si4703_Sweep& sweep, bool key, size_t offset) {
+        // A log must start with a keyframe, and the indexed one is known.
+        if (first && !key)
+          return false;
+        if (key && !(first && !index_.empty()))
+          found.push_back(IndexEntry{sweep.time, start + offset, sweeps_});
+        first = false;
+        since_keyframe_ = key ? 1 : since_keyframe_ + 1;
+        sweeps_++;
+        return true;
+      });
+  if (first && !index_.empty()) {
+    // The indexed keyframe itself is broken; rebuild the whole index.
+    ::close(index_fd_);
+    index_fd_ = -1;
+    unlink(index_path.c_str());
+    return load();
+  }
+  size_ = start + used;
+  if (size_ < file_size && ftruncate(fd_, size_) < 0) {
+    perror(path_.c_str());
+    return Status::FAIL;
+  }
+  if (ftruncate(index_fd_, 0) < 0 || lseek(index_fd_, 0, SEEK_SET) < 0 ||
+      !writeAll(index_fd_, index.data(),
+                INDEX_HEADER_LENGTH + index_.size() * INDEX_ENTRY_LENGTH)) {
+    perror(index_path.c_str());
+    return Status::FAIL;
+  }
+  for (const IndexEntry& entry : found) {
+    if (writeIndex(entry) != Status::SUCCESS)
+      return Status::FAIL;
+  }
+  if (sweeps_ == 0)
+    last_.points.clear();
+  return Status::SUCCESS;
+}
+
+// The caller holds mutex_.
+Status Si4703_SurveyLog::writeIndex(const IndexEntry& entry) {
+  uint8_t record[INDEX_ENTRY_LENGTH];
+  putU64(record, entry.time);
+  putU64(record + 8, entry.offset);
+  putU64(record + 16, entry.sweep);
+  if (lseek(index_fd_, 0, SEEK_END) < 0 ||
+      !writeAll(index_fd_, record, sizeof(record))) {
+    perror((path_ + ".idx").c_str());
+    // Leave no partial entry behind to misalign the next one.
+    if (ftruncate(index_fd_, INDEX_HEADER_LENGTH +
+                                 index_.size() * INDEX_ENTRY_LENGTH) < 0)
+      perror((path_ + ".idx").c_str());
+    return Status::FAIL;
+  }
+  index_.push_back(entry);
+  return Status::SUCCESS;
+}
+
+Status Si4703_SurveyLog::append(const Si4703_Sweep& sweep) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (fd_ < 0 || static_cast<int>(sweep.points.size()) != band_.channels ||
+      (!last_.points.empty() && sweep.time < last_.time))
+    return Status::FAIL;
+  const bool key =
+      last_.points.empty() || since_keyframe_ >= keyframe_interval_;
+  std::vector<uint8_t> frame;
+  encode(sweep, key, &frame);
+  if (lseek(fd_, size_, SEEK_SET) < 0 ||
+      !writeAll(fd_, frame.data(), frame.size())) {
+    perror(path_.c_str());
+    // Leave no partial frame behind for the next append.
+    if (ftruncate(fd_, size_) < 0)
+      perror(path_.c_str());
+    return Status::FAIL;
+  }
+  // The frame is in the log, so the next delta is against it whatever
+  // becomes of its index entry.
+  const IndexEntry entry{sweep.time, size_, sweeps_};
+  size_ += frame.size();
+  sweeps_++;
+  since_keyframe_ = key ? 1 : since_keyframe_ + 1;
+  last_ = sweep;
+  // Without the entry, queries start from an earlier keyframe: slower, not
+  // wrong, and the index is rebuildable.
+  if (key && (unindexed_ || writeIndex(entry) != Status::SUCCESS))
+    unindexed_++;
+  return Status::SUCCESS;
+}
+
+// The caller holds mutex_.
+void Si4703_SurveyLog::encode(const Si4703_Sweep& sweep,
+                              bool key,
+                              std::vector<uint8_t>* out) {
+  std::vector<uint8_t> payload;
+  BitWriter writer(&payload);
+  uint32_t run = 0;
+  for (int channel = 0; channel < band_.channels; channel++) {
+    const Si4703_SweepPoint& point = sweep.points[channel];
+    const Si4703_SweepPoint& ref =
+        Reference(sweep.points, last_.points, key, channel);
+    if (Same(point, ref)) {
+      run++;
+      continue;
+    }
+    writer.gamma(run + 1);
+    run = 0;
+    const int delta = point.rssi - ref.rssi;
+    if ((delta == 1 || delta == -1) && FlagsOf(point) == FlagsOf(ref)) {
+      writer.put(0, 1);
+      writer.put(delta < 0, 1);
+    } else if (delta >= -8 && delta <= 7) {
+      writer.put(0x2, 2);
+      writer.put(FlagsOf(point), 2);
+      writer.put(delta & 0xF, 4);
+    } else {
+      writer.put(0x3, 2);
+      writer.put(point.rssi, 8);
+      writer.put(FlagsOf(point), 2);
+    }
+  }
+  if (run)
+    writer.gamma(run + 1);
+
+  out->push_back(key ? KEYFRAME : DELTA);
+  putVarint(out, key ? sweep.time : sweep.time - last_.time);
+  putVarint(out, payload.size());
+  out->insert(out->end(), payload.begin(), payload.end());
+}
+
+size_t Si4703_SurveyLog::decode(
+    const uint8_t* data,
+    size_t length,
+    Si4703_Sweep* sweep,
+    const std::function<bool(const Si4703_Sweep&, bool key, size_t offset)>&
+        callback) {
+  size_t pos = 0;
+  while (pos < length) {
+    const size_t start = pos;
+    const uint8_t kind = data[pos++];
+    uint64_t time, size;
+    if ((kind != KEYFRAME && kind != DELTA) ||
+        !getVarint(data, length, &pos, &time) ||
+        !getVarint(data, length, &pos, &size) || size > length - pos)
+      return start;
+    const bool key = kind == KEYFRAME;
+    if (!DecodePoints(data + pos, size, key, &sweep->points))
+      return start;
+    sweep->time = key ? time : sweep->time + time;
+    pos += size;
+    if (!callback(*sweep, key, start))
+      return start;
+  }
+  return pos;
+}
+
+Status Si4703_SurveyLog::scan(
+    time_t from,
+    time_t to,
+    const std::function<void(const Si4703_Sweep&)>& callback) {
+  std::vector<uint8_t> data;
+  uint64_t start;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ < 0)
+      return Status::FAIL;
+    if (index_.empty() || to < from)
+      return Status::SUCCESS;
+    // From the last keyframe at or before |from| to the first one after
+    // |to|.
+    auto first = std::upper_bound(
+        index_.begin(), index_.end(), from,
+        [](time_t t, const IndexEntry& entry) { return t < entry.time; });
+    if (first != index_.begin())
+      first--;
+    const auto last = std::upper_bound(
+        first, index_.end(), to,
+        [](time_t t, const IndexEntry& entry) { return t < entry.time; });
+    start = first->offset;
+    const uint64_t end = last == index_.end() ? size_ : last->offset;
+    data.resize(end - start);
+    if (!readAll(fd_, data.data(), data.size(), start))
+      return Status::FAIL;
+  }
+  Si4703_Sweep sweep{0, std::vector<Si4703_SweepPoint>(band_.channels)};
+  decode(data.data(), data.size(), &sweep,
+         [&](const Si4703_Sweep& s, bool, size_t) {
+           if (s.time > to)
+             return false;
+           if (s.time >= from)
+             callback(s);
+           return true;
+         });
+  return Status::SUCCESS;
+}
+
+std::vector<Si4703_SurveyLog::Sample> Si4703_SurveyLog::history(int channel,
+                                                                time_t from,
+                                                                time_t to) {
+  std::vector<Sample> samples;
+  if (channel < 0 || channel >= band_.channels)
+    return samples;
+  scan(from, to, [&](const Si4703_Sweep& sweep) {
+    samples.push_back(Sample{sweep.time, sweep.points[channel]});
+  });
+  return samples;
+}
+
+std::vector<Si4703_SurveyLog::Change> Si4703_SurveyLog::changes(int min_db,
+                                                                time_t from,
+                                                                time_t to) {
+  std::vector<Change> all;
+  scan(from, to, [&](const Si4703_Sweep& sweep) {
+    if (all.empty()) {
+      for (int channel = 0; channel < band_.channels; channel++) {
+        const int rssi = sweep.points[channel].rssi;
+        all.push_back(Change{channel,
+                             band_.min_frequency + band_.spacing * channel,
+                             rssi, rssi, sweep.time, sweep.time});
+      }
+      return;
+    }
+    for (Change& change : all) {
+      const int rssi = sweep.points[change.channel].rssi;
+      if (rssi < change.min_rssi) {
+        change.min_rssi = rssi;
+        change.min_time = sweep.time;
+      } else if (rssi > change.max_rssi) {
+        change.max_rssi = rssi;
+        change.max_time = sweep.time;
+      }
+    }
+  });
+  std::vector<Change> changes;
+  for (const Change& change : all) {
+    if (change.max_rssi - change.min_rssi > min_db)
+      changes.push_back(change);
+  }
+  return changes;
+}
+
+Si4703_SurveyLog::Stats Si4703_SurveyLog::stats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return Stats{sweeps_, index_.size() + unindexed_, size_};
+}
+
+Si4703_SurveyRecorder::Si4703_SurveyRecorder(
+    Si4703_SurveyScheduler* scheduler,
+    Si4703_SurveyLog* log,
+    std::chrono::seconds interval)
+    : scheduler_(scheduler),
+      log_(log),
+      interval_(interval),
+      running_(false),
+      failures_(0) {}
+
+Si4703_SurveyRecorder::~Si4703_SurveyRecorder() {
+  stop();
+}
+
+void Si4703_SurveyRecorder::start() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (running_)
+    return;
+  running_ = true;
+  thread_ = std::thread(&Si4703_SurveyRecorder::run, this);
+}
+
+void Si4703_SurveyRecorder::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+  cv_.notify_all();
+  if (thread_.joinable())
+    thread_.join();
+}
+
+Status Si4703_SurveyRecorder::sweep() {
+  Si4703_Sweep sweep;
+  sweep.time = time(nullptr);
+  for (const Si4703_ChannelReport& report : scheduler_->run()) {
+    sweep.points.push_back(Si4703_SweepPoint{
+        static_cast<uint8_t>(std::max(0, std::min(report.rssi, 255))),
+        report.stereo, report.afc_rail});
+  }
+  const Status s = log_->append(sweep);
+  if (s != Status::SUCCESS) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    failures_++;
+  }
+  return s;
+}
+
+int Si4703_SurveyRecorder::failures() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return failures_;
+}
+
+// Sweeps start on a fixed grid from start(), so a slow sweep doesn't push
+// the later ones back. A sweep longer than the interval skips grid points.
+void Si4703_SurveyRecorder::run() {
+  using Clock = std::chrono::steady_clock;
+  Clock::time_point next = Clock::now();
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (running_) {
+    lock.unlock();
+    sweep();
+    lock.lock();
+    const Clock::time_point now = Clock::now();
+    while (next <= now)
+      next += interval_;
+    cv_.wait_until(lock, next, [this] { return !running_; });
+  }
+}
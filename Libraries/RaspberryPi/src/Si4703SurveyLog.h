@@ -0,0 +1,181 @@
+//
+// Band survey time series.
+//
+// Si4703_SurveyLog keeps band sweeps, the RSSI, stereo and AFC rail flags of
+// every channel, in an append-only file. Each sweep is stored as the bits
+// that changed since the previous one: runs of unchanged channels as Elias
+// gamma codes, a 1 dB step in 2 bits, up to 8 dB with new flags in 8 bits
+// and anything else in 12. Every |keyframe_interval| sweeps one is coded on
+// its own, against its lower neighbour channel, so a query never decodes
+// from the start of the file. The offsets and times of those keyframes go
+// in a second file, <path>.idx, the time index the queries start from.
+//
+// File format, integers little-endian:
+//
+//   <path>:     "S4SV" version:u8 reserved:u8 channels:u16
+//               min_frequency_khz:u32 spacing_khz:u32
+//               frame*
+//   frame:      kind:u8 time:varint length:varint payload:u8[length]
+//   <path>.idx: "S4SI" reserved:u32 (time:i64 offset:u64 sweep:u64)*
+//
+// kind is 'K' for a keyframe, whose time is in seconds since the epoch, or
+// 'D' for a delta frame, whose time is in seconds since the previous frame.
+// A frame cut short by a crash is dropped when the log is opened, and a lost
+// or short index is rebuilt from the frames.
+//
+// Si4703_SurveyRecorder runs Si4703_SurveyScheduler sweeps on a schedule
+// and appends them to a log.
+//
+
+#ifndef Si4703SurveyLog_h
+#define Si4703SurveyLog_h
+
+#include <time.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <inttypes.h>
+
+#include "Si4703Survey.h"
+
+struct Si4703_SweepPoint {
+  uint8_t rssi;  // dBuV.
+  bool stereo;
+  bool afc_rail;
+};
+
+struct Si4703_Sweep {
+  time_t time;  // Seconds since the epoch.
+  std::vector<Si4703_SweepPoint> points;  // By channel.
+};
+
+class Si4703_SurveyLog {
+ public:
+  struct Band {
+    float min_frequency;  // MHz.
+    float spacing;        // MHz.
+    int channels;
+  };
+
+  struct Sample {
+    time_t time;
+    Si4703_SweepPoint point;
+  };
+
+  struct Change {
+    int channel;
+    float frequency;  // MHz.
+    int min_rssi;
+    int max_rssi;
+    time_t min_time;  // Of the first sweep with |min_rssi|.
+    time_t max_time;
+  };
+
+  struct Stats {
+    uint64_t sweeps;
+    uint64_t keyframes;
+    uint64_t bytes;  // Of the log, index not included.
+  };
+
+  explicit Si4703_SurveyLog(const std::string& path);
+  ~Si4703_SurveyLog();
+
+  // Open the log, creating it for |band| if it doesn't exist. Fails if it
+  // exists for another band or can't be read.
+  Status open(const Band& band, int keyframe_interval = 240);
+  void close();
+
+  // Append |sweep|, which must have a point for every channel and must not
+  // be older than the last one.
+  Status append(const Si4703_Sweep& sweep);
+
+  // Call |callback| with every sweep from |from| to |to|, both included.
+  Status scan(time_t from,
+              time_t to,
+              const std::function<void(const Si4703_Sweep&)>& callback);
+
+  // |channel| in every sweep from |from| to |to|.
+  std::vector<Sample> history(int channel, time_t from, time_t to);
+
+  // The channels whose RSSI moved by more than |min_db| between the
+  // weakest and strongest sweep from |from| to |to|.
+  std::vector<Change> changes(int min_db, time_t from, time_t to);
+
+  const Band& band() const { return band_; }
+  Stats stats();
+
+ private:
+  struct IndexEntry {
+    time_t time;
+    uint64_t offset;
+    uint64_t sweep;
+  };
+
+  Status create();
+  Status load();
+  Status writeIndex(const IndexEntry& entry);
+  void encode(const Si4703_Sweep& sweep, bool key, std::vector<uint8_t>* out);
+  // Decode the frames in |data| into |sweep|, which holds the one before
+  // them, calling |callback| after each. Returns the bytes of whole frames.
+  size_t decode(const uint8_t* data,
+                size_t length,
+                Si4703_Sweep* sweep,
+                const std::function<bool(const Si4703_Sweep&, bool key,
+                                         size_t offset)>& callback);
+
+  std::string path_;
+  Band band_;
+  int keyframe_interval_;
+  std::mutex mutex_;  // Protects everything below.
+  int fd_;
+  int index_fd_;
+  std::vector<IndexEntry> index_;
+  // Keyframes left out of the index since a write to it failed. Once one
+  // is, so are the rest, and the next open() finds them all by scanning on
+  // from the last indexed one.
+  uint64_t unindexed_;
+  uint64_t size_;           // Bytes of whole frames.
+  uint64_t sweeps_;         // In the log.
+  int since_keyframe_;      // Sweeps since the last keyframe.
+  Si4703_Sweep last_;       // The last sweep appended.
+};
+
+class Si4703_SurveyRecorder {
+ public:
+  // Sweep with |scheduler| every |interval| and append to |log|, which must
+  // be open for the band of the scheduler's tuners. The scheduler should
+  // have RDS dwells off (a high rds_min_rssi) to keep sweeps short.
+  Si4703_SurveyRecorder(Si4703_SurveyScheduler* scheduler,
+                        Si4703_SurveyLog* log,
+                        std::chrono::seconds interval);
+  ~Si4703_SurveyRecorder();
+
+  // Sweep now, then every interval from now, on a thread of its own.
+  void start();
+  void stop();
+
+  // Run one sweep and append it.
+  Status sweep();
+
+  int failures();  // Sweeps that couldn't be appended.
+
+ private:
+  void run();
+
+  Si4703_SurveyScheduler* scheduler_;
+  Si4703_SurveyLog* log_;
+  std::chrono::seconds interval_;
+  std::thread thread_;
+  std::mutex mutex_;  // Protects everything below.
+  std::condition_variable cv_;
+  bool running_;
+  int failures_;
+};
+
+#endif
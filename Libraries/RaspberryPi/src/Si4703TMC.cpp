@@ -0,0 +1,395 @@
+#include <algorithm>
+
+#include "Si4703TMC.h"
+
+namespace {
+
+// Block B of an 8A group.
+const uint16_t TUNING_FLAG = 1 << 4;  // Tuning or system information.
+const uint16_t SINGLE_FLAG = 1 << 3;  // Single-group message.
+
+// Block C.
+const uint16_t FIRST_FLAG = 1 << 15;   // First group of a multi-group one.
+const uint16_t SECOND_FLAG = 1 << 14;  // Second group of a multi-group one.
+
+// Optional content (ISO 14819-1 section 5.5): a 4 bit label and then a
+// field of this many bits.
+const uint8_t LABEL_BITS = 4;
+const uint8_t FIELD_BITS[16] = {3, 3, 5, 5, 5, 8, 8, 8, 8, 11, 16, 16, 16, 16,
+                                0, 0};
+const uint8_t LABEL_DURATION = 0;
+const uint8_t LABEL_CONTROL = 1;
+const uint8_t LABEL_EVENT = 9;
+const uint8_t LABEL_RESERVED = 15;
+
+// Control codes.
+const uint8_t CONTROL_DIVERSION = 5;
+const uint8_t CONTROL_EXTENT_8 = 6;
+const uint8_t CONTROL_EXTENT_16 = 7;
+
+const uint8_t CHUNK_BITS = 28;
+
+// Reads the optional content of a multi-group message MSB first.
+class BitReader {
+ public:
+  BitReader(const uint32_t* chunks, uint8_t count)
+      : chunks_(chunks), size_(count * CHUNK_BITS), pos_(0) {}
+
+  int left() const { return size_ - pos_; }
+
+  uint32_t read(int bits) {
+    uint32_t value = 0;
+    for (int i = 0; i < bits; i++)
+      value = (value << 1) | bit(pos_++);
+    return value;
+  }
+
+  // Only zero padding is left.
+  bool padding() const {
+    for (int i = pos_; i < size_; i++) {
+      if (bit(i))
+        return false;
+    }
+    return true;
+  }
+
+ private:
+  uint32_t bit(int i) const {
+    return (chunks_[i / CHUNK_BITS] >> (CHUNK_BITS - 1 - i % CHUNK_BITS)) & 1;
+  }
+
+  const uint32_t* chunks_;
+  int size_;
+  int pos_;
+};
+
+}  // anonymous namespace
+
+Si4703_TmcDecoder::Si4703_TmcDecoder() : stats_{0, 0, 0, 0, 0, 0} {
+  clear();
+}
+
+void Si4703_TmcDecoder::clear() {
+  pi_ = 0;
+  last_[0] = last_[1] = last_[2] = 0;
+  for (Partial& partial : partials_)
+    partial.active = false;
+}
+
+bool Si4703_TmcDecoder::addGroup(const RdsGroup& group,
+                                 Si4703_TmcMessage* message) {
+  if (group.type() != 8 || group.version() != 0)
+    return false;
+  if (group.pi() != pi_) {
+    clear();
+    pi_ = group.pi();
+  }
+  stats_.groups++;
+  // Every group goes out twice in a row; take the first.
+  const uint16_t b = group.blocks[1], c = group.blocks[2],
+                 d = group.blocks[3];
+  if (b == last_[0] && c == last_[1] && d == last_[2]) {
+    stats_.repeats++;
+    return false;
+  }
+  last_[0] = b;
+  last_[1] = c;
+  last_[2] = d;
+
+  if (b & TUNING_FLAG) {
+    stats_.system++;
+    return false;
+  }
+  if (!(b & SINGLE_FLAG))
+    return addMulti(b & 0x7, group, message);
+
+  decodeFirst(c, d, message);
+  message->diversion = c & FIRST_FLAG;
+  message->duration = b & 0x7;
+  stats_.single++;
+  return true;
+}
+
+// Block C and D of a single-group message or the first group of a
+// multi-group one.
+void Si4703_TmcDecoder::decodeFirst(uint16_t c,
+                                    uint16_t d,
+                                    Si4703_TmcMessage* message) {
+  message->pi = pi_;
+  message->negative = c & (1 << 14);
+  message->extent = (c >> 11) & 0x7;
+  message->event = c & 0x7FF;
+  message->location = d;
+  message->diversion = false;
+  message->duration = 0;
+  message->groups = 1;
+  message->events.clear();
+}
+
+bool Si4703_TmcDecoder::addMulti(uint8_t ci,
+                                 const RdsGroup& group,
+                                 Si4703_TmcMessage* message) {
+  Partial& partial = partials_[ci];
+  const uint16_t c = group.blocks[2], d = group.blocks[3];
+  if (c & FIRST_FLAG) {
+    if (partial.active)
+      stats_.broken++;
+    partial.active = true;
+    partial.second = true;
+    partial.chunks = 0;
+    decodeFirst(c, d, &partial.message);
+    return false;
+  }
+  if (!partial.active)
+    return false;  // Its first group was lost.
+
+  const bool second = c & SECOND_FLAG;
+  const uint8_t gsi = (c >> 12) & 0x3;
+  if (second != partial.second ||
+      (!second && gsi != partial.remaining - 1) ||
+      partial.chunks == 4) {
+    stats_.broken++;
+    partial.active = false;
+    return false;
+  }
+  partial.second = false;
+  partial.remaining = gsi;
+  partial.bits[partial.chunks++] =
+      (static_cast<uint32_t>(c & 0xFFF) << 16) | d;
+  partial.message.groups++;
+  if (gsi)
+    return false;
+
+  partial.active = false;
+  decodeOptional(&partial);
+  std::swap(*message, partial.message);
+  stats_.multi++;
+  return true;
+}
+
+// The labels this decoder uses; the others are skipped.
+void Si4703_TmcDecoder::decodeOptional(Partial* partial) {
+  Si4703_TmcMessage& message = partial->message;
+  BitReader reader(partial->bits, partial->chunks);
+  while (reader.left() >= LABEL_BITS && !reader.padding()) {
+    const uint8_t label = reader.read(LABEL_BITS);
+    if (label == LABEL_RESERVED || reader.left() < FIELD_BITS[label])
+      return;
+    const uint32_t value = reader.read(FIELD_BITS[label]);
+    if (label == LABEL_DURATION) {
+      message.duration = value;
+    } else if (label == LABEL_EVENT) {
+      message.events.push_back(value);
+    } else if (label == LABEL_CONTROL) {
+      if (value == CONTROL_DIVERSION)
+        message.diversion = true;
+      else if (value == CONTROL_EXTENT_8)
+        message.extent += 8;
+      else if (value == CONTROL_EXTENT_16)
+        message.extent += 16;
+    }
+  }
+}
+
+void Si4703_TmcLocations::add(uint16_t location,
+                              uint16_t negative,
+                              uint16_t positive) {
+  offsets_[location] = std::make_pair(negative, positive);
+}
+
+uint16_t Si4703_TmcLocations::next(uint16_t location, bool negative) const {
+  const auto it = offsets_.find(location);
+  if (it == offsets_.end())
+    return 0;
+  return negative ? it->second.first : it->second.second;
+}
+
+Si4703_TmcStore::Si4703_TmcStore(const Si4703_TmcLocations* locations)
+    : locations_(locations), stats_{0, 0, 0, 0} {}
+
+// static
+std::chrono::minutes Si4703_TmcStore::persistence(uint8_t duration) {
+  // Persistence of dynamic events, the last one standing for "until the
+  // end of the day".
+  static const int MINUTES[8] = {15, 15, 30, 60, 120, 180, 240, 24 * 60};
+  return std::chrono::minutes(MINUTES[duration & 0x7]);
+}
+
+// static
+Si4703_TmcStore::Key Si4703_TmcStore::keyOf(const Si4703_TmcMessage& message) {
+  return (static_cast<Key>(message.location) << 16) | (message.event << 1) |
+         message.negative;
+}
+
+void Si4703_TmcStore::add(const Si4703_TmcMessage& message,
+                          uint8_t tuner,
+                          Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  expireLocked(now);
+  const Key key = keyOf(message);
+  const Clock::time_point expires = now + persistence(message.duration);
+  auto it = entries_.find(key);
+  if (it != entries_.end()) {
+    Event& event = it->second.event;
+    // An update may lengthen or shorten the extent, moving the span.
+    const bool moved = message.extent != event.message.extent;
+    event.message = message;
+    if (moved)
+      setSpan(&it->second, key);
+    event.tuner = tuner;
+    event.received = now;
+    if (expires > event.expires) {
+      event.expires = expires;
+      expiry_.push(std::make_pair(expires, key));
+    }
+    stats_.updated++;
+    return;
+  }
+
+  Entry& entry = entries_[key];
+  entry.event = Event{message, tuner, now, expires};
+  setSpan(&entry, key);
+  by_event_[message.event].push_back(key);
+  expiry_.push(std::make_pair(expires, key));
+  stats_.added++;
+}
+
+std::vector<Si4703_TmcStore::Event> Si4703_TmcStore::near(
+    uint16_t location,
+    int radius,
+    Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  expireLocked(now);
+  std::vector<Event> events;
+  std::vector<Key> seen;
+  auto collect = [&](uint16_t code) {
+    const auto it = by_location_.find(code);
+    if (it == by_location_.end())
+      return;
+    for (Key key : it->second) {
+      if (std::find(seen.begin(), seen.end(), key) != seen.end())
+        continue;
+      seen.push_back(key);
+      events.push_back(entries_[key].event);
+    }
+  };
+  collect(location);
+  uint16_t negative = location, positive = location;
+  for (int i = 0; locations_ && i < radius; i++) {
+    if (negative && (negative = locations_->next(negative, true)))
+      collect(negative);
+    if (positive && (positive = locations_->next(positive, false)))
+      collect(positive);
+    if (!negative && !positive)
+      break;
+  }
+  return events;
+}
+
+std::vector<Si4703_TmcStore::Event> Si4703_TmcStore::withEvent(
+    uint16_t event,
+    Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  expireLocked(now);
+  std::vector<Event> events;
+  const auto it = by_event_.find(event);
+  if (it != by_event_.end()) {
+    for (Key key : it->second)
+      events.push_back(entries_[key].event);
+  }
+  return events;
+}
+
+void Si4703_TmcStore::expire(Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  expireLocked(now);
+}
+
+void Si4703_TmcStore::expireLocked(Clock::time_point now) {
+  while (!expiry_.empty() && expiry_.top().first <= now) {
+    const Key key = expiry_.top().second;
+    const Clock::time_point when = expiry_.top().first;
+    expiry_.pop();
+    const auto it = entries_.find(key);
+    // Skip the stale times of events since extended or removed.
+    if (it == entries_.end() || it->second.event.expires != when)
+      continue;
+    remove(key);
+    stats_.expired++;
+  }
+}
+
+// Index the locations covered by |entry|'s message in place of its old span.
+void Si4703_TmcStore::setSpan(Entry* entry, Key key) {
+  for (uint16_t code : entry->span)
+    unindex(&by_location_, code, key);
+  entry->span.clear();
+  const Si4703_TmcMessage& message = entry->event.message;
+  uint16_t location = message.location;
+  entry->span.push_back(location);
+  for (int i = 0; locations_ && i < message.extent; i++) {
+    location = locations_->next(location, message.negative);
+    if (!location)
+      break;
+    entry->span.push_back(location);
+  }
+  for (uint16_t code : entry->span)
+    by_location_[code].push_back(key);
+}
+
+void Si4703_TmcStore::remove(Key key) {
+  const auto it = entries_.find(key);
+  for (uint16_t code : it->second.span)
+    unindex(&by_location_, code, key);
+  unindex(&by_event_, it->second.event.message.event, key);
+  entries_.erase(it);
+}
+
+// static
+void Si4703_TmcStore::unindex(Index* index, uint16_t code, Key key) {
+  const auto it = index->find(code);
+  if (it == index->end())
+    return;
+  std::vector<Key>& keys = it->second;
+  const auto pos = std::find(keys.begin(), keys.end(), key);
+  if (pos != keys.end()) {
+    *pos = keys.back();
+    keys.pop_back();
+  }
+  if (keys.empty())
+    index->erase(it);
+}
+
+Si4703_TmcStore::Stats Si4703_TmcStore::stats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Stats stats = stats_;
+  stats.active = entries_.size();
+  return stats;
+}
+
+Si4703_TmcMonitor::Si4703_TmcMonitor(Si4703_Breakout* radio,
+                                     Si4703_TmcStore* store,
+                                     uint8_t tuner)
+    : radio_(radio), store_(store), tuner_(tuner) {
+  listener_id_ = radio_->addRdsGroupListener(
+      [this](const RdsGroup& group) { onGroup(group); });
+}
+
+Si4703_TmcMonitor::~Si4703_TmcMonitor() {
+  radio_->removeRdsGroupListener(listener_id_);
+}
+
+void Si4703_TmcMonitor::onGroup(const RdsGroup& group) {
+  Si4703_TmcMessage message;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!decoder_.addGroup(group, &message))
+      return;
+  }
+  store_->add(message, tuner_);
+}
+
+Si4703_TmcDecoder::Stats Si4703_TmcMonitor::stats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return decoder_.stats();
+}
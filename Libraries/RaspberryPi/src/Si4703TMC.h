@@ -0,0 +1,195 @@
+//
+// RDS-TMC (Traffic Message Channel, ISO 14819-1) in group 8A.
+//
+// Si4703_TmcDecoder turns 8A groups into messages: single-group ones
+// directly, multi-group ones (up to five groups, told apart by their
+// continuity index) once the last group is in, so several can be under way
+// at once. Si4703_TmcStore keeps the messages as active events indexed by
+// location and event code until their duration runs out, and is shared by
+// any number of tuners, each fed by a Si4703_TmcMonitor. Location codes only
+// mean something with the location table of the service; give the store the
+// road points of that table in a Si4703_TmcLocations to find the events
+// near a location and to follow an event's extent along the road.
+//
+
+#ifndef Si4703TMC_h
+#define Si4703TMC_h
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <inttypes.h>
+
+#include "SparkFunSi4703.h"
+
+struct Si4703_TmcMessage {
+  uint16_t pi;
+  uint16_t location;  // Primary location.
+  uint16_t event;     // 11 bit event code.
+  // Further locations the event covers, stepping from |location| along the
+  // road in the direction |negative| gives.
+  uint8_t extent;
+  bool negative;
+  bool diversion;    // Diversion advice.
+  uint8_t duration;  // Duration and persistence, 0-7.
+  uint8_t groups;    // Groups the message came in, 1 for single-group.
+  // Further events from the optional content of a multi-group message.
+  std::vector<uint16_t> events;
+};
+
+class Si4703_TmcDecoder {
+ public:
+  struct Stats {
+    uint64_t groups;    // 8A groups, repeats included.
+    uint64_t repeats;   // Immediate repetitions, ignored.
+    uint64_t system;    // Tuning and system information groups.
+    uint64_t single;    // Single-group messages.
+    uint64_t multi;     // Multi-group messages.
+    uint64_t broken;    // Multi-group messages abandoned for a lost group.
+  };
+
+  Si4703_TmcDecoder();
+
+  // Returns true when |group| completed a message, put in |message|. Other
+  // groups than 8A are ignored.
+  bool addGroup(const RdsGroup& group, Si4703_TmcMessage* message);
+  // Forget messages under way, as after a retune.
+  void clear();
+
+  const Stats& stats() const { return stats_; }
+
+ private:
+  // A multi-group message under way.
+  struct Partial {
+    bool active;
+    bool second;        // The second group is next.
+    uint8_t remaining;  // Group sequence identifier of the last group.
+    uint8_t chunks;
+    uint32_t bits[4];   // 28 bits of optional content per group.
+    Si4703_TmcMessage message;
+  };
+
+  void decodeFirst(uint16_t c, uint16_t d, Si4703_TmcMessage* message);
+  bool addMulti(uint8_t ci, const RdsGroup& group, Si4703_TmcMessage* message);
+  void decodeOptional(Partial* partial);
+
+  uint16_t pi_;
+  uint16_t last_[3];  // Blocks B-D of the last 8A group.
+  Partial partials_[8];  // By continuity index.
+  Stats stats_;
+};
+
+// The road points of a location table, each with its neighbours.
+class Si4703_TmcLocations {
+ public:
+  // |negative| and |positive| are the next points along the road, 0 for
+  // none.
+  void add(uint16_t location, uint16_t negative, uint16_t positive);
+  // The next point from |location|, 0 if there is none or it is unknown.
+  uint16_t next(uint16_t location, bool negative) const;
+
+ private:
+  std::unordered_map<uint16_t, std::pair<uint16_t, uint16_t>> offsets_;
+};
+
+class Si4703_TmcStore {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Event {
+    Si4703_TmcMessage message;
+    uint8_t tuner;  // That last sent it.
+    Clock::time_point received;
+    Clock::time_point expires;
+  };
+
+  struct Stats {
+    uint64_t added;    // New events.
+    uint64_t updated;  // Repeats of an active event, expiry extended.
+    uint64_t expired;
+    size_t active;
+  };
+
+  // |locations|, if given, must not change while the store uses it.
+  explicit Si4703_TmcStore(const Si4703_TmcLocations* locations = nullptr);
+
+  // How long an event with |duration| 0-7 stays active.
+  static std::chrono::minutes persistence(uint8_t duration);
+
+  // Add |message| received by |tuner|. The same location, direction and
+  // event from any tuner is one event, kept until the latest copy expires.
+  void add(const Si4703_TmcMessage& message,
+           uint8_t tuner,
+           Clock::time_point now = Clock::now());
+
+  // Active events covering any location within |radius| road points of
+  // |location|, nearest first. Without a location table only events at
+  // |location| itself are found.
+  std::vector<Event> near(uint16_t location,
+                          int radius,
+                          Clock::time_point now = Clock::now());
+  // Active events with |event| as their primary event code.
+  std::vector<Event> withEvent(uint16_t event,
+                               Clock::time_point now = Clock::now());
+
+  // Drop the events that have expired by |now|. add() and the queries do
+  // this as they go.
+  void expire(Clock::time_point now = Clock::now());
+
+  Stats stats();
+
+ private:
+  using Key = uint64_t;
+  using Index = std::unordered_map<uint16_t, std::vector<Key>>;
+
+  struct Entry {
+    Event event;
+    std::vector<uint16_t> span;  // Locations covered, primary first.
+  };
+
+  static Key keyOf(const Si4703_TmcMessage& message);
+  static void unindex(Index* index, uint16_t code, Key key);
+  void setSpan(Entry* entry, Key key);
+  void expireLocked(Clock::time_point now);
+  void remove(Key key);
+
+  const Si4703_TmcLocations* locations_;
+  std::mutex mutex_;  // Protects everything below.
+  std::unordered_map<Key, Entry> entries_;
+  Index by_location_;  // Every location of the span.
+  Index by_event_;     // Primary event code.
+  // Expiry times, with stale ones left in for events since extended.
+  std::priority_queue<std::pair<Clock::time_point, Key>,
+                      std::vector<std::pair<Clock::time_point, Key>>,
+                      std::greater<std::pair<Clock::time_point, Key>>>
+      expiry_;
+  Stats stats_;
+};
+
+// Feeds the 8A groups one tuner receives into a shared store.
+class Si4703_TmcMonitor {
+ public:
+  Si4703_TmcMonitor(Si4703_Breakout* radio,
+                    Si4703_TmcStore* store,
+                    uint8_t tuner = 0);
+  ~Si4703_TmcMonitor();
+
+  Si4703_TmcDecoder::Stats stats();
+
+ private:
+  void onGroup(const RdsGroup& group);
+
+  Si4703_Breakout* radio_;
+  Si4703_TmcStore* store_;
+  uint8_t tuner_;
+  int listener_id_;
+  std::mutex mutex_;  // Protects decoder_.
+  Si4703_TmcDecoder decoder_;
+};
+
+#endif
@@ -0,0 +1,275 @@
+#include <algorithm>
+#include <thread>
+
+#include <string.h>
+
+#include "Si4703Bytes.h"
+#include "Si4703Trace.h"
+
+using namespace si4703bytes;
+
+namespace {
+
+const char MAGIC[4] = {'S', '4', 'T', 'R'};
+const uint8_t VERSION = 2;
+const size_t HEADER_LENGTH = 8;
+const size_t RECORD_HEADER_LENGTH = 10;
+
+const uint8_t KIND_WRITE = 1 << 0;
+const uint8_t KIND_FAILED = 1 << 1;
+const uint8_t KIND_RESET = 1 << 2;
+const uint8_t KIND_COMBINED = 1 << 3;
+
+uint32_t Micros(std::chrono::steady_clock::duration d) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+}  // anonymous namespace
+
+Si4703_TraceRecorder::Si4703_TraceRecorder(std::unique_ptr<Si4703_Bus> bus,
+                                           const std::string& path)
+    : bus_(std::move(bus)),
+      file_(fopen(path.c_str(), "wb")),
+      last_start_(Clock::now()) {
+  if (!file_) {
+    perror(path.c_str());
+    return;
+  }
+  uint8_t header[HEADER_LENGTH] = {0};
+  memcpy(header, MAGIC, sizeof(MAGIC));
+  header[4] = VERSION;
+  fwrite(header, 1, sizeof(header), file_);
+}
+
+Si4703_TraceRecorder::~Si4703_TraceRecorder() {
+  if (file_)
+    fclose(file_);
+}
+
+Status Si4703_TraceRecorder::open() {
+  return bus_->open();
+}
+
+Status Si4703_TraceRecorder::read(uint8_t* buffer, int length) {
+  const Clock::time_point start = Clock::now();
+  const Status s = bus_->read(buffer, length);
+  const Clock::time_point end = Clock::now();
+  if (s == Status::SUCCESS)
+    record(0, buffer, length, start, end);
+  else
+    record(KIND_FAILED, nullptr, length, start, end);
+  return s;
+}
+
+Status Si4703_TraceRecorder::write(const uint8_t* buffer, int length) {
+  const Clock::time_point start = Clock::now();
+  const Status s = bus_->write(buffer, length);
+  const Clock::time_point end = Clock::now();
+  record(KIND_WRITE | (s == Status::SUCCESS ? 0 : KIND_FAILED), buffer, length,
+         start, end);
+  return s;
+}
+
+Status Si4703_TraceRecorder::transfer(const Si4703_BusMessage* messages,
+                                      int count) {
+  const Clock::time_point start = Clock::now();
+  const Status s = bus_->transfer(messages, count);
+  const Clock::time_point end = Clock::now();
+  const uint8_t failed = s == Status::SUCCESS ? 0 : KIND_FAILED;
+  for (int i = 0; i < count; i++) {
+    const Si4703_BusMessage& m = messages[i];
+    const uint8_t kind = (m.read ? 0 : KIND_WRITE) | failed |
+                         (i > 0 ? KIND_COMBINED : 0);
+    record(kind, m.read && failed ? nullptr : m.buffer, m.length, start,
+           i == 0 ? end : start);
+  }
+  return s;
+}
+
+Status Si4703_TraceRecorder::reset() {
+  const Clock::time_point start = Clock::now();
+  const Status s = bus_->reset();
+  const Clock::time_point end = Clock::now();
+  record(KIND_RESET | (s == Status::SUCCESS ? 0 : KIND_FAILED), nullptr, 0,
+         start, end);
+  return s;
+}
+
+void Si4703_TraceRecorder::record(uint8_t kind,
+                                  const uint8_t* payload,
+                                  int length,
+                                  Clock::time_point start,
+                                  Clock::time_point end) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!file_)
+    return;
+  uint8_t header[RECORD_HEADER_LENGTH];
+  header[0] = kind;
+  header[1] = static_cast<uint8_t>(length);
+  putU32(header + 2, Micros(start - last_start_));
+  putU32(header + 6, Micros(end - start));
+  last_start_ = start;
+  fwrite(header, 1, sizeof(header), file_);
+  if (payload)
+    fwrite(payload, 1, length, file_);
+}
+
+Si4703_TraceReplayBus::Si4703_TraceReplayBus(const std::string& path,
+                                             Timing timing)
+    : path_(path),
+      timing_(timing),
+      next_read_(0),
+      next_write_(0),
+      next_reset_(0),
+      started_(false),
+      stats_{0, 0, 0, 0, 0, 0, std::chrono::microseconds(0)} {}
+
+Status Si4703_TraceReplayBus::open() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!records_.empty())
+    return Status::SUCCESS;
+
+  FILE* file = fopen(path_.c_str(), "rb");
+  if (!file) {
+    perror(path_.c_str());
+    return Status::FAIL;
+  }
+  uint8_t header[HEADER_LENGTH];
+  if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+      memcmp(header, MAGIC, sizeof(MAGIC)) != 0 || header[4] < 1 ||
+      header[4] > VERSION) {
+    fprintf(stderr, "%s: not a Si4703 trace\n", path_.c_str());
+    fclose(file);
+    return Status::FAIL;
+  }
+
+  std::chrono::microseconds start(0);
+  uint8_t record_header[RECORD_HEADER_LENGTH];
+  while (fread(record_header, 1, sizeof(record_header), file) ==
+         sizeof(record_header)) {
+    Record record;
+    record.kind = (record_header[0] & KIND_RESET)   ? RESET
+                  : (record_header[0] & KIND_WRITE) ? WRITE
+                                                    : READ;
+    record.failed = record_header[0] & KIND_FAILED;
+    start += std::chrono::microseconds(getU32(record_header + 2));
+    record.start = start;
+    record.duration = std::chrono::microseconds(getU32(record_header + 6));
+    record.payload.resize(record_header[1]);
+    const bool has_payload =
+        record.kind == WRITE || (record.kind == READ && !record.failed);
+    if (has_payload && fread(record.payload.data(), 1, record.payload.size(),
+                             file) != record.payload.size())
+      break;  // Truncated, e.g. the recording process was killed.
+    records_.push_back(std::move(record));
+  }
+  fclose(file);
+  return Status::SUCCESS;
+}
+
+// The next record of |kind|, or nullptr past the end.
+const Si4703_TraceReplayBus::Record* Si4703_TraceReplayBus::next(Kind kind) {
+  size_t& index = kind == READ    ? next_read_
+                  : kind == WRITE ? next_write_
+                                  : next_reset_;
+  while (index < records_.size() && records_[index].kind != kind)
+    index++;
+  if (index == records_.size()) {
+    stats_.missing++;
+    return nullptr;
+  }
+  const Record* record = &records_[index++];
+  if (!started_) {
+    started_ = true;
+    epoch_ = Clock::now() - record->start;
+  }
+  return record;
+}
+
+// Hold the caller until |record| completed in the recording.
+void Si4703_TraceReplayBus::pace(const Record& record) {
+  if (timing_ == Timing::Fast)
+    return;
+  const Clock::time_point before = Clock::now();
+  std::this_thread::sleep_until(epoch_ + record.start + record.duration);
+  const auto waited = std::chrono::duration_cast<std::chrono::microseconds>(
+      Clock::now() - before);
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.bus_time += waited;
+}
+
+Status Si4703_TraceReplayBus::read(uint8_t* buffer, int length) {
+  const Record* record;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.reads++;
+    record = next(READ);
+  }
+  if (!record)
+    return Status::FAIL;
+  pace(*record);
+  if (record->failed)
+    return Status::FAIL;
+  const int n = std::min<int>(length, record->payload.size());
+  memcpy(buffer, record->payload.data(), n);
+  memset(buffer + n, 0, length - n);
+  return Status::SUCCESS;
+}
+
+Status Si4703_TraceReplayBus::write(const uint8_t* buffer, int length) {
+  const Record* record;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.writes++;
+    record = next(WRITE);
+    if (record && (record->payload.size() != static_cast<size_t>(length) ||
+                   memcmp(record->payload.data(), buffer, length) != 0))
+      stats_.mismatches++;
+  }
+  if (!record)
+    return Status::FAIL;
+  pace(*record);
+  return record->failed ? Status::FAIL : Status::SUCCESS;
+}
+
+Status Si4703_TraceReplayBus::transfer(const Si4703_BusMessage* messages,
+                                       int count) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.transactions++;
+  }
+  // Every message has a record, also those after the one that failed.
+  Status status = Status::SUCCESS;
+  for (int i = 0; i < count; i++) {
+    const Si4703_BusMessage& m = messages[i];
+    if ((m.read ? read(m.buffer, m.length) : write(m.buffer, m.length)) !=
+        Status::SUCCESS)
+      status = Status::FAIL;
+  }
+  return status;
+}
+
+Status Si4703_TraceReplayBus::reset() {
+  const Record* record;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.resets++;
+    record = next(RESET);
+  }
+  if (!record)
+    return Status::FAIL;
+  pace(*record);
+  return record->failed ? Status::FAIL : Status::SUCCESS;
+}
+
+bool Si4703_TraceReplayBus::finished() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  while (next_read_ < records_.size() && records_[next_read_].kind != READ)
+    next_read_++;
+  return next_read_ == records_.size();
+}
+
+Si4703_TraceReplayBus::Stats Si4703_TraceReplayBus::stats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
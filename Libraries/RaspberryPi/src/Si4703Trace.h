@@ -0,0 +1,138 @@
+//
+// Binary traces of the transfers between Si4703_Breakout and the chip.
+//
+// Si4703_TraceRecorder sits between the breakout and the real bus and logs
+// every read, write and reset. Si4703_TraceReplayBus plays such a trace back in
+// place of the chip, so a recorded session can be reproduced bit for bit
+// without hardware, at the recorded pace or as fast as the driver goes.
+//
+// File format, all integers little-endian:
+//
+//   header: "S4TR" version:u8 reserved:u8[3]
+//   record: kind:u8 length:u8 start_delta_us:u32 duration_us:u32
+//           payload:u8[length]
+//
+// kind bit 0 is set for a write, bit 1 for a failed transfer and bit 2 for
+// a reset of the bus, which has no payload. A failed read has no payload
+// either. Bit 3 marks a read or write that continues the combined
+// transaction of the record before it; the first record of a transaction
+// holds its duration and the others 0, and all are failed if it failed.
+// Version 1 traces have no resets or transactions. start_delta_us is the
+// time since the start of the previous record (since the recorder was
+// created for the first one).
+//
+
+#ifndef Si4703Trace_h
+#define Si4703Trace_h
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "Si4703Bus.h"
+
+class Si4703_TraceRecorder : public Si4703_Bus {
+ public:
+  // Record the transfers made through |bus| to the file at |path|. If the
+  // file can't be created the transfers still go through, unrecorded.
+  Si4703_TraceRecorder(std::unique_ptr<Si4703_Bus> bus,
+                       const std::string& path);
+  ~Si4703_TraceRecorder() override;
+
+  Status open() override;
+  Status read(uint8_t* buffer, int length) override;
+  Status write(const uint8_t* buffer, int length) override;
+  // Passed to |bus| as one combined transaction.
+  Status transfer(const Si4703_BusMessage* messages, int count) override;
+  // Resets |bus|, as recovery from a wedged bus does.
+  Status reset() override;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  void record(uint8_t kind,
+              const uint8_t* payload,
+              int length,
+              Clock::time_point start,
+              Clock::time_point end);
+
+  std::unique_ptr<Si4703_Bus> bus_;
+  std::mutex mutex_;  // Protects everything below.
+  FILE* file_;
+  Clock::time_point last_start_;
+};
+
+class Si4703_TraceReplayBus : public Si4703_Bus {
+ public:
+  enum class Timing {
+    Recorded,  // Each transfer completes when it did in the recording.
+    Fast,      // Each transfer completes at once.
+  };
+
+  struct Stats {
+    int reads;
+    int writes;
+    // Combined transactions, their reads and writes counted above too.
+    int transactions;
+    // Writes whose payload differs from the recorded one.
+    int mismatches;
+    int resets;
+    // Transfers asked for after the trace ran out of that kind.
+    int missing;
+    // Time spent holding transfers back to the recorded pace.
+    std::chrono::microseconds bus_time;
+  };
+
+  Si4703_TraceReplayBus(const std::string& path, Timing timing);
+
+  // Loads the trace; fails if it can't be read or isn't a trace.
+  Status open() override;
+  // Reads and writes are each replayed in recorded order, independently of
+  // each other, so a different interleaving of the driver's threads still
+  // gets the recorded data.
+  Status read(uint8_t* buffer, int length) override;
+  Status write(const uint8_t* buffer, int length) override;
+  // Replays a read or write record per message. A recorded transaction
+  // fails as a whole.
+  Status transfer(const Si4703_BusMessage* messages, int count) override;
+  // Replays the next recorded reset, in order with the other resets.
+  Status reset() override;
+
+  // All recorded reads have been replayed.
+  bool finished();
+  Stats stats();
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  enum Kind { READ, WRITE, RESET };
+
+  struct Record {
+    Kind kind;
+    bool failed;
+    std::chrono::microseconds start;  // Since the start of the trace.
+    std::chrono::microseconds duration;
+    std::vector<uint8_t> payload;
+  };
+
+  const Record* next(Kind kind);
+  void pace(const Record& record);
+
+  std::string path_;
+  Timing timing_;
+  std::mutex mutex_;  // Protects everything below.
+  std::vector<Record> records_;
+  size_t next_read_;
+  size_t next_write_;
+  size_t next_reset_;
+  bool started_;
+  Clock::time_point epoch_;  // Replay time of the start of the trace.
+  Stats stats_;
+};
+
+#endif
@@ -0,0 +1,398 @@
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "Si4703Traffic.h"
+
+namespace {
+
+// Method A AF codes, see IEC 62106 section 3.2.1.6.1.
+const uint8_t AF_FIRST = 1;   // 87.6 MHz.
+const uint8_t AF_LAST = 204;  // 107.9 MHz.
+
+// Bits of block B.
+const uint16_t TP = 1 << 10;
+const uint16_t TA = 1 << 4;        // Of 0A/0B.
+const uint16_t TP_ON = 1 << 4;     // Of 14A/14B.
+const uint16_t TA_ON = 1 << 3;     // Of 14B.
+const uint8_t VARIANT_TA_ON = 13;  // 14A with PTY(ON) and TA(ON) in block C.
+
+bool SameFrequency(float a, float b) {
+  return std::fabs(a - b) < 0.01f;
+}
+
+float CodeFrequency(uint8_t code) {
+  return 87.5f + code / 10.0f;
+}
+
+}  // anonymous namespace
+
+Si4703_TrafficMonitor::Si4703_TrafficMonitor(Si4703_Breakout* radio)
+    : Si4703_TrafficMonitor(radio, Config()) {}
+
+Si4703_TrafficMonitor::Si4703_TrafficMonitor(Si4703_Breakout* radio,
+                                             const Config& config)
+    : radio_(radio),
+      config_(config),
+      stop_(false),
+      pi_(0),
+      frequency_(0),
+      ta_(false),
+      triggered_(false),
+      state_(IDLE),
+      announcer_(0),
+      eon_(false),
+      confirmed_(false),
+      ended_(false),
+      recorded_(false),
+      next_probe_at_(Clock::now()),
+      next_probe_(0),
+      stats_{0, 0, 0, 0, 0, 0, std::chrono::microseconds(0),
+             std::chrono::microseconds(0)} {
+  listener_id_ = radio_->addRdsGroupListener(
+      [this](const RdsGroup& group) { onGroup(group); });
+}
+
+Si4703_TrafficMonitor::~Si4703_TrafficMonitor() {
+  stop();
+  radio_->removeRdsGroupListener(listener_id_);
+}
+
+void Si4703_TrafficMonitor::start() {
+  if (thread_.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = false;
+  }
+  thread_ = std::thread(&Si4703_TrafficMonitor::run, this);
+}
+
+void Si4703_TrafficMonitor::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  if (thread_.joinable())
+    thread_.join();
+}
+
+std::vector<Si4703_EonNetwork> Si4703_TrafficMonitor::networks() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return networks_;
+}
+
+std::vector<Si4703_TrafficSwitch> Si4703_TrafficMonitor::switches() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return std::vector<Si4703_TrafficSwitch>(switches_.begin(),
+                                           switches_.end());
+}
+
+bool Si4703_TrafficMonitor::announcing() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return state_ == ANNOUNCING;
+}
+
+Si4703_TrafficMonitor::Stats Si4703_TrafficMonitor::stats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void Si4703_TrafficMonitor::onGroup(const RdsGroup& group) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const uint16_t b = group.blocks[1];
+  if (state_ == ANNOUNCING) {
+    // Only the announcing station is listened to, for the end of it.
+    if (group.pi() != announcer_ || group.type() != 0)
+      return;
+    if ((b & TP) && (b & TA)) {
+      if (!confirmed_) {
+        confirmed_ = true;
+        cv_.notify_all();
+      }
+    } else if (!ended_) {
+      ended_ = true;
+      cv_.notify_all();
+    }
+    return;
+  }
+
+  if (group.pi() != pi_) {
+    // Another station: its links are its own.
+    pi_ = group.pi();
+    ta_ = false;
+    networks_.clear();
+    next_probe_ = 0;
+  }
+  if (group.type() == 0) {
+    const bool ta = (b & TP) && (b & TA);
+    if (ta && !ta_ && !triggered_) {
+      trigger_ = Trigger{group.pi(), false, group.received};
+      triggered_ = true;
+      cv_.notify_all();
+    }
+    ta_ = ta;
+  } else if (group.type() == 14) {
+    onOtherNetwork(group);
+  }
+}
+
+// 14A carries, by variant in the low bits of block B, the PS name of the
+// other network (0-3), its AF list (4), frequencies mapped from the one
+// tuned to (5-8) and its TA flag (13); 14B only the TA flag. Both have its
+// PI code in block D and its TP flag in block B.
+void Si4703_TrafficMonitor::onOtherNetwork(const RdsGroup& group) {
+  const uint16_t b = group.blocks[1];
+  const uint16_t c = group.blocks[2];
+  Si4703_EonNetwork* other = network(group.blocks[3]);
+  other->tp = b & TP_ON;
+  bool ta;
+  if (group.version() == 1) {
+    ta = b & TA_ON;
+  } else {
+    const uint8_t variant = b & 0xF;
+    if (variant < 4) {
+      other->ps[variant * 2] = c >> 8;
+      other->ps[variant * 2 + 1] = c & 0xFF;
+      return;
+    }
+    if (variant == 4) {
+      addFrequency(other, c >> 8);
+      addFrequency(other, c & 0xFF);
+      return;
+    }
+    if (variant <= 8) {
+      const uint8_t tuning = c >> 8;
+      if (tuning >= AF_FIRST && tuning <= AF_LAST &&
+          SameFrequency(CodeFrequency(tuning), frequency_))
+        addFrequency(other, c & 0xFF);
+      return;
+    }
+    if (variant != VARIANT_TA_ON)
+      return;
+    ta = c & 0x1;
+  }
+  ta = ta && other->tp;
+  if (ta && !other->ta && config_.follow_eon && !triggered_) {
+    trigger_ = Trigger{other->pi, true, group.received};
+    triggered_ = true;
+    cv_.notify_all();
+  }
+  other->ta = ta;
+}
+
+Si4703_EonNetwork* Si4703_TrafficMonitor::network(uint16_t pi) {
+  for (Si4703_EonNetwork& network : networks_) {
+    if (network.pi == pi)
+      return &network;
+  }
+  networks_.push_back(Si4703_EonNetwork{pi, std::string(8, ' '), false,
+                                        false, {}});
+  return &networks_.back();
+}
+
+void Si4703_TrafficMonitor::addFrequency(Si4703_EonNetwork* network,
+                                         uint8_t code) {
+  // Number-of-AF codes, fillers and LF/MF frequencies carry no FM channel.
+  if (code < AF_FIRST || code > AF_LAST)
+    return;
+  const float frequency = CodeFrequency(code);
+  for (const Si4703_EonNetwork::Frequency& f : network->frequencies) {
+    if (SameFrequency(f.frequency, frequency))
+      return;
+  }
+  network->frequencies.push_back(
+      Si4703_EonNetwork::Frequency{frequency, -1, Clock::time_point()});
+}
+
+// The strongest frequency of |network| at the last probes, if strong
+// enough.
+const Si4703_EonNetwork::Frequency* Si4703_TrafficMonitor::target(
+    const Si4703_EonNetwork& network) const {
+  const Si4703_EonNetwork::Frequency* best = nullptr;
+  for (const Si4703_EonNetwork::Frequency& f : network.frequencies) {
+    if (f.rssi >= config_.min_rssi && (!best || f.rssi > best->rssi))
+      best = &f;
+  }
+  return best;
+}
+
+int Si4703_TrafficMonitor::transfers() {
+  return static_cast<int>(radio_->retryStats().transfers);
+}
+
+void Si4703_TrafficMonitor::announce(std::unique_lock<std::mutex>* lock,
+                                     const Trigger& trigger) {
+  stats_.announcements++;
+  Si4703_Changes changes;
+  if (trigger.eon) {
+    const Si4703_EonNetwork::Frequency* to = nullptr;
+    for (const Si4703_EonNetwork& network : networks_) {
+      if (network.pi == trigger.pi)
+        to = target(network);
+    }
+    if (!to) {
+      stats_.skipped++;
+      return;
+    }
+    changes.frequency = to->frequency;
+  }
+  // From here groups of other stations are ignored, so that the announcing
+  // station's aren't taken for a new station tuned to.
+  state_ = ANNOUNCING;
+  announcer_ = trigger.pi;
+  eon_ = trigger.eon;
+  confirmed_ = !trigger.eon;
+  ended_ = false;
+  recorded_ = false;
+  lock->unlock();
+
+  // Both come from the register snapshot, without bus traffic.
+  const float from = radio_->getFrequency();
+  const int volume = radio_->getVolume();
+  Si4703_Changes undo;
+  if (config_.volume >= 0 && config_.volume != volume) {
+    changes.volume = config_.volume;
+    undo.volume = volume;
+  }
+  if (changes.frequency > 0)
+    undo.frequency = from;
+  const int before = transfers();
+  Status status = Status::SUCCESS;
+  if (changes.frequency > 0 || changes.volume >= 0)
+    status = radio_->apply(changes);
+  const Clock::time_point done = Clock::now();
+  const int after = transfers();
+
+  lock->lock();
+  undo_ = undo;
+  switched_at_ = done;
+  if (status != Status::SUCCESS) {
+    // Go back to where it was, counted as aborted.
+    confirmed_ = false;
+    ended_ = true;
+    return;
+  }
+  if (trigger.eon)
+    stats_.switches++;
+  const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+      done - trigger.received);
+  stats_.total_latency += latency;
+  stats_.max_latency = std::max(stats_.max_latency, latency);
+  if (latency > config_.latency_bound)
+    stats_.late++;
+  switches_.push_back(Si4703_TrafficSwitch{
+      trigger.pi, from, trigger.eon ? changes.frequency : from,
+      trigger.received, latency, after - before, 0,
+      std::chrono::milliseconds(0)});
+  while (switches_.size() > config_.history)
+    switches_.pop_front();
+  recorded_ = true;
+}
+
+void Si4703_TrafficMonitor::endAnnouncement(
+    std::unique_lock<std::mutex>* lock) {
+  const Si4703_Changes undo = undo_;
+  lock->unlock();
+  const int before = transfers();
+  if (undo.frequency > 0 || undo.volume >= 0)
+    radio_->apply(undo);
+  const int after = transfers();
+  lock->lock();
+
+  if (recorded_ && !switches_.empty()) {
+    switches_.back().return_transfers = after - before;
+    switches_.back().length =
+        std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() -
+                                                              switched_at_);
+  }
+  // A station cut off still has TA up, and doesn't start another
+  // announcement until it drops it. One seen to drop it is ready for the
+  // next, without waiting to hear of it through EON.
+  if (!eon_) {
+    ta_ = !ended_;
+  } else if (ended_) {
+    for (Si4703_EonNetwork& network : networks_) {
+      if (network.pi == announcer_)
+        network.ta = false;
+    }
+  }
+  state_ = IDLE;
+  triggered_ = false;
+}
+
+// Probe the next frequency of a linked station with traffic programme whose
+// last probe is older than |validate_interval|.
+void Si4703_TrafficMonitor::validate(std::unique_lock<std::mutex>* lock) {
+  const Clock::time_point now = Clock::now();
+  next_probe_at_ = now + config_.probe_interval;
+  std::vector<std::pair<uint16_t, float>> due;
+  for (const Si4703_EonNetwork& network : networks_) {
+    if (!network.tp)
+      continue;
+    for (const Si4703_EonNetwork::Frequency& f : network.frequencies) {
+      if (f.probed == Clock::time_point() ||
+          now - f.probed >= config_.validate_interval)
+        due.emplace_back(network.pi, f.frequency);
+    }
+  }
+  if (due.empty())
+    return;
+  const std::pair<uint16_t, float> probe = due[next_probe_++ % due.size()];
+  lock->unlock();
+  const int rssi = radio_->probeRSSI(probe.second);
+  lock->lock();
+
+  stats_.probes++;
+  for (Si4703_EonNetwork& network : networks_) {
+    if (network.pi != probe.first)
+      continue;
+    for (Si4703_EonNetwork::Frequency& f : network.frequencies) {
+      if (SameFrequency(f.frequency, probe.second)) {
+        f.rssi = rssi;
+        f.probed = Clock::now();
+      }
+    }
+  }
+}
+
+void Si4703_TrafficMonitor::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stop_) {
+    if (state_ == ANNOUNCING) {
+      const Clock::time_point deadline =
+          switched_at_ + (confirmed_ ? std::chrono::milliseconds(
+                                           config_.max_announcement)
+                                     : config_.pi_timeout);
+      if (ended_ || Clock::now() >= deadline) {
+        if (!confirmed_)
+          stats_.aborted++;
+        endAnnouncement(&lock);
+        continue;
+      }
+      cv_.wait_until(lock, deadline);
+      continue;
+    }
+
+    if (triggered_) {
+      const Trigger trigger = trigger_;
+      announce(&lock, trigger);
+      if (state_ == IDLE)
+        triggered_ = false;
+      continue;
+    }
+    lock.unlock();
+    const float frequency = radio_->getFrequency();
+    lock.lock();
+    frequency_ = frequency;
+    if (Clock::now() >= next_probe_at_) {
+      validate(&lock);
+      continue;
+    }
+    cv_.wait_until(lock, next_probe_at_,
+                   [this] { return stop_ || triggered_; });
+  }
+  if (state_ == ANNOUNCING)
+    endAnnouncement(&lock);
+}
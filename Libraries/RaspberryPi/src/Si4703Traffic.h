@@ -0,0 +1,173 @@
+//
+// Traffic announcement (TA) switching.
+//
+// A station carrying traffic programme (TP) raises the TA flag in its 0A/0B
+// groups for the length of each traffic announcement. Through enhanced
+// other networks (EON, groups 14A and 14B) it also names the stations
+// linked to it, where they can be received and, with TA(ON), when one of
+// them starts an announcement.
+//
+// Si4703_TrafficMonitor keeps the linked stations of the station tuned to
+// and checks their frequencies ahead of time with one probeRSSI() each,
+// redone every |validate_interval|, so that an announcement finds a target
+// ready. When one starts it retunes with a single apply(), which writes the
+// channel and the announcement volume in one register write, and goes back
+// the same way to the frequency and volume it left once the announcing
+// station drops TA. An announcement on the station tuned to only changes
+// the volume.
+//
+// Every switch is recorded with its trigger-to-audio latency: from reading
+// the group that carried the TA flag to the end of the tune, when the chip
+// plays the announcing station.
+//
+
+#ifndef Si4703Traffic_h
+#define Si4703Traffic_h
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <inttypes.h>
+
+#include "SparkFunSi4703.h"
+
+// A station linked through EON.
+struct Si4703_EonNetwork {
+  struct Frequency {
+    float frequency;  // MHz.
+    int rssi;         // At the last probe; -1 until probed or if it failed.
+    std::chrono::steady_clock::time_point probed;
+  };
+
+  uint16_t pi;
+  std::string ps;  // 8 characters, spaces until received.
+  bool tp;
+  bool ta;
+  std::vector<Frequency> frequencies;
+};
+
+struct Si4703_TrafficSwitch {
+  uint16_t pi;  // Of the announcing station.
+  float from;   // MHz.
+  float to;     // The same as |from| for the station tuned to.
+  std::chrono::steady_clock::time_point trigger;
+  // From |trigger| to the audio of the announcing station.
+  std::chrono::microseconds latency;
+  // Register reads and writes of the switch, and of the switch back.
+  int transfers;
+  int return_transfers;
+  // How long the announcement held the tuner; 0 until it is over.
+  std::chrono::milliseconds length;
+};
+
+class Si4703_TrafficMonitor {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Config {
+    // Volume (0..15) for announcements; -1 leaves it.
+    int volume = -1;
+    // Switch to announcements on linked stations, not only the current one.
+    bool follow_eon = true;
+    // A frequency weaker than this at its last probe is not switched to.
+    int min_rssi = 25;
+    std::chrono::seconds validate_interval{300};
+    // Time between two probes. Each mutes the audio for two tunes.
+    std::chrono::milliseconds probe_interval{2000};
+    // How long to wait after a switch for the announcing station to show
+    // TA before going back.
+    std::chrono::milliseconds pi_timeout{1000};
+    std::chrono::seconds max_announcement{600};
+    // Switches slower than this count as late.
+    std::chrono::milliseconds latency_bound{150};
+    // Switches kept for switches().
+    size_t history = 64;
+  };
+
+  struct Stats {
+    int announcements;
+    int switches;  // Announcements on linked stations, switched to.
+    int skipped;   // Linked ones without a validated frequency.
+    // Switches undone because the tune failed or the target never showed
+    // TA.
+    int aborted;
+    int late;
+    int probes;
+    std::chrono::microseconds total_latency;
+    std::chrono::microseconds max_latency;
+  };
+
+  Si4703_TrafficMonitor(Si4703_Breakout* radio, const Config& config);
+  explicit Si4703_TrafficMonitor(Si4703_Breakout* radio);
+  ~Si4703_TrafficMonitor();
+
+  // Watch for announcements, and validate targets, on a thread of its own
+  // until stop(). The radio must be powered on.
+  void start();
+  void stop();
+
+  // The stations linked to the current one.
+  std::vector<Si4703_EonNetwork> networks();
+  // The latest switches, oldest first.
+  std::vector<Si4703_TrafficSwitch> switches();
+  bool announcing();
+
+  Stats stats();
+
+ private:
+  enum State { IDLE, ANNOUNCING };
+
+  struct Trigger {
+    uint16_t pi;
+    bool eon;
+    Clock::time_point received;
+  };
+
+  void onGroup(const RdsGroup& group);
+  void onOtherNetwork(const RdsGroup& group);
+  Si4703_EonNetwork* network(uint16_t pi);
+  void addFrequency(Si4703_EonNetwork* network, uint8_t code);
+  const Si4703_EonNetwork::Frequency* target(
+      const Si4703_EonNetwork& network) const;
+  void announce(std::unique_lock<std::mutex>* lock, const Trigger& trigger);
+  void endAnnouncement(std::unique_lock<std::mutex>* lock);
+  void validate(std::unique_lock<std::mutex>* lock);
+  int transfers();
+  void run();
+
+  Si4703_Breakout* radio_;
+  Config config_;
+  int listener_id_;
+  std::thread thread_;
+
+  std::mutex mutex_;  // Protects everything below.
+  std::condition_variable cv_;
+  bool stop_;
+  uint16_t pi_;      // Of the station tuned to, while idle.
+  float frequency_;  // MHz, of the same.
+  bool ta_;          // Its TA flag.
+  std::vector<Si4703_EonNetwork> networks_;
+  bool triggered_;  // |trigger_| waits for the thread.
+  Trigger trigger_;
+  State state_;
+  // The announcement under way: who makes it, whether its TA has been seen
+  // since the switch or has dropped, and how to go back.
+  uint16_t announcer_;
+  bool eon_;
+  bool confirmed_;
+  bool ended_;
+  bool recorded_;  // Its switch is the last of |switches_|.
+  Clock::time_point switched_at_;
+  Si4703_Changes undo_;
+  Clock::time_point next_probe_at_;
+  size_t next_probe_;
+  std::deque<Si4703_TrafficSwitch> switches_;
+  Stats stats_;
+};
+
+#endif
@@ -0,0 +1,419 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "Si4703Watchlist.h"
+
+namespace {
+
+using Seconds = std::chrono::duration<double>;
+
+// Before a station has been visited: the time from the tune to each field,
+// with the chip's group rate and a station sending 0A and 2A groups.
+const double INITIAL_LATENCY[Si4703_WatchReport::FIELDS] = {0, 0.2, 1.0, 3.0};
+const double INITIAL_TUNE = 0.06;
+// Weight of the latest visit in the averaged latencies, tune time and
+// time between tunes.
+const double ALPHA = 0.25;
+
+uint8_t Bit(int field) {
+  return 1 << field;
+}
+
+const uint8_t RDS_FIELDS = (1 << Si4703_WatchReport::PI) |
+                           (1 << Si4703_WatchReport::PS) |
+                           (1 << Si4703_WatchReport::RT);
+
+}  // anonymous namespace
+
+Si4703_Watchlist::Si4703_Watchlist(Si4703_Breakout* radio,
+                                   const std::vector<float>& frequencies,
+                                   const Config& config)
+    : radio_(radio),
+      config_(config),
+      stop_(false),
+      current_(-1),
+      refreshed_(0),
+      tune_seconds_(INITIAL_TUNE),
+      cycle_seconds_(0),
+      stats_{0, 0, 0, std::chrono::milliseconds(0)} {
+  for (float frequency : frequencies) {
+    Station station;
+    station.report.frequency = frequency;
+    station.report.rssi = 0;
+    station.report.stereo = false;
+    station.report.pi = 0;
+    station.report.pty = 0;
+    station.report.visits = 0;
+    for (int f = 0; f < Si4703_WatchReport::FIELDS; f++) {
+      Known& known = station.known[f];
+      known = Known();
+      known.rate = -1;
+      known.latency = INITIAL_LATENCY[f];
+    }
+    stations_.push_back(station);
+  }
+  listener_id_ = radio_->addRdsGroupListener(
+      [this](const RdsGroup& group) { onGroup(group); });
+}
+
+Si4703_Watchlist::Si4703_Watchlist(Si4703_Breakout* radio,
+                                   const std::vector<float>& frequencies)
+    : Si4703_Watchlist(radio, frequencies, Config()) {}
+
+Si4703_Watchlist::~Si4703_Watchlist() {
+  stop();
+  radio_->removeRdsGroupListener(listener_id_);
+}
+
+void Si4703_Watchlist::start() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (thread_.joinable() || stations_.empty())
+    return;
+  stop_ = false;
+  thread_ = std::thread(&Si4703_Watchlist::run, this);
+}
+
+void Si4703_Watchlist::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  if (thread_.joinable())
+    thread_.join();
+}
+
+void Si4703_Watchlist::run() {
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stop_)
+        return;
+    }
+    visit();
+  }
+}
+
+// The maximum likelihood rate of a Poisson process seen at irregular
+// intervals, knowing only whether it changed in each (Cho and
+// Garcia-Molina): the one at which the changed intervals I add up to
+// sum(I / (exp(rate * I) - 1)) = the sum of the unchanged ones. Its average
+// interval would underestimate it when intervals vary. A field never seen
+// to change gets half a change over the time it was watched, one always
+// seen to change their bias-reduced estimate.
+void Si4703_Watchlist::estimateRate(Known* known) const {
+  const int n = known->samples;
+  double total = 0;
+  double unchanged = 0;
+  int changes = 0;
+  for (int i = 0; i < n; i++) {
+    total += known->intervals[i];
+    if (known->changes[i])
+      changes++;
+    else
+      unchanged += known->intervals[i];
+  }
+  if (n < 2 || total <= 0) {
+    known->rate = -1;
+  } else if (changes == 0) {
+    known->rate = 0.5 / total;
+  } else if (changes == n) {
+    known->rate = -std::log(0.5 / (n + 0.5)) * n / total;
+  } else {
+    // Bisect on a log scale between a change in 4 months and 100 a second.
+    double low = 1e-7;
+    double high = 100;
+    for (int step = 0; step < 48; step++) {
+      const double rate = std::sqrt(low * high);
+      double sum = 0;
+      for (int i = 0; i < n; i++) {
+        if (known->changes[i])
+          sum += known->intervals[i] / std::expm1(rate * known->intervals[i]);
+      }
+      if (sum > unchanged)
+        low = rate;
+      else
+        high = rate;
+    }
+    known->rate = std::sqrt(low * high);
+  }
+}
+
+double Si4703_Watchlist::changeRate(const Known& known) const {
+  if (known.rate < 0)
+    return 1.0 / config_.assumed_change_interval.count();
+  return known.rate;
+}
+
+double Si4703_Watchlist::staleness(const Known& known,
+                                   Clock::time_point now) const {
+  if (known.seen == Clock::time_point())
+    return 1;
+  const double age = Seconds(now - known.seen).count();
+  return 1 - std::exp(-changeRate(known) * age);
+}
+
+// The share of the next |horizon| seconds that |known| stays right once
+// refreshed. A field that changes every few seconds is soon stale again,
+// and refreshing it is worth less than its staleness says.
+double Si4703_Watchlist::lasting(const Known& known, double horizon) const {
+  const double x = changeRate(known) * horizon;
+  if (x < 1e-9)
+    return 1;
+  return -std::expm1(-x) / x;
+}
+
+// The fields of |station| worth refreshing at |now|. None of RDS on a
+// station too weak for it.
+uint8_t Si4703_Watchlist::staleFields(const Station& station,
+                                      Clock::time_point now) const {
+  const bool weak =
+      station.known[Si4703_WatchReport::SIGNAL].seen != Clock::time_point() &&
+      station.report.rssi < config_.rds_min_rssi;
+  uint8_t fields = 0;
+  for (int f = 0; f < Si4703_WatchReport::FIELDS; f++) {
+    if (weak && f != Si4703_WatchReport::SIGNAL)
+      break;
+    const Known& known = station.known[f];
+    if (known.seen == Clock::time_point()) {
+      // Not waited for again soon if the station doesn't send it.
+      if (known.missed == Clock::time_point() ||
+          now - known.missed >= config_.max_age)
+        fields |= Bit(f);
+    } else if (now - known.seen >= config_.max_age ||
+               staleness(known, now) >= config_.stale_probability) {
+      fields |= Bit(f);
+    }
+  }
+  return fields;
+}
+
+// The station that refreshes the most stale fields per second of tuner
+// time, counting a field overdue for |max_age| twice. A field counts for
+// as long as it would stay right until the station's next turn, a round of
+// the list away. Among equals, the one visited longest ago.
+int Si4703_Watchlist::pick(Clock::time_point now) const {
+  const int count = stations_.size();
+  if (!config_.adaptive_order || count == 1)
+    return (current_ + 1) % count;
+  const Clock::time_point at =
+      now + std::chrono::duration_cast<Clock::duration>(
+                Seconds(tune_seconds_));
+  int best = -1;
+  double best_score = -1;
+  const double horizon = count * cycle_seconds_;
+  // With a tune budget, a visit however short holds the tuner until the
+  // next tune is allowed.
+  const double min_cost = config_.tunes_per_minute > 0
+                              ? 60.0 / config_.tunes_per_minute
+                              : 0;
+  Clock::time_point best_visited;
+  for (int i = 0; i < count; i++) {
+    if (i == current_)
+      continue;
+    const Station& station = stations_[i];
+    const uint8_t fields = staleFields(station, at);
+    double gain = 0;
+    double wait = 0;
+    for (int f = 0; f < Si4703_WatchReport::FIELDS; f++) {
+      const Known& known = station.known[f];
+      if (!(fields & Bit(f)))
+        continue;
+      gain += staleness(known, at) * lasting(known, horizon);
+      if (at - known.seen >= config_.max_age)
+        gain += 1;
+      wait = std::max(wait, known.latency);
+    }
+    if (!config_.adaptive_dwell)
+      wait = Seconds(config_.max_dwell).count();
+    const double score = gain / std::max(min_cost, tune_seconds_ + wait);
+    const Clock::time_point visited =
+        station.known[Si4703_WatchReport::SIGNAL].seen;
+    if (score > best_score ||
+        (score == best_score && visited < best_visited)) {
+      best = i;
+      best_score = score;
+      best_visited = visited;
+    }
+  }
+  return best;
+}
+
+void Si4703_Watchlist::refresh(Station* station,
+                               Field field,
+                               bool changed,
+                               Clock::time_point now) {
+  Known& known = station->known[field];
+  const bool first = !(refreshed_ & Bit(field));
+  // Only the first sighting of a visit is a sample: one taken because the
+  // field changed while tuned would overstate how often it does.
+  if (known.seen != Clock::time_point() && first) {
+    known.intervals[known.next] =
+        std::max(1e-3, Seconds(now - known.seen).count());
+    known.changes[known.next] = changed;
+    known.next = (known.next + 1) % HISTORY;
+    if (known.samples < HISTORY)
+      known.samples++;
+    estimateRate(&known);
+  }
+  if (first && field != Si4703_WatchReport::SIGNAL) {
+    known.latency = (1 - ALPHA) * known.latency +
+                    ALPHA * Seconds(now - tuned_at_).count();
+  }
+  known.seen = now;
+  refreshed_ |= Bit(field);
+}
+
+void Si4703_Watchlist::onGroup(const RdsGroup& group) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (current_ < 0 || group.received < tuned_at_)
+    return;
+  const uint8_t events = decoder_.decodeGroup(
+      group.blocks[0], group.blocks[1], group.blocks[2], group.blocks[3]);
+  Station& station = stations_[current_];
+  Si4703_WatchReport& report = station.report;
+  const uint8_t before = refreshed_;
+
+  refresh(&station, Si4703_WatchReport::PI,
+          report.pi != decoder_.pi || report.pty != decoder_.pty,
+          group.received);
+  report.pi = decoder_.pi;
+  report.pty = decoder_.pty;
+  if (events & si4703::RdsDecoder::PS_COMPLETE) {
+    refresh(&station, Si4703_WatchReport::PS, report.ps != decoder_.ps,
+            group.received);
+    report.ps = decoder_.ps;
+  }
+  if (events & si4703::RdsDecoder::RT_COMPLETE) {
+    // Without the padding, up to the carriage return if there was one.
+    size_t length = strlen(decoder_.rt);
+    while (length && decoder_.rt[length - 1] == ' ')
+      length--;
+    const bool changed =
+        report.radio_text.compare(0, std::string::npos, decoder_.rt,
+                                  length) != 0;
+    refresh(&station, Si4703_WatchReport::RT, changed, group.received);
+    if (changed)
+      report.radio_text.assign(decoder_.rt, length);
+  }
+  if (refreshed_ != before)
+    cv_.notify_all();
+}
+
+void Si4703_Watchlist::visit() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (stations_.empty())
+    return;
+  if (current_ >= 0 && Clock::now() < next_tune_at_) {
+    // Out of tunes: stay, and take whatever the station sends meanwhile.
+    stats_.visits++;
+    stations_[current_].report.visits++;
+    cv_.wait_until(lock, next_tune_at_, [this] { return stop_; });
+    lock.unlock();
+    const Si4703_StatusSnapshot status = radio_->status();
+    lock.lock();
+    Station& station = stations_[current_];
+    refresh(&station, Si4703_WatchReport::SIGNAL,
+            std::abs(status.rssi - station.report.rssi) >= config_.rssi_step ||
+                station.report.stereo !=
+                    bool(status.flags & Si4703_StatusSnapshot::STEREO),
+            Clock::now());
+    station.report.rssi = status.rssi;
+    station.report.stereo = status.flags & Si4703_StatusSnapshot::STEREO;
+    return;
+  }
+
+  const int next = pick(Clock::now());
+  const float frequency = stations_[next].report.frequency;
+  lock.unlock();
+  const Clock::time_point start = Clock::now();
+  radio_->setFrequency(frequency);
+  const Clock::time_point tuned = Clock::now();
+  // setFrequency() leaves the status registers of the new channel in the
+  // register snapshot.
+  const Si4703_StatusSnapshot status = radio_->status();
+  lock.lock();
+
+  tune_seconds_ = (1 - ALPHA) * tune_seconds_ +
+                  ALPHA * Seconds(tuned - start).count();
+  if (stats_.tunes > 0) {
+    const double cycle = Seconds(start - last_tune_at_).count();
+    cycle_seconds_ = stats_.tunes == 1
+                         ? cycle
+                         : (1 - ALPHA) * cycle_seconds_ + ALPHA * cycle;
+  }
+  last_tune_at_ = start;
+  stats_.tunes++;
+  stats_.visits++;
+  stats_.tuning += std::chrono::duration_cast<std::chrono::milliseconds>(
+      tuned - start);
+  if (config_.tunes_per_minute > 0)
+    next_tune_at_ = start + std::chrono::duration_cast<Clock::duration>(
+                                std::chrono::minutes(1)) /
+                                config_.tunes_per_minute;
+  current_ = next;
+  tuned_at_ = tuned;
+  decoder_.reset();
+  refreshed_ = 0;
+
+  Station& station = stations_[next];
+  Si4703_WatchReport& report = station.report;
+  report.visits++;
+  refresh(&station, Si4703_WatchReport::SIGNAL,
+          std::abs(status.rssi - report.rssi) >= config_.rssi_step ||
+              report.stereo !=
+                  bool(status.flags & Si4703_StatusSnapshot::STEREO),
+          tuned);
+  report.rssi = status.rssi;
+  report.stereo = status.flags & Si4703_StatusSnapshot::STEREO;
+
+  const Clock::time_point deadline = tuned + config_.max_dwell;
+  if (!config_.adaptive_dwell) {
+    cv_.wait_until(lock, deadline, [this] { return stop_; });
+    return;
+  }
+  const uint8_t wanted = staleFields(station, tuned) & RDS_FIELDS;
+  auto done = [this, wanted] {
+    return stop_ || (refreshed_ & wanted) == wanted;
+  };
+  // A station without RDS, or too weak for it, is left after the PI
+  // timeout.
+  if (wanted && !cv_.wait_until(lock, tuned + config_.pi_timeout, [&] {
+        return done() || (refreshed_ & Bit(Si4703_WatchReport::PI));
+      })) {
+    stats_.timeouts++;
+  } else if (!cv_.wait_until(lock, deadline, done)) {
+    stats_.timeouts++;
+  }
+  const Clock::time_point now = Clock::now();
+  for (int f = Si4703_WatchReport::PI; f < Si4703_WatchReport::FIELDS; f++) {
+    if ((wanted & Bit(f)) && !(refreshed_ & Bit(f)))
+      station.known[f].missed = now;
+  }
+}
+
+std::vector<Si4703_WatchReport> Si4703_Watchlist::reports() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const Clock::time_point now = Clock::now();
+  std::vector<Si4703_WatchReport> reports;
+  for (const Station& station : stations_) {
+    Si4703_WatchReport report = station.report;
+    for (int f = 0; f < Si4703_WatchReport::FIELDS; f++) {
+      const Known& known = station.known[f];
+      report.age[f] =
+          known.seen == Clock::time_point()
+              ? std::chrono::milliseconds(-1)
+              : std::chrono::duration_cast<std::chrono::milliseconds>(
+                    now - known.seen);
+      report.changes_per_hour[f] = changeRate(known) * 3600;
+    }
+    reports.push_back(report);
+  }
+  return reports;
+}
+
+Si4703_Watchlist::Stats Si4703_Watchlist::stats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
@@ -0,0 +1,176 @@
+//
+// One tuner watching a list of stations.
+//
+// Si4703_Watchlist cycles a tuner through a list of stations and keeps
+// what it last saw of each: the signal (RSSI and stereo), the PI code and
+// PTY, the PS name and the RadioText, each with the time it was last
+// confirmed. Every field of every station gets an estimate of how often it
+// changes, from whether it had changed each time it was seen again.
+//
+// With that, a field seen |age| ago has changed since with probability
+// 1 - exp(-rate * age). A visit waits only for the fields likely enough to
+// be stale and leaves as soon as they are in: the signal right after the
+// tune, the PI code with the first group, the PS name and RadioText when
+// complete. The next station is the one that refreshes the most stale
+// fields per second of tuner time: the tune plus the wait for its slowest
+// stale field, as learnt from earlier visits, or a tune's share of the
+// budget if that is longer. Each field counts for the share of a round of
+// the list it would then stay right, so a field that changes every few
+// seconds doesn't draw the tuner to it over and over. A field left for
+// |max_age| is refreshed anyway.
+//
+// The tuner is busy with the watchlist while it runs. Tunes can be rationed
+// with |tunes_per_minute|, e.g. to spare a shared antenna switch; the tuner
+// stays on the station it is on until the next tune is due.
+//
+
+#ifndef Si4703Watchlist_h
+#define Si4703Watchlist_h
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <inttypes.h>
+
+#include "SparkFunSi4703.h"
+
+struct Si4703_WatchReport {
+  enum Field { SIGNAL, PI, PS, RT, FIELDS };
+
+  float frequency;  // MHz.
+  int rssi;         // dBuV.
+  bool stereo;
+  uint16_t pi;      // 0 until received.
+  uint8_t pty;
+  std::string ps;          // 8 characters; empty until received.
+  std::string radio_text;  // Without padding; empty until received.
+  // Since each field was last confirmed, or -1 if it never was.
+  std::chrono::milliseconds age[FIELDS];
+  // Estimated changes of each field per hour.
+  double changes_per_hour[FIELDS];
+  int visits;
+};
+
+class Si4703_Watchlist {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Config {
+    // Pick the next station by the stale fields it would refresh per
+    // second. Without it, stations take turns in list order.
+    bool adaptive_order = true;
+    // Leave a station once its stale fields are refreshed. Without it,
+    // every visit lasts |max_dwell|.
+    bool adaptive_dwell = true;
+    // Tunes a minute; 0 for no limit.
+    int tunes_per_minute = 0;
+    std::chrono::milliseconds max_dwell{4000};
+    // No RDS is waited for below this RSSI (dBuV), or once no group has
+    // come this long after the tune.
+    int rds_min_rssi = 20;
+    std::chrono::milliseconds pi_timeout{600};
+    // Wait for a field once it has changed with at least this probability
+    // since it was last seen.
+    double stale_probability = 0.3;
+    // Refresh every field at least this often however seldom it changes.
+    std::chrono::seconds max_age{120};
+    // How often a field is taken to change before it has been seen to.
+    std::chrono::seconds assumed_change_interval{60};
+    // RSSI moves smaller than this are not a change of signal (dB).
+    int rssi_step = 3;
+  };
+
+  struct Stats {
+    int tunes;
+    int visits;    // Tunes and stays on the same station.
+    int timeouts;  // Visits that gave up on the stale fields.
+    // Time spent in setFrequency().
+    std::chrono::milliseconds tuning;
+  };
+
+  // Watch |frequencies| (MHz) with |radio|, which must be powered on.
+  Si4703_Watchlist(Si4703_Breakout* radio,
+                   const std::vector<float>& frequencies,
+                   const Config& config);
+  Si4703_Watchlist(Si4703_Breakout* radio,
+                   const std::vector<float>& frequencies);
+  ~Si4703_Watchlist();
+
+  // Watch on a thread of its own until stop().
+  void start();
+  void stop();
+
+  // Pick a station and visit it. What the thread does over and over.
+  void visit();
+
+  // One report per station, in list order.
+  std::vector<Si4703_WatchReport> reports();
+
+  Stats stats();
+
+ private:
+  using Field = Si4703_WatchReport::Field;
+
+  // Times a field was seen again kept for its change rate. Older ones are
+  // dropped, so the rate follows a station that changes its habits.
+  static const int HISTORY = 32;
+
+  // What is known of a field of a station.
+  struct Known {
+    Clock::time_point seen;  // Last confirmed; epoch if never.
+    // The latest times it was seen again, on the first sighting of each
+    // visit: the seconds since it was seen before and whether it had
+    // changed by then.
+    float intervals[HISTORY];
+    bool changes[HISTORY];
+    int samples;  // Up to HISTORY.
+    int next;     // Where the next one goes.
+    double rate;  // Changes per second; negative until estimated.
+    // Time from the tune to seeing it, averaged.
+    double latency;
+    // When a visit last waited for it in vain.
+    Clock::time_point missed;
+  };
+
+  struct Station {
+    Si4703_WatchReport report;
+    Known known[Si4703_WatchReport::FIELDS];
+  };
+
+  void onGroup(const RdsGroup& group);
+  void refresh(Station* station, Field field, bool changed,
+               Clock::time_point now);
+  void estimateRate(Known* known) const;
+  double changeRate(const Known& known) const;
+  double staleness(const Known& known, Clock::time_point now) const;
+  double lasting(const Known& known, double horizon) const;
+  uint8_t staleFields(const Station& station, Clock::time_point now) const;
+  int pick(Clock::time_point now) const;
+  void run();
+
+  Si4703_Breakout* radio_;
+  Config config_;
+  int listener_id_;
+  std::thread thread_;
+
+  std::mutex mutex_;  // Protects everything below.
+  std::condition_variable cv_;
+  bool stop_;
+  std::vector<Station> stations_;
+  int current_;  // Station tuned to, -1 before the first tune.
+  // Groups read before this time may come from the previous station.
+  Clock::time_point tuned_at_;
+  uint8_t refreshed_;  // Bits of the fields seen since the tune.
+  Clock::time_point next_tune_at_;
+  double tune_seconds_;  // Time a tune takes, averaged.
+  Clock::time_point last_tune_at_;
+  double cycle_seconds_;  // Time from one tune to the next, averaged.
+  si4703::RdsDecoder decoder_;
+  Stats stats_;
+};
+
+#endif
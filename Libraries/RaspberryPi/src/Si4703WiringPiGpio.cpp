@@ -0,0 +1,29 @@
+#include <wiringPi.h>
+
+#include "Si4703WiringPiGpio.h"
+
+Si4703_WiringPiGpio::Si4703_WiringPiGpio(int reset_pin, int sdio_pin)
+    : reset_pin_(reset_pin), sdio_pin_(sdio_pin), setup_(false) {}
+
+Status Si4703_WiringPiGpio::open() {
+  if (setup_)
+    return Status::SUCCESS;
+  if (wiringPiSetupGpio() < 0)  // Setup gpio access in BCM mode.
+    return Status::FAIL;
+  setup_ = true;
+  return Status::SUCCESS;
+}
+
+Status Si4703_WiringPiGpio::reset() {
+  pinMode(reset_pin_, OUTPUT);  // gpio bit-banging to get 2-wire (I2C) mode.
+  pinMode(sdio_pin_, OUTPUT);   // SDIO is connected to A4 for I2C.
+
+  digitalWrite(sdio_pin_, LOW);    // A low SDIO indicates a 2-wire interface.
+  digitalWrite(reset_pin_, LOW);   // Put Si4703 into reset.
+  delay(1);                        // Some delays while we allow pins to settle.
+  digitalWrite(reset_pin_, HIGH);  // Bring Si4703 out of reset with SDIO set
+                                   // to low and SEN pulled high with on-board
+                                   // resistor.
+  delay(1);                        // Allow Si4703 to come out of reset.
+  return Status::SUCCESS;
+}
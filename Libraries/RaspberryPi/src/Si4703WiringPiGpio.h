@@ -0,0 +1,28 @@
+//
+// The reset lines through wiringPi, for setups that already use it. Only
+// built with `make WIRINGPI=1`, which also links -lwiringPi; everything
+// else resets through Si4703_GpioChip and needs no more than the kernel
+// headers.
+//
+
+#ifndef Si4703WiringPiGpio_h
+#define Si4703WiringPiGpio_h
+
+#include "Si4703Gpio.h"
+
+// wiringPi, with pins in BCM numbering. Needs root, or /dev/gpiomem access,
+// and each step of the pulse waits a millisecond.
+class Si4703_WiringPiGpio : public Si4703_Gpio {
+ public:
+  Si4703_WiringPiGpio(int reset_pin, int sdio_pin);
+
+  Status open() override;
+  Status reset() override;
+
+ private:
+  int reset_pin_;
+  int sdio_pin_;
+  bool setup_;  // wiringPiSetupGpio() has been called.
+};
+
+#endif
@@ -4,49 +4,74 @@
 // Modified work Copyright 13.09.2013 Christoph Thoma
 //
 
+#include <algorithm>
 #include <cmath>
-#include <iomanip>
 #include <iostream>
 #include <memory>
-#include <sstream>
 #include <string>
 #include <thread>
 
-#include <fcntl.h>
-#include <linux/i2c-dev.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
 #include <string.h>
-#include <sys/ioctl.h>
-#include <unistd.h>
-#include <wiringPi.h>
+#include <sys/mman.h>
+#include <time.h>
 
 #include "SparkFunSi4703.h"
 
 using std::cerr;
 using std::cout;
-using std::dec;
 using std::endl;
-using std::hex;
-using std::setfill;
-using std::setw;
+
+using namespace si4703;
 
 namespace {
 
 // Max powerup time, from datasheet page 13.
-uint16_t MAX_POWERUP_TIME = 110;
+const std::chrono::milliseconds MAX_POWERUP_TIME(110);
 
 // Delay for clock to settle - from AN230 page 9.
-uint16_t CLOCK_SETTLE_DELAY = 500;
+const std::chrono::milliseconds CLOCK_SETTLE_DELAY(500);
 
-uint16_t SwapEndian(uint16_t val) {
-  return (val >> 8) | (val << 8);
-}
+// Time from setting TUNE to STC, from the datasheet.
+const std::chrono::milliseconds TUNE_TIME(60);
+
+// Time between two reads while polling for STC.
+const std::chrono::milliseconds POLL_INTERVAL(2);
+
+// Longest wait for STC. A tune takes 60 ms; a seek across the whole band
+// with 50 kHz spacing can take about 12 s.
+const std::chrono::milliseconds TUNE_TIMEOUT(500);
+const std::chrono::milliseconds SEEK_TIMEOUT(15000);
+
+// The RDS thread polls for RDSR this often, and once it has read a group
+// waits this long for RDSR to clear.
+const std::chrono::milliseconds RDS_POLL_INTERVAL(30);
+const std::chrono::milliseconds RDS_CLEAR_WAIT(40);
 
-uint16_t ToLittleEndian(uint16_t val) {
-  return SwapEndian(val);
+// A group is 104 bits at 1187.5 bit/s. A longer gap between two groups on
+// one channel means some were missed, unless it is so long that the signal
+// must have gone.
+const std::chrono::microseconds RDS_GROUP_TIME(87579);
+const std::chrono::seconds RDS_SIGNAL_LOST(2);
+
+// Upper bounds of the Si4703_RdsThreadStats lateness buckets but the last.
+const int LATENESS_BOUNDS[Si4703_RdsThreadStats::BUCKETS - 1] = {
+    10, 20, 50, 100, 200, 500, 1000, 2000, 5000};  // us.
+
+// Add |wait| to |time|.
+void AddTime(timespec* time, std::chrono::nanoseconds wait) {
+  const int64_t nsec = time->tv_nsec + wait.count();
+  time->tv_sec += nsec / 1000000000;
+  time->tv_nsec = nsec % 1000000000;
 }
 
-uint16_t ToBigEndian(uint16_t val) {
-  return SwapEndian(val);
+// |a| - |b|.
+std::chrono::nanoseconds Difference(const timespec& a, const timespec& b) {
+  return std::chrono::seconds(a.tv_sec - b.tv_sec) +
+         std::chrono::nanoseconds(a.tv_nsec - b.tv_nsec);
 }
 
 // Determine if two float values are "equal enough" - i.e. to within some small
@@ -56,31 +81,67 @@ bool FloatsEqual(float a, float b) {
   return std::abs(a - b) < epsilon;
 }
 
-char ToYesNo(uint16_t val) {
-  return val ? 'Y' : 'N';
+// |name| or, if that is nullptr, "<Unknown: 0x|value|>".
+std::string NameOrUnknown(const char* name, unsigned value) {
+  if (name)
+    return name;
+  char unknown[24];
+  snprintf(unknown, sizeof(unknown), "<Unknown: 0x%x>", value);
+  return unknown;
 }
 
 }  // anonymous namespace
 
 Si4703_Breakout::Si4703_Breakout(int resetPin, int sdioPin, Region region)
-    : resetPin_(resetPin),
-      sdioPin_(sdioPin),
+    : Si4703_Breakout(std::unique_ptr<Si4703_Bus>(new Si4703_LinuxI2CBus),
+                      resetPin,
+                      sdioPin,
+                      region) {}
+
+Si4703_Breakout::Si4703_Breakout(std::unique_ptr<Si4703_Bus> bus,
+                                 int resetPin,
+                                 int sdioPin,
+                                 Region region)
+    : Si4703_Breakout(std::move(bus),
+                      std::unique_ptr<Si4703_Gpio>(
+                          resetPin < 0
+                              ? nullptr
+                              : new Si4703_GpioChip(resetPin, sdioPin)),
+                      region) {}
+
+Si4703_Breakout::Si4703_Breakout(std::unique_ptr<Si4703_Bus> bus,
+                                 std::unique_ptr<Si4703_Gpio> gpio,
+                                 Region region)
+    : bus_(std::move(bus)),
+      gpio_(std::move(gpio)),
+      powered_(false),
+      dirty_(0),
+      retry_stats_{0, 0, 0, 0, 0},
+      failed_in_a_row_(0),
+      recovering_(false),
+      jitter_(std::chrono::steady_clock::now().time_since_epoch().count() |
+              1),
       region_(region),
+      rds_tunes_(0),
+      next_rds_listener_id_(0),
+      next_register_listener_id_(0),
+      rds_thread_stats_(),
       run_rds_thread_(false) {
+  memset(shadow_reg_, 0, sizeof(shadow_reg_));
   clearRDSBuffer();
   switch (region) {
     case Region::US:
-      band_ = Band_US_Europe;
-      channel_spacing_ = Spacing_200kHz;
+      band_ = BAND_US_EUROPE;
+      channel_spacing_ = SPACING_200KHZ;
       break;
     case Region::Europe:
-      band_ = Band_US_Europe;
-      channel_spacing_ = Spacing_100kHz;
+      band_ = BAND_US_EUROPE;
+      channel_spacing_ = SPACING_100KHZ;
       break;
     case Region::Japan:
-      band_ = Band_Japan_Wide;
+      band_ = BAND_JAPAN_WIDE;
       // TODO: verify spacing.
-      channel_spacing_ = Spacing_100kHz;
+      channel_spacing_ = SPACING_100KHZ;
       break;
   }
 }
@@ -93,60 +154,51 @@ Si4703_Breakout::~Si4703_Breakout() {
 // be low after a reset. The breakout board has SEN pulled high, but also has
 // SDIO pulled high. Therefore, after a normal power up the Si4703 will be in an
 // unknown state. RST must be controlled
-Status Si4703_Breakout::powerOn() {
-  wiringPiSetupGpio();  // Setup gpio access in BCM mode.
-
-  pinMode(resetPin_, OUTPUT);  // gpio bit-banging to get 2-wire (I2C) mode.
-  pinMode(sdioPin_, OUTPUT);   // SDIO is connected to A4 for I2C.
+Status Si4703_Breakout::resetChip() {
+  if (!gpio_)
+    return Status::SUCCESS;
+  return gpio_->reset();
+}
 
-  digitalWrite(sdioPin_, LOW);    // A low SDIO indicates a 2-wire interface.
-  digitalWrite(resetPin_, LOW);   // Put Si4703 into reset.
-  delay(1);                       // Some delays while we allow pins to settle.
-  digitalWrite(resetPin_, HIGH);  // Bring Si4703 out of reset with SDIO set to
-                                  // low and SEN pulled high with on-board
-                                  // resistor.
-  delay(1);                       // Allow Si4703 to come out of reset.
+Status Si4703_Breakout::powerOn() {
+  // The lines are requested by the first power on, and kept.
+  Status s = gpio_ ? gpio_->open() : Status::SUCCESS;
+  if (s == Status::SUCCESS)
+    s = resetChip();
+  if (s != Status::SUCCESS)
+    return s;
 
   // Setup I2C
-  const char filename[] = "/dev/i2c-1";
-  if ((si4703_fd_ = open(filename, O_RDWR)) < 0) {  // Open I2C slave device.
-    perror(filename);
-    return Status::FAIL;
-  }
-
-  if (ioctl(si4703_fd_, I2C_SLAVE, SI4703) < 0) {  // Set device address 0x10.
-    perror("Failed to acquire bus access and/or talk to slave");
-    return Status::FAIL;
-  }
-
-  if (ioctl(si4703_fd_, I2C_PEC, 1) < 0) {  // Enable "Packet Error Checking".
-    perror("Failed to enable PEC");
-    return Status::FAIL;
-  }
-
-  Status s = readRegisters();
+  s = bus_->open();
   if (s != Status::SUCCESS)
     return s;
 
-  // Enable the oscillator, from AN230 page 9, rev 0.61 (works).
-  shadow_reg_[0x07] = 0x8100;
-  updateRegisters();
+  {
+    std::lock_guard<std::mutex> lock(reg_owner_mutex_);
+    s = readRegistersLocked();
+    if (s != Status::SUCCESS)
+      return s;
 
-  delay(CLOCK_SETTLE_DELAY);
+    // Enable the oscillator, from AN230 page 9, rev 0.61 (works).
+    setRegister(shadow_reg_, TEST1, 0x8100, &dirty_);
+    updateRegisters();
 
-  readRegisters();                 // Read the current register set.
-  shadow_reg_[POWERCFG] = 0x4001;  // Enable the IC.
+    std::this_thread::sleep_for(CLOCK_SETTLE_DELAY);
 
-  shadow_reg_[SYSCONFIG1] |= RDS;  // Enable RDS.
-  if (region_ == Region::Europe)
-    shadow_reg_[SYSCONFIG1] |= DE;
-  shadow_reg_[SYSCONFIG2] |= band_;
-  shadow_reg_[SYSCONFIG2] |= channel_spacing_;
-  shadow_reg_[SYSCONFIG2] &= 0xFFF0;  // Clear volume bits.
-  shadow_reg_[SYSCONFIG2] |= 0x0001;  // Set volume to lowest.
-  updateRegisters();
+    readRegistersLocked();  // Read the current register set.
+    setRegister(shadow_reg_, POWERCFG, 0x4001, &dirty_);  // Enable the IC.
 
-  delay(MAX_POWERUP_TIME);
+    set<RDS>(shadow_reg_, 1, &dirty_);  // Enable RDS.
+    if (region_ == Region::Europe)
+      set<DE>(shadow_reg_, 1, &dirty_);
+    set<BAND>(shadow_reg_, band_, &dirty_);
+    set<SPACE>(shadow_reg_, channel_spacing_, &dirty_);
+    set<VOLUME>(shadow_reg_, 1, &dirty_);  // Set volume to lowest.
+    updateRegisters();
+
+    std::this_thread::sleep_for(MAX_POWERUP_TIME);
+  }
+  powered_ = true;
 
   // Start the RDS reading thread.
   run_rds_thread_ = true;
@@ -156,110 +208,432 @@ Status Si4703_Breakout::powerOn() {
 }
 
 void Si4703_Breakout::powerOff() {
+  if (!powered_)
+    return;
   stopRDSThread();
-  readRegisters();
-  shadow_reg_[POWERCFG] = 0x0000;  // Clear Enable Bit disables chip.
+  std::lock_guard<std::mutex> lock(reg_owner_mutex_);
+  powered_ = false;  // No recovery for the last write.
+  // Clear Enable Bit disables chip.
+  setRegister(shadow_reg_, POWERCFG, 0x0000, &dirty_);
   updateRegisters();
 }
 
-void Si4703_Breakout::setFrequency(float frequency) {
+// Is |frequency| a multiple of the channel spacing offset from the minimum
+// frequency? If so return its CHANNEL value in |channel|.
+bool Si4703_Breakout::validChannel(float frequency, uint16_t* channel) const {
   // See frequencyToChannel for source of equation.
   float fchannel = (frequency - minFrequency()) / channelSpacing();
-  uint16_t channel = frequencyToChannel(frequency);
-  if (!FloatsEqual(fchannel, channel)) {
-    // The freq must be a multiple of the channel spacing and offset from the
-    // minimum freq.
+  *channel = frequencyToChannel(frequency);
+  if (!FloatsEqual(fchannel, *channel)) {
     cerr << "Frequency (" << frequency << " MHz) is not a valid frequency."
          << endl;
-    return;
+    return false;
   }
-  clearRDSBuffer();
-  readRegisters();
-  shadow_reg_[CHANNEL] &= 0xFE00;   // Clear out the channel bits.
-  shadow_reg_[CHANNEL] |= channel;  // Mask in the new channel.
-  shadow_reg_[CHANNEL] |= TUNE;     // Set the TUNE bit to start.
-  updateRegisters();
+  return true;
+}
+
+void Si4703_Breakout::setFrequency(float frequency) {
+  Si4703_Changes changes;
+  changes.frequency = frequency;
+  apply(changes);
+}
 
-  delay(60);  // Wait 60ms - you can use or skip this delay.
+Status Si4703_Breakout::apply(const Si4703_Changes& changes,
+                              const std::function<bool()>& abandon) {
+  const bool tune = changes.frequency > 0;
+  uint16_t channel = 0;
+  if (tune && !validChannel(changes.frequency, &channel))
+    return Status::FAIL;
+  std::unique_lock<std::mutex> lock(tune_mutex_, std::defer_lock);
+  if (tune) {
+    lock.lock();
+    clearRDSBuffer();
+  }
+  std::lock_guard<std::mutex> owner(reg_owner_mutex_);
+  if (changes.volume >= 0)
+    set<VOLUME>(shadow_reg_, std::min(changes.volume, 15), &dirty_);
+  if (changes.mute >= 0)
+    // DMUTE set disables the mute.
+    set<DMUTE>(shadow_reg_, !changes.mute, &dirty_);
+  if (tune) {
+    set<CHAN>(shadow_reg_, channel, &dirty_);  // Mask in the new channel.
+    set<TUNE>(shadow_reg_, 1, &dirty_);        // Set the TUNE bit to start.
+  }
+  if (updateRegisters() != Status::SUCCESS)
+    return Status::FAIL;
+  if (!tune)
+    return Status::SUCCESS;
 
-  // Poll to see if STC is set.
+  // The tune takes about 60 ms: sleep through that, then poll STC.
+  const auto poll_from = std::chrono::steady_clock::now() + TUNE_TIME;
+  const auto give_up = poll_from + TUNE_TIMEOUT;
+  bool abandoned = false;
   while (true) {
-    readRegisters();
-    if ((shadow_reg_[STATUSRSSI] & STC) != 0)
-      break;  // Tuning complete!
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= poll_from) {
+      if (readRegistersLocked() == Status::SUCCESS && get<STC>(shadow_reg_))
+        break;
+      if (now > give_up) {
+        abandoned = true;  // Leave TUNE clear, not stuck on.
+        break;
+      }
+    }
+    if (abandon && abandon()) {
+      abandoned = true;
+      break;
+    }
+    std::this_thread::sleep_for(now < poll_from ? std::chrono::milliseconds(5)
+                                                : POLL_INTERVAL);
   }
 
-  readRegisters();
-  shadow_reg_[CHANNEL] &= ~TUNE;  // Clear the tune after a tune has completed.
-  updateRegisters();
+  // Clear the tune after a tune has completed, or to make the next tune
+  // start over.
+  set<TUNE>(shadow_reg_, 0, &dirty_);
+  if (abandoned) {
+    updateRegisters();
+    return Status::FAIL;
+  }
 
   // Wait for the si4703 to clear the STC as well.
+  return waitForSTC(false, TUNE_TIMEOUT);
+}
+
+// Tune to |channel| without touching the mute or RDS state. The caller holds
+// tune_mutex_ and reg_owner_mutex_, and the control registers in shadow_reg_
+// are current.
+Status Si4703_Breakout::tuneChannel(uint16_t channel) {
+  set<CHAN>(shadow_reg_, channel, &dirty_);
+  set<TUNE>(shadow_reg_, 1, &dirty_);
+  if (updateRegisters() != Status::SUCCESS)
+    return Status::FAIL;
+  Status s = waitForSTC(true, TUNE_TIMEOUT);
+  set<TUNE>(shadow_reg_, 0, &dirty_);
+  if (waitForSTC(false, TUNE_TIMEOUT) != Status::SUCCESS)
+    return Status::FAIL;
+  return s;
+}
+
+// Poll until the STC bit is |set|, for at most |timeout|. STC rises a tune
+// time or more after TUNE or SEEK is set, so a wait for it sleeps through
+// that first. It falls as soon as they are cleared: the write clearing them
+// goes out with the first poll, in one transaction, and that poll usually
+// ends the wait. The caller holds reg_owner_mutex_.
+Status Si4703_Breakout::waitForSTC(bool set,
+                                   std::chrono::milliseconds timeout) {
+  const auto give_up = std::chrono::steady_clock::now() + timeout;
+  if (set)
+    std::this_thread::sleep_for(TUNE_TIME);
   while (true) {
-    readRegisters();
-    if ((shadow_reg_[STATUSRSSI] & STC) == 0)
-      break;  // Tuning complete!
+    if (syncRegisters() == Status::SUCCESS && get<STC>(shadow_reg_) == set)
+      return Status::SUCCESS;
+    if (std::chrono::steady_clock::now() > give_up)
+      return Status::FAIL;
+    std::this_thread::sleep_for(POLL_INTERVAL);
   }
 }
 
 void Si4703_Breakout::setVolume(int volume) {
-  readRegisters();
+  std::lock_guard<std::mutex> lock(reg_owner_mutex_);
   if (volume < 0)
     volume = 0;
   if (volume > 15)
     volume = 15;
-  shadow_reg_[SYSCONFIG2] &= 0xFFF0;  // Clear volume bits.
-  shadow_reg_[SYSCONFIG2] |= volume;  // Set new volume.
+  set<VOLUME>(shadow_reg_, volume, &dirty_);  // Set new volume.
+  updateRegisters();
+}
+
+void Si4703_Breakout::setSeekThresholds(
+    const Si4703_SeekThresholds& thresholds) {
+  std::lock_guard<std::mutex> lock(reg_owner_mutex_);
+  set<SEEKTH>(shadow_reg_, std::min<uint8_t>(thresholds.rssi, 127),
+              &dirty_);
+  set<SKSNR>(shadow_reg_, std::min<uint8_t>(thresholds.snr, 15), &dirty_);
+  set<SKCNT>(shadow_reg_, std::min<uint8_t>(thresholds.impulses, 15),
+             &dirty_);
   updateRegisters();
 }
 
+Si4703_SeekThresholds Si4703_Breakout::seekThresholds() const {
+  uint16_t regs[NUM_REGISTERS];
+  snapshot_.read(regs);
+  return Si4703_SeekThresholds{static_cast<uint8_t>(get<SEEKTH>(regs)),
+                               static_cast<uint8_t>(get<SKSNR>(regs)),
+                               static_cast<uint8_t>(get<SKCNT>(regs))};
+}
+
+int Si4703_Breakout::getVolume() const {
+  return snapshot_.get(VOLUME);
+}
+
+void Si4703_Breakout::setMute(bool mute) {
+  std::lock_guard<std::mutex> lock(reg_owner_mutex_);
+  set<DMUTE>(shadow_reg_, !mute, &dirty_);  // DMUTE set disables the mute.
+  updateRegisters();
+}
+
+int Si4703_Breakout::probeRSSI(float frequency) {
+  uint16_t channel;
+  if (!validChannel(frequency, &channel))
+    return -1;
+  std::lock_guard<std::mutex> lock(tune_mutex_);
+  std::lock_guard<std::mutex> owner(reg_owner_mutex_);
+  // READ_CHAN only changes when we tune, and every tune ends with a read.
+  const uint16_t home = get<READ_CHAN>(shadow_reg_);
+  const uint16_t dmute = get<DMUTE>(shadow_reg_);
+
+  // The mute goes out in the same write as the first TUNE and is lifted in
+  // the same write that clears the last one, so the gap is just two tunes.
+  set<DMUTE>(shadow_reg_, 0, &dirty_);
+  Status s = tuneChannel(channel);
+  const int rssi = get<RSSI>(shadow_reg_);
+
+  set<CHAN>(shadow_reg_, home, &dirty_);
+  set<TUNE>(shadow_reg_, 1, &dirty_);
+  if (updateRegisters() != Status::SUCCESS ||
+      waitForSTC(true, TUNE_TIMEOUT) != Status::SUCCESS)
+    s = Status::FAIL;
+  set<TUNE>(shadow_reg_, 0, &dirty_);
+  set<DMUTE>(shadow_reg_, dmute, &dirty_);
+  if (waitForSTC(false, TUNE_TIMEOUT) != Status::SUCCESS)
+    s = Status::FAIL;
+  return s == Status::SUCCESS ? rssi : -1;
+}
+
 void Si4703_Breakout::getRDS(char* buffer) {
   std::lock_guard<std::mutex> lock(rds_data_mutex_);
   strcpy(buffer, rds_chars_);
 }
 
+int Si4703_Breakout::addRdsGroupListener(RdsGroupListener listener) {
+  std::lock_guard<std::mutex> lock(rds_listener_mutex_);
+  rds_listeners_[next_rds_listener_id_] = listener;
+  return next_rds_listener_id_++;
+}
+
+void Si4703_Breakout::removeRdsGroupListener(int id) {
+  std::lock_guard<std::mutex> lock(rds_listener_mutex_);
+  rds_listeners_.erase(id);
+}
+
+int Si4703_Breakout::addRegisterListener(RegisterListener listener) {
+  std::lock_guard<std::mutex> lock(register_listener_mutex_);
+  register_listeners_[next_register_listener_id_] = listener;
+  return next_register_listener_id_++;
+}
+
+void Si4703_Breakout::removeRegisterListener(int id) {
+  std::lock_guard<std::mutex> lock(register_listener_mutex_);
+  register_listeners_.erase(id);
+}
+
+// The caller holds reg_owner_mutex_.
+void Si4703_Breakout::notifyRegisterListeners(uint32_t version) {
+  std::lock_guard<std::mutex> lock(register_listener_mutex_);
+  for (auto& listener : register_listeners_)
+    listener.second(shadow_reg_, version);
+}
+
+uint16_t Si4703_Breakout::programId() {
+  std::lock_guard<std::mutex> lock(rds_data_mutex_);
+  return rds_decoder_.pi;
+}
+
+std::string Si4703_Breakout::stationName() {
+  std::lock_guard<std::mutex> lock(rds_data_mutex_);
+  return rds_station_name_;
+}
+
 // This is the thread function that reads the RDS data and writes it to an
 // instance character buffer.
 void Si4703_Breakout::rdsReadFunc() {
+  const Si4703_RdsThreadPolicy policy = applyRdsThreadPolicy();
+  timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  std::chrono::steady_clock::time_point last_group;
+  uint32_t last_tunes = 0;
   while (run_rds_thread_) {
-    readRegisters();
-    if (!(shadow_reg_[STATUSRSSI] & RDSR)) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(30));
-      continue;
-    }
-
-    // lowest order two bits of B are the word pair index.
-    uint16_t b = shadow_reg_[RDSB];
-    int index = b & 0b11;
-
-    auto now = std::chrono::system_clock::now();
-    if (b < 500) {
-      char Dh = (shadow_reg_[RDSD] & 0xFF00) >> 8;
-      char Dl = (shadow_reg_[RDSD] & 0x00FF);
-      {
+    RdsGroup group;
+    bool ready = false;
+    uint8_t events = 0;
+    uint64_t missed = 0;
+    {
+      std::lock_guard<std::mutex> tune_lock(tune_mutex_);
+      std::lock_guard<std::mutex> owner(reg_owner_mutex_);
+      // Never decode what is left in RDSA-RDSD from an earlier read.
+      ready = readRegistersLocked() == Status::SUCCESS &&
+              get<RDSR>(shadow_reg_);
+      if (ready) {
+        auto now = std::chrono::system_clock::now();
         std::lock_guard<std::mutex> lock(rds_data_mutex_);
-        rds_chars_[index * 2] = Dh;
-        rds_chars_[index * 2 + 1] = Dl;
-        rds_last_valid_[index] = now;
+        events = rds_decoder_.decode(shadow_reg_);
+        if (events & RdsDecoder::PI_CHANGED)
+          rds_station_name_.clear();
+        if (events & RdsDecoder::PS_COMPLETE)
+          rds_station_name_ = rds_decoder_.ps;
+        if (events & RdsDecoder::PS_SEGMENT) {
+          // lowest order two bits of B are the word pair index.
+          int index = shadow_reg_[RDSB] & 0b11;
+          rds_chars_[index * 2] = rds_decoder_.ps[index * 2];
+          rds_chars_[index * 2 + 1] = rds_decoder_.ps[index * 2 + 1];
+          rds_last_valid_[index] = now;
+        }
+        // If we haven't received RDS data for a character tuple in 500msec
+        // then clear that tuple.
+        for (int index = 0; index < 4; index++) {
+          if (now - rds_last_valid_[index] > std::chrono::milliseconds(500))
+            rds_chars_[index * 2] = rds_chars_[index * 2 + 1] = ' ';
+        }
+        std::copy(shadow_reg_ + RDSA, shadow_reg_ + RDSD + 1, group.blocks);
+        group.received = std::chrono::steady_clock::now();
+        // Groups come every RDS_GROUP_TIME; count the ones that came and
+        // went between two polls. A tune in between starts over.
+        const auto gap = group.received - last_group;
+        if (last_tunes == rds_tunes_ && gap < RDS_SIGNAL_LOST) {
+          missed = (gap + RDS_GROUP_TIME / 2) / RDS_GROUP_TIME;
+          missed = missed ? missed - 1 : 0;
+        }
+        last_group = group.received;
+        last_tunes = rds_tunes_;
       }
-    } else {
-      // If we haven't received RDS data for this character tuple in 500msec
-      // then clear that tuple.
-      if (now - rds_last_valid_[index] > std::chrono::milliseconds(500)) {
-        rds_chars_[index * 2] = rds_chars_[index * 2 + 1] = ' ';
+    }
+    {
+      std::lock_guard<std::mutex> lock(rds_thread_mutex_);
+      rds_thread_stats_.polls++;
+      if (ready) {
+        rds_thread_stats_.groups++;
+        rds_thread_stats_.missed_groups += missed;
       }
     }
 
+    if (!ready) {
+      rdsSleep(RDS_POLL_INTERVAL, policy.absolute_deadlines, &deadline);
+      continue;
+    }
+
+    // The decoder drops groups with uncorrectable errors.
+    if (events) {
+      std::lock_guard<std::mutex> lock(rds_listener_mutex_);
+      for (auto& listener : rds_listeners_)
+        listener.second(group);
+    }
+
     // Notify any listener that we have RDS data.
     rds_cv_.notify_all();
 
     // Wait for the RDS bit to clear.
-    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    rdsSleep(RDS_CLEAR_WAIT, policy.absolute_deadlines, &deadline);
+  }
+}
+
+// Set up the calling thread, the RDS thread, as the policy says, and start
+// its stats over. Returns the policy.
+Si4703_RdsThreadPolicy Si4703_Breakout::applyRdsThreadPolicy() {
+  std::lock_guard<std::mutex> lock(rds_thread_mutex_);
+  const Si4703_RdsThreadPolicy policy = rds_thread_policy_;
+  rds_thread_stats_ = Si4703_RdsThreadStats();
+  auto report = [](const char* what, int error) {
+    cerr << "RDS thread: could not " << what << " (" << strerror(error)
+         << "), going on without" << endl;
+  };
+  if (policy.lock_memory) {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0)
+      rds_thread_stats_.memory_locked = true;
+    else
+      report("lock memory", errno);
+  }
+  if (policy.cpu >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(policy.cpu, &cpus);
+    const int error =
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (!error)
+      rds_thread_stats_.pinned = true;
+    else
+      report("pin to the CPU", error);
+  }
+  if (policy.priority > 0) {
+    sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = policy.priority;
+    const int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (!error)
+      rds_thread_stats_.realtime = true;
+    else
+      report("run with SCHED_FIFO", error);
+  }
+  return policy;
+}
+
+// Sleep |wait| past |deadline| if |absolute|, otherwise past now, leaving
+// the time slept until in |deadline|. A deadline the thread is already past
+// is an overrun, and the next one counts from now. Records how late the
+// thread woke. Runs on the RDS thread.
+void Si4703_Breakout::rdsSleep(std::chrono::milliseconds wait,
+                               bool absolute,
+                               timespec* deadline) {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (!absolute)
+    *deadline = now;
+  AddTime(deadline, wait);
+  bool overrun = false;
+  if (Difference(*deadline, now).count() < 0) {
+    overrun = true;
+    *deadline = now;
+  }
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, nullptr) ==
+         EINTR) {
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  const auto late =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          Difference(now, *deadline));
+
+  std::lock_guard<std::mutex> lock(rds_thread_mutex_);
+  Si4703_RdsThreadStats& stats = rds_thread_stats_;
+  if (overrun)
+    stats.overruns++;
+  stats.total_lateness += late;
+  stats.max_lateness = std::max(stats.max_lateness, late);
+  int bucket = 0;
+  while (bucket < Si4703_RdsThreadStats::BUCKETS - 1 &&
+         late.count() >= LATENESS_BOUNDS[bucket])
+    bucket++;
+  stats.lateness[bucket]++;
+}
+
+void Si4703_Breakout::setRdsThreadPolicy(
+    const Si4703_RdsThreadPolicy& policy) {
+  std::lock_guard<std::mutex> lock(rds_thread_mutex_);
+  rds_thread_policy_ = policy;
+}
+
+Si4703_RdsThreadStats Si4703_Breakout::rdsThreadStats() {
+  std::lock_guard<std::mutex> lock(rds_thread_mutex_);
+  return rds_thread_stats_;
+}
+
+std::chrono::microseconds Si4703_RdsThreadStats::percentile(
+    double fraction) const {
+  uint64_t wakeups = 0;
+  for (int i = 0; i < BUCKETS; i++)
+    wakeups += lateness[i];
+  uint64_t below = 0;
+  for (int i = 0; i < BUCKETS - 1; i++) {
+    below += lateness[i];
+    if (below >= fraction * wakeups)
+      return std::chrono::microseconds(LATENESS_BOUNDS[i]);
   }
+  return max_lateness;
 }
 
 void Si4703_Breakout::clearRDSBuffer() {
   std::lock_guard<std::mutex> lock(rds_data_mutex_);
   strcpy(rds_chars_, "        ");
+  rds_tunes_++;
+  rds_decoder_.reset();
+  rds_station_name_.clear();
   for (int i = 0; i < 4; i++)
     rds_last_valid_[i] =
         std::chrono::time_point<std::chrono::system_clock>::min();
@@ -275,283 +649,294 @@ void Si4703_Breakout::stopRDSThread() {
   clearRDSBuffer();
 }
 
-// Read the entire register control set from 0x00 to 0x0F.
 Status Si4703_Breakout::readRegisters() {
-  uint16_t buffer[16];
+  std::lock_guard<std::mutex> lock(reg_owner_mutex_);
+  return readRegistersLocked();
+}
+
+Status Si4703_Breakout::refresh(std::chrono::milliseconds max_age) {
+  if (snapshot_.fresh(max_age))
+    return Status::SUCCESS;
+  std::lock_guard<std::mutex> lock(reg_owner_mutex_);
+  // Another caller may have read the chip while we waited for the lock.
+  if (snapshot_.fresh(max_age))
+    return Status::SUCCESS;
+  return readRegistersLocked();
+}
+
+// Read the entire register control set from 0x00 to 0x0F. The caller holds
+// reg_owner_mutex_.
+Status Si4703_Breakout::readRegistersLocked() {
+  uint8_t buffer[READ_LENGTH];
 
   // Si4703 begins reading from upper byte of register 0x0A and reads to 0x0F,
   // then loops to 0x00.
   // We want to read the entire register set from 0x0A to 0x09 = 32 bytes.
-  if (read(si4703_fd_, buffer, 32) != 32) {
-    perror("Could not read from I2C slave device");
+  if (retry(false, [&] { return bus_->read(buffer, READ_LENGTH); }) !=
+      Status::SUCCESS)
     return Status::FAIL;
-  }
 
-  // We may want some time-out error here.
-
-  // Remember, register 0x0A comes in first so we have to shuffle the array
-  // around a bit.
-  std::lock_guard<std::mutex> lock(shadow_reg_mutex_);
-
-  int i = 0;
-  for (int x = 0x0A;; x++) {
-    if (x == 0x10)
-      x = 0;  // Loop back to zero.
-    shadow_reg_[x] = ToLittleEndian(buffer[i++]);
-    if (x == 0x09)
-      break;  // We're done!
-  }
+  const auto read_at = std::chrono::steady_clock::now();
+  decodeRead(buffer, READ_LENGTH, shadow_reg_);
+  notifyRegisterListeners(snapshot_.publish(shadow_reg_, read_at));
 
   return Status::SUCCESS;
 }
 
-// Write the current 9 control registers (0x02 to 0x07) to the Si4703.
+// Write the changed control registers (0x02 to 0x07) to the Si4703.
 // It's a little weird, you don't write an I2C address.
-// The Si4703 assumes you are writing to 0x02 first, then increments.
+// The Si4703 assumes you are writing to 0x02 first, then increments, so the
+// write runs from 0x02 up to the highest register in dirty_. Setting TUNE
+// is 4 bytes instead of 12, and a write that changes nothing is skipped.
+// The host is the only writer of these registers, so shadow_reg_ always holds
+// their current value and callers modify them without reading them first.
+// The caller holds reg_owner_mutex_.
 Status Si4703_Breakout::updateRegisters() {
-  int i = 0;
-  uint16_t buffer[6];
-
-  {
-    std::lock_guard<std::mutex> lock(shadow_reg_mutex_);
-
-    // A write command automatically begins with register 0x02 so no need to
-    // send a write-to address. First we send the 0x02 to 0x07 control
-    // registers, first upper byte, then lower byte and so on. In general, we
-    // should not write to registers 0x08 and 0x09.
-    for (int regSpot = 0x02; regSpot < 0x08; regSpot++)
-      buffer[i++] = ToBigEndian(shadow_reg_[regSpot]);
+  const uint8_t count = writeCount(dirty_);
+  if (!count)
+    return Status::SUCCESS;
+  uint8_t buffer[WRITE_LENGTH];
+  encodeWrite(shadow_reg_, buffer, count);
+
+  Status s = retry(true, [&] { return bus_->write(buffer, 2 * count); });
+  if (s == Status::SUCCESS) {
+    dirty_ = 0;
+    notifyRegisterListeners(snapshot_.publish(shadow_reg_));
   }
+  return s;
+}
+
+// Write the changed control registers and read the whole register file
+// back in one combined bus transfer: one kernel round trip where
+// updateRegisters() and readRegistersLocked() take two. Just a read if
+// nothing changed. The caller holds reg_owner_mutex_.
+Status Si4703_Breakout::syncRegisters() {
+  const uint8_t count = writeCount(dirty_);
+  if (!count)
+    return readRegistersLocked();
+  uint8_t write[WRITE_LENGTH];
+  uint8_t read[READ_LENGTH];
+  encodeWrite(shadow_reg_, write, count);
+  const Si4703_BusMessage messages[] = {{false, write, 2 * count},
+                                        {true, read, READ_LENGTH}};
+  if (retry(false, [&] { return bus_->transfer(messages, 2); }) !=
+      Status::SUCCESS)
+    return Status::FAIL;
 
-  if (write(si4703_fd_, buffer, 12) < 12) {
-    perror("Could not write to I2C slave device");
+  dirty_ = 0;
+  const auto read_at = std::chrono::steady_clock::now();
+  decodeRead(read, READ_LENGTH, shadow_reg_);
+  notifyRegisterListeners(snapshot_.publish(shadow_reg_, read_at));
+  return Status::SUCCESS;
+}
+
+// Try |transfer| under retry_policy_: again after a jittered backoff while
+// tries are left and the deadline allows. A run of failed transfers while
+// powered on escalates to recover(), after which a read is tried once more;
+// a |write| needs no further try, recover() wrote every control register.
+// The caller holds reg_owner_mutex_.
+template <typename Transfer>
+Status Si4703_Breakout::retry(bool write, Transfer transfer) {
+  retry_stats_.transfers++;
+  const auto deadline =
+      std::chrono::steady_clock::now() + retry_policy_.deadline;
+  auto backoff = retry_policy_.backoff;
+  for (int attempt = 1;; attempt++) {
+    if (transfer() == Status::SUCCESS) {
+      failed_in_a_row_ = 0;
+      return Status::SUCCESS;
+    }
+    if (attempt >= retry_policy_.attempts)
+      break;
+    jitter_ ^= jitter_ << 13;
+    jitter_ ^= jitter_ >> 7;
+    jitter_ ^= jitter_ << 17;
+    const auto wait = backoff / 2 + std::chrono::microseconds(
+                                        jitter_ % (backoff.count() + 1));
+    if (std::chrono::steady_clock::now() + wait > deadline)
+      break;
+    retry_stats_.retries++;
+    std::this_thread::sleep_for(wait);
+    backoff = std::min(backoff * 2, retry_policy_.max_backoff);
+  }
+  retry_stats_.failures++;
+  if (recovering_ || !powered_ || retry_policy_.recover_after <= 0 ||
+      ++failed_in_a_row_ < retry_policy_.recover_after)
     return Status::FAIL;
+  failed_in_a_row_ = 0;
+  if (recover() != Status::SUCCESS)
+    return Status::FAIL;
+  return write ? Status::SUCCESS : transfer();
+}
+
+// Reset the chip and put it back the way the host left it: pulse the reset
+// pin, reacquire the bus, start the oscillator as in powerOn() and power up
+// with the control registers from shadow_reg_ in one write. A tune or seek
+// that was under way restarts with that write, for its caller to finish;
+// otherwise we retune to the channel we were on. Holding tune_mutex_ is not
+// needed: nobody else can touch the chip while we hold reg_owner_mutex_,
+// which the caller does.
+Status Si4703_Breakout::recover() {
+  retry_stats_.recoveries++;
+  recovering_ = true;
+  uint16_t saved[NUM_REGISTERS];
+  std::copy(shadow_reg_, shadow_reg_ + NUM_REGISTERS, saved);
+
+  Status s = resetChip();
+  if (s == Status::SUCCESS)
+    s = bus_->reset();
+  if (s == Status::SUCCESS)
+    s = readRegistersLocked();
+  if (s == Status::SUCCESS) {
+    setRegister(shadow_reg_, TEST1, 0x8100, &dirty_);
+    s = updateRegisters();
+  }
+  if (s == Status::SUCCESS) {
+    std::this_thread::sleep_for(CLOCK_SETTLE_DELAY);
+    s = readRegistersLocked();
   }
+  if (s == Status::SUCCESS) {
+    for (uint8_t reg = WRITE_START; reg < WRITE_START + WRITE_COUNT; reg++)
+      setRegister(shadow_reg_, reg, saved[reg], &dirty_);
+    s = updateRegisters();
+  }
+  if (s == Status::SUCCESS) {
+    std::this_thread::sleep_for(MAX_POWERUP_TIME);
+    if (!get<TUNE>(saved) && !get<SEEK>(saved))
+      s = tuneChannel(get<READ_CHAN>(saved));
+  }
+  recovering_ = false;
+  if (s != Status::SUCCESS)
+    retry_stats_.failed_recoveries++;
+  return s;
+}
 
-  return Status::SUCCESS;
+void Si4703_Breakout::setRetryPolicy(const Si4703_RetryPolicy& policy) {
+  std::lock_guard<std::mutex> lock(reg_owner_mutex_);
+  retry_policy_ = policy;
+}
+
+Si4703_RetryStats Si4703_Breakout::retryStats() {
+  std::lock_guard<std::mutex> lock(reg_owner_mutex_);
+  return retry_stats_;
+}
+
+uint32_t Si4703_Breakout::registers(uint16_t* regs) const {
+  return snapshot_.read(regs);
 }
 
 uint16_t Si4703_Breakout::manufacturer() const {
-  return shadow_reg_[DEVICEID] & MANUFACTURER_MASK;
+  return snapshot_.get(MFGID);
 }
 
 uint16_t Si4703_Breakout::part() const {
-  return (shadow_reg_[DEVICEID] & PART_MASK) >> 12;
+  return snapshot_.get(PN);
 }
 
 uint16_t Si4703_Breakout::firmware() const {
-  return shadow_reg_[CHIPID] & FIRMWARE_MASK;
+  return snapshot_.get(FIRMWARE);
 }
 
 uint16_t Si4703_Breakout::device() const {
-  return (shadow_reg_[CHIPID] & DEVICE_MASK) >> 6;
+  return snapshot_.get(DEV);
 }
 
 uint16_t Si4703_Breakout::revision() const {
-  return (shadow_reg_[CHIPID] & REVISION_MASK) >> 10;
+  return snapshot_.get(REV);
 }
 
 std::string Si4703_Breakout::manufacturer_str() const {
-  uint16_t mfr = manufacturer();
-  if (mfr == 0x242)
-    return "Silicon Labs";
-  else {
-    std::stringstream ss;
-    ss << "<Unknown: 0x" << hex << mfr << '>';
-    return ss.str();
-  }
+  return NameOrUnknown(
+      Si4703_StatusSnapshot::manufacturerName(manufacturer()),
+      manufacturer());
 }
 
 std::string Si4703_Breakout::part_str() const {
-  if (part() == 1) {
-    return "Si4700/01/02/03";
-  } else {
-    std::stringstream ss;
-    ss << "<Unknown: 0x" << hex << part() << '>';
-    return ss.str();
-  }
+  return NameOrUnknown(Si4703_StatusSnapshot::partName(part()), part());
 }
 
 std::string Si4703_Breakout::firmware_str() const {
-  std::stringstream ss;
-  ss << firmware();
-  return ss.str();
+  return std::to_string(firmware());
 }
 
 std::string Si4703_Breakout::device_str() const {
-  uint16_t dev = device();
-  switch (dev) {
-    case 0b0000:
-      return "Si4700";  // or not yet powered up.
-    case 0b0001:
-      return "Si4702";
-    case 0b1000:
-      return "Si4701";
-    case 0b1001:
-      return "Si4703";
-    default: {
-      std::stringstream ss;
-      ss << "<Unknown: 0x" << hex << dev << '>';
-      return ss.str();
-    }
-  }
+  return NameOrUnknown(Si4703_StatusSnapshot::deviceName(device()),
+                       device());
 }
 
 std::string Si4703_Breakout::revision_str() const {
-  switch (revision()) {
-    case 1:
-      return "A";
-    case 2:
-      return "B";
-    case 3:
-      return "C";
-    case 4:
-      return "D";
-    default: {
-      std::stringstream ss;
-      ss << "<Unknown: 0x" << hex << revision() << '>';
-      return ss.str();
-    }
-  }
+  return NameOrUnknown(Si4703_StatusSnapshot::revisionName(revision()),
+                       revision());
 }
 
 int Si4703_Breakout::signalStrength() const {
-  return shadow_reg_[STATUSRSSI] & RSSI_MASK;
+  return snapshot_.get(RSSI);
+}
+
+int Si4703_Breakout::signalStrength(std::chrono::milliseconds max_age) {
+  refresh(max_age);
+  return signalStrength();
+}
+
+bool Si4703_Breakout::stereo() const {
+  return snapshot_.get(STEREO);
 }
 
 uint16_t Si4703_Breakout::blockAErrors() const {
-  return (shadow_reg_[STATUSRSSI] & BLERA_MASK) >> 9;
+  return snapshot_.get(BLERA);
 }
 
 std::string Si4703_Breakout::blockAErrors_str() const {
-  uint16_t val = blockAErrors();
-  switch (val) {
-    case 0b00:
-      return "0";
-    case 0b01:
-      return "1-2";
-    case 0b10:
-      return "3-5";
-    case 0b11:
-      return "6+";
-    default: {
-      std::stringstream ss;
-      ss << "<Unknown: 0x" << hex << val << '>';
-      return ss.str();
-    }
-  }
+  return NameOrUnknown(
+      Si4703_StatusSnapshot::blockErrorsName(blockAErrors()), blockAErrors());
 }
 
-// static
-const char* Si4703_Breakout::registerName(uint16_t idx) {
-  switch (idx) {
-    case DEVICEID:
-      return "  DEVICEID";
-    case CHIPID:
-      return "    CHIPID";
-    case POWERCFG:
-      return "  POWERCFG";
-    case CHANNEL:
-      return "   CHANNEL";
-    case SYSCONFIG1:
-      return "SYSCONFIG1";
-    case SYSCONFIG2:
-      return "SYSCONFIG2";
-    case STATUSRSSI:
-      return "STATUSRSSI";
-    case READCHAN:
-      return "  READCHAN";
-    case RDSA:
-      return "      RDSA";
-    case RDSB:
-      return "      RDSB";
-    case RDSC:
-      return "      RDSC";
-    case RDSD:
-      return "      RDSD";
-    default:
-      return "  RESERVED";
-  }
+Si4703_StatusSnapshot Si4703_Breakout::status() const {
+  uint16_t regs[NUM_REGISTERS];
+  const uint32_t version = registers(regs);
+  Si4703_StatusSnapshot status;
+  status.fill(regs, version);
+  return status;
 }
 
 void Si4703_Breakout::printRegisters() {
-  cout << "Register  Value" << endl;
-  cout << "========= ================================================" << endl;
-
-  for (int i = 0; i < 16; i++) {
-    cout << registerName(i) << hex << "[0x" << i << "]: 0x" << setfill('0')
-         << setw(4) << shadow_reg_[i];
-    // Now the decoded supplemental data.
-    switch (i) {
-      case DEVICEID:
-        cout << setfill('0') << " (mfr=\"" << manufacturer_str()
-             << "\", part=" << part_str() << ')' << endl;
-        break;
-      case CHIPID:
-        cout << " (firmware=" << firmware_str() << ", device=\"" << device_str()
-             << "\", rev=" << revision_str() << ')' << endl;
-        break;
-      case READCHAN: {
-        const int channel = shadow_reg_[READCHAN] & 0x03FF;
-        cout << " (channel=" << dec << channel << " ("
-             << channelToFrequency(channel) << "MHz))" << endl;
-      } break;
-      case STATUSRSSI:
-        cout << " (RDSR:" << ToYesNo(shadow_reg_[i] & RDSR)
-             << ", STC:" << ToYesNo(shadow_reg_[i] & STC)
-             << ", SFBL:" << ToYesNo(shadow_reg_[i] & SFBL)
-             << ", AFCRL:" << ToYesNo(shadow_reg_[i] & AFCRL)
-             << ", RDSS:" << ToYesNo(shadow_reg_[i] & RDSS)
-             << ", STEREO:" << ToYesNo(shadow_reg_[i] & STEREO)
-             << ", RSSI:" << dec << signalStrength()
-             << ", BLERA:" << blockAErrors_str() << ')' << endl;
-        break;
-      default:
-        cout << endl;
-    }
-  }
+  // One consistent snapshot for the whole printout.
+  const Si4703_StatusSnapshot snapshot = status();
+  char text[2048];
+  cout.write(text, snapshot.toText(text, sizeof(text)));
 }
 
 // Seeks out the next available station.
 // Returns the freq if it made it.
 // Returns zero if failed.
 float Si4703_Breakout::seek(SeekDirection direction) {
-  readRegisters();
+  std::unique_lock<std::mutex> lock(tune_mutex_);
+  clearRDSBuffer();
+  std::unique_lock<std::mutex> owner(reg_owner_mutex_);
   // Set seek mode wrap bit.
-  shadow_reg_[POWERCFG] |= SKMODE;  // Allow wrap.
-  // shadow_reg_[POWERCFG] &= ~SKMODE; // Disallow wrap - if you
+  set<SKMODE>(shadow_reg_, 1, &dirty_);  // Allow wrap.
+  // set<SKMODE>(shadow_reg_, 0, &dirty_); // Disallow wrap - if you
   // disallow wrap, you may want to tune to 87.5 first.
-  if (direction == SeekDirection::Down)
-    shadow_reg_[POWERCFG] &= ~SEEKUP;  // The default upon reset.
-  else
-    shadow_reg_[POWERCFG] |= SEEKUP;
+  // Seek down is the default upon reset.
+  set<SEEKUP>(shadow_reg_, direction == SeekDirection::Up, &dirty_);
 
-  shadow_reg_[POWERCFG] |= SEEK;  // Start seek.
-  updateRegisters();              // Seeking will now start.
+  set<SEEK>(shadow_reg_, 1, &dirty_);  // Start seek.
+  // Seeking will now start. Poll to see if STC is set.
+  bool failed = updateRegisters() != Status::SUCCESS ||
+                waitForSTC(true, SEEK_TIMEOUT) != Status::SUCCESS;
 
-  // Poll to see if STC is set.
-  while (true) {
-    readRegisters();
-    if ((shadow_reg_[STATUSRSSI] & STC) != 0)
-      break;  // Tuning complete!
-  }
-
-  readRegisters();
   // Store the value of SFBL.
-  int valueSFBL = shadow_reg_[STATUSRSSI] & SFBL;
-  // Clear the seek bit after seek has completed.
-  shadow_reg_[POWERCFG] &= ~SEEK;
-  updateRegisters();
-
+  failed = failed || get<SFBL>(shadow_reg_);
+  // Clear the seek bit after seek has completed, or to stop it.
+  set<SEEK>(shadow_reg_, 0, &dirty_);
   // Wait for the si4703 to clear the STC as well.
-  while (true) {
-    readRegisters();
-    if ((shadow_reg_[STATUSRSSI] & STC) == 0)
-      break;  // Tuning complete!
-  }
+  if (waitForSTC(false, TUNE_TIMEOUT) != Status::SUCCESS)
+    failed = true;
+  owner.unlock();
+  lock.unlock();
 
-  if (valueSFBL) {  // The bit was set indicating we hit a band limit or failed
-                    // to find a station.
+  if (failed) {  // The SFBL bit was set indicating we hit a band limit or
+                 // failed to find a station, or the chip didn't answer.
     return 0.0f;
   }
 
@@ -560,23 +945,15 @@ float Si4703_Breakout::seek(SeekDirection direction) {
 
 // Return the space between channels (in MHz).
 float Si4703_Breakout::channelSpacing() const {
-  switch (channel_spacing_) {
-    case Spacing_200kHz:
-      return 0.2;
-    case Spacing_100kHz:
-      return 0.1;
-    case Spacing_50kHz:
-      return 0.05;
-  }
+  return spacingStep(channel_spacing_) / 100.0f;
 }
 
 float Si4703_Breakout::minFrequency() const {
-  switch (band_) {
-    case Band_US_Europe:
-      return 87.5;
-    case Band_Japan:
-      return 76.0;
-  }
+  return bandBottom(band_) / 100.0f;
+}
+
+float Si4703_Breakout::maxFrequency() const {
+  return bandTop(band_) / 100.0f;
 }
 
 // Given the |channel| value from the READCHAN registry convert it to frequency.
@@ -596,9 +973,7 @@ uint16_t Si4703_Breakout::frequencyToChannel(float frequency) const {
                                (frequency - minFrequency()) / channelSpacing());
 }
 
-float Si4703_Breakout::getFrequency() {
-  readRegisters();
-  // Mask out everything but the lower 10 bits.
-  const int channel = shadow_reg_[READCHAN] & 0x03FF;
-  return channelToFrequency(channel);
+float Si4703_Breakout::getFrequency(std::chrono::milliseconds max_age) {
+  refresh(max_age);
+  return channelToFrequency(snapshot_.get(READ_CHAN));
 }
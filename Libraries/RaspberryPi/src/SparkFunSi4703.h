@@ -57,9 +57,13 @@ cables. Too short of a cable may degrade reception.
 #ifndef SparkFunSi4703_h
 #define SparkFunSi4703_h
 
+#include <time.h>
+
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <functional>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -67,15 +71,132 @@ cables. Too short of a cable may degrade reception.
 
 #include <inttypes.h>
 
-enum class Region { US, Europe, Japan };
+#include "Si4703Bus.h"
+#include "Si4703Core.h"
+#include "Si4703Gpio.h"
+#include "Si4703Snapshot.h"
+#include "Si4703Status.h"
 
-enum class Status { SUCCESS, FAIL };
+enum class Region { US, Europe, Japan };
 
 enum class SeekDirection { Up, Down };
 
+// One RDS group as read from the RDSA-RDSD registers.
+struct RdsGroup {
+  uint16_t blocks[4];  // A, B, C, D.
+  std::chrono::time_point<std::chrono::steady_clock> received;
+
+  uint16_t pi() const { return blocks[0]; }
+  // Group type 0..15 and version (0 = A, 1 = B).
+  uint8_t type() const { return blocks[1] >> 12; }
+  uint8_t version() const { return (blocks[1] >> 11) & 0x1; }
+};
+
+// Register changes for Si4703_Breakout::apply(). Members left at their
+// defaults stay as they are.
+struct Si4703_Changes {
+  float frequency = 0;  // MHz.
+  int volume = -1;      // 0..15.
+  int mute = -1;        // 1 mutes, 0 unmutes.
+};
+
+// When a seek stops on a channel, see AN230 section 3.6. The chip's reset
+// values disable the SNR and impulse criteria.
+struct Si4703_SeekThresholds {
+  uint8_t rssi;      // SEEKTH: minimum RSSI in dBuV, 0..127.
+  uint8_t snr;       // SKSNR: 0 = off, 1 (most stops) .. 15 (fewest stops).
+  uint8_t impulses;  // SKCNT: 0 = off, 1 (most stops) .. 15 (fewest stops).
+};
+
+// How hard a register read or write is tried before it fails, see
+// Si4703_Breakout::setRetryPolicy().
+struct Si4703_RetryPolicy {
+  int attempts = 4;  // Per transfer, the first try included.
+  // Wait before the first retry, doubled for each one after up to
+  // |max_backoff|. Each wait is jittered by +-50% so retries don't fall into
+  // step with whatever disturbs the bus.
+  std::chrono::microseconds backoff = std::chrono::microseconds(1000);
+  std::chrono::microseconds max_backoff = std::chrono::microseconds(8000);
+  // No retry starts later than this after the first try.
+  std::chrono::microseconds deadline = std::chrono::microseconds(25000);
+  // Reset and re-initialize the chip once this many transfers in a row have
+  // failed. 0 never does.
+  int recover_after = 3;
+};
+
+struct Si4703_RetryStats {
+  uint64_t transfers;   // Register reads and writes, retries not counted.
+  uint64_t retries;
+  uint64_t failures;    // Transfers that failed every try.
+  uint64_t recoveries;  // Chip resets.
+  uint64_t failed_recoveries;
+};
+
+// How the RDS thread is scheduled, see Si4703_Breakout::setRdsThreadPolicy().
+// The defaults make it an ordinary thread.
+struct Si4703_RdsThreadPolicy {
+  // SCHED_FIFO priority, 1 (lowest) to 99. 0 leaves the thread with the
+  // normal time-sharing scheduler.
+  int priority = 0;
+  // Run the thread only on this CPU. -1 lets it run on any.
+  int cpu = -1;
+  // Lock the memory of the whole process (mlockall()) so a poll never waits
+  // for a page to be brought in.
+  bool lock_memory = false;
+  // Poll at fixed deadlines, sleeping with clock_nanosleep() and
+  // TIMER_ABSTIME, so the time a poll takes or loses to preemption doesn't
+  // push back every poll after it.
+  bool absolute_deadlines = false;
+};
+
+// How well the RDS thread kept to its polls since powerOn().
+struct Si4703_RdsThreadStats {
+  static const int BUCKETS = 10;
+
+  // What the policy got. False where it asked for something the process
+  // isn't allowed, e.g. SCHED_FIFO without CAP_SYS_NICE or RLIMIT_RTPRIO;
+  // the thread runs on without it.
+  bool realtime;
+  bool pinned;
+  bool memory_locked;
+  uint64_t polls;
+  uint64_t groups;         // Polls that found RDSR set.
+  uint64_t missed_groups;  // Estimated from the gaps between groups.
+  uint64_t overruns;       // Polls that ran past the next deadline.
+  // How late the thread woke up after its deadlines: the poll jitter.
+  std::chrono::microseconds total_lateness;
+  std::chrono::microseconds max_lateness;
+  // Wakeups by lateness: under 10, 20, 50, 100, 200 and 500 us, 1, 2 and
+  // 5 ms, and the rest.
+  uint64_t lateness[BUCKETS];
+
+  // The lateness that |fraction| of the wakeups kept under, as the upper
+  // bound of its bucket; max_lateness for the last one.
+  std::chrono::microseconds percentile(double fraction) const;
+};
+
 class Si4703_Breakout {
  public:
+  using RdsGroupListener = std::function<void(const RdsGroup& group)>;
+  using RegisterListener =
+      std::function<void(const uint16_t* regs, uint32_t version)>;
+
+  // Use the Si4703 on /dev/i2c-1, reset through /dev/gpiochip0 with pins
+  // in BCM numbering.
   Si4703_Breakout(int resetPin, int sdioPin, Region region = Region::US);
+  // Use the Si4703 on |bus|, reset through /dev/gpiochip0. A negative
+  // |resetPin| skips the GPIO reset sequence, e.g. for a
+  // Si4703_SimulatedChip.
+  Si4703_Breakout(std::unique_ptr<Si4703_Bus> bus,
+                  int resetPin,
+                  int sdioPin,
+                  Region region = Region::US);
+  // Use the Si4703 on |bus|, reset through |gpio|, e.g. a Si4703_GpioChip
+  // on another chip or a Si4703_WiringPiGpio. A null |gpio| skips the reset
+  // sequence.
+  Si4703_Breakout(std::unique_ptr<Si4703_Bus> bus,
+                  std::unique_ptr<Si4703_Gpio> gpio,
+                  Region region = Region::US);
   ~Si4703_Breakout();
 
   // Power on the radio.
@@ -91,9 +212,32 @@ class Si4703_Breakout {
   // frequency or 0 of seek failed.
   float seek(SeekDirection direction);
 
+  // Make all of |changes| with a single register write (plus the polling a
+  // tune needs). While tuning, |abandon| is called every few ms; once it
+  // returns true the tune is cut short, for a following apply() to start
+  // over on another channel, and FAIL is returned.
+  Status apply(const Si4703_Changes& changes,
+               const std::function<bool()>& abandon = nullptr);
+
+  // Set the seek stop criteria. Takes effect from the next seek().
+  void setSeekThresholds(const Si4703_SeekThresholds& thresholds);
+  Si4703_SeekThresholds seekThresholds() const;
+
   // Set the radio volume (0..15).
   void setVolume(int volume);
 
+  // The radio volume (0..15).
+  int getVolume() const;
+
+  // Mute or unmute the audio output.
+  void setMute(bool mute);
+
+  // Briefly tune to |frequency|, measure its signal strength and return to
+  // the current channel. Audio is muted for the two tunes in between (about
+  // 2 x 60 ms) and the RDS thread is held off so it never decodes the other
+  // station. Returns the RSSI in dBuV or -1 on failure.
+  int probeRSSI(float frequency);
+
   // Read the current RDS characters into the |message| buffer.
   // |message| must be at least 9 chars. |message| will be null terminated.
   // This method is thread safe.
@@ -104,22 +248,73 @@ class Si4703_Breakout {
   // characters.
   std::condition_variable& rdsCV() { return rds_cv_; }
 
-  // Return the currently tuned frequency.
-  float getFrequency();
+  // Call |listener| on the RDS thread for every group received without
+  // uncorrectable errors. Returns an id for removeRdsGroupListener().
+  int addRdsGroupListener(RdsGroupListener listener);
+  void removeRdsGroupListener(int id);
+
+  // Call |listener| with the register file and its snapshot version after
+  // every read from or write to the chip. It runs on the thread doing the
+  // transfer with the register owner lock held, so it must be quick and
+  // must not call back into this breakout. Returns an id for
+  // removeRegisterListener().
+  int addRegisterListener(RegisterListener listener);
+  void removeRegisterListener(int id);
+
+  // The PI code of the station being received, 0 if none yet.
+  uint16_t programId();
+
+  // The full programme service name of the station being received, empty
+  // until all of its segments have arrived.
+  std::string stationName();
+
+  // Return the currently tuned frequency. Reads the chip only if the last
+  // read is older than |max_age|; while powered on the RDS thread reads it
+  // every 30-40 ms, so the default never adds bus traffic.
+  float getFrequency(
+      std::chrono::milliseconds max_age = std::chrono::milliseconds(100));
+
+  // Set how failed bus transfers are retried. While powered on, a run of
+  // failures resets the chip through the reset pin, reopens the bus and
+  // restores the volume, mute, band, thresholds and channel.
+  void setRetryPolicy(const Si4703_RetryPolicy& policy);
+  Si4703_RetryStats retryStats();
+
+  // Set how the RDS thread is scheduled. Takes effect from the next
+  // powerOn(). A real-time thread also runs the RDS group listeners at its
+  // priority, so they must be quick. Whatever the process isn't allowed is
+  // reported on stderr and in rdsThreadStats(), and skipped.
+  void setRdsThreadPolicy(const Si4703_RdsThreadPolicy& policy);
+  Si4703_RdsThreadStats rdsThreadStats();
 
   // Print the shadow register values to stdout. Does not refresh the shadow
   // registers before printing.
   void printRegisters();
 
+  // Decode the latest register snapshot, see Si4703Status.h. Never blocks,
+  // and doesn't allocate.
+  Si4703_StatusSnapshot status() const;
+
   // Read the registers from the radio into the shadow registers.
   Status readRegisters();
 
+  // Read the registers unless the last read is at most |max_age| old.
+  Status refresh(std::chrono::milliseconds max_age);
+
+  // Copy the latest register snapshot into |regs| (16 words) and return its
+  // version. Never blocks, and never blocks the RDS thread. The getters
+  // below read the same snapshot.
+  uint32_t registers(uint16_t* regs) const;
+
   // The channel spacing (in MHz) between channels.
   float channelSpacing() const;
 
   // The minimum (lowest) frequency possible with the current band.
   float minFrequency() const;
 
+  // The maximum (highest) frequency possible with the current band.
+  float maxFrequency() const;
+
   // The portions of the DEVICEID/CHIPID registers shifted accordingly.
   uint16_t manufacturer() const;
   uint16_t part() const;
@@ -127,6 +322,9 @@ class Si4703_Breakout {
   uint16_t device() const;
   uint16_t revision() const;
   int signalStrength() const;
+  // As above, reading the chip first if the snapshot is older than |max_age|.
+  int signalStrength(std::chrono::milliseconds max_age);
+  bool stereo() const;
   uint16_t blockAErrors() const;
 
   // The human-readable decoded DEVICEID/CHIPID register values.
@@ -138,104 +336,72 @@ class Si4703_Breakout {
   std::string blockAErrors_str() const;
 
  private:
-  // See AN230 Programmers Guide section 3.4.1 for bands. Band is bits 6:7 in
-  // SYSCONFIG2 register.
-  enum Band : uint16_t {
-    Band_US_Europe = 0b0000000,
-    Band_Japan_Wide = 0b0100000,
-    Band_Japan = 0b1000000,
-    Band_Reserved = 0b1100000
-  };
-
-  // See AN230 Programmers Guide section 3.4.2 for channel spacing. Spacing is
-  // bits 4:5 in SYSCONFIG2 register.
-  enum ChannelSpacing : uint16_t {
-    Spacing_200kHz = 0b00000,
-    Spacing_100kHz = 0b01000,
-    Spacing_50kHz = 0b10000,
-    Spacing_Reserved = 0b11000,
-  };
-
-  // 0b._001.0000 = I2C address of Si4703 - note that the Wire
-  // function assumes non-left-shifted I2C address, not 0b.0010.000W
-  static const int SI4703 = 0x10;
-  static const uint16_t I2C_FAIL_MAX = 10;  // This is the number of attempts we
-                                            // will try to contact the device
-                                            // before erroring out.
-  // Define the register names
-  static const uint16_t DEVICEID = 0x00;
-  static const uint16_t CHIPID = 0x01;
-  static const uint16_t POWERCFG = 0x02;
-  static const uint16_t CHANNEL = 0x03;
-  static const uint16_t SYSCONFIG1 = 0x04;
-  static const uint16_t SYSCONFIG2 = 0x05;
-  static const uint16_t STATUSRSSI = 0x0A;
-  static const uint16_t READCHAN = 0x0B;
-  static const uint16_t RDSA = 0x0C;
-  static const uint16_t RDSB = 0x0D;
-  static const uint16_t RDSC = 0x0E;
-  static const uint16_t RDSD = 0x0F;
-
-  // Register 0x02 - POWERCFG
-  static const uint16_t SMUTE = 1 << 15;
-  static const uint16_t DMUTE = 1 << 14;
-  static const uint16_t SKMODE = 1 << 10;
-  static const uint16_t SEEKUP = 1 << 9;
-  static const uint16_t SEEK = 1 << 8;
-
-  // Register 0x03 - CHANNEL
-  static const uint16_t TUNE = 1 << 15;
-
-  // Register 0x04 - SYSCONFIG1
-  static const uint16_t RDS = 1 << 12;
-  static const uint16_t DE = 1 << 11;
-
-  // Register 0x0A - STATUSRSSI
-  static const uint16_t RDSR = 1 << 15;
-  static const uint16_t STC = 1 << 14;    // Seek/Tune Complete.
-  static const uint16_t SFBL = 1 << 13;   // Seek Fail/Band Limit.
-  static const uint16_t AFCRL = 1 << 12;  // AFC Rail.
-  static const uint16_t RDSS = 1 << 11;   // RDS Synchronized.
-  static const uint16_t STEREO = 1 << 8;  // Stereo Indicator.
-  // RSSI (Received Signal Strength Indicator).
-  static const uint16_t RSSI_MASK = 0xf;
-  static const uint16_t BLERA_MASK = 0b11000000000;  // RDS Block A Errors.
-
-  // Register 0x00 - DEVICEID
-  // https://www.silabs.com/documents/public/data-sheets/Si4702-03-C19.pdf
-  static const uint16_t MANUFACTURER_MASK = 0b111111111111;
-  static const uint16_t PART_MASK = 0b1111000000000000;
-
-  // Register 0x01 - CHIPID
-  // https://www.silabs.com/documents/public/data-sheets/Si4702-03-C19.pdf
-  static const uint16_t FIRMWARE_MASK = 0b111111;
-  static const uint16_t DEVICE_MASK = 0b1111000000;
-  static const uint16_t REVISION_MASK = 0b1111110000000000;
-
-  static const char* registerName(uint16_t idx);
-
+  Status resetChip();
+  Status readRegistersLocked();
   Status updateRegisters();
+  Status syncRegisters();
+  template <typename Transfer>
+  Status retry(bool write, Transfer transfer);
+  Status recover();
+  void notifyRegisterListeners(uint32_t version);
   float channelToFrequency(uint16_t channel) const;
   uint16_t frequencyToChannel(float frequency) const;
+  bool validChannel(float frequency, uint16_t* channel) const;
+  Status tuneChannel(uint16_t channel);
+  Status waitForSTC(bool set, std::chrono::milliseconds timeout);
   void rdsReadFunc();
+  Si4703_RdsThreadPolicy applyRdsThreadPolicy();
+  void rdsSleep(std::chrono::milliseconds wait,
+                bool absolute,
+                timespec* deadline);
   void stopRDSThread();
   void clearRDSBuffer();
 
-  int resetPin_;
-  int sdioPin_;
-  std::mutex shadow_reg_mutex_;  // Synchronize access to shadow_reg_.
-  uint16_t shadow_reg_[16];      // There are 16 registers, each 16 bits large.
-  int si4703_fd_;                // I2C file descriptor.
+  std::unique_ptr<Si4703_Bus> bus_;
+  std::unique_ptr<Si4703_Gpio> gpio_;
+  bool powered_;
+  // Held for a whole tune, seek or probe, and by the RDS thread around each
+  // read and decode, so RDS is never decoded from a channel we pass through.
+  std::mutex tune_mutex_;
+  // The register owner: only its holder reads, modifies or writes
+  // shadow_reg_, talks to the chip and publishes to snapshot_. Taken after
+  // tune_mutex_ when both are needed.
+  std::mutex reg_owner_mutex_;
+  uint16_t shadow_reg_[si4703::NUM_REGISTERS];  // Owner's working copy.
+  // Registers of shadow_reg_ changed since the last write, as a bit mask.
+  uint16_t dirty_;
+  // The retry state, also owned by the reg_owner_mutex_ holder.
+  Si4703_RetryPolicy retry_policy_;
+  Si4703_RetryStats retry_stats_;
+  int failed_in_a_row_;  // Transfers that failed every try.
+  bool recovering_;
+  uint64_t jitter_;  // xorshift state.
+  // What readers see: shadow_reg_ as of the last read or write.
+  Si4703_RegisterSnapshot snapshot_;
   Region region_;
-  Band band_;
-  std::mutex rds_data_mutex_;  // protect both RDS variables below.
-  char rds_chars_[9];          // The current RDS characters.
+  si4703::Band band_;
+  std::mutex rds_data_mutex_;  // protect the RDS variables below.
+  si4703::RdsDecoder rds_decoder_;
+  // The last whole name, copied when it completed: rds_decoder_.ps is
+  // overwritten segment by segment as the next one arrives.
+  std::string rds_station_name_;
+  char rds_chars_[9];  // The current RDS characters.
+  uint32_t rds_tunes_;  // Counts clearRDSBuffer() calls.
   // The last time a pair of chars was valid.
   std::chrono::time_point<std::chrono::system_clock> rds_last_valid_[4];
+  std::mutex rds_listener_mutex_;  // Protects the two variables below.
+  std::map<int, RdsGroupListener> rds_listeners_;
+  int next_rds_listener_id_;
+  std::mutex register_listener_mutex_;  // Protects the two variables below.
+  std::map<int, RegisterListener> register_listeners_;
+  int next_register_listener_id_;
+  std::mutex rds_thread_mutex_;  // Protects the two variables below.
+  Si4703_RdsThreadPolicy rds_thread_policy_;
+  Si4703_RdsThreadStats rds_thread_stats_;
   std::unique_ptr<std::thread> rds_thread_;
   std::condition_variable rds_cv_;
   std::atomic<bool> run_rds_thread_;
-  ChannelSpacing channel_spacing_;
+  si4703::Spacing channel_spacing_;
 };
 
 #endif